@@ -0,0 +1,186 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "indexed/buffer.h"
+#include "workload.h"
+
+
+// Catalog size, device count, clip size and thread count are swept by the Args below. Catalogs
+// are built directly in the table, and only the rows a benchmark looks up are written to disk.
+
+static void BM_BufferPush(benchmark::State& state) {
+    const auto devices = static_cast<unsigned int>(state.range(0));
+    const auto clip_size = static_cast<unsigned long long>(state.range(1));
+    Workload workload{"prism_indexed_bench_push"};
+    prism::indexed::Buffer buffer{workload.RootPath().string(), 1000.0};
+    unsigned long long pushed = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto staged = workload.Stage(clip_size);
+        auto time_point = Workload::TimePoint(24000000 + pushed / devices);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(
+                buffer.Push(time_point, static_cast<unsigned int>(pushed % devices), staged));
+        ++pushed;
+    }
+    state.SetBytesProcessed(state.iterations() * clip_size);
+}
+BENCHMARK(BM_BufferPush)
+        ->ArgsProduct({{1, 16, 64}, {1 << 10, 64 << 10, 1 << 20}})
+        ->ArgNames({"devices", "clip_size"})
+        ->Unit(benchmark::kMicrosecond);
+
+static void BM_BufferPushEviction(benchmark::State& state) {
+    const auto catalog_size = static_cast<unsigned long long>(state.range(0));
+    const unsigned long long clip_size = 1 << 10;
+    Workload workload{"prism_indexed_bench_eviction"};
+    auto rows = workload.Generate(catalog_size, 1, clip_size);
+    workload.Populate(rows);
+    workload.Materialize(rows);
+
+    // The quota sits just under the catalog, so every push evicts before it stores
+    prism::indexed::Buffer buffer{workload.RootPath().string(),
+                                  catalog_size * clip_size / (1024 * 1024 * 1024.)};
+    unsigned long long pushed = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto staged = workload.Stage(clip_size);
+        auto time_point = Workload::TimePoint(25000000 + pushed);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(buffer.Push(time_point, 1, staged));
+        ++pushed;
+    }
+}
+BENCHMARK(BM_BufferPushEviction)
+        ->RangeMultiplier(8)
+        ->Range(1 << 10, 1 << 16)
+        ->ArgName("catalog")
+        ->Unit(benchmark::kMicrosecond);
+
+static void BM_BufferGetFilepath(benchmark::State& state) {
+    const auto catalog_size = static_cast<unsigned long long>(state.range(0));
+    const auto devices = static_cast<unsigned int>(state.range(1));
+    Workload workload{"prism_indexed_bench_get_filepath"};
+    auto rows = workload.Generate(catalog_size, devices, 1 << 10);
+    workload.Populate(rows);
+    auto lookups = workload.Sample(rows, 256);
+    workload.Materialize(lookups);
+    prism::indexed::Buffer buffer{workload.RootPath().string(), 1000.0};
+    std::size_t i = 0;
+    for (auto _ : state) {
+        const auto& row = lookups[i++ % lookups.size()];
+        benchmark::DoNotOptimize(
+                buffer.GetFilepath(Workload::TimePoint(row.time_value), row.device));
+    }
+}
+BENCHMARK(BM_BufferGetFilepath)
+        ->ArgsProduct({{1 << 10, 1 << 14, 1 << 17, 1 << 20}, {1, 16}})
+        ->ArgNames({"catalog", "devices"})
+        ->Unit(benchmark::kMicrosecond);
+
+static void BM_BufferGetFilepaths(benchmark::State& state) {
+    const auto catalog_size = static_cast<unsigned long long>(state.range(0));
+    Workload workload{"prism_indexed_bench_get_filepaths"};
+    auto rows = workload.Generate(catalog_size, 1, 1 << 10);
+    workload.Populate(rows);
+
+    // One day of footage for the scrubbed device
+    std::vector<Workload::Row> day(rows.begin(), rows.begin() + std::min<std::size_t>(
+                                                                     rows.size(), 1440));
+    workload.Materialize(day);
+    prism::indexed::Buffer buffer{workload.RootPath().string(), 1000.0};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+                buffer.GetFilepaths(0, Workload::TimePoint(day.front().time_value),
+                                    Workload::TimePoint(day.back().time_value)));
+    }
+    state.SetItemsProcessed(state.iterations() * day.size());
+}
+BENCHMARK(BM_BufferGetFilepaths)
+        ->RangeMultiplier(8)
+        ->Range(1 << 11, 1 << 20)
+        ->ArgName("catalog")
+        ->Unit(benchmark::kMillisecond);
+
+static void BM_BufferGetCatalog(benchmark::State& state) {
+    const auto catalog_size = static_cast<unsigned long long>(state.range(0));
+    const auto devices = static_cast<unsigned int>(state.range(1));
+    Workload workload{"prism_indexed_bench_catalog"};
+    workload.Populate(workload.Generate(catalog_size, devices, 1 << 10));
+    prism::indexed::Buffer buffer{workload.RootPath().string(), 1000.0};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(buffer.GetCatalog());
+    }
+    state.SetItemsProcessed(state.iterations() * catalog_size);
+}
+BENCHMARK(BM_BufferGetCatalog)
+        ->ArgsProduct({{1 << 10, 1 << 14, 1 << 17, 1 << 20}, {1, 16}})
+        ->ArgNames({"catalog", "devices"})
+        ->Unit(benchmark::kMillisecond);
+
+static void BM_BufferConstruct(benchmark::State& state) {
+    const auto catalog_size = static_cast<unsigned long long>(state.range(0));
+    Workload workload{"prism_indexed_bench_construct"};
+    workload.Populate(workload.Generate(catalog_size, 16, 1 << 10));
+    for (auto _ : state) {
+        prism::indexed::Buffer buffer{workload.RootPath().string(), 1000.0};
+        benchmark::DoNotOptimize(buffer.Full());
+    }
+}
+BENCHMARK(BM_BufferConstruct)
+        ->RangeMultiplier(32)
+        ->Range(1 << 10, 1 << 20)
+        ->ArgName("catalog")
+        ->Unit(benchmark::kMillisecond);
+
+// Concurrent pushes from several ingest threads into one shared buffer
+
+static std::unique_ptr<Workload> shared_workload;
+static std::unique_ptr<prism::indexed::Buffer> shared_buffer;
+
+static void setUpSharedBuffer(const benchmark::State&) {
+    shared_workload.reset(new Workload{"prism_indexed_bench_threads"});
+    shared_buffer.reset(
+            new prism::indexed::Buffer{shared_workload->RootPath().string(), 1000.0});
+}
+
+static void tearDownSharedBuffer(const benchmark::State&) {
+    shared_buffer.reset();
+    shared_workload.reset();
+}
+
+static void BM_BufferPushThreads(benchmark::State& state) {
+    const unsigned long long clip_size = 64 << 10;
+    const auto device = static_cast<unsigned int>(state.thread_index());
+    std::vector<std::string> staged;
+    for (int i = 0; i < 4096; ++i) {
+        staged.push_back((shared_workload->StagingPath() /
+                          (std::to_string(device) + "_" + std::to_string(i))).string());
+    }
+    unsigned long long pushed = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        const auto& filepath = staged[pushed % staged.size()];
+        {
+            std::ofstream out_stream{filepath, std::ios::binary};
+            out_stream << std::string(clip_size, 'x');
+        }
+        auto time_point = Workload::TimePoint(24000000 + pushed);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(shared_buffer->Push(time_point, device, filepath));
+        ++pushed;
+    }
+    state.SetBytesProcessed(state.iterations() * clip_size);
+}
+BENCHMARK(BM_BufferPushThreads)
+        ->Setup(setUpSharedBuffer)
+        ->Teardown(tearDownSharedBuffer)
+        ->ThreadRange(1, 8)
+        ->UseRealTime()
+        ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
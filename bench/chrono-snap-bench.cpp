@@ -0,0 +1,17 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+
+#include "indexed/chrono-snap.h"
+
+
+static void BM_SnapToMinute(benchmark::State& state) {
+    auto time_point = std::chrono::system_clock::now();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(prism::indexed::utility::SnapToMinute(time_point));
+        time_point += std::chrono::seconds(7);
+    }
+}
+BENCHMARK(BM_SnapToMinute);
+
+BENCHMARK_MAIN();
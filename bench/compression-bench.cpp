@@ -0,0 +1,66 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "indexed/compression.h"
+
+
+// One 64 KiB block, the unit CompressFile works in, of log text, slowly drifting 16-bit sensor
+// samples or random bytes, selected by the argument
+static std::string corpus(const int& kind) {
+    static const std::size_t size = 64 * 1024;
+    std::string data;
+    if (kind == 0) {
+        for (int i = 0; data.size() < size; ++i) {
+            data += "2024-05-01T12:00:" + std::to_string(i % 60) + " device=" +
+                    std::to_string(i % 7) + " frame=" + std::to_string(i) + " status=ok\n";
+        }
+    } else if (kind == 1) {
+        int16_t sample = 0;
+        while (data.size() < size) {
+            sample += static_cast<int16_t>(std::rand() % 5 - 2);
+            data.append(reinterpret_cast<const char*>(&sample), sizeof(sample));
+        }
+    } else {
+        while (data.size() < size) {
+            data.push_back(static_cast<char>(std::rand()));
+        }
+    }
+    data.resize(size);
+    return data;
+}
+
+static void BM_Lz4Compress(benchmark::State& state) {
+    const auto data = corpus(state.range(0));
+    std::vector<char> compressed(data.size() * 2);
+    std::size_t length = 0;
+    for (auto _ : state) {
+        length = prism::indexed::utility::Lz4Compress(data.data(), data.size(), compressed.data(),
+                                                      compressed.size());
+        benchmark::DoNotOptimize(length);
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.counters["ratio"] = static_cast<double>(data.size()) / length;
+}
+BENCHMARK(BM_Lz4Compress)->DenseRange(0, 2)->ArgName("corpus");
+
+static void BM_Lz4Decompress(benchmark::State& state) {
+    const auto data = corpus(state.range(0));
+    std::vector<char> compressed(data.size() * 2);
+    compressed.resize(prism::indexed::utility::Lz4Compress(
+            data.data(), data.size(), compressed.data(), compressed.size()));
+    std::vector<char> raw(data.size());
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(prism::indexed::utility::Lz4Decompress(
+                compressed.data(), compressed.size(), raw.data(), raw.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+    state.counters["ratio"] = static_cast<double>(data.size()) / compressed.size();
+}
+BENCHMARK(BM_Lz4Decompress)->DenseRange(0, 2)->ArgName("corpus");
+
+BENCHMARK_MAIN();
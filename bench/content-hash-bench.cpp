@@ -0,0 +1,19 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "indexed/content-hash.h"
+
+
+static void BM_Xxh64(benchmark::State& state) {
+    const std::string data(state.range(0), 'x');
+    for (auto _ : state) {
+        prism::indexed::utility::Xxh64 hash;
+        hash.Update(data.data(), data.size());
+        benchmark::DoNotOptimize(hash.Digest());
+    }
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Xxh64)->RangeMultiplier(16)->Range(1 << 6, 1 << 22)->ArgName("bytes");
+
+BENCHMARK_MAIN();
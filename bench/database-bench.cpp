@@ -0,0 +1,166 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "indexed/database.h"
+#include "workload.h"
+
+
+static void BM_DatabaseFindHash(benchmark::State& state) {
+    const auto catalog_size = static_cast<unsigned long long>(state.range(0));
+    Workload workload{"prism_indexed_bench_find_hash"};
+    auto rows = workload.Generate(catalog_size, 16, 1 << 10);
+    workload.Populate(rows);
+    auto lookups = workload.Sample(rows, 256);
+    prism::indexed::Database database{workload.DatabasePath()};
+    std::size_t i = 0;
+    for (auto _ : state) {
+        const auto& row = lookups[i++ % lookups.size()];
+        benchmark::DoNotOptimize(database.FindHash(row.time_value, row.device));
+    }
+}
+BENCHMARK(BM_DatabaseFindHash)
+        ->RangeMultiplier(8)
+        ->Range(1 << 10, 1 << 20)
+        ->ArgName("catalog")
+        ->Unit(benchmark::kMicrosecond);
+
+static void BM_DatabaseInsert(benchmark::State& state) {
+    const auto catalog_size = static_cast<unsigned long long>(state.range(0));
+    Workload workload{"prism_indexed_bench_insert"};
+    workload.Populate(workload.Generate(catalog_size, 16, 1 << 10));
+    prism::indexed::Database database{workload.DatabasePath()};
+    unsigned long long inserted = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto hash = workload.MakeHash();
+        state.ResumeTiming();
+        database.Insert(30000000 + inserted++, 0, hash, 1 << 10, ATTEMPT_KEEP);
+    }
+}
+BENCHMARK(BM_DatabaseInsert)
+        ->RangeMultiplier(32)
+        ->Range(1 << 10, 1 << 20)
+        ->ArgName("catalog")
+        ->Unit(benchmark::kMicrosecond);
+
+static void BM_DatabaseGetLowestDeletableHashes(benchmark::State& state) {
+    const auto catalog_size = static_cast<unsigned long long>(state.range(0));
+    Workload workload{"prism_indexed_bench_lowest_deletable"};
+    workload.Populate(workload.Generate(catalog_size, 16, 1 << 10));
+    prism::indexed::Database database{workload.DatabasePath()};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(database.GetLowestDeletableHashes());
+    }
+}
+BENCHMARK(BM_DatabaseGetLowestDeletableHashes)
+        ->RangeMultiplier(8)
+        ->Range(1 << 10, 1 << 20)
+        ->ArgName("catalog")
+        ->Unit(benchmark::kMillisecond);
+
+static void BM_DatabaseSelectRange(benchmark::State& state) {
+    const auto catalog_size = static_cast<unsigned long long>(state.range(0));
+    Workload workload{"prism_indexed_bench_select_range"};
+    auto rows = workload.Generate(catalog_size, 16, 1 << 10);
+    workload.Populate(rows);
+    prism::indexed::Database database{workload.DatabasePath()};
+    const auto start = rows.front().time_value;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(database.SelectRange(0, start, start + 1439));
+    }
+}
+BENCHMARK(BM_DatabaseSelectRange)
+        ->RangeMultiplier(8)
+        ->Range(1 << 10, 1 << 20)
+        ->ArgName("catalog")
+        ->Unit(benchmark::kMicrosecond);
+
+static void BM_DatabaseBulkSetKeep(benchmark::State& state) {
+    const auto window = static_cast<unsigned long long>(state.range(0));
+    Workload workload{"prism_indexed_bench_bulk_set_keep"};
+    auto rows = workload.Generate(1 << 16, 1, 1 << 10);
+    workload.Populate(rows);
+    prism::indexed::Database database{workload.DatabasePath()};
+    std::vector<unsigned long long> time_values;
+    for (unsigned long long i = 0; i < window; ++i) {
+        time_values.push_back(rows.front().time_value + i);
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(database.BulkSetKeep(time_values, 0, PRESERVE_RECORD));
+    }
+}
+BENCHMARK(BM_DatabaseBulkSetKeep)
+        ->RangeMultiplier(4)
+        ->Range(16, 1 << 12)
+        ->ArgName("window")
+        ->Unit(benchmark::kMicrosecond);
+
+static void BM_DatabaseSetKeepRange(benchmark::State& state) {
+    const auto window = static_cast<unsigned long long>(state.range(0));
+    Workload workload{"prism_indexed_bench_set_keep_range"};
+    auto rows = workload.Generate(1 << 16, 1, 1 << 10);
+    workload.Populate(rows);
+    prism::indexed::Database database{workload.DatabasePath()};
+    const auto start = rows.front().time_value;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+                database.SetKeepRange(0, start, start + window - 1, PRESERVE_RECORD));
+    }
+}
+BENCHMARK(BM_DatabaseSetKeepRange)
+        ->RangeMultiplier(4)
+        ->Range(16, 1 << 12)
+        ->ArgName("window")
+        ->Unit(benchmark::kMicrosecond);
+
+static std::unique_ptr<Workload> group_workload;
+static std::unique_ptr<prism::indexed::Database> group_database;
+
+// Writers on every thread insert rows of their own device. Items per second is the rate of
+// committed writes and latency the mean microseconds a writer waits for its commit. A zero
+// interval is the Database without group commit, with a transaction per write.
+static void BM_DatabaseGroupCommitInsert(benchmark::State& state) {
+    const auto interval = std::chrono::milliseconds{state.range(0)};
+    if (state.thread_index() == 0) {
+        group_workload.reset(new Workload{"prism_indexed_bench_group_commit"});
+        if (interval.count() == 0) {
+            group_database.reset(new prism::indexed::Database{group_workload->DatabasePath()});
+        } else {
+            group_database.reset(new prism::indexed::Database{
+                    group_workload->DatabasePath(), prism::indexed::CommitWindow{interval, 0}});
+        }
+    }
+    const auto device = static_cast<unsigned int>(state.thread_index());
+    const auto prefix = std::to_string(device) + "_";
+    unsigned long long inserted = 0;
+    double latency = 0;
+    for (auto _ : state) {
+        const auto start = std::chrono::steady_clock::now();
+        group_database->Insert(30000000 + inserted, device, prefix + std::to_string(inserted),
+                               1 << 10, ATTEMPT_KEEP);
+        latency += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() -
+                                                             start)
+                           .count();
+        ++inserted;
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["latency_us"] = benchmark::Counter(latency, benchmark::Counter::kAvgIterations);
+    if (state.thread_index() == 0) {
+        group_database.reset();
+        group_workload.reset();
+    }
+}
+BENCHMARK(BM_DatabaseGroupCommitInsert)
+        ->Arg(0)
+        ->Arg(2)
+        ->Arg(10)
+        ->ArgName("interval_ms")
+        ->ThreadRange(1, 16)
+        ->UseRealTime()
+        ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,123 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "indexed/chrono-snap.h"
+#include "indexed/eviction-policy.h"
+#include "indexed/memory-index.h"
+#include "workload.h"
+
+
+// How many unlinks each policy needs to free a given number of bytes from the same catalog, and
+// how long it takes to produce its victim order. The catalog spans the last catalog_minutes
+// minutes, so the TTL policy finds half of it expired.
+
+using IndexFactory = std::function<std::unique_ptr<prism::indexed::Index>(
+        Workload&, const std::vector<Workload::Row>&)>;
+using PolicyFactory = std::function<std::unique_ptr<prism::indexed::EvictionPolicy>()>;
+
+static const unsigned long long catalog_rows = 1 << 15;
+static const unsigned int catalog_devices = 16;
+static const unsigned long long catalog_minutes = catalog_rows / catalog_devices;
+
+static std::unique_ptr<prism::indexed::EvictionPolicy> oldestFirst() {
+    return std::unique_ptr<prism::indexed::EvictionPolicy>{new prism::indexed::OldestFirstPolicy};
+}
+
+static std::unique_ptr<prism::indexed::EvictionPolicy> largestFirst() {
+    return std::unique_ptr<prism::indexed::EvictionPolicy>{new prism::indexed::LargestFirstPolicy};
+}
+
+static std::unique_ptr<prism::indexed::EvictionPolicy> timeToLive() {
+    return std::unique_ptr<prism::indexed::EvictionPolicy>{
+            new prism::indexed::TimeToLivePolicy{std::chrono::minutes(catalog_minutes / 2)}};
+}
+
+static std::unique_ptr<prism::indexed::EvictionPolicy> decayedPriority() {
+    return std::unique_ptr<prism::indexed::EvictionPolicy>{
+            new prism::indexed::DecayedPriorityPolicy{std::chrono::minutes(60)}};
+}
+
+// Clip sizes vary from 256KiB to 16MiB, as they do between cameras and bitrates
+static std::vector<Workload::Row> generate(Workload& workload) {
+    const auto now = prism::indexed::utility::SnapToMinute(std::chrono::system_clock::now());
+    auto rows = workload.Generate(catalog_rows, catalog_devices, 0, now - catalog_minutes);
+    std::mt19937_64 random(42);
+    std::uniform_int_distribution<unsigned long long> size_distribution(1 << 18, 1 << 24);
+    for (auto& row : rows) {
+        row.size = size_distribution(random);
+    }
+    return rows;
+}
+
+static std::unique_ptr<prism::indexed::Index> openDatabase(
+        Workload& workload, const std::vector<Workload::Row>& rows) {
+    workload.Populate(rows);
+    return std::unique_ptr<prism::indexed::Index>{
+            new prism::indexed::Database{workload.DatabasePath()}};
+}
+
+static std::unique_ptr<prism::indexed::Index> openMemoryIndex(
+        Workload& workload, const std::vector<Workload::Row>& rows) {
+    std::unique_ptr<prism::indexed::Index> index{
+            new prism::indexed::MemoryIndex{workload.MemoryIndexPath(), rows.size() + 1}};
+    for (const auto& row : rows) {
+        index->Insert(row.time_value, row.device, row.hash, row.size, row.keep);
+    }
+    return index;
+}
+
+static void BM_EvictionUnlinks(benchmark::State& state, IndexFactory open_index,
+                               PolicyFactory make_policy) {
+    const auto bytes_to_free = static_cast<unsigned long long>(state.range(0)) << 20;
+    Workload workload{"prism_indexed_bench_eviction_unlinks"};
+    auto rows = generate(workload);
+    std::unordered_map<std::string, unsigned long long> sizes;
+    for (const auto& row : rows) {
+        sizes[row.hash] = row.size;
+    }
+    auto index = open_index(workload, rows);
+    auto policy = make_policy();
+    // The first call builds any index the order needs, which a buffer pays once
+    policy->Victims(*index);
+
+    unsigned long long unlinks = 0;
+    unsigned long long freed = 0;
+    for (auto _ : state) {
+        unlinks = 0;
+        freed = 0;
+        for (const auto& hash : policy->Victims(*index)) {
+            if (freed >= bytes_to_free) {
+                break;
+            }
+            freed += sizes[hash];
+            ++unlinks;
+        }
+    }
+    state.counters["unlinks"] = unlinks;
+    state.counters["freed_mib"] = freed >> 20;
+}
+
+#define PRISM_INDEXED_EVICTION_BENCHMARK(name, open_index, make_policy)                           \
+    BENCHMARK_CAPTURE(BM_EvictionUnlinks, name, open_index, make_policy)                          \
+            ->RangeMultiplier(16)                                                                  \
+            ->Range(64, 16 << 10)                                                                  \
+            ->ArgName("free_mib")                                                                  \
+            ->Unit(benchmark::kMillisecond)
+
+PRISM_INDEXED_EVICTION_BENCHMARK(database_oldest_first, openDatabase, oldestFirst);
+PRISM_INDEXED_EVICTION_BENCHMARK(database_largest_first, openDatabase, largestFirst);
+PRISM_INDEXED_EVICTION_BENCHMARK(database_time_to_live, openDatabase, timeToLive);
+PRISM_INDEXED_EVICTION_BENCHMARK(database_decayed_priority, openDatabase, decayedPriority);
+PRISM_INDEXED_EVICTION_BENCHMARK(memory_index_oldest_first, openMemoryIndex, oldestFirst);
+PRISM_INDEXED_EVICTION_BENCHMARK(memory_index_largest_first, openMemoryIndex, largestFirst);
+PRISM_INDEXED_EVICTION_BENCHMARK(memory_index_time_to_live, openMemoryIndex, timeToLive);
+PRISM_INDEXED_EVICTION_BENCHMARK(memory_index_decayed_priority, openMemoryIndex, decayedPriority);
+
+BENCHMARK_MAIN();
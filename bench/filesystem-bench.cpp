@@ -0,0 +1,105 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "indexed/filesystem.h"
+#include "workload.h"
+
+
+static void BM_FilesystemMove(benchmark::State& state) {
+    const auto clip_size = static_cast<unsigned long long>(state.range(0));
+    Workload workload{"prism_indexed_bench_move"};
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer", workload.RootPath().string(),
+                                          1000.0};
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto staged = workload.Stage(clip_size);
+        auto hash = workload.MakeHash();
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(filesystem.Move(staged, hash));
+    }
+    state.SetBytesProcessed(state.iterations() * clip_size);
+}
+BENCHMARK(BM_FilesystemMove)
+        ->RangeMultiplier(16)
+        ->Range(1 << 10, 1 << 22)
+        ->ArgName("clip_size")
+        ->Unit(benchmark::kMicrosecond);
+
+static void BM_FilesystemDelete(benchmark::State& state) {
+    const auto nesting = state.range(0);
+    Workload workload{"prism_indexed_bench_delete"};
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer", workload.RootPath().string(),
+                                          1000.0};
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto hash = workload.MakeHash();
+        for (int i = 0; i < nesting; ++i) {
+            hash = workload.MakeHash().substr(0, 2) + "/" + hash;
+        }
+        filesystem.Move(workload.Stage(1 << 10), hash);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(filesystem.Delete(hash));
+    }
+}
+BENCHMARK(BM_FilesystemDelete)
+        ->DenseRange(0, 2)
+        ->ArgName("nesting")
+        ->Unit(benchmark::kMicrosecond);
+
+// One reclaimer batch, deleted one file at a time against the same batch through BulkDelete
+static void BM_FilesystemBulkDelete(benchmark::State& state) {
+    const auto batch_size = static_cast<std::size_t>(state.range(0));
+    const bool bulk = state.range(1);
+    Workload workload{"prism_indexed_bench_bulk_delete"};
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer", workload.RootPath().string(),
+                                          1000.0};
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::vector<std::string> hashes;
+        for (std::size_t i = 0; i < batch_size; ++i) {
+            hashes.push_back(workload.MakeHash());
+            filesystem.Move(workload.Stage(1 << 10), hashes.back());
+        }
+        state.ResumeTiming();
+        if (bulk) {
+            benchmark::DoNotOptimize(filesystem.BulkDelete(hashes));
+        } else {
+            for (const auto& hash : hashes) {
+                benchmark::DoNotOptimize(filesystem.Delete(hash));
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK(BM_FilesystemBulkDelete)
+        ->ArgsProduct({{8, 64, 256}, {0, 1}})
+        ->ArgNames({"batch", "bulk"})
+        ->Unit(benchmark::kMicrosecond);
+
+static void BM_FilesystemScan(benchmark::State& state) {
+    const auto files = static_cast<unsigned long long>(state.range(0));
+    const auto threads = static_cast<unsigned int>(state.range(1));
+    Workload workload{"prism_indexed_bench_scan"};
+    auto rows = workload.Generate(files, 1, 0);
+    for (auto& row : rows) {
+        row.hash = row.hash.substr(0, 2) + "/" + row.hash;
+        fs::create_directories(workload.BufferPath() / row.hash.substr(0, 2));
+    }
+    workload.Materialize(rows);
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer", workload.RootPath().string(),
+                                          1000.0};
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(filesystem.Scan(
+                std::chrono::steady_clock::now() + std::chrono::hours(1), threads));
+    }
+    state.SetItemsProcessed(state.iterations() * files);
+}
+BENCHMARK(BM_FilesystemScan)
+        ->ArgsProduct({{1 << 10, 1 << 14, 1 << 17}, {1, 4, 8}})
+        ->ArgNames({"files", "threads"})
+        ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,121 @@
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "indexed/database.h"
+#include "indexed/memory-index.h"
+#include "workload.h"
+
+
+// The same index operations against SQLite and the in-memory index. Each benchmark opens the
+// index after the catalog is built, so the memory index numbers include nothing of the load.
+
+template <typename IndexType>
+std::unique_ptr<prism::indexed::Index> openIndex(Workload& workload,
+                                                 const std::vector<Workload::Row>& rows);
+
+template <>
+std::unique_ptr<prism::indexed::Index> openIndex<prism::indexed::Database>(
+        Workload& workload, const std::vector<Workload::Row>& rows) {
+    workload.Populate(rows);
+    return std::unique_ptr<prism::indexed::Index>{
+            new prism::indexed::Database{workload.DatabasePath()}};
+}
+
+template <>
+std::unique_ptr<prism::indexed::Index> openIndex<prism::indexed::MemoryIndex>(
+        Workload& workload, const std::vector<Workload::Row>& rows) {
+    {
+        prism::indexed::MemoryIndex index{workload.MemoryIndexPath(), rows.size() + 1};
+        for (const auto& row : rows) {
+            index.Insert(row.time_value, row.device, row.hash, row.size, row.keep);
+        }
+        index.Compact();
+    }
+    return std::unique_ptr<prism::indexed::Index>{
+            new prism::indexed::MemoryIndex{workload.MemoryIndexPath()}};
+}
+
+// The index side of Buffer::Push, a pending insert finalized once the file is in place
+template <typename IndexType>
+static void BM_IndexPush(benchmark::State& state) {
+    const auto catalog_size = static_cast<unsigned long long>(state.range(0));
+    Workload workload{"prism_indexed_bench_index_push"};
+    auto index = openIndex<IndexType>(workload, workload.Generate(catalog_size, 16, 1 << 10));
+    unsigned long long pushed = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto hash = workload.MakeHash();
+        state.ResumeTiming();
+        index->InsertPending(30000000 + pushed++, 0, hash, 1 << 10, ATTEMPT_KEEP);
+        index->FinalizePending(hash);
+    }
+}
+BENCHMARK_TEMPLATE(BM_IndexPush, prism::indexed::Database)
+        ->RangeMultiplier(32)
+        ->Range(1 << 10, 1 << 20)
+        ->ArgName("catalog")
+        ->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_IndexPush, prism::indexed::MemoryIndex)
+        ->RangeMultiplier(32)
+        ->Range(1 << 10, 1 << 20)
+        ->ArgName("catalog")
+        ->Unit(benchmark::kMicrosecond);
+
+template <typename IndexType>
+static void BM_IndexFindHash(benchmark::State& state) {
+    const auto catalog_size = static_cast<unsigned long long>(state.range(0));
+    Workload workload{"prism_indexed_bench_index_find_hash"};
+    auto rows = workload.Generate(catalog_size, 16, 1 << 10);
+    auto lookups = workload.Sample(rows, 256);
+    auto index = openIndex<IndexType>(workload, rows);
+    std::size_t i = 0;
+    for (auto _ : state) {
+        const auto& row = lookups[i++ % lookups.size()];
+        benchmark::DoNotOptimize(index->FindHash(row.time_value, row.device));
+    }
+}
+BENCHMARK_TEMPLATE(BM_IndexFindHash, prism::indexed::Database)
+        ->RangeMultiplier(32)
+        ->Range(1 << 10, 1 << 20)
+        ->ArgName("catalog")
+        ->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_IndexFindHash, prism::indexed::MemoryIndex)
+        ->RangeMultiplier(32)
+        ->Range(1 << 10, 1 << 20)
+        ->ArgName("catalog")
+        ->Unit(benchmark::kMicrosecond);
+
+// The index side of one eviction: find the lowest deletable row, mark it, delete it, and insert
+// the clip that needed the room
+template <typename IndexType>
+static void BM_IndexEviction(benchmark::State& state) {
+    const auto catalog_size = static_cast<unsigned long long>(state.range(0));
+    Workload workload{"prism_indexed_bench_index_eviction"};
+    auto index = openIndex<IndexType>(workload, workload.Generate(catalog_size, 16, 1 << 10));
+    unsigned long long pushed = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto hash = workload.MakeHash();
+        state.ResumeTiming();
+        auto hashes = index->GetLowestDeletableHashes();
+        std::vector<std::string> victim{hashes.front()};
+        index->MarkDeleting(victim);
+        index->BulkDelete(victim);
+        index->Insert(30000000 + pushed++, 0, hash, 1 << 10, ATTEMPT_KEEP);
+    }
+}
+BENCHMARK_TEMPLATE(BM_IndexEviction, prism::indexed::Database)
+        ->RangeMultiplier(32)
+        ->Range(1 << 10, 1 << 20)
+        ->ArgName("catalog")
+        ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_IndexEviction, prism::indexed::MemoryIndex)
+        ->RangeMultiplier(32)
+        ->Range(1 << 10, 1 << 20)
+        ->ArgName("catalog")
+        ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
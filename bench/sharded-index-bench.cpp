@@ -0,0 +1,61 @@
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+
+#include "indexed/sharded-index.h"
+#include "workload.h"
+
+
+static std::unique_ptr<Workload> sharded_workload;
+static std::unique_ptr<prism::indexed::ShardedIndex> sharded_index;
+
+// Every thread records its own device, as a recorder does with one thread per camera. With one
+// shard all of them queue on the same database writer.
+static void BM_ShardedIndexInsert(benchmark::State& state) {
+    const auto shards = static_cast<std::size_t>(state.range(0));
+    if (state.thread_index() == 0) {
+        sharded_workload.reset(new Workload{"prism_indexed_bench_sharded_insert"});
+        sharded_index.reset(new prism::indexed::ShardedIndex{sharded_workload->DatabasePath(),
+                                                             shards});
+    }
+    const auto device = static_cast<unsigned int>(state.thread_index());
+    const auto prefix = std::to_string(device) + "_";
+    unsigned long long inserted = 0;
+    for (auto _ : state) {
+        sharded_index->Insert(30000000 + inserted, device, prefix + std::to_string(inserted),
+                              1 << 10, ATTEMPT_KEEP);
+        ++inserted;
+    }
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) {
+        sharded_index.reset();
+        sharded_workload.reset();
+    }
+}
+BENCHMARK(BM_ShardedIndexInsert)
+        ->Arg(1)
+        ->Arg(4)
+        ->ArgName("shards")
+        ->ThreadRange(1, 8)
+        ->UseRealTime()
+        ->Unit(benchmark::kMicrosecond);
+
+static void BM_ShardedIndexGetLowestDeletableHashes(benchmark::State& state) {
+    const auto shards = static_cast<std::size_t>(state.range(0));
+    const auto catalog_size = static_cast<unsigned long long>(state.range(1));
+    Workload workload{"prism_indexed_bench_sharded_lowest"};
+    prism::indexed::ShardedIndex index{workload.DatabasePath(), shards};
+    for (const auto& row : workload.Generate(catalog_size, 16, 1 << 10)) {
+        index.Insert(row.time_value, row.device, row.hash, row.size, row.keep);
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(index.GetLowestDeletableHashes());
+    }
+}
+BENCHMARK(BM_ShardedIndexGetLowestDeletableHashes)
+        ->ArgsProduct({{1, 4}, {1 << 10, 1 << 12}})
+        ->ArgNames({"shards", "catalog"})
+        ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
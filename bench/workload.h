@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <sqlite3.h>
+
+#include "indexed/database.h"
+
+
+namespace fs = ::boost::filesystem;
+
+// Reproducible synthetic workload. Every run with the same seed produces the same rows, hashes,
+// keep levels and clip contents, so numbers from different builds can be compared directly.
+class Workload {
+  public:
+    struct Row {
+        unsigned long long time_value;
+        unsigned int device;
+        std::string hash;
+        unsigned long long size;
+        unsigned int keep;
+    };
+
+    Workload(const std::string& name, const unsigned long& seed = 42)
+            : root_path_(fs::temp_directory_path() / name), random_(seed) {
+        fs::remove_all(root_path_);
+        fs::create_directories(BufferPath());
+        fs::create_directories(StagingPath());
+    }
+
+    ~Workload() {
+        fs::remove_all(root_path_);
+    }
+
+    fs::path RootPath() const {
+        return root_path_;
+    }
+
+    fs::path BufferPath() const {
+        return root_path_ / "prism_indexed_buffer";
+    }
+
+    fs::path StagingPath() const {
+        return root_path_ / "staging";
+    }
+
+    std::string DatabasePath() const {
+        return (BufferPath() / "prism_indexed_data.db").string();
+    }
+
+    std::string MemoryIndexPath() const {
+        return (BufferPath() / "prism_indexed_data.snapshot").string();
+    }
+
+    static std::chrono::system_clock::time_point TimePoint(const unsigned long long& time_value) {
+        return std::chrono::system_clock::time_point(std::chrono::minutes(time_value));
+    }
+
+    // Rows are laid out as consecutive minutes for each device, starting at start_time_value,
+    // with keep levels drawn from the same mix a recorder sees: mostly ATTEMPT_KEEP, some
+    // uploaded and lowered to DELETE_IF_FULL, and a few preserved incidents.
+    std::vector<Row> Generate(const unsigned long long& rows, const unsigned int& devices,
+                              const unsigned long long& clip_size,
+                              const unsigned long long& start_time_value = 24000000) {
+        std::vector<Row> generated;
+        generated.reserve(rows);
+        std::uniform_int_distribution<int> keep_distribution(0, 99);
+        for (unsigned long long i = 0; i < rows; ++i) {
+            auto keep_draw = keep_distribution(random_);
+            auto keep = keep_draw < 70 ? ATTEMPT_KEEP :
+                        keep_draw < 98 ? DELETE_IF_FULL : PRESERVE_RECORD;
+            generated.push_back(Row{start_time_value + i / devices,
+                                    static_cast<unsigned int>(i % devices), MakeHash(), clip_size,
+                                    keep});
+        }
+        return generated;
+    }
+
+    // Writes rows straight into the table in one transaction, which is the only practical way to
+    // build catalogs of a million rows in benchmark setup
+    void Populate(const std::vector<Row>& rows) {
+        prism::indexed::Database database{DatabasePath()};
+        sqlite3* sqlite_db;
+        sqlite3_open(DatabasePath().data(), &sqlite_db);
+        sqlite3_exec(sqlite_db, "BEGIN;", nullptr, nullptr, nullptr);
+        sqlite3_stmt* statement;
+        sqlite3_prepare_v2(sqlite_db,
+                           "INSERT INTO prism_indexed_data(time_value, device, hash, size, keep) "
+                           "VALUES (?, ?, ?, ?, ?);",
+                           -1, &statement, nullptr);
+        for (const auto& row : rows) {
+            sqlite3_bind_int64(statement, 1, row.time_value);
+            sqlite3_bind_int(statement, 2, row.device);
+            sqlite3_bind_text(statement, 3, row.hash.data(), row.hash.size(), SQLITE_STATIC);
+            sqlite3_bind_int64(statement, 4, row.size);
+            sqlite3_bind_int(statement, 5, row.keep);
+            sqlite3_step(statement);
+            sqlite3_reset(statement);
+        }
+        sqlite3_finalize(statement);
+        sqlite3_exec(sqlite_db, "COMMIT;", nullptr, nullptr, nullptr);
+        sqlite3_close(sqlite_db);
+    }
+
+    // Creates the buffer files for the given rows so lookups against them see real files
+    void Materialize(const std::vector<Row>& rows) {
+        for (const auto& row : rows) {
+            writeFile(BufferPath() / row.hash, row.size);
+        }
+    }
+
+    std::string Stage(const unsigned long long& size) {
+        auto filepath = StagingPath() / MakeHash();
+        writeFile(filepath, size);
+        return filepath.string();
+    }
+
+    std::string MakeHash() {
+        static const char alphanum[] =
+                "0123456789"
+                "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                "abcdefghijklmnopqrstuvwxyz";
+        std::uniform_int_distribution<int> distribution(0, sizeof(alphanum) - 2);
+        std::string hash(32, '0');
+        for (auto& character : hash) {
+            character = alphanum[distribution(random_)];
+        }
+        return hash;
+    }
+
+    std::vector<Row> Sample(const std::vector<Row>& rows, const std::size_t& count) {
+        std::vector<Row> sampled;
+        std::uniform_int_distribution<std::size_t> distribution(0, rows.size() - 1);
+        for (std::size_t i = 0; i < count && !rows.empty(); ++i) {
+            sampled.push_back(rows[distribution(random_)]);
+        }
+        return sampled;
+    }
+
+  private:
+    void writeFile(const fs::path& filepath, const unsigned long long& size) {
+        if (!contents_.empty() && contents_.size() < size) {
+            contents_.clear();
+        }
+        if (contents_.empty()) {
+            std::uniform_int_distribution<int> distribution(0, 255);
+            contents_.resize(std::max<unsigned long long>(size, 1));
+            for (auto& character : contents_) {
+                character = static_cast<char>(distribution(random_));
+            }
+        }
+        std::ofstream out_stream{filepath.native(), std::ios::binary};
+        out_stream.write(contents_.data(), size);
+    }
+
+    fs::path root_path_;
+    std::mt19937_64 random_;
+    std::string contents_;
+};
@@ -2,12 +2,24 @@
 #define PRISM_INDEXED_BUFFER_H
 
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "indexed/compression.h"
+#include "indexed/event-ring.h"
+#include "indexed/eviction-policy.h"
+#include "indexed/index.h"
+#include "indexed/stats.h"
+#include "indexed/storage.h"
+#include "indexed/striped-storage.h"
+#include "indexed/tiered-storage.h"
+#include "indexed/trace.h"
+
 
 namespace prism {
 namespace indexed {
@@ -19,6 +31,112 @@ struct Item {
 using ItemMap = std::map<std::chrono::system_clock::time_point, std::vector<Item>>;
 using Device = unsigned int;
 
+enum class Direction { Before, After, Nearest };
+
+// Packed clips share a segment file with other clips and occupy length bytes at offset. A clip
+// with a file of its own starts at offset zero. A compressed clip expands to raw_length bytes
+// and is read through DecompressingReader, while any other clip has raw_length equal to length.
+struct Clip {
+    std::chrono::system_clock::time_point time_point;
+    std::string filepath;
+    uintmax_t offset;
+    uintmax_t length;
+    Codec codec;
+    uintmax_t raw_length;
+};
+
+struct UnsyncedClip {
+    Device device;
+    Clip clip;
+};
+
+// Limits on the bytes one device may hold. A device is never evicted below its reserve to make
+// room for other devices, and a nonzero quota caps it even while the buffer as a whole has room.
+struct DeviceQuota {
+    uintmax_t quota;
+    uintmax_t reserve;
+};
+
+struct Options {
+    Options();
+
+    std::function<std::string(void)> hash_function;
+    // Interval of the background walk that corrects the stored size, zero disables it
+    std::chrono::minutes verify_size_interval;
+    // Receives spans around index queries, file moves and deletes, and eviction. Only used when
+    // built with BUILD_INDEXEDBUFFER_TRACING.
+    std::shared_ptr<Tracer> tracer;
+    // Clips up to this many bytes are packed into segment files instead of getting a file of
+    // their own, zero disables packing
+    uintmax_t segment_threshold;
+    uintmax_t segment_size;
+    // Build the storage and index the buffer runs on. Unset factories select Filesystem and the
+    // SQLite Database, and the index factory is handed the storage it will sit beside.
+    std::function<std::unique_ptr<Storage>(const std::string& buffer_root,
+                                           const double& gigabyte_quota)>
+            storage_factory;
+    std::function<std::unique_ptr<Index>(Storage& storage)> index_factory;
+    // When set, eviction takes clips from the devices furthest over their share instead of the
+    // oldest clips overall. A device's share is its quota, or an equal split of the buffer quota
+    // when it has none.
+    std::map<Device, DeviceQuota> device_quotas;
+    // Order of eviction when no device quotas are set, unset keeps OldestFirstPolicy
+    std::shared_ptr<EvictionPolicy> eviction_policy;
+    // Clips older than their retention are deleted by a background task every retention_interval,
+    // even while the buffer has room. A clip's retention is the shortest of retention and the
+    // entries for its device and keep level, zero or no entry meaning no limit.
+    std::chrono::minutes retention;
+    std::map<Device, std::chrono::minutes> device_retention;
+    std::map<unsigned int, std::chrono::minutes> keep_retention;
+    std::chrono::minutes retention_interval;
+    // Evicted and deleted files are unlinked by the background reclaimer instead of inside Push
+    // and Delete. Eviction counts queued bytes as free at once, while GetSize and Full only drop
+    // once the unlink completes. A crash before then leaves the file for Reconcile.
+    bool unlink_in_background;
+    // Clips with identical contents share one file, so the bytes are stored and charged against
+    // the quota once and freed when the last clip holding them goes. The first copy is named
+    // after a hash of its contents and later copies are hard links to it. Packed clips are not
+    // deduplicated. Rows keep each clip's full size, so startup walks the buffer for its size
+    // instead of summing the rows.
+    bool deduplicate;
+    // Clips too large to be packed are compressed with this codec before they are stored, and
+    // kept compressed only when that saves at least an eighth of their bytes. The quota is
+    // charged for the compressed bytes. Compressed files carry the codec's suffix, so the codec
+    // of a clip is known from its filename as well as from the index.
+    Codec compression;
+    // Slower filesystems the buffer spills to, fastest first, each with a quota of its own. When
+    // set without a storage_factory, buffer_root and the buffer quota become the first tier of a
+    // TieredStorage. Clips land on the first tier and are demoted down the list in the
+    // background, and eviction starts only once the last tier is full.
+    std::vector<StorageTier> tiers;
+    // Further disks the buffer spreads clips over beside buffer_root, with the buffer quota
+    // covering all of them. When set without a storage_factory or tiers, the buffer runs on a
+    // StripedStorage placing clips by stripe_placement. A root missing at startup is left out
+    // and the quota shrinks to the share of the rest.
+    std::vector<std::string> stripe_roots;
+    StripePlacement stripe_placement;
+    // Above one and without an index_factory, the index is split by device over this many SQLite
+    // databases in a ShardedIndex, each written independently. The count must not change for an
+    // existing buffer, since it decides which database holds each device.
+    std::size_t index_shards;
+    // Lets several processes open the same buffer_root at once. They count stored bytes in
+    // memory shared through a file in the buffer directory, and every change to the buffer or its
+    // index is made under a lock shared between them, so none of them waits on SQLite. The first
+    // process to open the buffer holds a lease and evicts for all of them, and retention and size
+    // verification run only there. A push by another process that finds the buffer full asks the
+    // owner for room and waits for it. The lease passes to another process when the owner exits.
+    // Needs the default Filesystem storage without packing, and a POSIX system. Elsewhere the
+    // constructor throws FilesystemException.
+    bool shared;
+};
+
+struct ReconcileReport {
+    unsigned long long orphan_files_removed;
+    unsigned long long orphan_bytes_removed;
+    unsigned long long missing_records_removed;
+    bool complete;
+};
+
 class Buffer {
   public:
     Buffer();
@@ -26,17 +144,42 @@ class Buffer {
     Buffer(const std::string& buffer_root, const double& gigabyte_quota);
     Buffer(const std::string& buffer_root, const double& gigabyte_quota,
            std::function<std::string(void)> hash_function);
+    Buffer(const std::string& buffer_root, const double& gigabyte_quota, const Options& options);
     ~Buffer();
 
     bool Delete(const std::chrono::system_clock::time_point& time_point,
                 const unsigned int& device);
+    bool DeleteRange(const std::chrono::system_clock::time_point& start,
+                     const std::chrono::system_clock::time_point& end);
+    bool DeleteRange(const unsigned int& device,
+                     const std::chrono::system_clock::time_point& start,
+                     const std::chrono::system_clock::time_point& end);
+    Clip FindNearest(const std::chrono::system_clock::time_point& time_point,
+                     const unsigned int& device, const Direction& direction);
     std::string GetBufferDirectory() const;
     std::map<Device, ItemMap> GetCatalog();
     std::string GetFilepath(const std::chrono::system_clock::time_point& time_point,
                             const unsigned int& device);
+    // Also finds packed clips, which GetFilepath cannot return
+    Clip GetLocation(const std::chrono::system_clock::time_point& time_point,
+                     const unsigned int& device);
+    std::vector<Clip> GetFilepaths(const unsigned int& device,
+                                   const std::chrono::system_clock::time_point& start,
+                                   const std::chrono::system_clock::time_point& end);
     bool Full();
+    // Up to count clips not yet marked synced, oldest first, from the given devices or from all of
+    // them when devices is empty. Every clip starts unsynced, so an uploader can work through
+    // the buffer with these two calls instead of diffing GetCatalog.
+    std::vector<UnsyncedClip> NextUnsynced(const std::size_t& count,
+                                           const std::vector<Device>& devices);
+    bool MarkSynced(const std::vector<std::chrono::system_clock::time_point>& time_points,
+                    const unsigned int& device);
     bool PreserveRecord(const std::chrono::system_clock::time_point& time_point,
                         const unsigned int& device);
+    ReconcileReport Reconcile(const std::chrono::milliseconds& budget);
+    // Deletes every clip past its retention now instead of waiting for the background task, and
+    // returns how many were deleted
+    unsigned long long Expire();
     bool SetLowPriority(const std::chrono::system_clock::time_point& time_point,
                         const unsigned int& device);
     bool KeepIfPossible(const std::chrono::system_clock::time_point& time_point,
@@ -47,8 +190,31 @@ class Buffer {
                             const unsigned int& device);
     bool BulkKeepIfPossible(const std::vector<std::chrono::system_clock::time_point>& time_points,
                             const unsigned int& device);
+    bool SetKeepRange(const std::chrono::system_clock::time_point& start,
+                      const std::chrono::system_clock::time_point& end, const unsigned int& keep);
+    bool SetKeepRange(const unsigned int& device,
+                      const std::chrono::system_clock::time_point& start,
+                      const std::chrono::system_clock::time_point& end, const unsigned int& keep);
     bool Push(const std::chrono::system_clock::time_point& time_point, const unsigned int& device,
               const std::string& filepath);
+    StatsSnapshot GetStats() const;
+    // Writes the stats in Prometheus text format, replacing the file atomically
+    bool DumpStats(const std::string& filepath) const;
+    // Count of changes to the clips of a shared buffer made by any process that has it open, and
+    // a wait until it moves past sequence that returns false on timeout. A buffer that is not
+    // shared counts nothing, and WaitForChange waits out its timeout.
+    unsigned int GetChangeSequence() const;
+    bool WaitForChange(const unsigned int& sequence, const std::chrono::milliseconds& timeout) const;
+    // Whether this process holds the lease of a shared buffer, taking it if it is free. Always
+    // true for a buffer that is not shared.
+    bool IsEvictionOwner();
+    // Calls subscriber with every change this process makes to the clips, in the order they were
+    // made, from a thread of the buffer's own and without the buffer's lock held. Changes made by
+    // other processes sharing the buffer are only seen through WaitForChange. Subscribers must
+    // not throw, nor subscribe, unsubscribe or destroy the buffer from inside the call.
+    unsigned int Subscribe(const std::function<void(const Event& event)>& subscriber);
+    // Once it returns the subscriber is not called again
+    void Unsubscribe(const unsigned int& subscription);
 
   private:
     class Impl;
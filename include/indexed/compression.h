@@ -0,0 +1,52 @@
+#ifndef PRISM_INDEXED_COMPRESSION_H_
+#define PRISM_INDEXED_COMPRESSION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+
+namespace prism {
+namespace indexed {
+
+// Stored in the index beside each compressed clip, so the values must not change
+enum class Codec : unsigned int { None = 0, Lz4 = 1 };
+
+// Streams the original bytes of a clip file written by utility::CompressFile. Throws
+// FilesystemException when the file cannot be opened or is not a compressed clip, and from Read
+// when a block is corrupt.
+class DecompressingReader {
+  public:
+    DecompressingReader(const std::string& filepath);
+    ~DecompressingReader();
+
+    // Fills data with up to length bytes and returns how many, zero once the clip is exhausted
+    std::size_t Read(char* data, const std::size_t& length);
+    uintmax_t GetRawSize() const;
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+namespace utility {
+
+// LZ4 block format, readable by any LZ4 decoder given the decompressed length. Compress returns
+// the compressed length, or zero when it does not fit in capacity. Decompress succeeds only when
+// the block expands to exactly raw_length bytes.
+std::size_t Lz4Compress(const char* source, const std::size_t& length, char* destination,
+                        const std::size_t& capacity);
+bool Lz4Decompress(const char* source, const std::size_t& length, char* destination,
+                   const std::size_t& raw_length);
+
+// Writes source to destination as independently LZ4 compressed 64 KiB blocks, storing any block
+// that does not shrink as it is. Returns the bytes written, or zero after removing destination
+// when source cannot be read or destination cannot be written.
+uintmax_t CompressFile(const std::string& source, const std::string& destination);
+
+} // namespace utility
+} // namespace indexed
+} // namespace prism
+
+#endif /* PRISM_INDEXED_COMPRESSION_H_ */
@@ -0,0 +1,37 @@
+#ifndef PRISM_INDEXED_CONTENT_HASH_H_
+#define PRISM_INDEXED_CONTENT_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+namespace prism {
+namespace indexed {
+namespace utility {
+
+// Streaming XXH64, matching the reference implementation on little-endian hosts
+class Xxh64 {
+  public:
+    Xxh64(const uint64_t& seed = 0);
+
+    void Update(const void* data, const std::size_t& length);
+    uint64_t Digest() const;
+
+  private:
+    uint64_t seed_;
+    uint64_t accumulators_[4];
+    uint64_t total_length_;
+    unsigned char pending_[32];
+    std::size_t pending_length_;
+};
+
+// 128 bits of the file's contents as 32 hex characters, from two XXH64 passes with different
+// seeds run over one read of the file. Empty when the file cannot be read.
+std::string HashFile(const std::string& filepath);
+
+} // namespace utility
+} // namespace indexed
+} // namespace prism
+
+#endif /* PRISM_INDEXED_CONTENT_HASH_H_ */
@@ -1,53 +1,138 @@
 #ifndef PRISM_INDEXED_DATABASE_H_
 #define PRISM_INDEXED_DATABASE_H_
 
+#include <chrono>
+#include <cstddef>
 #include <exception>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
-#define DELETE_IF_FULL 0U
-#define ATTEMPT_KEEP 10U
-#define PRESERVE_RECORD 1000U
+#include "indexed/index.h"
+#include "indexed/trace.h"
 
 
 namespace prism {
 namespace indexed {
 
-using Record = std::map<std::string, std::string>;
+// How long and how many writes a group commit gathers before it writes them in one transaction.
+// interval bounds how long a write waits to be committed, and a batch is committed as soon as
+// operations writes are queued, zero meaning no limit.
+struct CommitWindow {
+    std::chrono::milliseconds interval;
+    std::size_t operations;
+};
+
+// Called once a queued write is committed, or with the error that failed it. applied is false
+// when the write changed nothing, such as a SetKeep matching no row. Runs on the committer
+// thread, so it must not wait on the database.
+using CommitCallback = std::function<void(const bool& applied, const std::exception_ptr& error)>;
 
-class Database {
+class Database : public Index {
   public:
     Database(const std::string& path);
-    ~Database();
+    // Group commit: every write is queued and written by a committer thread, which commits
+    // everything queued within window in one transaction instead of one transaction each. Each
+    // write still returns only once it is committed, so writers on several threads share a
+    // commit. Reads run at once and see a queued write only after it is committed.
+    //
+    // A Buffer makes its index writes one at a time under its own lock, so there is nothing to
+    // share a commit with and each write waits out the whole window. Give a Buffer a Database
+    // without a window.
+    Database(const std::string& path, const CommitWindow& window);
+    ~Database() override;
 
-    void Delete(const std::string& hash);
-    void BulkDelete(const std::vector<std::string>& hash);
-    std::vector<std::string> GetLowestDeletableHashes();
-    std::string FindHash(const unsigned long long& time_value, const unsigned int& device);
+    void ClearIntents(const std::vector<std::string>& hashes) override;
+    void CompactSegment(const std::vector<std::string>& evicted_hashes,
+                        const std::vector<Record>& relocations) override;
+    void Delete(const std::string& hash) override;
+    void BulkDelete(const std::vector<std::string>& hash) override;
+    std::vector<std::string> DeleteRange(const unsigned long long& start_time_value,
+                                         const unsigned long long& end_time_value) override;
+    std::vector<std::string> DeleteRange(const unsigned int& device,
+                                         const unsigned long long& start_time_value,
+                                         const unsigned long long& end_time_value) override;
+    std::vector<std::string> DeleteExpired(const unsigned long long& cutoff_time_value,
+                                           const std::size_t& limit) override;
+    std::vector<std::string> DeleteExpired(const unsigned int& device,
+                                           const unsigned long long& cutoff_time_value,
+                                           const std::size_t& limit) override;
+    std::vector<std::string> DeleteExpiredKeep(const unsigned int& keep,
+                                               const unsigned long long& cutoff_time_value,
+                                               const std::size_t& limit) override;
+    void FinalizePending(const std::string& hash) override;
+    Record GetCompression(const std::string& hash) override;
+    std::vector<std::string> GetDecayedDeletableHashes(
+            const unsigned long long& decay_minutes) override;
+    std::map<unsigned int, unsigned long long> GetDeviceSizes() override;
+    std::vector<std::string> GetExpiredHashes(
+            const unsigned long long& cutoff_time_value) override;
+    std::vector<Record> GetIntents() override;
+    std::vector<std::string> GetLargestDeletableHashes() override;
+    Record GetLocation(const std::string& hash) override;
+    std::vector<Record> GetLowestDeletable(const unsigned int& device) override;
+    std::vector<std::string> GetLowestDeletableHashes() override;
+    unsigned long long GetMetadataSize() override;
+    std::vector<Record> GetSegmentItems(const unsigned long long& segment) override;
+    std::vector<unsigned long long> GetSegments() override;
+    unsigned long long GetSegmentedSize() override;
+    unsigned long long GetTotalSize() override;
+    std::string FindHash(const unsigned long long& time_value, const unsigned int& device) override;
+    Record FindNext(const unsigned long long& time_value, const unsigned int& device) override;
+    Record FindPrevious(const unsigned long long& time_value, const unsigned int& device) override;
     void Insert(const unsigned long long& time_value, const unsigned int& device,
-                const std::string& hash, const unsigned long long& size, const unsigned int& keep);
-    std::vector<Record> SelectAll();
+                const std::string& hash, const unsigned long long& size,
+                const unsigned int& keep) override;
+    void InsertCompressed(const unsigned long long& time_value, const unsigned int& device,
+                          const std::string& hash, const unsigned long long& size,
+                          const unsigned int& keep, const unsigned int& codec,
+                          const unsigned long long& raw_size) override;
+    void InsertPending(const unsigned long long& time_value, const unsigned int& device,
+                       const std::string& hash, const unsigned long long& size,
+                       const unsigned int& keep) override;
+    void InsertSegmented(const unsigned long long& time_value, const unsigned int& device,
+                         const std::string& hash, const unsigned long long& size,
+                         const unsigned int& keep, const unsigned long long& segment,
+                         const unsigned long long& offset) override;
+    void MarkDeleting(const std::vector<std::string>& hashes) override;
+    bool MarkSynced(const std::vector<unsigned long long>& time_values,
+                    const unsigned int& device) override;
+    std::vector<Record> NextUnsynced(const std::size_t& limit,
+                                     const std::vector<unsigned int>& devices) override;
+    std::vector<Record> SelectAll() override;
+    std::vector<Record> SelectHashes(const std::vector<std::string>& hashes) override;
+    std::vector<Record> SelectRange(const unsigned int& device,
+                                    const unsigned long long& start_time_value,
+                                    const unsigned long long& end_time_value) override;
     bool SetKeep(const unsigned long long& time_value, const unsigned int& device,
-                 const unsigned int& keep);
+                 const unsigned int& keep) override;
     bool BulkSetKeep(const std::vector<unsigned long long>& time_values, const unsigned int& device,
-                     const unsigned int& keep);
+                     const unsigned int& keep) override;
+    bool SetKeepRange(const unsigned long long& start_time_value,
+                      const unsigned long long& end_time_value, const unsigned int& keep) override;
+    bool SetKeepRange(const unsigned int& device, const unsigned long long& start_time_value,
+                      const unsigned long long& end_time_value, const unsigned int& keep) override;
+    void SetTracer(const std::shared_ptr<Tracer>& tracer) override;
 
-  private:
-    class Impl;
-    std::unique_ptr<Impl> impl_;
-};
+    // Deletable rows with their hash, size, keep and time_value, in the order of
+    // GetLowestDeletableHashes, so the eviction order of several databases can be merged
+    std::vector<Record> SelectDeletable();
 
-class DatabaseException : public std::exception {
-  public:
-    DatabaseException(const std::string& reason) : reason_(reason) {}
-    virtual const char* what() const throw() {
-        return reason_.data();
-    }
+    // Insert and SetKeep that return at once and report to callback from the committer thread.
+    // Without a commit window they run at once and callback is called before they return.
+    void InsertAsync(const unsigned long long& time_value, const unsigned int& device,
+                     const std::string& hash, const unsigned long long& size,
+                     const unsigned int& keep, const CommitCallback& callback);
+    void SetKeepAsync(const unsigned long long& time_value, const unsigned int& device,
+                      const unsigned int& keep, const CommitCallback& callback);
+    // Returns once every write queued before it is committed
+    void Flush();
 
   private:
-    std::string reason_;
+    class Impl;
+    std::unique_ptr<Impl> impl_;
 };
 
 } // namespace indexed
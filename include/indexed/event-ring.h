@@ -0,0 +1,50 @@
+#ifndef PRISM_INDEXED_EVENT_RING_H_
+#define PRISM_INDEXED_EVENT_RING_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+
+namespace prism {
+namespace indexed {
+
+// Evicted clips were removed by the buffer itself, to make room or past their retention, and
+// Deleted clips by a caller or because their file had gone. Dropped stands in for events lost
+// while subscribers fell behind, with their count in size, after which the catalog is to be
+// read again.
+enum class EventType { Pushed, Evicted, Deleted, KeepChanged, Dropped };
+
+struct Event {
+    EventType type;
+    unsigned int device;
+    std::chrono::system_clock::time_point time_point;
+    uintmax_t size;
+};
+
+// Bounded queue of events between one producer and one consumer that never blocks either. A
+// push that finds the ring full drops the event and counts it instead.
+class EventRing {
+  public:
+    // Capacity is rounded up to a power of two
+    EventRing(const std::size_t& capacity);
+    ~EventRing();
+
+    bool Push(const Event& event);
+    bool Pop(Event& event);
+    bool Empty() const;
+    // Counts events the producer could not describe as dropped, as if the ring had been full
+    void Drop(const uint64_t& count);
+    // Count of events dropped since the last call, resetting it
+    uint64_t TakeDropped();
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace indexed
+} // namespace prism
+
+#endif /* PRISM_INDEXED_EVENT_RING_H_ */
@@ -0,0 +1,63 @@
+#ifndef PRISM_INDEXED_EVICTION_POLICY_H_
+#define PRISM_INDEXED_EVICTION_POLICY_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "indexed/index.h"
+
+
+namespace prism {
+namespace indexed {
+
+// Chooses the order in which Buffer evicts clips to get back under quota. Each policy reads an
+// order the index keeps sorted, so the next victim costs one step of an index scan. Clips at
+// PRESERVE_RECORD are never victims.
+class EvictionPolicy {
+  public:
+    virtual ~EvictionPolicy() {}
+
+    virtual std::vector<std::string> Victims(Index& index) = 0;
+};
+
+// Lowest keep first, oldest first within a keep level. This is the order without a policy.
+class OldestFirstPolicy : public EvictionPolicy {
+  public:
+    std::vector<std::string> Victims(Index& index) override;
+};
+
+// Lowest keep first, largest first within a keep level, so quota is freed with fewer unlinks
+class LargestFirstPolicy : public EvictionPolicy {
+  public:
+    std::vector<std::string> Victims(Index& index) override;
+};
+
+// Clips older than time_to_live go first whatever their keep, oldest first, then the rest in
+// OldestFirstPolicy order
+class TimeToLivePolicy : public EvictionPolicy {
+  public:
+    TimeToLivePolicy(const std::chrono::minutes& time_to_live);
+
+    std::vector<std::string> Victims(Index& index) override;
+
+  private:
+    std::chrono::minutes time_to_live_;
+};
+
+// A clip's keep level falls by one for every decay of age, so an old ATTEMPT_KEEP clip can go
+// before a fresh DELETE_IF_FULL one
+class DecayedPriorityPolicy : public EvictionPolicy {
+  public:
+    DecayedPriorityPolicy(const std::chrono::minutes& decay);
+
+    std::vector<std::string> Victims(Index& index) override;
+
+  private:
+    std::chrono::minutes decay_;
+};
+
+} // namespace indexed
+} // namespace prism
+
+#endif /* PRISM_INDEXED_EVICTION_POLICY_H_ */
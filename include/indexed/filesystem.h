@@ -1,44 +1,58 @@
 #ifndef PRISM_INDEXED_FILESYSTEM_H_
 #define PRISM_INDEXED_FILESYSTEM_H_
 
-#include <exception>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
+
+#include "indexed/storage.h"
+#include "indexed/trace.h"
 
 
 namespace prism {
 namespace indexed {
 
-class Filesystem {
+class Filesystem : public Storage {
   public:
     Filesystem(const std::string& buffer_directory,
                const std::string& buffer_parent = std::string{},
-               const double& gigabyte_quota = 2.0);
-    ~Filesystem();
-
-    bool AboveQuota();
-    bool Delete(const std::string& filename);
-    std::string GetBufferDirectory() const;
-    std::string GetExistingFilepath(const std::string& filename) const;
-    std::string GetFilepath(const std::string& filename) const;
-    bool Move(const std::string& filepath_move_from, const std::string& filename_move_to);
+               const double& gigabyte_quota = 2.0,
+               const bool& scan_size = true);
+    ~Filesystem() override;
+
+    void AddSize(const uintmax_t& bytes) override;
+    bool AboveQuota() override;
+    bool AboveQuota(const uintmax_t& releasing_bytes) override;
+    bool Delete(const std::string& filename) override;
+    std::size_t BulkDelete(const std::vector<std::string>& filenames) override;
+    std::string GetBufferDirectory() const override;
+    std::string GetExistingFilepath(const std::string& filename) const override;
+    std::string GetFilepath(const std::string& filename) const override;
+    uintmax_t GetFileSize(const std::string& filename) const override;
+    uintmax_t GetSize() const override;
+    void SetSize(const uintmax_t& size) override;
+    void SetTracer(const std::shared_ptr<Tracer>& tracer) override;
+    bool VerifySize(const std::atomic<bool>& cancel) override;
+    bool Move(const std::string& filepath_move_from,
+              const std::string& filename_move_to) override;
+    bool Link(const std::string& filename_link_from,
+              const std::string& filename_link_to) override;
+    FileListing Scan(const std::chrono::steady_clock::time_point& deadline,
+                     const unsigned int& threads) const override;
+
+    // Counts stored bytes in size, such as a counter shared with other processes, instead of a
+    // counter of its own. size keeps its value. Call before the storage is in use.
+    void ShareSize(std::atomic<uintmax_t>& size);
 
   private:
     class Impl;
     std::unique_ptr<Impl> impl_;
 };
 
-class FilesystemException : public std::exception {
-  public:
-    FilesystemException(const std::string& reason) : reason_(reason) {}
-    virtual const char* what() const throw() {
-        return reason_.data();
-    }
-
-  private:
-    std::string reason_;
-};
-
 } // namespace indexed
 } // namespace prism
 
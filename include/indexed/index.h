@@ -0,0 +1,143 @@
+#ifndef PRISM_INDEXED_INDEX_H_
+#define PRISM_INDEXED_INDEX_H_
+
+#include <cstddef>
+#include <exception>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "indexed/trace.h"
+
+#define DELETE_IF_FULL 0U
+#define ATTEMPT_KEEP 10U
+#define PRESERVE_RECORD 1000U
+
+#define INTENT_PUSH 1U
+#define INTENT_DELETE 2U
+
+
+namespace prism {
+namespace indexed {
+
+using Record = std::map<std::string, std::string>;
+
+// Catalog of stored clips behind Buffer. Records use the column names of the SQLite schema in
+// Database, and failures are reported by throwing DatabaseException.
+class Index {
+  public:
+    virtual ~Index() {}
+
+    virtual void ClearIntents(const std::vector<std::string>& hashes) = 0;
+    virtual void CompactSegment(const std::vector<std::string>& evicted_hashes,
+                                const std::vector<Record>& relocations) = 0;
+    virtual void Delete(const std::string& hash) = 0;
+    virtual void BulkDelete(const std::vector<std::string>& hash) = 0;
+    virtual std::vector<std::string> DeleteRange(const unsigned long long& start_time_value,
+                                                 const unsigned long long& end_time_value) = 0;
+    virtual std::vector<std::string> DeleteRange(const unsigned int& device,
+                                                 const unsigned long long& start_time_value,
+                                                 const unsigned long long& end_time_value) = 0;
+    // Delete up to limit of the oldest rows recorded before cutoff_time_value, like DeleteRange.
+    // The device overload and DeleteExpiredKeep only consider rows of that device or keep level.
+    virtual std::vector<std::string> DeleteExpired(const unsigned long long& cutoff_time_value,
+                                                   const std::size_t& limit) = 0;
+    virtual std::vector<std::string> DeleteExpired(const unsigned int& device,
+                                                   const unsigned long long& cutoff_time_value,
+                                                   const std::size_t& limit) = 0;
+    virtual std::vector<std::string> DeleteExpiredKeep(const unsigned int& keep,
+                                                       const unsigned long long& cutoff_time_value,
+                                                       const std::size_t& limit) = 0;
+    virtual void FinalizePending(const std::string& hash) = 0;
+    // Codec and raw size of a row added by InsertCompressed, empty for any other row
+    virtual Record GetCompression(const std::string& hash) = 0;
+    // Deletable hashes ordered by keep * decay_minutes + time_value, so a clip's keep level in
+    // effect drops by one for every decay_minutes of age
+    virtual std::vector<std::string> GetDecayedDeletableHashes(
+            const unsigned long long& decay_minutes) = 0;
+    // Bytes held by each device that has any, from an aggregate rather than a scan
+    virtual std::map<unsigned int, unsigned long long> GetDeviceSizes() = 0;
+    // Deletable hashes recorded before cutoff_time_value, oldest first whatever their keep
+    virtual std::vector<std::string> GetExpiredHashes(
+            const unsigned long long& cutoff_time_value) = 0;
+    virtual std::vector<Record> GetIntents() = 0;
+    // Deletable hashes by keep, then largest first
+    virtual std::vector<std::string> GetLargestDeletableHashes() = 0;
+    virtual Record GetLocation(const std::string& hash) = 0;
+    // Deletable rows of one device with their hash and size, in the same order as
+    // GetLowestDeletableHashes
+    virtual std::vector<Record> GetLowestDeletable(const unsigned int& device) = 0;
+    virtual std::vector<std::string> GetLowestDeletableHashes() = 0;
+    // Bytes the index itself occupies on disk, counted against the quota
+    virtual unsigned long long GetMetadataSize() = 0;
+    virtual std::vector<Record> GetSegmentItems(const unsigned long long& segment) = 0;
+    virtual std::vector<unsigned long long> GetSegments() = 0;
+    virtual unsigned long long GetSegmentedSize() = 0;
+    virtual unsigned long long GetTotalSize() = 0;
+    virtual std::string FindHash(const unsigned long long& time_value,
+                                 const unsigned int& device) = 0;
+    virtual Record FindNext(const unsigned long long& time_value, const unsigned int& device) = 0;
+    virtual Record FindPrevious(const unsigned long long& time_value,
+                                const unsigned int& device) = 0;
+    virtual void Insert(const unsigned long long& time_value, const unsigned int& device,
+                        const std::string& hash, const unsigned long long& size,
+                        const unsigned int& keep) = 0;
+    // Like InsertPending for a clip stored compressed in size bytes, recording its codec and
+    // raw size in the same transaction
+    virtual void InsertCompressed(const unsigned long long& time_value, const unsigned int& device,
+                                  const std::string& hash, const unsigned long long& size,
+                                  const unsigned int& keep, const unsigned int& codec,
+                                  const unsigned long long& raw_size) = 0;
+    virtual void InsertPending(const unsigned long long& time_value, const unsigned int& device,
+                               const std::string& hash, const unsigned long long& size,
+                               const unsigned int& keep) = 0;
+    virtual void InsertSegmented(const unsigned long long& time_value, const unsigned int& device,
+                                 const std::string& hash, const unsigned long long& size,
+                                 const unsigned int& keep, const unsigned long long& segment,
+                                 const unsigned long long& offset) = 0;
+    virtual void MarkDeleting(const std::vector<std::string>& hashes) = 0;
+    // Every row starts unsynced. MarkSynced returns whether any of the rows exist, like
+    // BulkSetKeep.
+    virtual bool MarkSynced(const std::vector<unsigned long long>& time_values,
+                            const unsigned int& device) = 0;
+    // Up to limit unsynced rows with their time_value, device, hash and size, oldest first and
+    // then by device, from any device when devices is empty
+    virtual std::vector<Record> NextUnsynced(const std::size_t& limit,
+                                             const std::vector<unsigned int>& devices) = 0;
+    virtual std::vector<Record> SelectAll() = 0;
+    // Rows with any of the given hashes, with their time_value, device, hash and size, in no
+    // particular order
+    virtual std::vector<Record> SelectHashes(const std::vector<std::string>& hashes) = 0;
+    virtual std::vector<Record> SelectRange(const unsigned int& device,
+                                            const unsigned long long& start_time_value,
+                                            const unsigned long long& end_time_value) = 0;
+    virtual bool SetKeep(const unsigned long long& time_value, const unsigned int& device,
+                         const unsigned int& keep) = 0;
+    virtual bool BulkSetKeep(const std::vector<unsigned long long>& time_values,
+                             const unsigned int& device, const unsigned int& keep) = 0;
+    virtual bool SetKeepRange(const unsigned long long& start_time_value,
+                              const unsigned long long& end_time_value,
+                              const unsigned int& keep) = 0;
+    virtual bool SetKeepRange(const unsigned int& device,
+                              const unsigned long long& start_time_value,
+                              const unsigned long long& end_time_value,
+                              const unsigned int& keep) = 0;
+    virtual void SetTracer(const std::shared_ptr<Tracer>& tracer) = 0;
+};
+
+class DatabaseException : public std::exception {
+  public:
+    DatabaseException(const std::string& reason) : reason_(reason) {}
+    virtual const char* what() const throw() {
+        return reason_.data();
+    }
+
+  private:
+    std::string reason_;
+};
+
+} // namespace indexed
+} // namespace prism
+
+#endif /* PRISM_INDEXED_INDEX_H_ */
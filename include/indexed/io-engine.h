@@ -0,0 +1,80 @@
+#ifndef PRISM_INDEXED_IO_ENGINE_H_
+#define PRISM_INDEXED_IO_ENGINE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace prism {
+namespace indexed {
+
+enum class IoOperation { Stat, Unlink, Rename };
+
+// Paths are absolute or relative to the working directory. A rename moves path to target.
+struct IoRequest {
+    IoOperation operation;
+    std::string path;
+    std::string target;
+};
+
+// error holds the errno of a failed request, or the system error code where the call sets none,
+// and zero otherwise. size, links and directory are
+// only filled in by a successful Stat.
+struct IoResult {
+    int error;
+    uintmax_t size;
+    uintmax_t links;
+    bool directory;
+};
+
+// Runs a batch of filesystem calls with all of them in flight at once, so one thread can keep
+// the disk busy instead of waiting out each call in turn. Requests in a batch complete in any
+// order and must not depend on one another. Thread-safe.
+class IoEngine {
+  public:
+    virtual ~IoEngine() {}
+
+    // Returns once every request has completed, with the results in request order
+    virtual std::vector<IoResult> Submit(const std::vector<IoRequest>& requests) = 0;
+
+    // io_uring when built with BUILD_INDEXEDBUFFER_IO_URING and the kernel supports every
+    // operation, a ThreadPoolIoEngine of the given size otherwise
+    static std::unique_ptr<IoEngine> Make(const unsigned int& threads);
+};
+
+// Blocking calls spread over a fixed set of worker threads
+class ThreadPoolIoEngine : public IoEngine {
+  public:
+    ThreadPoolIoEngine(const unsigned int& threads);
+    ~ThreadPoolIoEngine() override;
+
+    std::vector<IoResult> Submit(const std::vector<IoRequest>& requests) override;
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+#ifdef PRISM_INDEXED_IO_URING
+// One io_uring submission per batch of up to queue_depth requests, driven through the raw
+// system calls so there is no dependency on liburing. Needs Linux 5.11 for unlinkat and
+// renameat, and throws FilesystemException when the ring cannot be set up or lacks an operation.
+class UringIoEngine : public IoEngine {
+  public:
+    UringIoEngine(const unsigned int& queue_depth = 64);
+    ~UringIoEngine() override;
+
+    std::vector<IoResult> Submit(const std::vector<IoRequest>& requests) override;
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+#endif
+
+} // namespace indexed
+} // namespace prism
+
+#endif /* PRISM_INDEXED_IO_ENGINE_H_ */
@@ -0,0 +1,109 @@
+#ifndef PRISM_INDEXED_MEMORY_INDEX_H_
+#define PRISM_INDEXED_MEMORY_INDEX_H_
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "indexed/index.h"
+#include "indexed/trace.h"
+
+
+namespace prism {
+namespace indexed {
+
+// Index held entirely in memory, for devices where every SQLite commit is a costly flash write.
+// Each change appends one line to a journal beside the snapshot at path, and once the journal
+// reaches compact_records lines it is folded into a fresh snapshot. Journal lines are not synced,
+// so a power cut can lose the latest changes, which Buffer::Reconcile repairs.
+class MemoryIndex : public Index {
+  public:
+    MemoryIndex(const std::string& path, const std::size_t& compact_records = 65536);
+    ~MemoryIndex() override;
+
+    void ClearIntents(const std::vector<std::string>& hashes) override;
+    void CompactSegment(const std::vector<std::string>& evicted_hashes,
+                        const std::vector<Record>& relocations) override;
+    void Delete(const std::string& hash) override;
+    void BulkDelete(const std::vector<std::string>& hash) override;
+    std::vector<std::string> DeleteRange(const unsigned long long& start_time_value,
+                                         const unsigned long long& end_time_value) override;
+    std::vector<std::string> DeleteRange(const unsigned int& device,
+                                         const unsigned long long& start_time_value,
+                                         const unsigned long long& end_time_value) override;
+    std::vector<std::string> DeleteExpired(const unsigned long long& cutoff_time_value,
+                                           const std::size_t& limit) override;
+    std::vector<std::string> DeleteExpired(const unsigned int& device,
+                                           const unsigned long long& cutoff_time_value,
+                                           const std::size_t& limit) override;
+    std::vector<std::string> DeleteExpiredKeep(const unsigned int& keep,
+                                               const unsigned long long& cutoff_time_value,
+                                               const std::size_t& limit) override;
+    void FinalizePending(const std::string& hash) override;
+    Record GetCompression(const std::string& hash) override;
+    std::vector<std::string> GetDecayedDeletableHashes(
+            const unsigned long long& decay_minutes) override;
+    std::map<unsigned int, unsigned long long> GetDeviceSizes() override;
+    std::vector<std::string> GetExpiredHashes(
+            const unsigned long long& cutoff_time_value) override;
+    std::vector<Record> GetIntents() override;
+    std::vector<std::string> GetLargestDeletableHashes() override;
+    Record GetLocation(const std::string& hash) override;
+    std::vector<Record> GetLowestDeletable(const unsigned int& device) override;
+    std::vector<std::string> GetLowestDeletableHashes() override;
+    unsigned long long GetMetadataSize() override;
+    std::vector<Record> GetSegmentItems(const unsigned long long& segment) override;
+    std::vector<unsigned long long> GetSegments() override;
+    unsigned long long GetSegmentedSize() override;
+    unsigned long long GetTotalSize() override;
+    std::string FindHash(const unsigned long long& time_value, const unsigned int& device) override;
+    Record FindNext(const unsigned long long& time_value, const unsigned int& device) override;
+    Record FindPrevious(const unsigned long long& time_value, const unsigned int& device) override;
+    void Insert(const unsigned long long& time_value, const unsigned int& device,
+                const std::string& hash, const unsigned long long& size,
+                const unsigned int& keep) override;
+    void InsertCompressed(const unsigned long long& time_value, const unsigned int& device,
+                          const std::string& hash, const unsigned long long& size,
+                          const unsigned int& keep, const unsigned int& codec,
+                          const unsigned long long& raw_size) override;
+    void InsertPending(const unsigned long long& time_value, const unsigned int& device,
+                       const std::string& hash, const unsigned long long& size,
+                       const unsigned int& keep) override;
+    void InsertSegmented(const unsigned long long& time_value, const unsigned int& device,
+                         const std::string& hash, const unsigned long long& size,
+                         const unsigned int& keep, const unsigned long long& segment,
+                         const unsigned long long& offset) override;
+    void MarkDeleting(const std::vector<std::string>& hashes) override;
+    bool MarkSynced(const std::vector<unsigned long long>& time_values,
+                    const unsigned int& device) override;
+    std::vector<Record> NextUnsynced(const std::size_t& limit,
+                                     const std::vector<unsigned int>& devices) override;
+    std::vector<Record> SelectAll() override;
+    std::vector<Record> SelectHashes(const std::vector<std::string>& hashes) override;
+    std::vector<Record> SelectRange(const unsigned int& device,
+                                    const unsigned long long& start_time_value,
+                                    const unsigned long long& end_time_value) override;
+    bool SetKeep(const unsigned long long& time_value, const unsigned int& device,
+                 const unsigned int& keep) override;
+    bool BulkSetKeep(const std::vector<unsigned long long>& time_values,
+                     const unsigned int& device, const unsigned int& keep) override;
+    bool SetKeepRange(const unsigned long long& start_time_value,
+                      const unsigned long long& end_time_value, const unsigned int& keep) override;
+    bool SetKeepRange(const unsigned int& device, const unsigned long long& start_time_value,
+                      const unsigned long long& end_time_value, const unsigned int& keep) override;
+    void SetTracer(const std::shared_ptr<Tracer>& tracer) override;
+
+    // Folds the journal into a new snapshot now instead of waiting for compact_records lines
+    void Compact();
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace indexed
+} // namespace prism
+
+#endif /* PRISM_INDEXED_MEMORY_INDEX_H_ */
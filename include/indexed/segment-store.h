@@ -0,0 +1,49 @@
+#ifndef PRISM_INDEXED_SEGMENT_STORE_H_
+#define PRISM_INDEXED_SEGMENT_STORE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "indexed/storage.h"
+
+
+namespace prism {
+namespace indexed {
+
+struct SegmentLocation {
+    unsigned long long segment;
+    uintmax_t offset;
+    uintmax_t length;
+};
+
+// Packs small items into large preallocated segment files under the buffer directory, so an item
+// costs a write into an open file instead of an inode, a rename and later an unlink. Segments are
+// only ever appended to and are freed whole, through the Storage so quota accounting sees them.
+// Not thread-safe, callers serialize access.
+class SegmentStore {
+  public:
+    SegmentStore(Storage& storage, const uintmax_t& segment_size);
+    ~SegmentStore();
+
+    SegmentLocation Append(const std::string& filepath);
+    SegmentLocation Copy(const SegmentLocation& location);
+    unsigned long long GetActive() const;
+    uintmax_t GetAllocatedSize() const;
+    std::string GetFilepath(const unsigned long long& segment) const;
+    std::vector<unsigned long long> List() const;
+    bool Remove(const unsigned long long& segment);
+    void Seal();
+
+    static const char* Directory();
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace indexed
+} // namespace prism
+
+#endif /* PRISM_INDEXED_SEGMENT_STORE_H_ */
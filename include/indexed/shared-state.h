@@ -0,0 +1,62 @@
+#ifndef PRISM_INDEXED_SHARED_STATE_H_
+#define PRISM_INDEXED_SHARED_STATE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+
+namespace prism {
+namespace indexed {
+
+// State of a buffer directory shared by every process that has it open: the stored size, a lock
+// on changes to the buffer, a lease naming the one process that evicts, and counters other
+// processes can wait on. It lives in files beside the database, held with locks the kernel drops
+// when a process exits, so a crashed process never leaves the buffer locked or owned. Throws
+// FilesystemException when the files cannot be opened or mapped, and always on Windows, which has
+// none of the locks and mappings it needs.
+class SharedState {
+  public:
+    SharedState(const std::string& buffer_directory);
+    ~SharedState();
+
+    // True when no other process had the buffer open, so the counters were reset and the size
+    // is to be seeded by the caller
+    bool IsFresh() const;
+    std::atomic<uintmax_t>& Size();
+
+    // Lock on changes to the buffer, shared across processes. It is held per SharedState, so the
+    // threads of one process must also serialize among themselves.
+    void lock();
+    void unlock();
+
+    // Takes the ownership lease if no other process holds it, and returns whether this one does.
+    // The lease is held until the SharedState is destroyed.
+    bool AcquireOwnership();
+    bool IsOwner() const;
+
+    // Count of changes to the buffer made by any process. WaitForChange returns true once the
+    // count differs from sequence, or false after timeout.
+    unsigned int GetChangeSequence() const;
+    void NotifyChange();
+    bool WaitForChange(const unsigned int& sequence,
+                       const std::chrono::milliseconds& timeout) const;
+
+    // Count of requests for the owner to evict, made by processes whose pushes find the buffer
+    // full
+    unsigned int GetEvictionRequests() const;
+    void RequestEviction();
+    bool WaitForEvictionRequest(const unsigned int& seen,
+                                const std::chrono::milliseconds& timeout) const;
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace indexed
+} // namespace prism
+
+#endif /* PRISM_INDEXED_SHARED_STATE_H_ */
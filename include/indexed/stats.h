@@ -0,0 +1,102 @@
+#ifndef PRISM_INDEXED_STATS_H_
+#define PRISM_INDEXED_STATS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace prism {
+namespace indexed {
+
+// One for every public Buffer call that reads or changes clips. Accessors, waits and
+// subscriptions are not timed.
+enum class Operation {
+    BulkKeepIfPossible,
+    BulkPreserveRecord,
+    BulkSetLowPriority,
+    Delete,
+    DeleteRange,
+    Expire,
+    FindNearest,
+    Full,
+    GetCatalog,
+    GetFilepath,
+    GetFilepaths,
+    GetLocation,
+    KeepIfPossible,
+    MarkSynced,
+    NextUnsynced,
+    PreserveRecord,
+    Push,
+    Reconcile,
+    SetKeepRange,
+    SetLowPriority
+};
+
+enum class Phase { LockWait, QuotaCheck, Eviction, Move, Insert };
+
+struct HistogramSnapshot {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    // Log-linear buckets of nanoseconds, eight per power of two, see Stats::BucketLowerBound
+    std::vector<uint64_t> buckets;
+
+    // Upper bound in nanoseconds of the bucket holding the given quantile, within 12.5%
+    uint64_t Percentile(const double& quantile) const;
+};
+
+struct StatsSnapshot {
+    std::map<std::string, HistogramSnapshot> operations;
+    std::map<std::string, HistogramSnapshot> phases;
+    uint64_t bytes_ingested;
+    uint64_t bytes_evicted;
+    uint64_t files_evicted;
+};
+
+class Stats {
+  public:
+    Stats();
+    ~Stats();
+
+    void AddEvicted(const uint64_t& files, const uint64_t& bytes);
+    void AddIngested(const uint64_t& bytes);
+    void Record(const Operation& operation, const std::chrono::nanoseconds& elapsed);
+    void Record(const Phase& phase, const std::chrono::nanoseconds& elapsed);
+    StatsSnapshot Snapshot() const;
+
+    static std::size_t BucketIndex(const uint64_t& nanoseconds);
+    static uint64_t BucketLowerBound(const std::size_t& index);
+    static std::string FormatPrometheus(const StatsSnapshot& snapshot);
+    static const char* Name(const Operation& operation);
+    static const char* Name(const Phase& phase);
+
+    // Records the lifetime of the enclosing scope against an operation or phase
+    template <typename Key>
+    class Timer {
+      public:
+        Timer(Stats& stats, const Key& key)
+                : stats_(stats), key_(key), start_(std::chrono::steady_clock::now()) {}
+        ~Timer() {
+            stats_.Record(key_, std::chrono::steady_clock::now() - start_);
+        }
+
+      private:
+        Stats& stats_;
+        Key key_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace indexed
+} // namespace prism
+
+#endif /* PRISM_INDEXED_STATS_H_ */
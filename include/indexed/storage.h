@@ -0,0 +1,77 @@
+#ifndef PRISM_INDEXED_STORAGE_H_
+#define PRISM_INDEXED_STORAGE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "indexed/trace.h"
+
+
+namespace prism {
+namespace indexed {
+
+struct FileListing {
+    std::vector<std::pair<std::string, uintmax_t>> files;
+    bool complete;
+};
+
+// Where Buffer keeps clip files, addressed by filenames relative to the buffer directory.
+// Implementations track the bytes they hold against the quota and throw FilesystemException when
+// they cannot be set up.
+class Storage {
+  public:
+    virtual ~Storage() {}
+
+    virtual void AddSize(const uintmax_t& bytes) = 0;
+    virtual bool AboveQuota() = 0;
+    // As AboveQuota, counting releasing_bytes queued for removal as already free
+    virtual bool AboveQuota(const uintmax_t& releasing_bytes) = 0;
+    virtual bool Delete(const std::string& filename) = 0;
+    // Deletes many files with their calls batched, and returns how many were deleted
+    virtual std::size_t BulkDelete(const std::vector<std::string>& filenames) = 0;
+    virtual std::string GetBufferDirectory() const = 0;
+    virtual std::string GetExistingFilepath(const std::string& filename) const = 0;
+    virtual std::string GetFilepath(const std::string& filename) const = 0;
+    // Zero when there is no such file
+    virtual uintmax_t GetFileSize(const std::string& filename) const = 0;
+    virtual uintmax_t GetSize() const = 0;
+    virtual void SetSize(const uintmax_t& size) = 0;
+    virtual void SetTracer(const std::shared_ptr<Tracer>& tracer) = 0;
+    virtual bool VerifySize(const std::atomic<bool>& cancel) = 0;
+    virtual bool Move(const std::string& filepath_move_from,
+                      const std::string& filename_move_to) = 0;
+    // Gives an existing file a second name without charging its bytes again. Its bytes are freed
+    // when the last of its names is deleted.
+    virtual bool Link(const std::string& filename_link_from,
+                      const std::string& filename_link_to) = 0;
+    virtual FileListing Scan(const std::chrono::steady_clock::time_point& deadline,
+                             const unsigned int& threads) const = 0;
+
+    // Files starting with this are the index, segments or an implementation's own, never clips
+    static const char* ReservedPrefix() {
+        return "prism_indexed";
+    }
+};
+
+class FilesystemException : public std::exception {
+  public:
+    FilesystemException(const std::string& reason) : reason_(reason) {}
+    virtual const char* what() const throw() {
+        return reason_.data();
+    }
+
+  private:
+    std::string reason_;
+};
+
+} // namespace indexed
+} // namespace prism
+
+#endif /* PRISM_INDEXED_STORAGE_H_ */
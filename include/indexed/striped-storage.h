@@ -0,0 +1,71 @@
+#ifndef PRISM_INDEXED_STRIPED_STORAGE_H_
+#define PRISM_INDEXED_STRIPED_STORAGE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "indexed/storage.h"
+#include "indexed/trace.h"
+
+
+namespace prism {
+namespace indexed {
+
+enum class StripePlacement { RoundRobin, FreeSpace };
+
+// Files spread over equal filesystems, each holding buffer_directory under its root, against one
+// quota for all of them. New files go to the roots in turn, or to the root with the most space
+// available, skipping any whose disk is nearly full. A file stays on the root it was placed on
+// and is never rebalanced. A file is found by looking through the roots, and deletes, scans and
+// size checks run on every root at once. The index and anything
+// else named through GetFilepath live on the first usable root.
+//
+// A root that is missing or cannot be set up at construction is left out instead of failing the
+// storage, and the quota shrinks to the share of the roots still usable. Throws
+// FilesystemException only when no root is usable.
+class StripedStorage : public Storage {
+  public:
+    StripedStorage(const std::string& buffer_directory, const std::vector<std::string>& roots,
+                   const double& gigabyte_quota,
+                   const StripePlacement& placement = StripePlacement::RoundRobin);
+    ~StripedStorage() override;
+
+    void AddSize(const uintmax_t& bytes) override;
+    bool AboveQuota() override;
+    bool AboveQuota(const uintmax_t& releasing_bytes) override;
+    bool Delete(const std::string& filename) override;
+    std::size_t BulkDelete(const std::vector<std::string>& filenames) override;
+    std::string GetBufferDirectory() const override;
+    std::string GetExistingFilepath(const std::string& filename) const override;
+    std::string GetFilepath(const std::string& filename) const override;
+    uintmax_t GetFileSize(const std::string& filename) const override;
+    uintmax_t GetSize() const override;
+    void SetSize(const uintmax_t& size) override;
+    void SetTracer(const std::shared_ptr<Tracer>& tracer) override;
+    bool VerifySize(const std::atomic<bool>& cancel) override;
+    bool Move(const std::string& filepath_move_from,
+              const std::string& filename_move_to) override;
+    bool Link(const std::string& filename_link_from,
+              const std::string& filename_link_to) override;
+    FileListing Scan(const std::chrono::steady_clock::time_point& deadline,
+                     const unsigned int& threads) const override;
+
+    // Roots left out at construction, in the order they were given
+    std::vector<std::string> GetDegradedRoots() const;
+    // Bytes held under one usable root, zero for a root that does not exist
+    uintmax_t GetRootSize(const std::size_t& root) const;
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace indexed
+} // namespace prism
+
+#endif /* PRISM_INDEXED_STRIPED_STORAGE_H_ */
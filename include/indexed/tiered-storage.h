@@ -0,0 +1,71 @@
+#ifndef PRISM_INDEXED_TIERED_STORAGE_H_
+#define PRISM_INDEXED_TIERED_STORAGE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "indexed/storage.h"
+#include "indexed/trace.h"
+
+
+namespace prism {
+namespace indexed {
+
+struct StorageTier {
+    std::string root;
+    double gigabyte_quota;
+};
+
+// Files spread over filesystems ordered from fastest to slowest, each holding buffer_directory
+// under its root with a quota of its own. A new file lands on the fastest tier with room for it,
+// and a background mover copies the oldest files of any tier past demote_fraction of its quota
+// down to the next, so the fast tier keeps room for incoming clips instead of evicting. Every tier
+// but the last keeps a map of the files it holds, so a lookup goes straight to one tier, and a
+// demotion switches the file's tier under the same lock as its final rename. The index, segments
+// and anything else named through GetFilepath stay on the first tier. The storage is above quota once the last
+// tier is, or once all tiers together are. Throws FilesystemException without any tiers.
+class TieredStorage : public Storage {
+  public:
+    TieredStorage(const std::string& buffer_directory, const std::vector<StorageTier>& tiers,
+                  const double& demote_fraction = 0.9);
+    ~TieredStorage() override;
+
+    void AddSize(const uintmax_t& bytes) override;
+    bool AboveQuota() override;
+    bool AboveQuota(const uintmax_t& releasing_bytes) override;
+    bool Delete(const std::string& filename) override;
+    std::size_t BulkDelete(const std::vector<std::string>& filenames) override;
+    std::string GetBufferDirectory() const override;
+    std::string GetExistingFilepath(const std::string& filename) const override;
+    std::string GetFilepath(const std::string& filename) const override;
+    uintmax_t GetFileSize(const std::string& filename) const override;
+    uintmax_t GetSize() const override;
+    void SetSize(const uintmax_t& size) override;
+    void SetTracer(const std::shared_ptr<Tracer>& tracer) override;
+    bool VerifySize(const std::atomic<bool>& cancel) override;
+    bool Move(const std::string& filepath_move_from,
+              const std::string& filename_move_to) override;
+    bool Link(const std::string& filename_link_from,
+              const std::string& filename_link_to) override;
+    FileListing Scan(const std::chrono::steady_clock::time_point& deadline,
+                     const unsigned int& threads) const override;
+
+    // Demotes files now instead of waiting for the mover, and returns how many were demoted
+    std::size_t Demote();
+    // Bytes held by one tier, zero for a tier that does not exist
+    uintmax_t GetTierSize(const std::size_t& tier) const;
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace indexed
+} // namespace prism
+
+#endif /* PRISM_INDEXED_TIERED_STORAGE_H_ */
@@ -0,0 +1,73 @@
+#ifndef PRISM_INDEXED_TRACE_H_
+#define PRISM_INDEXED_TRACE_H_
+
+#include <memory>
+#include <string>
+
+
+namespace prism {
+namespace indexed {
+
+// Receives the start and end of each traced span. Spans nest per thread and may arrive from the
+// background reclaimer and verifier threads as well as the caller's, so implementations must be
+// thread-safe.
+class Tracer {
+  public:
+    virtual ~Tracer() {}
+
+    virtual void Begin(const char* name) = 0;
+    virtual void End(const char* name) = 0;
+};
+
+// Writes Chrome trace-event JSON, viewable in chrome://tracing or Perfetto. Events are buffered
+// and written in batches once 64 KiB or a second old, and on Flush or destruction. The viewers
+// accept an unterminated array, so the file of a stuck or killed process still opens with all but
+// its last batch.
+class ChromeTracer : public Tracer {
+  public:
+    ChromeTracer(const std::string& filepath);
+    ~ChromeTracer();
+
+    void Flush();
+
+    void Begin(const char* name) override;
+    void End(const char* name) override;
+
+  private:
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+class TraceSpan {
+  public:
+    TraceSpan(Tracer* tracer, const char* name) : tracer_(tracer), name_(name) {
+        if (tracer_) {
+            tracer_->Begin(name_);
+        }
+    }
+    ~TraceSpan() {
+        if (tracer_) {
+            tracer_->End(name_);
+        }
+    }
+
+  private:
+    Tracer* tracer_;
+    const char* name_;
+};
+
+} // namespace indexed
+} // namespace prism
+
+// Spans are only compiled in when the project is configured with BUILD_INDEXEDBUFFER_TRACING
+#define PRISM_INDEXED_TRACE_CONCAT_(a, b) a##b
+#define PRISM_INDEXED_TRACE_CONCAT(a, b) PRISM_INDEXED_TRACE_CONCAT_(a, b)
+#ifdef PRISM_INDEXED_TRACING
+#define PRISM_INDEXED_TRACE_SPAN(tracer, name)                                                  \
+    ::prism::indexed::TraceSpan PRISM_INDEXED_TRACE_CONCAT(prism_indexed_trace_span_,          \
+                                                           __LINE__)((tracer).get(), name)
+#else
+#define PRISM_INDEXED_TRACE_SPAN(tracer, name) static_cast<void>(tracer)
+#endif
+
+#endif /* PRISM_INDEXED_TRACE_H_ */
@@ -1,20 +1,46 @@
 #include "indexed/buffer.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
+#include <fstream>
 #include <functional>
 #include <map>
 #include <mutex>
+#include <numeric>
+#include <queue>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <boost/filesystem.hpp>
 
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #include "indexed/chrono-snap.h"
+#include "indexed/compression.h"
+#include "indexed/content-hash.h"
 #include "indexed/database.h"
+#include "indexed/eviction-policy.h"
 #include "indexed/filesystem.h"
+#include "indexed/segment-store.h"
+#include "indexed/sharded-index.h"
+#include "indexed/shared-state.h"
+#include "indexed/stats.h"
+#include "indexed/striped-storage.h"
+#include "indexed/tiered-storage.h"
 
 
 namespace prism {
@@ -22,20 +48,79 @@ namespace indexed {
 
 namespace fs = ::boost::filesystem;
 
+namespace {
+
+const std::string compressed_suffix = ".lz4";
+const std::size_t event_capacity = 4096;
+
+// The buffer's mutex. For a shared buffer it also takes the lock shared with other processes,
+// after the mutex, so the threads of one process queue on the mutex alone.
+class BufferMutex {
+  public:
+    BufferMutex() : shared_(nullptr) {}
+
+    void Share(SharedState* shared) {
+        shared_ = shared;
+    }
+
+    void lock() {
+        mutex_.lock();
+        if (shared_) {
+            try {
+                shared_->lock();
+            } catch (const FilesystemException& e) {
+                mutex_.unlock();
+                throw;
+            }
+        }
+    }
+
+    void unlock() {
+        if (shared_) {
+            shared_->unlock();
+        }
+        mutex_.unlock();
+    }
+
+  private:
+    std::mutex mutex_;
+    SharedState* shared_;
+};
+
+} // namespace
+
 class Buffer::Impl {
   public:
-    Impl(const std::string& buffer_root, const double& gigabyte_quota,
-         std::function<std::string(void)> hash_function);
+    Impl(const std::string& buffer_root, const double& gigabyte_quota, const Options& options);
+    ~Impl();
 
     bool Delete(const std::chrono::system_clock::time_point& time_point,
                 const unsigned int& device);
+    bool DeleteRange(const std::chrono::system_clock::time_point& start,
+                     const std::chrono::system_clock::time_point& end);
+    bool DeleteRange(const unsigned int& device,
+                     const std::chrono::system_clock::time_point& start,
+                     const std::chrono::system_clock::time_point& end);
+    Clip FindNearest(const std::chrono::system_clock::time_point& time_point,
+                     const unsigned int& device, const Direction& direction);
     std::string GetBufferDirectory() const;
     std::map<Device, ItemMap> GetCatalog();
     std::string GetFilepath(const std::chrono::system_clock::time_point& time_point,
                             const unsigned int& device);
+    Clip GetLocation(const std::chrono::system_clock::time_point& time_point,
+                     const unsigned int& device);
+    std::vector<Clip> GetFilepaths(const unsigned int& device,
+                                   const std::chrono::system_clock::time_point& start,
+                                   const std::chrono::system_clock::time_point& end);
     bool Full();
+    std::vector<UnsyncedClip> NextUnsynced(const std::size_t& count,
+                                           const std::vector<Device>& devices);
+    bool MarkSynced(const std::vector<std::chrono::system_clock::time_point>& time_points,
+                    const unsigned int& device);
     bool PreserveRecord(const std::chrono::system_clock::time_point& time_point,
                         const unsigned int& device);
+    ReconcileReport Reconcile(const std::chrono::milliseconds& budget);
+    unsigned long long Expire();
     bool SetLowPriority(const std::chrono::system_clock::time_point& time_point,
                         const unsigned int& device);
     bool KeepIfPossible(const std::chrono::system_clock::time_point& time_point,
@@ -46,37 +131,255 @@ class Buffer::Impl {
                             const unsigned int& device);
     bool BulkKeepIfPossible(const std::vector<std::chrono::system_clock::time_point>& time_points,
                             const unsigned int& device);
+    bool SetKeepRange(const std::chrono::system_clock::time_point& start,
+                      const std::chrono::system_clock::time_point& end, const unsigned int& keep);
+    bool SetKeepRange(const unsigned int& device,
+                      const std::chrono::system_clock::time_point& start,
+                      const std::chrono::system_clock::time_point& end, const unsigned int& keep);
     bool Push(const std::chrono::system_clock::time_point& time_point, const unsigned int& device,
               const std::string& filepath);
+    StatsSnapshot GetStats() const;
+    bool DumpStats(const std::string& filepath) const;
+    unsigned int GetChangeSequence() const;
+    bool WaitForChange(const unsigned int& sequence, const std::chrono::milliseconds& timeout) const;
+    bool IsEvictionOwner();
+    unsigned int Subscribe(const std::function<void(const Event& event)>& subscriber);
+    void Unsubscribe(const unsigned int& subscription);
     static std::string MakeHash();
+    static std::unique_ptr<Index> MakeIndex(Storage& storage, const std::size_t& shards);
+    static std::unique_ptr<Storage> MakeStorage(const std::string& buffer_root,
+                                                const double& gigabyte_quota,
+                                                const Options& options);
 
   private:
+    static void lowerThreadPriority();
+
+    std::unique_lock<BufferMutex> acquire();
+    bool awaitEviction(std::unique_lock<BufferMutex>& lock, const std::string& filepath);
+    void changed();
+    Codec compress(const std::string& filepath, uintmax_t& raw_size);
+    std::unordered_map<std::string, Record> describe(const std::vector<std::string>& hashes);
+    std::unordered_map<std::string, Record> describeRange(
+            const bool& all_devices, const unsigned int& device,
+            const unsigned long long& start_time_value, const unsigned long long& end_time_value);
+    bool dropMissing(const std::vector<std::string>& hashes);
+    bool evict(const std::string& filepath);
+    bool evictDevice(const std::string& filepath, const unsigned int& device,
+                     const unsigned long long& incoming_size);
+    bool evictHashes(const std::string& filepath, const std::vector<std::string>& hashes,
+                     const std::function<bool()>& satisfied);
+    std::vector<std::string> fairShareVictims();
+    std::vector<std::string> evictSegment(const unsigned long long& segment,
+                                          const unsigned int& keep);
+    Record findNeighbor(const unsigned long long& time_value, const unsigned int& device,
+                        const Direction& direction);
     bool setKeep(const std::chrono::system_clock::time_point& time_point,
                  const unsigned int& device, const unsigned int& keep);
     bool bulkSetKeep(const std::vector<std::chrono::system_clock::time_point>& time_points,
                      const unsigned int& device, const unsigned int& keep);
+    Clip locate(Record& record);
+    void notify();
+    void publish(const EventType& type, const unsigned int& device,
+                 const unsigned long long& time_value, const uintmax_t& size);
+    void publish(const EventType& type, const std::unordered_map<std::string, Record>& described);
+    void publishRemoved(const EventType& type,
+                        const std::unordered_map<std::string, Record>& described,
+                        const std::vector<std::string>& hashes);
+    void reclaim();
+    void coordinate();
+    std::unique_ptr<Index> openIndex(const Options& options);
+    void recover();
+    void recoverSegments();
+    void retain();
+    void scheduleReclaim(const std::vector<std::string>& hashes);
+    void scheduleReclaim(const std::string& hash, const uintmax_t& bytes);
+    void verify();
 
-    Filesystem filesystem_;
-    Database database_;
-    std::mutex mutex_;
+    std::unique_ptr<Storage> storage_;
+    std::unique_ptr<SharedState> shared_;
+    std::unique_ptr<Index> index_;
+    SegmentStore segments_;
+    BufferMutex mutex_;
     std::function<std::string(void)> hash_function_;
+
+    std::chrono::minutes verify_size_interval_;
+    uintmax_t segment_threshold_;
+    std::shared_ptr<Tracer> tracer_;
+    uintmax_t byte_quota_;
+    std::map<Device, DeviceQuota> device_quotas_;
+    std::shared_ptr<EvictionPolicy> eviction_policy_;
+    std::chrono::minutes retention_;
+    std::map<Device, std::chrono::minutes> device_retention_;
+    std::map<unsigned int, std::chrono::minutes> keep_retention_;
+    std::chrono::minutes retention_interval_;
+    bool unlink_in_background_;
+    bool deduplicate_;
+    Codec compression_;
+
+    std::condition_variable_any reclaim_condition_;
+    std::deque<std::pair<std::string, uintmax_t>> reclaim_queue_;
+    // Hashes queued or being unlinked, whose files are still on disk without rows
+    std::unordered_set<std::string> reclaiming_;
+    std::atomic<uintmax_t> reclaim_bytes_;
+    std::atomic<bool> stopping_;
+    std::thread reclaimer_;
+    std::mutex verify_mutex_;
+    std::condition_variable verify_condition_;
+    std::thread verifier_;
+    std::mutex retain_mutex_;
+    std::condition_variable retain_condition_;
+    std::thread retainer_;
+    std::thread coordinator_;
+
+    // Events are only pushed with the buffer's lock held, so the ring has a single producer. The
+    // rows behind an event are only looked up while anyone is subscribed.
+    EventRing events_;
+    std::atomic<bool> subscribed_;
+    std::atomic<bool> notifying_;
+    std::mutex subscribe_mutex_;
+    std::condition_variable event_condition_;
+    std::map<unsigned int, std::function<void(const Event& event)>> subscribers_;
+    unsigned int next_subscription_;
+    std::thread notifier_;
+
+    Stats stats_;
 };
 
 Buffer::Impl::Impl(const std::string& buffer_root, const double& gigabyte_quota,
-                   std::function<std::string(void)> hash_function)
-        : filesystem_{"prism_indexed_buffer", buffer_root, gigabyte_quota},
-          database_{filesystem_.GetFilepath("prism_indexed_data.db")},
-          hash_function_{hash_function} {
+                   const Options& options)
+        : storage_{options.storage_factory ? options.storage_factory(buffer_root, gigabyte_quota)
+                                           : Buffer::Impl::MakeStorage(buffer_root, gigabyte_quota,
+                                                                     options)},
+          shared_{options.shared ? new SharedState{storage_->GetBufferDirectory()} : nullptr},
+          index_{openIndex(options)},
+          segments_{*storage_, options.segment_size},
+          hash_function_{options.hash_function ? options.hash_function : Buffer::Impl::MakeHash},
+          verify_size_interval_{options.verify_size_interval},
+          segment_threshold_{options.segment_threshold},
+          tracer_{options.tracer},
+          byte_quota_{static_cast<uintmax_t>(
+                  std::accumulate(options.tiers.begin(), options.tiers.end(), gigabyte_quota,
+                                  [](const double& sum, const StorageTier& tier) {
+                                      return sum + tier.gigabyte_quota;
+                                  }) *
+                  1024 * 1024 * 1024)},
+          device_quotas_{options.device_quotas},
+          eviction_policy_{options.eviction_policy ? options.eviction_policy
+                                                   : std::make_shared<OldestFirstPolicy>()},
+          retention_{options.retention},
+          device_retention_{options.device_retention},
+          keep_retention_{options.keep_retention},
+          retention_interval_{options.retention_interval},
+          unlink_in_background_{options.unlink_in_background},
+          deduplicate_{options.deduplicate},
+          compression_{options.compression},
+          reclaim_bytes_{0},
+          stopping_{false},
+          events_{event_capacity},
+          subscribed_{false},
+          notifying_{false},
+          next_subscription_{0} {
     assert(gigabyte_quota > 0);
     srand(std::chrono::system_clock::now().time_since_epoch().count());
+    if (shared_) {
+        // Only Filesystem can count its bytes in the shared counter, and the active segment
+        // belongs to one process
+        auto filesystem = dynamic_cast<Filesystem*>(storage_.get());
+        if (!filesystem || segment_threshold_ > 0) {
+            throw FilesystemException{"A shared buffer needs Filesystem storage without packing"};
+        }
+        filesystem->ShareSize(shared_->Size());
+        mutex_.Share(shared_.get());
+        shared_->AcquireOwnership();
+    }
+    storage_->SetTracer(tracer_);
+    index_->SetTracer(tracer_);
+
+    // Processes already sharing the buffer have recovered it and keep its size up to date
+    if (!shared_ || shared_->IsFresh()) {
+        std::lock_guard<BufferMutex> lock(mutex_);
+        recover();
+        recoverSegments();
+
+        // The stored size comes from the aggregate the database keeps, instead of statting every
+        // file under the buffer. Packed items are counted by the segments that hold them instead.
+        try {
+            auto size = index_->GetTotalSize() + index_->GetMetadataSize();
+            if (!segments_.List().empty()) {
+                size = size - index_->GetSegmentedSize() + segments_.GetAllocatedSize();
+            }
+            storage_->SetSize(size);
+        } catch (const DatabaseException& e) {
+            storage_->SetSize(index_->GetMetadataSize());
+        }
+        // Rows keep each clip's full size, so linked copies would be charged once per clip. Only
+        // the files know which clips share bytes.
+        if (deduplicate_) {
+            storage_->VerifySize(stopping_);
+        }
+    }
+
+    reclaimer_ = std::thread{&Buffer::Impl::reclaim, this};
+    if (verify_size_interval_.count() > 0) {
+        verifier_ = std::thread{&Buffer::Impl::verify, this};
+    }
+    if (retention_.count() > 0 || !device_retention_.empty() || !keep_retention_.empty()) {
+        retainer_ = std::thread{&Buffer::Impl::retain, this};
+    }
+    if (shared_) {
+        coordinator_ = std::thread{&Buffer::Impl::coordinate, this};
+    }
+}
+
+Buffer::Impl::~Impl() {
+    {
+        std::lock_guard<BufferMutex> lock(mutex_);
+        stopping_ = true;
+    }
+    reclaim_condition_.notify_all();
+    if (shared_) {
+        shared_->RequestEviction();
+    }
+    {
+        std::lock_guard<std::mutex> lock(verify_mutex_);
+    }
+    verify_condition_.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(retain_mutex_);
+    }
+    retain_condition_.notify_all();
+    if (retainer_.joinable()) {
+        retainer_.join();
+    }
+    reclaimer_.join();
+    if (verifier_.joinable()) {
+        verifier_.join();
+    }
+    if (coordinator_.joinable()) {
+        coordinator_.join();
+    }
+    if (notifier_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(subscribe_mutex_);
+            notifying_ = false;
+        }
+        event_condition_.notify_all();
+        notifier_.join();
+    }
+    if (shared_) {
+        // The database clears its last intents as it closes, under the lock like any other write
+        std::lock_guard<BufferMutex> lock(mutex_);
+        index_.reset();
+    }
 }
 
 bool Buffer::Impl::Delete(const std::chrono::system_clock::time_point& time_point,
                           const unsigned int& device) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    Stats::Timer<Operation> timer{stats_, Operation::Delete};
+    auto lock = acquire();
     std::string hash;
     try {
-        hash = database_.FindHash(utility::SnapToMinute(time_point), device);
+        hash = index_->FindHash(utility::SnapToMinute(time_point), device);
     } catch (const DatabaseException& e) {
         return false;
     }
@@ -85,22 +388,108 @@ bool Buffer::Impl::Delete(const std::chrono::system_clock::time_point& time_poin
         return false;
     }
 
-    filesystem_.Delete(hash);
+    const auto described = describe({hash});
+    if (unlink_in_background_) {
+        scheduleReclaim(hash, storage_->GetFileSize(hash));
+    } else {
+        storage_->Delete(hash);
+    }
     try {
-        database_.Delete(hash);
+        index_->Delete(hash);
     } catch (const DatabaseException& e) {
         return false;
     }
+    changed();
+    publishRemoved(EventType::Deleted, described, {hash});
     return true;
 }
 
+Clip Buffer::Impl::FindNearest(const std::chrono::system_clock::time_point& time_point,
+                               const unsigned int& device, const Direction& direction) {
+    Stats::Timer<Operation> timer{stats_, Operation::FindNearest};
+    auto lock = acquire();
+    const auto time_value = utility::SnapToMinute(time_point);
+
+    while (true) {
+        Record record;
+        try {
+            record = findNeighbor(time_value, device, direction);
+        } catch (const DatabaseException& e) {
+            return Clip{};
+        }
+
+        if (record.empty()) {
+            return Clip{};
+        }
+
+        auto clip = locate(record);
+        if (!clip.filepath.empty()) {
+            return clip;
+        }
+
+        if (!dropMissing({record["hash"]})) {
+            return Clip{};
+        }
+    }
+}
+
+bool Buffer::Impl::DeleteRange(const std::chrono::system_clock::time_point& start,
+                               const std::chrono::system_clock::time_point& end) {
+    Stats::Timer<Operation> timer{stats_, Operation::DeleteRange};
+    auto lock = acquire();
+    const auto described = describeRange(true, 0, utility::SnapToMinute(start),
+                                         utility::SnapToMinute(end));
+    std::vector<std::string> hashes;
+    try {
+        hashes = index_->DeleteRange(utility::SnapToMinute(start), utility::SnapToMinute(end));
+    } catch (const DatabaseException& e) {
+        return false;
+    }
+
+    scheduleReclaim(hashes);
+    if (!hashes.empty()) {
+        changed();
+        publishRemoved(EventType::Deleted, described, hashes);
+    }
+    return !hashes.empty();
+}
+
+bool Buffer::Impl::DeleteRange(const unsigned int& device,
+                               const std::chrono::system_clock::time_point& start,
+                               const std::chrono::system_clock::time_point& end) {
+    Stats::Timer<Operation> timer{stats_, Operation::DeleteRange};
+    auto lock = acquire();
+    const auto described = describeRange(false, device, utility::SnapToMinute(start),
+                                         utility::SnapToMinute(end));
+    std::vector<std::string> hashes;
+    try {
+        hashes = index_->DeleteRange(device, utility::SnapToMinute(start),
+                                       utility::SnapToMinute(end));
+    } catch (const DatabaseException& e) {
+        return false;
+    }
+
+    scheduleReclaim(hashes);
+    if (!hashes.empty()) {
+        changed();
+        publishRemoved(EventType::Deleted, described, hashes);
+    }
+    return !hashes.empty();
+}
+
 std::string Buffer::Impl::GetBufferDirectory() const {
-    return filesystem_.GetBufferDirectory();
+    return storage_->GetBufferDirectory();
 }
 
 std::map<Device, ItemMap> Buffer::Impl::GetCatalog() {
+    Stats::Timer<Operation> timer{stats_, Operation::GetCatalog};
+    // Without the lock, writes by other processes would leave the query on SQLite's busy timeout
+    std::unique_lock<BufferMutex> lock;
+    if (shared_) {
+        lock = acquire();
+    }
     std::map<Device, ItemMap> catalog;
-    auto records = database_.SelectAll();
+    auto records = index_->SelectAll();
     for (auto& record : records) {
         Device device = std::stoi(record["device"]);
         auto time_value = std::stoull(record["time_value"]);
@@ -115,11 +504,12 @@ std::map<Device, ItemMap> Buffer::Impl::GetCatalog() {
 
 std::string Buffer::Impl::GetFilepath(const std::chrono::system_clock::time_point& time_point,
                                       const unsigned int& device) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    Stats::Timer<Operation> timer{stats_, Operation::GetFilepath};
+    auto lock = acquire();
     std::string hash;
 
     try {
-         hash = database_.FindHash(utility::SnapToMinute(time_point), device);
+         hash = index_->FindHash(utility::SnapToMinute(time_point), device);
     } catch (const DatabaseException& e) {
     }
 
@@ -127,10 +517,13 @@ std::string Buffer::Impl::GetFilepath(const std::chrono::system_clock::time_poin
         return hash;
     }
 
-    const auto filepath = filesystem_.GetExistingFilepath(hash);
+    // Packed items have no file of their own and are read through GetLocation
+    const auto filepath = storage_->GetExistingFilepath(hash);
     if (filepath.empty()) {
         try {
-            database_.Delete(hash);
+            if (index_->GetLocation(hash).empty()) {
+                dropMissing({hash});
+            }
         } catch (const DatabaseException& e) {
         }
     }
@@ -138,95 +531,554 @@ std::string Buffer::Impl::GetFilepath(const std::chrono::system_clock::time_poin
     return filepath;
 }
 
+Clip Buffer::Impl::GetLocation(const std::chrono::system_clock::time_point& time_point,
+                               const unsigned int& device) {
+    Stats::Timer<Operation> timer{stats_, Operation::GetLocation};
+    auto lock = acquire();
+    const auto time_value = utility::SnapToMinute(time_point);
+    std::vector<Record> records;
+
+    try {
+        records = index_->SelectRange(device, time_value, time_value);
+    } catch (const DatabaseException& e) {
+        return Clip{};
+    }
+
+    if (records.empty()) {
+        return Clip{};
+    }
+
+    auto clip = locate(records.front());
+    if (clip.filepath.empty()) {
+        dropMissing({records.front()["hash"]});
+    }
+
+    return clip;
+}
+
+std::vector<Clip> Buffer::Impl::GetFilepaths(const unsigned int& device,
+                                             const std::chrono::system_clock::time_point& start,
+                                             const std::chrono::system_clock::time_point& end) {
+    Stats::Timer<Operation> timer{stats_, Operation::GetFilepaths};
+    auto lock = acquire();
+    std::vector<Clip> clips;
+    std::vector<Record> records;
+
+    try {
+        records = index_->SelectRange(device, utility::SnapToMinute(start),
+                                        utility::SnapToMinute(end));
+    } catch (const DatabaseException& e) {
+        return clips;
+    }
+
+    std::vector<std::string> missing_hashes;
+    for (auto& record : records) {
+        auto clip = locate(record);
+        if (clip.filepath.empty()) {
+            missing_hashes.push_back(record["hash"]);
+            continue;
+        }
+        clips.push_back(clip);
+    }
+
+    dropMissing(missing_hashes);
+
+    return clips;
+}
+
 bool Buffer::Impl::Full() {
-    return filesystem_.AboveQuota();
+    Stats::Timer<Operation> timer{stats_, Operation::Full};
+    return storage_->AboveQuota();
+}
+
+std::vector<UnsyncedClip> Buffer::Impl::NextUnsynced(const std::size_t& count,
+                                                     const std::vector<Device>& devices) {
+    Stats::Timer<Operation> timer{stats_, Operation::NextUnsynced};
+    auto lock = acquire();
+    std::vector<UnsyncedClip> clips;
+    std::vector<Record> records;
+
+    try {
+        records = index_->NextUnsynced(count, devices);
+    } catch (const DatabaseException& e) {
+        return clips;
+    }
+
+    std::vector<std::string> missing_hashes;
+    for (auto& record : records) {
+        auto clip = locate(record);
+        if (clip.filepath.empty()) {
+            missing_hashes.push_back(record["hash"]);
+            continue;
+        }
+        clips.push_back(UnsyncedClip{static_cast<Device>(std::stoul(record["device"])), clip});
+    }
+
+    dropMissing(missing_hashes);
+
+    return clips;
+}
+
+bool Buffer::Impl::MarkSynced(
+        const std::vector<std::chrono::system_clock::time_point>& time_points,
+        const unsigned int& device) {
+    Stats::Timer<Operation> timer{stats_, Operation::MarkSynced};
+    auto lock = acquire();
+
+    std::vector<unsigned long long> minutes;
+    for (const auto& time_point : time_points) {
+        minutes.emplace_back(utility::SnapToMinute(time_point));
+    }
+
+    bool synced;
+    try {
+        synced = index_->MarkSynced(minutes, device);
+    } catch (const DatabaseException& e) {
+        return false;
+    }
+    changed();
+    return synced;
 }
 
 bool Buffer::Impl::PreserveRecord(const std::chrono::system_clock::time_point& time_point,
                                   const unsigned int& device) {
+    Stats::Timer<Operation> timer{stats_, Operation::PreserveRecord};
     return setKeep(time_point, device, PRESERVE_RECORD);
 }
 
+ReconcileReport Buffer::Impl::Reconcile(const std::chrono::milliseconds& budget) {
+    Stats::Timer<Operation> timer{stats_, Operation::Reconcile};
+    ReconcileReport report{0, 0, 0, false};
+    const auto deadline = std::chrono::steady_clock::now() + budget;
+
+    // The walk runs without the lock. Rows are read afterwards, so any file moved in during the
+    // walk already has its row by the time the two are compared.
+    auto listing = storage_->Scan(deadline, std::thread::hardware_concurrency());
+
+    auto lock = acquire();
+    std::vector<Record> records;
+    try {
+        records = index_->SelectAll();
+    } catch (const DatabaseException& e) {
+        return report;
+    }
+
+    std::unordered_map<std::string, bool> indexed_hashes;
+    for (auto& record : records) {
+        indexed_hashes[record["hash"]] = false;
+    }
+
+    // Files queued for the reclaimer or with an intent are already on their way out or in
+    std::unordered_set<std::string> pending_hashes{reclaiming_};
+    try {
+        for (auto& intent : index_->GetIntents()) {
+            pending_hashes.insert(intent["hash"]);
+        }
+    } catch (const DatabaseException& e) {
+        return report;
+    }
+
+    const std::string reserved_prefix{Storage::ReservedPrefix()};
+    std::vector<std::string> orphans;
+    for (const auto& file : listing.files) {
+        if (file.first.compare(0, reserved_prefix.size(), reserved_prefix) == 0 ||
+                pending_hashes.count(file.first) != 0) {
+            continue;
+        }
+        auto indexed = indexed_hashes.find(file.first);
+        if (indexed != indexed_hashes.end()) {
+            indexed->second = true;
+            continue;
+        }
+        orphans.push_back(file.first);
+        ++report.orphan_files_removed;
+        report.orphan_bytes_removed += file.second;
+    }
+
+    // Orphans have no row, so the stored size loaded at startup never counted them
+    storage_->AddSize(report.orphan_bytes_removed);
+    scheduleReclaim(orphans);
+
+    // Rows can only be judged missing against a complete walk, and each one is confirmed
+    // against the disk since a push may have landed in a directory after it was walked
+    if (listing.complete) {
+        std::vector<std::string> missing_hashes;
+        try {
+            for (const auto& segment : index_->GetSegments()) {
+                for (auto& item : index_->GetSegmentItems(segment)) {
+                    indexed_hashes[item["hash"]] = true;
+                }
+            }
+        } catch (const DatabaseException& e) {
+            return report;
+        }
+        for (const auto& indexed : indexed_hashes) {
+            if (!indexed.second && storage_->GetExistingFilepath(indexed.first).empty()) {
+                missing_hashes.push_back(indexed.first);
+            }
+        }
+        if (!dropMissing(missing_hashes)) {
+            return report;
+        }
+        report.missing_records_removed = missing_hashes.size();
+    }
+
+    report.complete = listing.complete;
+    return report;
+}
+
+unsigned long long Buffer::Impl::Expire() {
+    Stats::Timer<Operation> timer{stats_, Operation::Expire};
+    PRISM_INDEXED_TRACE_SPAN(tracer_, "Buffer::Expire");
+    // Each rule is applied as a range delete on time_value of at most batch_size rows, taking the
+    // lock only for that one delete. The rows go to the reclaimer, which unlinks their files in
+    // batches of its own, so expiry adds no more lock hold time than a small DeleteRange.
+    static const std::size_t batch_size = 256;
+    const auto now = std::chrono::system_clock::now();
+    auto cutoff = [&now](const std::chrono::minutes& age) {
+        return utility::SnapToMinute(now - age);
+    };
+    auto describeBefore = [this](const bool& all_devices, const unsigned int& device,
+                                 const unsigned long long& cutoff_time_value) {
+        return cutoff_time_value == 0
+                       ? std::unordered_map<std::string, Record>{}
+                       : describeRange(all_devices, device, 0, cutoff_time_value - 1);
+    };
+
+    // Rows are gone once a batch returns, so for subscribers every row a batch may delete is looked
+    // up in the same lock hold, before a clip pushed in between could be deleted undescribed
+    struct Rule {
+        std::function<std::vector<std::string>()> expire;
+        std::function<std::unordered_map<std::string, Record>()> describe;
+    };
+    std::vector<Rule> rules;
+    if (retention_.count() > 0) {
+        rules.push_back(Rule{
+                [this, &cutoff]() {
+                    return index_->DeleteExpired(cutoff(retention_), batch_size);
+                },
+                [this, &cutoff, &describeBefore]() {
+                    return describeBefore(true, 0, cutoff(retention_));
+                }});
+    }
+    for (const auto& retention : device_retention_) {
+        if (retention.second.count() > 0) {
+            rules.push_back(Rule{
+                    [this, &cutoff, &retention]() {
+                        return index_->DeleteExpired(retention.first, cutoff(retention.second),
+                                                     batch_size);
+                    },
+                    [&cutoff, &describeBefore, &retention]() {
+                        return describeBefore(false, retention.first, cutoff(retention.second));
+                    }});
+        }
+    }
+    for (const auto& retention : keep_retention_) {
+        if (retention.second.count() > 0) {
+            rules.push_back(Rule{
+                    [this, &cutoff, &retention]() {
+                        return index_->DeleteExpiredKeep(retention.first,
+                                                         cutoff(retention.second), batch_size);
+                    },
+                    [&cutoff, &describeBefore, &retention]() {
+                        return describeBefore(true, 0, cutoff(retention.second));
+                    }});
+        }
+    }
+
+    unsigned long long expired = 0;
+    for (const auto& rule : rules) {
+        std::size_t deleted = batch_size;
+        while (deleted == batch_size && !stopping_) {
+            auto lock = acquire();
+            std::unordered_map<std::string, Record> described;
+            if (subscribed_) {
+                described = rule.describe();
+            }
+            std::vector<std::string> hashes;
+            try {
+                hashes = rule.expire();
+            } catch (const DatabaseException& e) {
+                return expired;
+            }
+            scheduleReclaim(hashes);
+            if (!hashes.empty()) {
+                changed();
+                publishRemoved(EventType::Evicted, described, hashes);
+            }
+            deleted = hashes.size();
+            expired += deleted;
+            lock.unlock();
+            std::this_thread::yield();
+        }
+    }
+    return expired;
+}
+
 bool Buffer::Impl::SetLowPriority(const std::chrono::system_clock::time_point& time_point,
                                   const unsigned int& device) {
+    Stats::Timer<Operation> timer{stats_, Operation::SetLowPriority};
     return setKeep(time_point, device, DELETE_IF_FULL);
 }
 
 bool Buffer::Impl::KeepIfPossible(const std::chrono::system_clock::time_point& time_point,
                                   const unsigned int& device) {
+    Stats::Timer<Operation> timer{stats_, Operation::KeepIfPossible};
     return setKeep(time_point, device, ATTEMPT_KEEP);
 }
 
 bool Buffer::Impl::BulkPreserveRecord(
         const std::vector<std::chrono::system_clock::time_point>& time_points,
         const unsigned int& device) {
+    Stats::Timer<Operation> timer{stats_, Operation::BulkPreserveRecord};
     return bulkSetKeep(time_points, device, PRESERVE_RECORD);
 }
 
 bool Buffer::Impl::BulkSetLowPriority(
         const std::vector<std::chrono::system_clock::time_point>& time_points,
         const unsigned int& device) {
+    Stats::Timer<Operation> timer{stats_, Operation::BulkSetLowPriority};
     return bulkSetKeep(time_points, device, DELETE_IF_FULL);
 }
 
 bool Buffer::Impl::BulkKeepIfPossible(
         const std::vector<std::chrono::system_clock::time_point>& time_points,
         const unsigned int& device) {
+    Stats::Timer<Operation> timer{stats_, Operation::BulkKeepIfPossible};
     return bulkSetKeep(time_points, device, ATTEMPT_KEEP);
 }
 
+bool Buffer::Impl::SetKeepRange(const std::chrono::system_clock::time_point& start,
+                                const std::chrono::system_clock::time_point& end,
+                                const unsigned int& keep) {
+    Stats::Timer<Operation> timer{stats_, Operation::SetKeepRange};
+    auto lock = acquire();
+    bool kept;
+    try {
+        kept = index_->SetKeepRange(utility::SnapToMinute(start), utility::SnapToMinute(end),
+                                      keep);
+    } catch (const DatabaseException& e) {
+        return false;
+    }
+    changed();
+    publish(EventType::KeepChanged,
+            describeRange(true, 0, utility::SnapToMinute(start), utility::SnapToMinute(end)));
+    return kept;
+}
+
+bool Buffer::Impl::SetKeepRange(const unsigned int& device,
+                                const std::chrono::system_clock::time_point& start,
+                                const std::chrono::system_clock::time_point& end,
+                                const unsigned int& keep) {
+    Stats::Timer<Operation> timer{stats_, Operation::SetKeepRange};
+    auto lock = acquire();
+    bool kept;
+    try {
+        kept = index_->SetKeepRange(device, utility::SnapToMinute(start),
+                                      utility::SnapToMinute(end), keep);
+    } catch (const DatabaseException& e) {
+        return false;
+    }
+    changed();
+    publish(EventType::KeepChanged, describeRange(false, device, utility::SnapToMinute(start),
+                                                  utility::SnapToMinute(end)));
+    return kept;
+}
+
 bool Buffer::Impl::Push(const std::chrono::system_clock::time_point& time_point,
                         const unsigned int& device, const std::string& filepath) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (filesystem_.AboveQuota()) {
-        std::vector<std::string> hashes;
-        std::vector<std::string> deleted_hashes;
-        try {
-            hashes = database_.GetLowestDeletableHashes();
-        } catch (const DatabaseException& e) {
+    Stats::Timer<Operation> timer{stats_, Operation::Push};
+    PRISM_INDEXED_TRACE_SPAN(tracer_, "Buffer::Push");
+    // Hashing and compression read the whole file, so they happen before the lock is taken. The
+    // hash is of the original contents, and the compressed copy sits beside the original until
+    // it is stored in its place.
+    const auto content_hash = deduplicate_ ? utility::HashFile(filepath) : std::string{};
+    uintmax_t raw_size = 0;
+    const auto codec = compress(filepath, raw_size);
+    const std::string suffix = codec == Codec::None ? "" : compressed_suffix;
+    const auto source = filepath + suffix;
+    auto discard_compressed = [&]() {
+        boost::system::error_code error_code;
+        if (codec != Codec::None) {
+            fs::remove(source, error_code);
+        }
+    };
+
+    auto lock = acquire();
+    bool above_quota;
+    {
+        Stats::Timer<Phase> phase_timer{stats_, Phase::QuotaCheck};
+        above_quota = storage_->AboveQuota(reclaim_bytes_);
+    }
+    if (above_quota) {
+        Stats::Timer<Phase> phase_timer{stats_, Phase::Eviction};
+        const bool made_room = shared_ && !shared_->AcquireOwnership()
+                                       ? awaitEviction(lock, filepath)
+                                       : evict(filepath);
+        if (!made_room) {
+            discard_compressed();
             return false;
         }
+    }
 
-        for (const auto& hash : hashes) {
-            if (!filesystem_.AboveQuota()) {
-                break;
-            }
+    if (!fs::exists(filepath) || fs::is_directory(filepath)) {
+        discard_compressed();
+        return false;
+    }
 
-            if (hash.empty()) {
-                fs::remove(filepath);
-                return false;
-            }
+    auto size = fs::file_size(source);
+    auto hash = hash_function_() + suffix;
+
+    auto device_quota = device_quotas_.find(device);
+    if (device_quota != device_quotas_.end() && device_quota->second.quota > 0) {
+        Stats::Timer<Phase> phase_timer{stats_, Phase::Eviction};
+        if (!evictDevice(filepath, device, size)) {
+            discard_compressed();
+            return false;
+        }
+    }
 
-            filesystem_.Delete(hash);
-            deleted_hashes.push_back(hash);
+    // Small items are packed into the active segment. The row and its location commit together
+    // after the write, so a crash in between leaves only unreferenced bytes in the segment.
+    if (segment_threshold_ > 0 && size <= segment_threshold_ && codec == Codec::None) {
+        SegmentLocation location;
+        try {
+            Stats::Timer<Phase> phase_timer{stats_, Phase::Move};
+            location = segments_.Append(filepath);
+        } catch (const FilesystemException& e) {
+            fs::remove(filepath);
+            return true;
         }
 
         try {
-            database_.BulkDelete(deleted_hashes);
+            Stats::Timer<Phase> phase_timer{stats_, Phase::Insert};
+            index_->InsertSegmented(utility::SnapToMinute(time_point), device, hash, size,
+                                      ATTEMPT_KEEP, location.segment, location.offset);
         } catch (const DatabaseException& e) {
-            return false;
+            return true;
         }
+        stats_.AddIngested(size);
+        changed();
+        publish(EventType::Pushed, device, utility::SnapToMinute(time_point), size);
+        return true;
     }
 
-    if (!fs::exists(filepath) || fs::is_directory(filepath)) {
-        return false;
+    // A copy of contents already in the buffer becomes a link to the file holding them. The
+    // first copy takes the content hash as its name, so later copies find it after a restart.
+    std::string link_from;
+    if (!content_hash.empty()) {
+        if (storage_->GetExistingFilepath(content_hash + suffix).empty()) {
+            hash = content_hash + suffix;
+        } else {
+            link_from = content_hash + suffix;
+        }
     }
 
-    auto size = fs::file_size(filepath);
-    auto hash = hash_function_();
+    // The row is recorded as pending before the rename and finalized lazily afterwards, so a
+    // crash in between is resolved on restart by checking only the pending rows
+    try {
+        Stats::Timer<Phase> phase_timer{stats_, Phase::Insert};
+        if (codec == Codec::None) {
+            index_->InsertPending(utility::SnapToMinute(time_point), device, hash, size,
+                                    ATTEMPT_KEEP);
+        } else {
+            index_->InsertCompressed(utility::SnapToMinute(time_point), device, hash, size,
+                                       ATTEMPT_KEEP, static_cast<unsigned int>(codec), raw_size);
+        }
+    } catch (const DatabaseException& e) {
+        fs::remove(filepath);
+        discard_compressed();
+        return true;
+    }
 
-    if (filesystem_.Move(filepath, hash)) {
-        try {
-            database_.Insert(utility::SnapToMinute(time_point), device, hash, size, ATTEMPT_KEEP);
-        } catch (const DatabaseException& e) {
-            filesystem_.Delete(hash);
+    bool moved;
+    {
+        Stats::Timer<Phase> phase_timer{stats_, Phase::Move};
+        // The linked file may have just been unlinked by the reclaimer, so a failed link falls
+        // back to moving the copy in
+        if (!link_from.empty() && storage_->Link(link_from, hash)) {
+            fs::remove(source);
+            moved = true;
+        } else {
+            moved = storage_->Move(source, hash);
+        }
+    }
+    if (moved) {
+        if (codec != Codec::None) {
+            fs::remove(filepath);
         }
+        index_->FinalizePending(hash);
+        stats_.AddIngested(size);
+        changed();
+        publish(EventType::Pushed, device, utility::SnapToMinute(time_point), size);
     } else {
         fs::remove(filepath);
+        discard_compressed();
+        try {
+            index_->Delete(hash);
+            index_->FinalizePending(hash);
+        } catch (const DatabaseException& e) {
+        }
     }
     return true;
 }
 
+StatsSnapshot Buffer::Impl::GetStats() const {
+    return stats_.Snapshot();
+}
+
+bool Buffer::Impl::DumpStats(const std::string& filepath) const {
+    // Written beside the target and renamed over it, so a collector never reads a partial file
+    const auto staging_filepath = filepath + ".tmp";
+    {
+        std::ofstream out_stream{staging_filepath};
+        out_stream << Stats::FormatPrometheus(stats_.Snapshot());
+        if (!out_stream) {
+            return false;
+        }
+    }
+
+    boost::system::error_code error_code;
+    fs::rename(staging_filepath, filepath, error_code);
+    return !error_code;
+}
+
+unsigned int Buffer::Impl::GetChangeSequence() const {
+    return shared_ ? shared_->GetChangeSequence() : 0;
+}
+
+bool Buffer::Impl::WaitForChange(const unsigned int& sequence,
+                                 const std::chrono::milliseconds& timeout) const {
+    if (!shared_) {
+        std::this_thread::sleep_for(timeout);
+        return false;
+    }
+    return shared_->WaitForChange(sequence, timeout);
+}
+
+bool Buffer::Impl::IsEvictionOwner() {
+    return !shared_ || shared_->AcquireOwnership();
+}
+
+unsigned int Buffer::Impl::Subscribe(const std::function<void(const Event& event)>& subscriber) {
+    std::lock_guard<std::mutex> lock(subscribe_mutex_);
+    const auto subscription = next_subscription_++;
+    subscribers_[subscription] = subscriber;
+    subscribed_ = true;
+    if (!notifier_.joinable()) {
+        notifying_ = true;
+        notifier_ = std::thread{&Buffer::Impl::notify, this};
+    }
+    return subscription;
+}
+
+void Buffer::Impl::Unsubscribe(const unsigned int& subscription) {
+    // Subscribers are only called with this mutex held, so none is running once it is taken
+    std::lock_guard<std::mutex> lock(subscribe_mutex_);
+    subscribers_.erase(subscription);
+    subscribed_ = !subscribers_.empty();
+}
+
 std::string Buffer::Impl::MakeHash() {
     static const char alphanum[] =
             "0123456789"
@@ -241,47 +1093,777 @@ std::string Buffer::Impl::MakeHash() {
     return stream.str();
 }
 
+std::unique_ptr<Index> Buffer::Impl::MakeIndex(Storage& storage, const std::size_t& shards) {
+    if (shards > 1) {
+        return std::unique_ptr<Index>{
+                new ShardedIndex{storage.GetFilepath("prism_indexed_data.db"), shards}};
+    }
+    return std::unique_ptr<Index>{new Database{storage.GetFilepath("prism_indexed_data.db")}};
+}
+
+std::unique_ptr<Storage> Buffer::Impl::MakeStorage(const std::string& buffer_root,
+                                                   const double& gigabyte_quota,
+                                                   const Options& options) {
+    if (!options.tiers.empty()) {
+        std::vector<StorageTier> tiers{StorageTier{buffer_root, gigabyte_quota}};
+        tiers.insert(tiers.end(), options.tiers.begin(), options.tiers.end());
+        return std::unique_ptr<Storage>{new TieredStorage{"prism_indexed_buffer", tiers}};
+    }
+    if (!options.stripe_roots.empty()) {
+        std::vector<std::string> roots{buffer_root};
+        roots.insert(roots.end(), options.stripe_roots.begin(), options.stripe_roots.end());
+        return std::unique_ptr<Storage>{new StripedStorage{"prism_indexed_buffer", roots,
+                                                           gigabyte_quota,
+                                                           options.stripe_placement}};
+    }
+
+    // The size is loaded from the index at startup rather than by walking the buffer
+    return std::unique_ptr<Storage>{
+            new Filesystem{"prism_indexed_buffer", buffer_root, gigabyte_quota, false}};
+}
+
+void Buffer::Impl::lowerThreadPriority() {
+#ifdef __linux__
+    // Idle I/O class and lowest CPU priority for the calling thread only
+    static const int ioprio_who_process = 1;
+    static const int ioprio_idle = 3 << 13;
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+    syscall(SYS_ioprio_set, ioprio_who_process, 0, ioprio_idle);
+#endif
+}
+
+std::unique_lock<BufferMutex> Buffer::Impl::acquire() {
+    Stats::Timer<Phase> timer{stats_, Phase::LockWait};
+    return std::unique_lock<BufferMutex>{mutex_};
+}
+
+bool Buffer::Impl::awaitEviction(std::unique_lock<BufferMutex>& lock,
+                                 const std::string& filepath) {
+    // Another process owns the shared buffer and evicts for all of them. The lock is let go
+    // while it does, and the push evicts for itself if the owner exits in the meantime.
+    static const std::chrono::seconds eviction_wait{10};
+    const auto deadline = std::chrono::steady_clock::now() + eviction_wait;
+    while (storage_->AboveQuota(reclaim_bytes_)) {
+        if (shared_->AcquireOwnership()) {
+            return evict(filepath);
+        }
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            return false;
+        }
+        const auto sequence = shared_->GetChangeSequence();
+        shared_->RequestEviction();
+        lock.unlock();
+        shared_->WaitForChange(sequence,
+                               std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now));
+        lock.lock();
+    }
+    return true;
+}
+
+void Buffer::Impl::changed() {
+    if (shared_) {
+        shared_->NotifyChange();
+    }
+}
+
+Codec Buffer::Impl::compress(const std::string& filepath, uintmax_t& raw_size) {
+    boost::system::error_code error_code;
+    if (compression_ == Codec::None || !fs::is_regular_file(filepath, error_code)) {
+        return Codec::None;
+    }
+
+    // Clips small enough to be packed are left as they are
+    raw_size = fs::file_size(filepath, error_code);
+    if (error_code || raw_size == 0 || raw_size <= segment_threshold_) {
+        return Codec::None;
+    }
+
+    PRISM_INDEXED_TRACE_SPAN(tracer_, "Buffer::compress");
+    // Left beside the original for Push to store in its place
+    const auto compressed_filepath = filepath + compressed_suffix;
+    const auto compressed_size = utility::CompressFile(filepath, compressed_filepath);
+    if (compressed_size == 0 || compressed_size > raw_size - raw_size / 8) {
+        fs::remove(compressed_filepath, error_code);
+        return Codec::None;
+    }
+    return compression_;
+}
+
+std::unordered_map<std::string, Record> Buffer::Impl::describe(
+        const std::vector<std::string>& hashes) {
+    std::unordered_map<std::string, Record> described;
+    if (!subscribed_ || hashes.empty()) {
+        return described;
+    }
+    try {
+        for (auto& record : index_->SelectHashes(hashes)) {
+            described[record["hash"]] = record;
+        }
+    } catch (const DatabaseException& e) {
+    }
+    return described;
+}
+
+std::unordered_map<std::string, Record> Buffer::Impl::describeRange(
+        const bool& all_devices, const unsigned int& device,
+        const unsigned long long& start_time_value, const unsigned long long& end_time_value) {
+    std::unordered_map<std::string, Record> described;
+    if (!subscribed_) {
+        return described;
+    }
+    try {
+        std::vector<unsigned int> devices{device};
+        if (all_devices) {
+            devices.clear();
+            for (const auto& size : index_->GetDeviceSizes()) {
+                devices.push_back(size.first);
+            }
+        }
+        for (const auto& range_device : devices) {
+            for (auto& record : index_->SelectRange(range_device, start_time_value,
+                                                    end_time_value)) {
+                record["device"] = std::to_string(range_device);
+                described[record["hash"]] = record;
+            }
+        }
+    } catch (const DatabaseException& e) {
+    }
+    return described;
+}
+
+// Removes the rows of clips whose files are gone and reports them as deleted
+bool Buffer::Impl::dropMissing(const std::vector<std::string>& hashes) {
+    if (hashes.empty()) {
+        return true;
+    }
+    const auto described = describe(hashes);
+    try {
+        index_->BulkDelete(hashes);
+    } catch (const DatabaseException& e) {
+        return false;
+    }
+    changed();
+    publishRemoved(EventType::Deleted, described, hashes);
+    return true;
+}
+
+bool Buffer::Impl::evict(const std::string& filepath) {
+    std::vector<std::string> hashes;
+    try {
+        hashes = device_quotas_.empty() ? eviction_policy_->Victims(*index_) : fairShareVictims();
+    } catch (const DatabaseException& e) {
+        return false;
+    }
+    return evictHashes(filepath, hashes,
+                       [this]() { return !storage_->AboveQuota(reclaim_bytes_); });
+}
+
+bool Buffer::Impl::evictDevice(const std::string& filepath, const unsigned int& device,
+                               const unsigned long long& incoming_size) {
+    // Only the device's own clips make room under its cap, oldest of the least important first
+    std::vector<std::string> hashes;
+    try {
+        const auto sizes = index_->GetDeviceSizes();
+        auto found = sizes.find(device);
+        auto size = (found == sizes.end() ? 0 : found->second) + incoming_size;
+        const auto quota = device_quotas_.at(device).quota;
+        if (size <= quota) {
+            return true;
+        }
+        for (auto& record : index_->GetLowestDeletable(device)) {
+            if (size <= quota) {
+                break;
+            }
+            hashes.push_back(record["hash"]);
+            size -= std::min<unsigned long long>(size, std::stoull(record["size"]));
+        }
+    } catch (const DatabaseException& e) {
+        return false;
+    }
+    return evictHashes(filepath, hashes, []() { return false; });
+}
+
+bool Buffer::Impl::evictHashes(const std::string& filepath,
+                               const std::vector<std::string>& hashes,
+                               const std::function<bool()>& satisfied) {
+    PRISM_INDEXED_TRACE_SPAN(tracer_, "Buffer::evict");
+    // Victims are marked as deleting a few at a time before they are unlinked, so an
+    // interrupted eviction is finished on restart from the intent table alone
+    static const std::size_t mark_batch_size = 8;
+    std::vector<std::string> deleted_hashes;
+    std::unordered_set<std::string> packed_hashes;
+    std::size_t evicted = 0;
+    std::size_t marked = 0;
+    uintmax_t queued_bytes = 0;
+    const auto size_before = storage_->GetSize();
+
+    for (const auto& hash : hashes) {
+        if (satisfied()) {
+            break;
+        }
+
+        if (hash.empty()) {
+            fs::remove(filepath);
+            return false;
+        }
+
+        if (deleted_hashes.size() == marked) {
+            auto batch_end = hashes.begin() +
+                             std::min(hashes.size(), marked + mark_batch_size);
+            try {
+                index_->MarkDeleting(std::vector<std::string>(
+                        hashes.begin() + marked, batch_end));
+            } catch (const DatabaseException& e) {
+                return false;
+            }
+            marked = batch_end - hashes.begin();
+        }
+
+        deleted_hashes.push_back(hash);
+        if (packed_hashes.count(hash)) {
+            continue;
+        }
+        if (unlink_in_background_) {
+            const auto size = storage_->GetFileSize(hash);
+            if (size > 0) {
+                scheduleReclaim(hash, size);
+                queued_bytes += size;
+                ++evicted;
+                continue;
+            }
+        } else if (storage_->Delete(hash)) {
+            ++evicted;
+            continue;
+        }
+
+        // A packed victim takes its whole segment with it, along with every other item there
+        // that is no more important. The rest are copied forward before the segment is freed.
+        try {
+            auto location = index_->GetLocation(hash);
+            if (!location.empty()) {
+                for (const auto& packed_hash :
+                     evictSegment(std::stoull(location["segment"]), std::stoul(location["keep"]))) {
+                    packed_hashes.insert(packed_hash);
+                    ++evicted;
+                }
+            } else if (unlink_in_background_) {
+                // An empty file frees nothing but still has to go
+                scheduleReclaim(hash, 0);
+            }
+        } catch (const DatabaseException& e) {
+            return false;
+        }
+    }
+
+    const auto size_after = storage_->GetSize();
+    stats_.AddEvicted(evicted,
+                      (size_before > size_after ? size_before - size_after : 0) + queued_bytes);
+    // Packed victims were described as their segment was compacted
+    std::vector<std::string> unpacked_hashes;
+    for (const auto& hash : deleted_hashes) {
+        if (!packed_hashes.count(hash)) {
+            unpacked_hashes.push_back(hash);
+        }
+    }
+    const auto described = describe(unpacked_hashes);
+    try {
+        index_->BulkDelete(deleted_hashes);
+        for (auto i = deleted_hashes.size(); i < marked; ++i) {
+            index_->FinalizePending(hashes[i]);
+        }
+    } catch (const DatabaseException& e) {
+        return false;
+    }
+
+    if (!deleted_hashes.empty()) {
+        changed();
+        publishRemoved(EventType::Evicted, described, unpacked_hashes);
+    }
+    return true;
+}
+
+std::vector<std::string> Buffer::Impl::fairShareVictims() {
+    // Each round takes the next victim from whichever device is furthest over its share, so a
+    // chatty device is trimmed back before a quiet one loses anything. A device without a quota
+    // of its own shares the buffer quota equally with every other device holding clips.
+    struct Candidate {
+        long long excess;
+        unsigned int device;
+        bool operator<(const Candidate& other) const {
+            return excess < other.excess || (excess == other.excess && device > other.device);
+        }
+    };
+
+    auto sizes = index_->GetDeviceSizes();
+    if (sizes.empty()) {
+        return std::vector<std::string>{};
+    }
+    const auto equal_share = byte_quota_ / sizes.size();
+    auto share = [this, &equal_share](const unsigned int& device) -> unsigned long long {
+        auto found = device_quotas_.find(device);
+        return found != device_quotas_.end() && found->second.quota > 0 ? found->second.quota
+                                                                        : equal_share;
+    };
+    auto reserve = [this](const unsigned int& device) -> unsigned long long {
+        auto found = device_quotas_.find(device);
+        return found != device_quotas_.end() ? found->second.reserve : 0;
+    };
+
+    std::priority_queue<Candidate> candidates;
+    for (const auto& size : sizes) {
+        candidates.push(Candidate{static_cast<long long>(size.second) -
+                                          static_cast<long long>(share(size.first)),
+                                  size.first});
+    }
+
+    std::map<unsigned int, std::vector<Record>> deletable;
+    std::map<unsigned int, std::size_t> taken;
+    std::vector<std::string> hashes;
+    while (!candidates.empty()) {
+        const auto candidate = candidates.top();
+        candidates.pop();
+        const auto device = candidate.device;
+        if (!deletable.count(device)) {
+            deletable[device] = index_->GetLowestDeletable(device);
+        }
+
+        auto& records = deletable[device];
+        auto& next = taken[device];
+        if (next == records.size()) {
+            continue;
+        }
+        const auto victim_size = std::stoull(records[next]["size"]);
+        if (sizes[device] < reserve(device) + victim_size) {
+            continue;
+        }
+
+        hashes.push_back(records[next]["hash"]);
+        ++next;
+        sizes[device] -= victim_size;
+        candidates.push(Candidate{candidate.excess - static_cast<long long>(victim_size), device});
+    }
+    return hashes;
+}
+
+std::vector<std::string> Buffer::Impl::evictSegment(const unsigned long long& segment,
+                                                    const unsigned int& keep) {
+    if (segment == segments_.GetActive()) {
+        segments_.Seal();
+    }
+
+    std::vector<std::string> evicted_hashes;
+    std::vector<Record> relocations;
+    for (auto& item : index_->GetSegmentItems(segment)) {
+        if (std::stoul(item["keep"]) <= keep) {
+            evicted_hashes.push_back(item["hash"]);
+            continue;
+        }
+
+        SegmentLocation copied;
+        try {
+            copied = segments_.Copy(SegmentLocation{segment, std::stoull(item["offset"]),
+                                                    std::stoull(item["length"])});
+        } catch (const FilesystemException& e) {
+            return std::vector<std::string>{};
+        }
+        relocations.push_back(Record{{"hash", item["hash"]},
+                                     {"segment", std::to_string(copied.segment)},
+                                     {"offset", std::to_string(copied.offset)}});
+    }
+
+    const auto described = describe(evicted_hashes);
+    index_->CompactSegment(evicted_hashes, relocations);
+    publishRemoved(EventType::Evicted, described, evicted_hashes);
+    segments_.Remove(segment);
+    return evicted_hashes;
+}
+
+Record Buffer::Impl::findNeighbor(const unsigned long long& time_value,
+                                  const unsigned int& device, const Direction& direction) {
+    if (direction == Direction::Before) {
+        return index_->FindPrevious(time_value, device);
+    }
+    if (direction == Direction::After) {
+        return index_->FindNext(time_value, device);
+    }
+
+    auto previous = index_->FindPrevious(time_value, device);
+    if (!previous.empty() && std::stoull(previous["time_value"]) == time_value) {
+        return previous;
+    }
+    auto next = index_->FindNext(time_value, device);
+    if (previous.empty()) {
+        return next;
+    }
+    if (next.empty()) {
+        return previous;
+    }
+    if (std::stoull(next["time_value"]) - time_value <
+            time_value - std::stoull(previous["time_value"])) {
+        return next;
+    }
+    return previous;
+}
+
 bool Buffer::Impl::setKeep(const std::chrono::system_clock::time_point& time_point,
                            const unsigned int& device, const unsigned int& keep) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    auto lock = acquire();
+    bool kept;
     try {
-        return database_.SetKeep(utility::SnapToMinute(time_point), device, keep);
+        kept = index_->SetKeep(utility::SnapToMinute(time_point), device, keep);
     } catch (const DatabaseException& e) {
         return false;
     }
-    return false;
+    if (kept) {
+        changed();
+        const auto time_value = utility::SnapToMinute(time_point);
+        publish(EventType::KeepChanged, describeRange(false, device, time_value, time_value));
+    }
+    return kept;
 }
 
 bool Buffer::Impl::bulkSetKeep(
         const std::vector<std::chrono::system_clock::time_point>& time_points,
         const unsigned int& device, const unsigned int& keep) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    auto lock = acquire();
 
     std::vector<unsigned long long> minutes;
     for (const auto& time_point : time_points) {
         minutes.emplace_back(utility::SnapToMinute(time_point));
     }
 
+    bool kept;
     try {
-        return database_.BulkSetKeep(minutes, device, keep);
+        kept = index_->BulkSetKeep(minutes, device, keep);
     } catch (const DatabaseException& e) {
         return false;
     }
-    return false;
+    changed();
+    if (subscribed_ && !minutes.empty()) {
+        const std::unordered_set<unsigned long long> kept_minutes{minutes.begin(), minutes.end()};
+        auto described = describeRange(false, device,
+                                       *std::min_element(minutes.begin(), minutes.end()),
+                                       *std::max_element(minutes.begin(), minutes.end()));
+        for (auto it = described.begin(); it != described.end();) {
+            if (kept_minutes.count(std::stoull(it->second["time_value"]))) {
+                ++it;
+            } else {
+                it = described.erase(it);
+            }
+        }
+        publish(EventType::KeepChanged, described);
+    }
+    return kept;
+}
+
+Clip Buffer::Impl::locate(Record& record) {
+    const auto size = std::stoull(record["size"]);
+    Clip clip{std::chrono::system_clock::time_point(
+                      std::chrono::minutes(std::stoull(record["time_value"]))),
+              storage_->GetExistingFilepath(record["hash"]), 0, size, Codec::None, size};
+    if (!clip.filepath.empty()) {
+        // Only names with the codec suffix cost a lookup
+        const auto& hash = record["hash"];
+        if (hash.size() > compressed_suffix.size() &&
+            hash.compare(hash.size() - compressed_suffix.size(), compressed_suffix.size(),
+                         compressed_suffix) == 0) {
+            try {
+                auto compression = index_->GetCompression(hash);
+                if (!compression.empty()) {
+                    clip.codec = static_cast<Codec>(std::stoul(compression["codec"]));
+                    clip.raw_length = std::stoull(compression["raw_size"]);
+                }
+            } catch (const DatabaseException& e) {
+            }
+        }
+        return clip;
+    }
+
+    try {
+        auto location = index_->GetLocation(record["hash"]);
+        if (!location.empty()) {
+            clip.filepath = segments_.GetFilepath(std::stoull(location["segment"]));
+            clip.offset = std::stoull(location["offset"]);
+        }
+    } catch (const DatabaseException& e) {
+    }
+    return clip;
+}
+
+void Buffer::Impl::notify() {
+    // Subscribers run here, outside the buffer's lock. Producers never take subscribe_mutex_, so
+    // a wakeup can be missed between the check and the wait, which the poll bounds.
+    static const std::chrono::milliseconds poll_interval{10};
+    std::unique_lock<std::mutex> lock(subscribe_mutex_);
+    while (true) {
+        std::vector<Event> events;
+        Event event;
+        while (events_.Pop(event)) {
+            events.push_back(event);
+        }
+        const auto dropped = events_.TakeDropped();
+        if (dropped > 0) {
+            events.push_back(Event{EventType::Dropped, 0, std::chrono::system_clock::time_point{},
+                                   dropped});
+        }
+        for (const auto& delivered : events) {
+            for (const auto& subscriber : subscribers_) {
+                subscriber.second(delivered);
+            }
+        }
+
+        if (!notifying_ && events_.Empty()) {
+            return;
+        }
+        event_condition_.wait_for(lock, poll_interval,
+                                  [this]() { return !notifying_ || !events_.Empty(); });
+    }
+}
+
+void Buffer::Impl::publish(const EventType& type, const unsigned int& device,
+                           const unsigned long long& time_value, const uintmax_t& size) {
+    if (!subscribed_) {
+        return;
+    }
+    events_.Push(Event{type, device,
+                       std::chrono::system_clock::time_point(std::chrono::minutes(time_value)),
+                       size});
+    event_condition_.notify_one();
+}
+
+void Buffer::Impl::publish(const EventType& type,
+                           const std::unordered_map<std::string, Record>& described) {
+    for (const auto& record : described) {
+        publish(type, std::stoul(record.second.at("device")),
+                std::stoull(record.second.at("time_value")), std::stoull(record.second.at("size")));
+    }
+}
+
+void Buffer::Impl::publishRemoved(const EventType& type,
+                                  const std::unordered_map<std::string, Record>& described,
+                                  const std::vector<std::string>& hashes) {
+    // A removed row that was not described beforehand is reported as a dropped event, so the
+    // subscriber knows to read the catalog again
+    if (!subscribed_) {
+        return;
+    }
+    for (const auto& hash : hashes) {
+        auto found = described.find(hash);
+        if (found == described.end()) {
+            events_.Drop(1);
+            continue;
+        }
+        publish(type, std::stoul(found->second.at("device")),
+                std::stoull(found->second.at("time_value")), std::stoull(found->second.at("size")));
+    }
+    event_condition_.notify_one();
+}
+
+void Buffer::Impl::reclaim() {
+    // Files whose rows are already gone are unlinked here in small batches. Nothing references
+    // them any more, so the unlinks run without the lock as one batch, and only the intents are
+    // cleared under it. Queued bytes stop counting as free once the storage has subtracted them.
+    static const std::size_t batch_size = 64;
+    std::vector<std::pair<std::string, uintmax_t>> batch;
+    std::unique_lock<BufferMutex> lock(mutex_);
+    while (true) {
+        reclaim_condition_.wait(lock, [this]() { return stopping_ || !reclaim_queue_.empty(); });
+        if (reclaim_queue_.empty()) {
+            return;
+        }
+
+        batch.clear();
+        while (batch.size() < batch_size && !reclaim_queue_.empty()) {
+            batch.push_back(std::move(reclaim_queue_.front()));
+            reclaim_queue_.pop_front();
+        }
+
+        lock.unlock();
+        std::vector<std::string> filenames;
+        uintmax_t bytes = 0;
+        for (const auto& item : batch) {
+            filenames.push_back(item.first);
+            bytes += item.second;
+        }
+        storage_->BulkDelete(filenames);
+        reclaim_bytes_ -= bytes;
+        lock.lock();
+        for (const auto& filename : filenames) {
+            reclaiming_.erase(filename);
+        }
+
+        for (const auto& item : batch) {
+            try {
+                index_->FinalizePending(item.first);
+            } catch (const DatabaseException& e) {
+            }
+        }
+    }
+}
+
+void Buffer::Impl::coordinate() {
+    // Every process sharing the buffer waits for eviction requests, and the one holding the lease
+    // serves them. The others try for the lease on each wakeup, so it passes on soon after its
+    // holder exits.
+    static const std::chrono::seconds lease_interval{1};
+    auto seen = shared_->GetEvictionRequests();
+    while (!stopping_) {
+        const bool requested = shared_->WaitForEvictionRequest(seen, lease_interval);
+        seen = shared_->GetEvictionRequests();
+        if (stopping_ || !shared_->AcquireOwnership() || !requested) {
+            continue;
+        }
+
+        auto lock = acquire();
+        if (storage_->AboveQuota(reclaim_bytes_)) {
+            Stats::Timer<Phase> phase_timer{stats_, Phase::Eviction};
+            evict(std::string{});
+        }
+        // Wakes the waiting pushes even when there was nothing to evict
+        changed();
+    }
+}
+
+std::unique_ptr<Index> Buffer::Impl::openIndex(const Options& options) {
+    // Processes opening a shared buffer at once would otherwise race to create the schema
+    std::unique_lock<SharedState> lock;
+    if (shared_) {
+        lock = std::unique_lock<SharedState>{*shared_};
+    }
+    return options.index_factory ? options.index_factory(*storage_)
+                                 : Buffer::Impl::MakeIndex(*storage_, options.index_shards);
+}
+
+void Buffer::Impl::recover() {
+    std::vector<Record> intents;
+    try {
+        intents = index_->GetIntents();
+    } catch (const DatabaseException& e) {
+        return;
+    }
+
+    std::vector<std::string> completed_hashes;
+    std::vector<std::string> dropped_hashes;
+    for (auto& intent : intents) {
+        const auto& hash = intent["hash"];
+        if (std::stoul(intent["operation"]) == INTENT_PUSH &&
+                !storage_->GetExistingFilepath(hash).empty()) {
+            completed_hashes.push_back(hash);
+            continue;
+        }
+
+        storage_->Delete(hash);
+        dropped_hashes.push_back(hash);
+    }
+
+    try {
+        index_->BulkDelete(dropped_hashes);
+        index_->ClearIntents(completed_hashes);
+    } catch (const DatabaseException& e) {
+    }
+}
+
+void Buffer::Impl::recoverSegments() {
+    // A segment whose items were all evicted or copied forward may still be on disk if the
+    // process stopped before it was removed
+    const auto segments = segments_.List();
+    if (segments.empty()) {
+        return;
+    }
+
+    std::vector<unsigned long long> referenced;
+    try {
+        referenced = index_->GetSegments();
+    } catch (const DatabaseException& e) {
+        return;
+    }
+
+    for (const auto& segment : segments) {
+        if (!std::binary_search(referenced.begin(), referenced.end(), segment)) {
+            segments_.Remove(segment);
+        }
+    }
+}
+
+void Buffer::Impl::retain() {
+    lowerThreadPriority();
+    std::unique_lock<std::mutex> lock(retain_mutex_);
+    while (!stopping_) {
+        lock.unlock();
+        if (IsEvictionOwner()) {
+            Expire();
+        }
+        lock.lock();
+        retain_condition_.wait_for(lock, retention_interval_, [this]() { return !!stopping_; });
+    }
+}
+
+void Buffer::Impl::scheduleReclaim(const std::vector<std::string>& hashes) {
+    if (hashes.empty()) {
+        return;
+    }
+
+    for (const auto& hash : hashes) {
+        reclaim_queue_.emplace_back(hash, 0);
+        reclaiming_.insert(hash);
+    }
+    reclaim_condition_.notify_one();
+}
+
+void Buffer::Impl::scheduleReclaim(const std::string& hash, const uintmax_t& bytes) {
+    reclaim_bytes_ += bytes;
+    reclaim_queue_.emplace_back(hash, bytes);
+    reclaiming_.insert(hash);
+    reclaim_condition_.notify_one();
+}
+
+void Buffer::Impl::verify() {
+    lowerThreadPriority();
+    std::unique_lock<std::mutex> lock(verify_mutex_);
+    while (!stopping_) {
+        lock.unlock();
+        if (IsEvictionOwner()) {
+            storage_->VerifySize(stopping_);
+        }
+        lock.lock();
+        verify_condition_.wait_for(lock, verify_size_interval_, [this]() { return !!stopping_; });
+    }
 }
 
 // Bridge
 
+Options::Options()
+        : verify_size_interval{0},
+          segment_threshold{0},
+          segment_size{64 * 1024 * 1024},
+          retention{0},
+          retention_interval{1},
+          unlink_in_background{false},
+          deduplicate{false},
+          compression{Codec::None},
+          stripe_placement{StripePlacement::RoundRobin},
+          index_shards{1},
+          shared{false} {}
+
 Buffer::Buffer() : Buffer(std::string{}, 2.0) {}
 
 Buffer::Buffer(const std::string& buffer_root) : Buffer(buffer_root, 2.0) {}
 
 Buffer::Buffer(const std::string& buffer_root, const double& gigabyte_quota)
-        : Buffer(buffer_root, gigabyte_quota, Buffer::Impl::MakeHash) {}
+        : Buffer(buffer_root, gigabyte_quota, Options{}) {}
 
 Buffer::Buffer(const std::string& buffer_root, const double& gigabyte_quota,
                std::function<std::string(void)> hash_function)
-        : impl_{new Impl{buffer_root, gigabyte_quota, hash_function}} {}
+        : Buffer(buffer_root, gigabyte_quota, [&hash_function]() {
+              Options options;
+              options.hash_function = hash_function;
+              return options;
+          }()) {}
+
+Buffer::Buffer(const std::string& buffer_root, const double& gigabyte_quota,
+               const Options& options)
+        : impl_{new Impl{buffer_root, gigabyte_quota, options}} {}
 
 Buffer::~Buffer() {}
 
@@ -290,6 +1872,22 @@ bool Buffer::Delete(const std::chrono::system_clock::time_point& time_point,
     return impl_->Delete(time_point, device);
 }
 
+Clip Buffer::FindNearest(const std::chrono::system_clock::time_point& time_point,
+                         const unsigned int& device, const Direction& direction) {
+    return impl_->FindNearest(time_point, device, direction);
+}
+
+bool Buffer::DeleteRange(const std::chrono::system_clock::time_point& start,
+                         const std::chrono::system_clock::time_point& end) {
+    return impl_->DeleteRange(start, end);
+}
+
+bool Buffer::DeleteRange(const unsigned int& device,
+                         const std::chrono::system_clock::time_point& start,
+                         const std::chrono::system_clock::time_point& end) {
+    return impl_->DeleteRange(device, start, end);
+}
+
 std::string Buffer::GetBufferDirectory() const {
     return impl_->GetBufferDirectory();
 }
@@ -303,15 +1901,44 @@ std::string Buffer::GetFilepath(const std::chrono::system_clock::time_point& tim
     return impl_->GetFilepath(time_point, device);
 }
 
+Clip Buffer::GetLocation(const std::chrono::system_clock::time_point& time_point,
+                         const unsigned int& device) {
+    return impl_->GetLocation(time_point, device);
+}
+
+std::vector<Clip> Buffer::GetFilepaths(const unsigned int& device,
+                                       const std::chrono::system_clock::time_point& start,
+                                       const std::chrono::system_clock::time_point& end) {
+    return impl_->GetFilepaths(device, start, end);
+}
+
 bool Buffer::Full() {
     return impl_->Full();
 }
 
+std::vector<UnsyncedClip> Buffer::NextUnsynced(const std::size_t& count,
+                                               const std::vector<Device>& devices) {
+    return impl_->NextUnsynced(count, devices);
+}
+
+bool Buffer::MarkSynced(const std::vector<std::chrono::system_clock::time_point>& time_points,
+                        const unsigned int& device) {
+    return impl_->MarkSynced(time_points, device);
+}
+
 bool Buffer::PreserveRecord(const std::chrono::system_clock::time_point& time_point,
                             const unsigned int& device) {
     return impl_->PreserveRecord(time_point, device);
 }
 
+ReconcileReport Buffer::Reconcile(const std::chrono::milliseconds& budget) {
+    return impl_->Reconcile(budget);
+}
+
+unsigned long long Buffer::Expire() {
+    return impl_->Expire();
+}
+
 bool Buffer::SetLowPriority(const std::chrono::system_clock::time_point& time_point,
                             const unsigned int& device) {
     return impl_->SetLowPriority(time_point, device);
@@ -340,10 +1967,52 @@ bool Buffer::BulkKeepIfPossible(
     return impl_->BulkKeepIfPossible(time_points, device);
 }
 
+bool Buffer::SetKeepRange(const std::chrono::system_clock::time_point& start,
+                          const std::chrono::system_clock::time_point& end,
+                          const unsigned int& keep) {
+    return impl_->SetKeepRange(start, end, keep);
+}
+
+bool Buffer::SetKeepRange(const unsigned int& device,
+                          const std::chrono::system_clock::time_point& start,
+                          const std::chrono::system_clock::time_point& end,
+                          const unsigned int& keep) {
+    return impl_->SetKeepRange(device, start, end, keep);
+}
+
 bool Buffer::Push(const std::chrono::system_clock::time_point& time_point,
                   const unsigned int& device, const std::string& filepath) {
     return impl_->Push(time_point, device, filepath);
 }
 
+StatsSnapshot Buffer::GetStats() const {
+    return impl_->GetStats();
+}
+
+bool Buffer::DumpStats(const std::string& filepath) const {
+    return impl_->DumpStats(filepath);
+}
+
+unsigned int Buffer::GetChangeSequence() const {
+    return impl_->GetChangeSequence();
+}
+
+bool Buffer::WaitForChange(const unsigned int& sequence,
+                           const std::chrono::milliseconds& timeout) const {
+    return impl_->WaitForChange(sequence, timeout);
+}
+
+bool Buffer::IsEvictionOwner() {
+    return impl_->IsEvictionOwner();
+}
+
+unsigned int Buffer::Subscribe(const std::function<void(const Event& event)>& subscriber) {
+    return impl_->Subscribe(subscriber);
+}
+
+void Buffer::Unsubscribe(const unsigned int& subscription) {
+    impl_->Unsubscribe(subscription);
+}
+
 } // namespace indexed
 } // namespace prism
@@ -0,0 +1,379 @@
+#include "indexed/compression.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "indexed/storage.h"
+
+
+namespace prism {
+namespace indexed {
+
+namespace {
+
+// A compressed clip is the magic and raw size, then blocks of at most block_size raw bytes. Each
+// block has a header of its raw length and stored length, the top bit of which marks a block
+// kept uncompressed.
+const char magic[4] = {'P', 'I', 'Z', '4'};
+const std::size_t file_header_size = sizeof(magic) + 8;
+const std::size_t block_header_size = 8;
+const std::size_t block_size = 64 * 1024;
+const uint32_t stored_flag = 0x80000000U;
+
+const std::size_t min_match = 4;
+// The format ends every block with at least five literals, and no match may start within the
+// last twelve bytes
+const std::size_t last_literals = 5;
+const std::size_t match_start_limit = 12;
+const std::size_t max_offset = 65535;
+const int hash_bits = 12;
+
+uint32_t read32(const unsigned char* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t hashSequence(const uint32_t& sequence) {
+    return (sequence * 2654435761U) >> (32 - hash_bits);
+}
+
+void writeLength(unsigned char*& output, std::size_t length) {
+    while (length >= 255) {
+        *output++ = 255;
+        length -= 255;
+    }
+    *output++ = static_cast<unsigned char>(length);
+}
+
+bool readLength(const unsigned char*& input, const unsigned char* end, std::size_t& length) {
+    unsigned char byte;
+    do {
+        if (input == end) {
+            return false;
+        }
+        byte = *input++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+void encode32(unsigned char* data, const uint32_t& value) {
+    for (int i = 0; i < 4; ++i) {
+        data[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+uint32_t decode32(const unsigned char* data) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(data[i]) << (8 * i);
+    }
+    return value;
+}
+
+} // namespace
+
+namespace utility {
+
+std::size_t Lz4Compress(const char* source, const std::size_t& length, char* destination,
+                        const std::size_t& capacity) {
+    const auto input = reinterpret_cast<const unsigned char*>(source);
+    const auto output_begin = reinterpret_cast<unsigned char*>(destination);
+    const auto output_end = output_begin + capacity;
+    auto output = output_begin;
+
+    // Worst case for one sequence: token, literal length bytes, literals, offset and match
+    // length bytes
+    auto emit = [&](const std::size_t& anchor, const std::size_t& literals,
+                    const std::size_t& offset, const std::size_t& match_length) {
+        const std::size_t needed = 1 + literals / 255 + 1 + literals + 2 + match_length / 255 + 1;
+        if (static_cast<std::size_t>(output_end - output) < needed) {
+            return false;
+        }
+        const auto match_code = match_length > 0 ? match_length - min_match : 0;
+        auto token = output++;
+        *token = static_cast<unsigned char>((literals < 15 ? literals : 15) << 4);
+        if (literals >= 15) {
+            writeLength(output, literals - 15);
+        }
+        std::memcpy(output, input + anchor, literals);
+        output += literals;
+        if (match_length == 0) {
+            return true;
+        }
+        *output++ = static_cast<unsigned char>(offset);
+        *output++ = static_cast<unsigned char>(offset >> 8);
+        *token |= static_cast<unsigned char>(match_code < 15 ? match_code : 15);
+        if (match_code >= 15) {
+            writeLength(output, match_code - 15);
+        }
+        return true;
+    };
+
+    std::size_t anchor = 0;
+    if (length > match_start_limit) {
+        std::vector<uint32_t> table(1 << hash_bits, 0);
+        const auto match_end_limit = length - last_literals;
+        std::size_t position = 0;
+        while (position + match_start_limit <= length) {
+            const auto sequence = read32(input + position);
+            auto& slot = table[hashSequence(sequence)];
+            const std::size_t candidate = slot;
+            slot = static_cast<uint32_t>(position);
+            if (candidate >= position || position - candidate > max_offset ||
+                read32(input + candidate) != sequence) {
+                // Skip ahead faster the longer no match has been found
+                position += 1 + ((position - anchor) >> 6);
+                continue;
+            }
+
+            auto match_length = min_match;
+            while (position + match_length < match_end_limit &&
+                   input[candidate + match_length] == input[position + match_length]) {
+                ++match_length;
+            }
+            if (!emit(anchor, position - anchor, position - candidate, match_length)) {
+                return 0;
+            }
+            position += match_length;
+            anchor = position;
+            if (position >= 2 && position + match_start_limit <= length) {
+                table[hashSequence(read32(input + position - 2))] =
+                        static_cast<uint32_t>(position - 2);
+            }
+        }
+    }
+
+    if (!emit(anchor, length - anchor, 0, 0)) {
+        return 0;
+    }
+    return output - output_begin;
+}
+
+bool Lz4Decompress(const char* source, const std::size_t& length, char* destination,
+                   const std::size_t& raw_length) {
+    auto input = reinterpret_cast<const unsigned char*>(source);
+    const auto input_end = input + length;
+    const auto output_begin = reinterpret_cast<unsigned char*>(destination);
+    const auto output_end = output_begin + raw_length;
+    auto output = output_begin;
+
+    while (input != input_end) {
+        const auto token = *input++;
+        std::size_t literals = token >> 4;
+        if (literals == 15 && !readLength(input, input_end, literals)) {
+            return false;
+        }
+        if (literals > static_cast<std::size_t>(input_end - input) ||
+            literals > static_cast<std::size_t>(output_end - output)) {
+            return false;
+        }
+        std::memcpy(output, input, literals);
+        output += literals;
+        input += literals;
+        if (input == input_end) {
+            break;
+        }
+
+        if (input_end - input < 2) {
+            return false;
+        }
+        const std::size_t offset = input[0] | (input[1] << 8);
+        input += 2;
+        if (offset == 0 || offset > static_cast<std::size_t>(output - output_begin)) {
+            return false;
+        }
+        std::size_t match_length = token & 15;
+        if (match_length == 15 && !readLength(input, input_end, match_length)) {
+            return false;
+        }
+        match_length += min_match;
+        if (match_length > static_cast<std::size_t>(output_end - output)) {
+            return false;
+        }
+        // Matches may overlap the bytes they produce, so short offsets copy one byte at a time
+        const auto match = output - offset;
+        if (offset >= match_length) {
+            std::memcpy(output, match, match_length);
+        } else {
+            for (std::size_t i = 0; i < match_length; ++i) {
+                output[i] = match[i];
+            }
+        }
+        output += match_length;
+    }
+    return output == output_end;
+}
+
+uintmax_t CompressFile(const std::string& source, const std::string& destination) {
+    std::ifstream in_stream{source, std::ios::binary};
+    if (!in_stream) {
+        return 0;
+    }
+    std::ofstream out_stream{destination, std::ios::binary | std::ios::trunc};
+    if (!out_stream) {
+        return 0;
+    }
+
+    // The raw size is filled in once every block is written
+    unsigned char header[file_header_size] = {};
+    std::memcpy(header, magic, sizeof(magic));
+    out_stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    std::vector<char> raw(block_size);
+    std::vector<char> compressed(block_header_size + block_size);
+    uintmax_t raw_size = 0;
+    uintmax_t written = sizeof(header);
+    while (in_stream && out_stream) {
+        in_stream.read(raw.data(), raw.size());
+        const std::size_t raw_length = in_stream.gcount();
+        if (raw_length == 0) {
+            break;
+        }
+
+        // Anything that does not shrink is stored, so a block never grows past its header
+        auto compressed_length = Lz4Compress(raw.data(), raw_length,
+                                             compressed.data() + block_header_size,
+                                             raw_length - 1);
+        uint32_t stored_length = static_cast<uint32_t>(compressed_length);
+        if (compressed_length == 0) {
+            std::memcpy(compressed.data() + block_header_size, raw.data(), raw_length);
+            compressed_length = raw_length;
+            stored_length = static_cast<uint32_t>(raw_length) | stored_flag;
+        }
+        auto block_header = reinterpret_cast<unsigned char*>(compressed.data());
+        encode32(block_header, static_cast<uint32_t>(raw_length));
+        encode32(block_header + 4, stored_length);
+        out_stream.write(compressed.data(), block_header_size + compressed_length);
+        raw_size += raw_length;
+        written += block_header_size + compressed_length;
+    }
+
+    encode32(header + sizeof(magic), static_cast<uint32_t>(raw_size));
+    encode32(header + sizeof(magic) + 4, static_cast<uint32_t>(raw_size >> 32));
+    out_stream.seekp(0);
+    out_stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out_stream.close();
+    if (in_stream.bad() || !out_stream) {
+        std::remove(destination.data());
+        return 0;
+    }
+    return written;
+}
+
+} // namespace utility
+
+class DecompressingReader::Impl {
+  public:
+    Impl(const std::string& filepath);
+
+    std::size_t Read(char* data, const std::size_t& length);
+    uintmax_t GetRawSize() const;
+
+  private:
+    bool nextBlock();
+
+    std::string filepath_;
+    std::ifstream in_stream_;
+    uintmax_t raw_size_;
+    uintmax_t remaining_;
+    std::vector<char> compressed_;
+    std::vector<char> block_;
+    std::size_t block_offset_;
+    std::size_t block_length_;
+};
+
+DecompressingReader::Impl::Impl(const std::string& filepath)
+        : filepath_(filepath),
+          in_stream_{filepath, std::ios::binary},
+          raw_size_(0),
+          remaining_(0),
+          compressed_(block_size),
+          block_(block_size),
+          block_offset_(0),
+          block_length_(0) {
+    unsigned char header[file_header_size];
+    in_stream_.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!in_stream_ || std::memcmp(header, magic, sizeof(magic)) != 0) {
+        throw FilesystemException{"Not a compressed clip " + filepath};
+    }
+    raw_size_ = decode32(header + sizeof(magic)) |
+                static_cast<uintmax_t>(decode32(header + sizeof(magic) + 4)) << 32;
+    remaining_ = raw_size_;
+}
+
+std::size_t DecompressingReader::Impl::Read(char* data, const std::size_t& length) {
+    std::size_t read = 0;
+    while (read < length) {
+        if (block_offset_ == block_length_ && !nextBlock()) {
+            break;
+        }
+        auto count = std::min(length - read, block_length_ - block_offset_);
+        std::memcpy(data + read, block_.data() + block_offset_, count);
+        block_offset_ += count;
+        read += count;
+    }
+    return read;
+}
+
+uintmax_t DecompressingReader::Impl::GetRawSize() const {
+    return raw_size_;
+}
+
+bool DecompressingReader::Impl::nextBlock() {
+    if (remaining_ == 0) {
+        return false;
+    }
+
+    unsigned char header[block_header_size];
+    in_stream_.read(reinterpret_cast<char*>(header), sizeof(header));
+    const std::size_t raw_length = decode32(header);
+    const auto stored_length = decode32(header + 4);
+    const std::size_t compressed_length = stored_length & ~stored_flag;
+    if (!in_stream_ || raw_length == 0 || raw_length > block_size || raw_length > remaining_ ||
+        compressed_length > block_size) {
+        throw FilesystemException{"Corrupt compressed clip " + filepath_};
+    }
+
+    bool decoded;
+    if (stored_length & stored_flag) {
+        in_stream_.read(block_.data(), compressed_length);
+        decoded = compressed_length == raw_length;
+    } else {
+        in_stream_.read(compressed_.data(), compressed_length);
+        decoded = utility::Lz4Decompress(compressed_.data(), compressed_length, block_.data(),
+                                         raw_length);
+    }
+    if (!in_stream_ || !decoded) {
+        throw FilesystemException{"Corrupt compressed clip " + filepath_};
+    }
+
+    remaining_ -= raw_length;
+    block_offset_ = 0;
+    block_length_ = raw_length;
+    return true;
+}
+
+// Bridge
+
+DecompressingReader::DecompressingReader(const std::string& filepath)
+        : impl_{new DecompressingReader::Impl{filepath}} {}
+
+DecompressingReader::~DecompressingReader() {}
+
+std::size_t DecompressingReader::Read(char* data, const std::size_t& length) {
+    return impl_->Read(data, length);
+}
+
+uintmax_t DecompressingReader::GetRawSize() const {
+    return impl_->GetRawSize();
+}
+
+} // namespace indexed
+} // namespace prism
@@ -0,0 +1,152 @@
+#include "indexed/content-hash.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace prism {
+namespace indexed {
+namespace utility {
+
+namespace {
+
+const uint64_t prime_1 = 11400714785074694791ULL;
+const uint64_t prime_2 = 14029467366897019727ULL;
+const uint64_t prime_3 = 1609587929392839161ULL;
+const uint64_t prime_4 = 9650029242287828579ULL;
+const uint64_t prime_5 = 2870177450012600261ULL;
+
+uint64_t rotateLeft(const uint64_t& value, const int& bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t read64(const unsigned char* data) {
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t read32(const unsigned char* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint64_t consume(uint64_t accumulator, const uint64_t& input) {
+    accumulator += input * prime_2;
+    return rotateLeft(accumulator, 31) * prime_1;
+}
+
+uint64_t mergeRound(uint64_t accumulator, const uint64_t& value) {
+    accumulator ^= consume(0, value);
+    return accumulator * prime_1 + prime_4;
+}
+
+} // namespace
+
+Xxh64::Xxh64(const uint64_t& seed)
+        : seed_(seed),
+          accumulators_{seed + prime_1 + prime_2, seed + prime_2, seed, seed - prime_1},
+          total_length_(0),
+          pending_length_(0) {}
+
+void Xxh64::Update(const void* data, const std::size_t& length) {
+    auto input = static_cast<const unsigned char*>(data);
+    const auto end = input + length;
+    total_length_ += length;
+
+    if (pending_length_ + length < sizeof(pending_)) {
+        std::memcpy(pending_ + pending_length_, input, length);
+        pending_length_ += length;
+        return;
+    }
+
+    if (pending_length_ > 0) {
+        const auto fill = sizeof(pending_) - pending_length_;
+        std::memcpy(pending_ + pending_length_, input, fill);
+        for (int i = 0; i < 4; ++i) {
+            accumulators_[i] = consume(accumulators_[i], read64(pending_ + 8 * i));
+        }
+        input += fill;
+        pending_length_ = 0;
+    }
+
+    for (; input + 32 <= end; input += 32) {
+        for (int i = 0; i < 4; ++i) {
+            accumulators_[i] = consume(accumulators_[i], read64(input + 8 * i));
+        }
+    }
+
+    pending_length_ = end - input;
+    std::memcpy(pending_, input, pending_length_);
+}
+
+uint64_t Xxh64::Digest() const {
+    uint64_t hash;
+    if (total_length_ >= 32) {
+        hash = rotateLeft(accumulators_[0], 1) + rotateLeft(accumulators_[1], 7) +
+               rotateLeft(accumulators_[2], 12) + rotateLeft(accumulators_[3], 18);
+        for (const auto& accumulator : accumulators_) {
+            hash = mergeRound(hash, accumulator);
+        }
+    } else {
+        hash = seed_ + prime_5;
+    }
+    hash += total_length_;
+
+    auto input = pending_;
+    const auto end = pending_ + pending_length_;
+    for (; input + 8 <= end; input += 8) {
+        hash ^= consume(0, read64(input));
+        hash = rotateLeft(hash, 27) * prime_1 + prime_4;
+    }
+    if (input + 4 <= end) {
+        hash ^= read32(input) * prime_1;
+        hash = rotateLeft(hash, 23) * prime_2 + prime_3;
+        input += 4;
+    }
+    for (; input < end; ++input) {
+        hash ^= *input * prime_5;
+        hash = rotateLeft(hash, 11) * prime_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime_2;
+    hash ^= hash >> 29;
+    hash *= prime_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+std::string HashFile(const std::string& filepath) {
+    std::ifstream in_stream{filepath, std::ios::binary};
+    if (!in_stream) {
+        return std::string{};
+    }
+
+    Xxh64 low{0};
+    Xxh64 high{prime_5};
+    std::vector<char> chunk(64 * 1024);
+    while (in_stream) {
+        in_stream.read(chunk.data(), chunk.size());
+        low.Update(chunk.data(), in_stream.gcount());
+        high.Update(chunk.data(), in_stream.gcount());
+    }
+    if (in_stream.bad()) {
+        return std::string{};
+    }
+
+    std::stringstream stream;
+    stream << std::hex << std::setfill('0') << std::setw(16) << high.Digest() << std::setw(16)
+           << low.Digest();
+    return stream.str();
+}
+
+} // namespace utility
+} // namespace indexed
+} // namespace prism
@@ -1,9 +1,16 @@
 #include "indexed/database.h"
 
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <boost/filesystem.hpp>
@@ -18,38 +25,236 @@ namespace fs = ::boost::filesystem;
 class Database::Impl {
   public:
     Impl(const std::string& path);
+    ~Impl();
 
+    void StartCommitter(const CommitWindow& window);
+
+    void ClearIntents(const std::vector<std::string>& hashes);
+    void CompactSegment(const std::vector<std::string>& evicted_hashes,
+                        const std::vector<Record>& relocations);
     void Delete(const std::string& hash);
     void BulkDelete(const std::vector<std::string>& hashes);
+    std::vector<std::string> DeleteExpired(const std::string& condition, const std::size_t& limit);
+    std::vector<std::string> DeleteRange(const std::string& condition);
+    void FinalizePending(const std::string& hash);
+    Record GetCompression(const std::string& hash);
+    std::vector<std::string> GetDecayedDeletableHashes(const unsigned long long& decay_minutes);
+    std::map<unsigned int, unsigned long long> GetDeviceSizes();
+    std::vector<std::string> GetExpiredHashes(const unsigned long long& cutoff_time_value);
+    std::vector<Record> GetIntents();
+    std::vector<std::string> GetLargestDeletableHashes();
+    Record GetLocation(const std::string& hash);
+    std::vector<Record> GetLowestDeletable(const unsigned int& device);
     std::vector<std::string> GetLowestDeletableHashes();
+    unsigned long long GetMetadataSize();
+    std::vector<Record> GetSegmentItems(const unsigned long long& segment);
+    std::vector<unsigned long long> GetSegments();
+    unsigned long long GetSegmentedSize();
+    unsigned long long GetTotalSize();
     std::string FindHash(const unsigned long long& time_value, const unsigned int& device);
+    Record FindNext(const unsigned long long& time_value, const unsigned int& device);
+    Record FindPrevious(const unsigned long long& time_value, const unsigned int& device);
     void Insert(const unsigned long long& time_value, const unsigned int& device,
                 const std::string& hash, const unsigned long long& size, const unsigned int& keep);
+    void InsertCompressed(const unsigned long long& time_value, const unsigned int& device,
+                          const std::string& hash, const unsigned long long& size,
+                          const unsigned int& keep, const unsigned int& codec,
+                          const unsigned long long& raw_size);
+    void InsertPending(const unsigned long long& time_value, const unsigned int& device,
+                       const std::string& hash, const unsigned long long& size,
+                       const unsigned int& keep);
+    void InsertSegmented(const unsigned long long& time_value, const unsigned int& device,
+                         const std::string& hash, const unsigned long long& size,
+                         const unsigned int& keep, const unsigned long long& segment,
+                         const unsigned long long& offset);
+    void MarkDeleting(const std::vector<std::string>& hashes);
+    bool MarkSynced(const std::vector<unsigned long long>& time_values,
+                    const unsigned int& device);
+    std::vector<Record> NextUnsynced(const std::size_t& limit,
+                                     const std::vector<unsigned int>& devices);
     std::vector<Record> SelectAll();
+    std::vector<Record> SelectHashes(const std::vector<std::string>& hashes);
+    std::vector<Record> SelectDeletable();
+    std::vector<Record> SelectRange(const unsigned int& device,
+                                    const unsigned long long& start_time_value,
+                                    const unsigned long long& end_time_value);
     bool SetKeep(const unsigned long long& time_value, const unsigned int& device,
                  const unsigned int& keep);
     bool BulkSetKeep(const std::vector<unsigned long long>& time_values, const unsigned int& device,
                      const unsigned int& keep);
+    bool SetKeepRange(const std::string& condition, const unsigned int& keep);
+    void SetTracer(const std::shared_ptr<Tracer>& tracer);
+    void InsertAsync(const unsigned long long& time_value, const unsigned int& device,
+                     const std::string& hash, const unsigned long long& size,
+                     const unsigned int& keep, const CommitCallback& callback);
+    void SetKeepAsync(const unsigned long long& time_value, const unsigned int& device,
+                      const unsigned int& keep, const CommitCallback& callback);
+    void Flush();
+
+    static std::string ExpiredCondition(const unsigned long long& cutoff_time_value);
+    static std::string ExpiredCondition(const unsigned int& device,
+                                        const unsigned long long& cutoff_time_value);
+    static std::string ExpiredKeepCondition(const unsigned int& keep,
+                                            const unsigned long long& cutoff_time_value);
+    static std::string RangeCondition(const unsigned long long& start_time_value,
+                                      const unsigned long long& end_time_value);
+    static std::string RangeCondition(const unsigned int& device,
+                                      const unsigned long long& start_time_value,
+                                      const unsigned long long& end_time_value);
 
   private:
     using DatabaseHandle = std::unique_ptr<sqlite3, std::function<int(sqlite3*)>>;
 
+    // A write waiting for the committer. applied_by_row marks statements ending in a SELECT of
+    // the row they changed, which returns nothing when there was no row to change.
+    struct Mutation {
+        std::string sql;
+        bool applied_by_row;
+        CommitCallback callback;
+        // Receives the rows the write selected, for a caller waiting on the commit
+        std::vector<Record>* rows;
+    };
+
     static int callback(void* response_ptr, int num_values, char** values, char** names);
+    static std::vector<Record> executeOn(sqlite3* sqlite_database, const std::string& sql);
+
+    static std::string hashSet(const std::vector<std::string>& hashes);
+    static bool validHash(const std::string& hash);
 
     bool checkTable();
+    void createCompressionTable();
+    void createDeviceTable();
+    void createIndexes();
+    void createIntentTable();
+    void createMetadataTable();
+    void createSegmentTable();
+    std::string clearFinalizedStatement();
     void createTable();
+    void createUnsyncedTable();
+    void commit(std::deque<Mutation>& batch, const std::shared_ptr<Tracer>& tracer);
+    void commitLoop();
+    bool commitWait(const std::string& sql, const bool& applied_by_row,
+                    std::vector<Record>* rows = nullptr);
+    void enqueue(const std::string& sql, const bool& applied_by_row,
+                 const CommitCallback& callback, std::vector<Record>* rows = nullptr);
+    void ensureIndex(const std::string& name, const std::string& definition);
+    Record findOne(const std::string& sql);
     std::vector<Record> execute(const std::string& sql);
+    std::string insertStatement(const unsigned long long& time_value, const unsigned int& device,
+                                const std::string& hash, const unsigned long long& size,
+                                const unsigned int& keep);
+    std::string keepStatement(const unsigned long long& time_value, const unsigned int& device,
+                              const unsigned int& keep);
     DatabaseHandle openDatabase();
+    std::vector<std::string> selectHashes(const std::string& sql);
+    bool write(const std::string& sql, const bool& applied_by_row);
+    std::vector<Record> writeSelect(const std::string& sql);
 
     std::string table_path_;
     std::string table_name_;
+    std::string compression_table_name_;
+    std::string device_table_name_;
+    std::string intent_table_name_;
+    std::string metadata_table_name_;
+    std::string segment_table_name_;
+    std::string unsynced_table_name_;
+    std::vector<std::string> finalized_hashes_;
+    std::set<std::string> ensured_indexes_;
+    std::shared_ptr<Tracer> tracer_;
+
+    bool grouped_;
+    CommitWindow window_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_condition_;
+    std::deque<Mutation> queue_;
+    std::chrono::steady_clock::time_point oldest_;
+    bool flushing_;
+    bool stopping_;
+    std::thread committer_;
 };
 
 Database::Impl::Impl(const std::string& path)
-        : table_path_(path), table_name_("prism_indexed_data") {
+        : table_path_(path),
+          table_name_("prism_indexed_data"),
+          compression_table_name_("prism_indexed_compression"),
+          device_table_name_("prism_indexed_device"),
+          intent_table_name_("prism_indexed_intent"),
+          metadata_table_name_("prism_indexed_meta"),
+          segment_table_name_("prism_indexed_segment"),
+          unsynced_table_name_("prism_indexed_unsynced"),
+          grouped_(false),
+          window_(CommitWindow{std::chrono::milliseconds{0}, 0}),
+          flushing_(false),
+          stopping_(false) {
     if (!checkTable()) {
         createTable();
     }
+    createIntentTable();
+    createMetadataTable();
+    createSegmentTable();
+    createDeviceTable();
+    createCompressionTable();
+    createUnsyncedTable();
+    createIndexes();
+}
+
+Database::Impl::~Impl() {
+    if (grouped_) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            stopping_ = true;
+        }
+        queue_condition_.notify_one();
+        committer_.join();
+        grouped_ = false;
+    }
+    try {
+        ClearIntents(finalized_hashes_);
+    } catch (const DatabaseException& e) {
+    }
+}
+
+void Database::Impl::StartCommitter(const CommitWindow& window) {
+    window_ = window;
+    grouped_ = true;
+    committer_ = std::thread{&Database::Impl::commitLoop, this};
+}
+
+void Database::Impl::ClearIntents(const std::vector<std::string>& hashes) {
+    if (hashes.empty()) {
+        return;
+    }
+
+    std::stringstream stream;
+    stream << "DELETE FROM "
+           << intent_table_name_
+           << " WHERE hash IN " << hashSet(hashes)
+           << ";";
+    write(stream.str(), false);
+}
+
+void Database::Impl::CompactSegment(const std::vector<std::string>& evicted_hashes,
+                                    const std::vector<Record>& relocations) {
+    if (evicted_hashes.empty() && relocations.empty()) {
+        return;
+    }
+
+    std::stringstream stream;
+    if (!evicted_hashes.empty()) {
+        stream << " DELETE FROM "
+               << table_name_
+               << " WHERE hash IN " << hashSet(evicted_hashes)
+               << ";";
+    }
+    for (const auto& relocation : relocations) {
+        stream << " UPDATE "
+               << segment_table_name_
+               << " SET segment=" << relocation.at("segment")
+               << ", offset=" << relocation.at("offset")
+               << " WHERE hash='" << relocation.at("hash")
+               << "';";
+    }
+    write(stream.str(), false);
 }
 
 void Database::Impl::Delete(const std::string& hash) {
@@ -63,7 +268,7 @@ void Database::Impl::Delete(const std::string& hash) {
            << " WHERE hash='"
            << hash
            << "';";
-    execute(stream.str());
+    write(stream.str(), false);
 }
 
 void Database::Impl::BulkDelete(const std::vector<std::string>& hashes) {
@@ -71,25 +276,152 @@ void Database::Impl::BulkDelete(const std::vector<std::string>& hashes) {
         return;
     }
 
-    // Produce set of hashes to delete
-    std::stringstream hashes_stream;
-    hashes_stream << "(";
-    auto it = hashes.cbegin();
-    for (; it != hashes.end() - 1; ++it) {
-        hashes_stream << "'" << *it << "',";
-    }
-    hashes_stream << "'" << *it << "'";
-    hashes_stream << ")";
-
-    auto hashes_string = hashes_stream.str();
+    auto hashes_string = hashSet(hashes);
 
     std::stringstream stream;
     stream << "DELETE FROM "
            << table_name_
            << " WHERE hash IN " << hashes_string
+           << "; DELETE FROM "
+           << intent_table_name_
+           << " WHERE hash IN " << hashes_string
            << ";";
 
-    execute(stream.str());
+    write(stream.str(), false);
+}
+
+std::vector<std::string> Database::Impl::DeleteExpired(const std::string& condition,
+                                                     const std::size_t& limit) {
+    std::stringstream stream;
+    stream << "rowid IN (SELECT rowid FROM "
+           << table_name_
+           << " WHERE " << condition
+           << " ORDER BY time_value ASC LIMIT " << limit
+           << ")";
+    return DeleteRange(stream.str());
+}
+
+std::vector<std::string> Database::Impl::DeleteRange(const std::string& condition) {
+    std::stringstream stream;
+    stream << "SELECT hash FROM "
+           << table_name_
+           << " WHERE " << condition
+           << " ORDER BY time_value ASC; INSERT OR REPLACE INTO "
+           << intent_table_name_
+           << "(hash, operation) SELECT hash, " << INTENT_DELETE
+           << " FROM " << table_name_
+           << " WHERE " << condition
+           << "; DELETE FROM "
+           << table_name_
+           << " WHERE " << condition
+           << ";";
+    auto response = writeSelect(stream.str());
+    std::vector<std::string> hashes;
+    for (auto& record : response) {
+        if (!record.empty()) {
+            hashes.push_back(record["hash"]);
+        }
+    }
+
+    return hashes;
+}
+
+void Database::Impl::FinalizePending(const std::string& hash) {
+    // Finalized intents are cleared as part of the next write transaction, so completing a push
+    // never costs a commit of its own
+    static const std::size_t max_finalized_hashes = 1024;
+    finalized_hashes_.push_back(hash);
+    if (finalized_hashes_.size() >= max_finalized_hashes) {
+        ClearIntents(finalized_hashes_);
+        finalized_hashes_.clear();
+    }
+}
+
+std::vector<std::string> Database::Impl::GetDecayedDeletableHashes(
+        const unsigned long long& decay_minutes) {
+    std::stringstream expression;
+    expression << "keep * " << decay_minutes << " + time_value";
+    std::stringstream definition;
+    definition << "(" << expression.str() << ") WHERE keep < " << PRESERVE_RECORD;
+    ensureIndex(table_name_ + "_decay_" + std::to_string(decay_minutes), definition.str());
+
+    std::stringstream stream;
+    stream << "SELECT hash FROM "
+           << table_name_
+           << " WHERE keep < " << PRESERVE_RECORD
+           << " ORDER BY " << expression.str() << " ASC;";
+    return selectHashes(stream.str());
+}
+
+std::map<unsigned int, unsigned long long> Database::Impl::GetDeviceSizes() {
+    std::stringstream stream;
+    stream << "SELECT device, size FROM "
+           << device_table_name_
+           << " WHERE size > 0 ORDER BY device ASC;";
+    std::map<unsigned int, unsigned long long> sizes;
+    for (auto& record : execute(stream.str())) {
+        if (!record.empty()) {
+            sizes[std::stoul(record["device"])] = std::stoull(record["size"]);
+        }
+    }
+    return sizes;
+}
+
+std::vector<std::string> Database::Impl::GetExpiredHashes(
+        const unsigned long long& cutoff_time_value) {
+    std::stringstream stream;
+    stream << "SELECT hash FROM "
+           << table_name_
+           << " WHERE time_value < " << cutoff_time_value
+           << " AND keep < " << PRESERVE_RECORD
+           << " ORDER BY time_value ASC;";
+    return selectHashes(stream.str());
+}
+
+std::vector<Record> Database::Impl::GetIntents() {
+    std::stringstream stream;
+    stream << "SELECT hash, operation FROM "
+           << intent_table_name_
+           << ";";
+    return execute(stream.str());
+}
+
+Record Database::Impl::GetCompression(const std::string& hash) {
+    std::stringstream stream;
+    stream << "SELECT codec, raw_size FROM "
+           << compression_table_name_
+           << " WHERE hash='" << hash
+           << "';";
+    return findOne(stream.str());
+}
+
+Record Database::Impl::GetLocation(const std::string& hash) {
+    std::stringstream stream;
+    stream << "SELECT segment, offset, length, keep FROM "
+           << table_name_
+           << " JOIN " << segment_table_name_
+           << " USING (hash) WHERE hash='" << hash
+           << "';";
+    return findOne(stream.str());
+}
+
+std::vector<Record> Database::Impl::GetLowestDeletable(const unsigned int& device) {
+    std::stringstream stream;
+    stream << "SELECT hash, size FROM "
+           << table_name_
+           << " WHERE device=" << device
+           << " AND keep < " << PRESERVE_RECORD
+           << " ORDER BY keep ASC, time_value ASC;";
+    return execute(stream.str());
+}
+
+std::vector<std::string> Database::Impl::GetLargestDeletableHashes() {
+    std::stringstream stream;
+    stream << "SELECT hash FROM "
+           << table_name_
+           << " WHERE keep < " << PRESERVE_RECORD
+           << " ORDER BY keep ASC, size DESC, time_value ASC;";
+    return selectHashes(stream.str());
 }
 
 std::vector<std::string> Database::Impl::GetLowestDeletableHashes() {
@@ -98,17 +430,69 @@ std::vector<std::string> Database::Impl::GetLowestDeletableHashes() {
            << table_name_
            << " WHERE keep < " << PRESERVE_RECORD
            << " ORDER BY keep ASC, time_value ASC;";
-    auto response = execute(stream.str());
-    std::vector<std::string> hashes;
-    if (!response.empty()) {
-        for (auto& record : response) {
-            if (!record.empty()) {
-                hashes.push_back(record["hash"]);
-            }
+    return selectHashes(stream.str());
+}
+
+unsigned long long Database::Impl::GetMetadataSize() {
+    unsigned long long size = 0;
+    for (const auto& suffix : {"", "-journal", "-wal", "-shm"}) {
+        boost::system::error_code error;
+        const auto file_size = fs::file_size(table_path_ + suffix, error);
+        if (!error) {
+            size += file_size;
+        }
+    }
+    return size;
+}
+
+std::vector<Record> Database::Impl::GetSegmentItems(const unsigned long long& segment) {
+    std::stringstream stream;
+    stream << "SELECT hash, offset, length, keep FROM "
+           << table_name_
+           << " JOIN " << segment_table_name_
+           << " USING (hash) WHERE segment=" << segment
+           << " ORDER BY offset ASC;";
+    return execute(stream.str());
+}
+
+std::vector<unsigned long long> Database::Impl::GetSegments() {
+    std::stringstream stream;
+    stream << "SELECT DISTINCT segment FROM "
+           << table_name_
+           << " JOIN " << segment_table_name_
+           << " USING (hash) ORDER BY segment ASC;";
+    std::vector<unsigned long long> segments;
+    for (auto& record : execute(stream.str())) {
+        if (!record.empty()) {
+            segments.push_back(std::stoull(record["segment"]));
         }
     }
+    return segments;
+}
 
-    return hashes;
+unsigned long long Database::Impl::GetSegmentedSize() {
+    std::stringstream stream;
+    stream << "SELECT IFNULL(SUM(length), 0) AS size FROM "
+           << table_name_
+           << " JOIN " << segment_table_name_
+           << " USING (hash);";
+    auto record = findOne(stream.str());
+    if (record.empty()) {
+        return 0;
+    }
+    return std::stoull(record["size"]);
+}
+
+unsigned long long Database::Impl::GetTotalSize() {
+    std::stringstream stream;
+    stream << "SELECT value FROM "
+           << metadata_table_name_
+           << " WHERE key='size';";
+    auto record = findOne(stream.str());
+    if (record.empty()) {
+        return 0;
+    }
+    return std::stoull(record["value"]);
 }
 
 std::string Database::Impl::FindHash(const unsigned long long& time_value,
@@ -130,34 +514,202 @@ std::string Database::Impl::FindHash(const unsigned long long& time_value,
     return hash;
 }
 
+Record Database::Impl::FindNext(const unsigned long long& time_value,
+                                const unsigned int& device) {
+    std::stringstream stream;
+    stream << "SELECT time_value, hash, size FROM "
+           << table_name_
+           << " WHERE device=" << device
+           << " AND time_value>=" << time_value
+           << " ORDER BY time_value ASC LIMIT 1;";
+    return findOne(stream.str());
+}
+
+Record Database::Impl::FindPrevious(const unsigned long long& time_value,
+                                    const unsigned int& device) {
+    std::stringstream stream;
+    stream << "SELECT time_value, hash, size FROM "
+           << table_name_
+           << " WHERE device=" << device
+           << " AND time_value<=" << time_value
+           << " ORDER BY time_value DESC LIMIT 1;";
+    return findOne(stream.str());
+}
+
 void Database::Impl::Insert(const unsigned long long& time_value, const unsigned int& device,
                             const std::string& hash, const unsigned long long& size,
                             const unsigned int& keep) {
-    if (hash.empty()) {
+    if (!validHash(hash)) {
         return;
     }
 
-    const auto hash_path = fs::path(hash);
+    write(insertStatement(time_value, device, hash, size, keep), false);
+}
 
-    for (const auto& hash_part : hash_path) {
-        if (!fs::portable_name(hash_part.string())) {
-            return;
+void Database::Impl::InsertCompressed(const unsigned long long& time_value,
+                                      const unsigned int& device, const std::string& hash,
+                                      const unsigned long long& size, const unsigned int& keep,
+                                      const unsigned int& codec,
+                                      const unsigned long long& raw_size) {
+    if (!validHash(hash)) {
+        return;
+    }
+
+    std::stringstream stream;
+    stream << clearFinalizedStatement()
+           << insertStatement(time_value, device, hash, size, keep)
+           << " INSERT OR REPLACE INTO "
+           << compression_table_name_
+           << "(hash, codec, raw_size) VALUES ('" << hash << "',"
+           << codec << ","
+           << raw_size
+           << "); INSERT OR REPLACE INTO "
+           << intent_table_name_
+           << "(hash, operation) VALUES ('" << hash << "'," << INTENT_PUSH << ");";
+    write(stream.str(), false);
+    finalized_hashes_.clear();
+}
+
+void Database::Impl::InsertPending(const unsigned long long& time_value,
+                                   const unsigned int& device, const std::string& hash,
+                                   const unsigned long long& size, const unsigned int& keep) {
+    if (!validHash(hash)) {
+        return;
+    }
+
+    std::stringstream stream;
+    stream << clearFinalizedStatement()
+           << insertStatement(time_value, device, hash, size, keep)
+           << " INSERT OR REPLACE INTO "
+           << intent_table_name_
+           << "(hash, operation) VALUES ('" << hash << "'," << INTENT_PUSH << ");";
+    write(stream.str(), false);
+    finalized_hashes_.clear();
+}
+
+void Database::Impl::InsertSegmented(const unsigned long long& time_value,
+                                     const unsigned int& device, const std::string& hash,
+                                     const unsigned long long& size, const unsigned int& keep,
+                                     const unsigned long long& segment,
+                                     const unsigned long long& offset) {
+    if (!validHash(hash)) {
+        return;
+    }
+
+    // The item is already written to its segment, so the row and its location commit together
+    // and need no intent
+    std::stringstream stream;
+    stream << clearFinalizedStatement()
+           << insertStatement(time_value, device, hash, size, keep)
+           << " INSERT INTO "
+           << segment_table_name_
+           << "(hash, segment, offset, length) VALUES ('" << hash << "',"
+           << segment << ","
+           << offset << ","
+           << size
+           << ");";
+    write(stream.str(), false);
+    finalized_hashes_.clear();
+}
+
+void Database::Impl::MarkDeleting(const std::vector<std::string>& hashes) {
+    if (hashes.empty()) {
+        return;
+    }
+
+    std::stringstream stream;
+    stream << "INSERT OR REPLACE INTO "
+           << intent_table_name_
+           << "(hash, operation) VALUES ";
+    for (auto it = hashes.cbegin(); it != hashes.cend(); ++it) {
+        if (it != hashes.cbegin()) {
+            stream << ",";
         }
+        stream << "('" << *it << "'," << INTENT_DELETE << ")";
+    }
+    stream << ";";
+    write(stream.str(), false);
+}
+
+bool Database::Impl::MarkSynced(const std::vector<unsigned long long>& time_values,
+                                const unsigned int& device) {
+    if (time_values.empty()) {
+        return true;
+    }
+
+    std::stringstream time_values_stream;
+    time_values_stream << "(";
+    auto it = time_values.cbegin();
+    for (; it != time_values.end() - 1; ++it) {
+        time_values_stream << *it << ",";
     }
+    time_values_stream << *it;
+    time_values_stream << ")";
+
+    auto time_values_string = time_values_stream.str();
 
     std::stringstream stream;
-    stream << "INSERT INTO "
+    stream << "DELETE FROM "
+           << unsynced_table_name_
+           << " WHERE time_value IN " << time_values_string
+           << " AND device=" << device
+           << "; SELECT id FROM "
            << table_name_
-           << "(time_value, device, hash, size, keep)"
-           << "VALUES"
-           << "("
-           << time_value << ","
-           << device << ","
-           << "'" << hash << "',"
-           << size << ","
-           << keep
-           << ");";
-    execute(stream.str());
+           << " WHERE time_value IN " << time_values_string
+           << " AND device=" << device
+           << " LIMIT 1;";
+
+    return write(stream.str(), true);
+}
+
+std::vector<Record> Database::Impl::NextUnsynced(const std::size_t& limit,
+                                                 const std::vector<unsigned int>& devices) {
+    if (limit == 0) {
+        return std::vector<Record>{};
+    }
+
+    // Every branch walks the unsynced table in key order and stops after limit rows, so the cost
+    // follows the rows returned rather than the size of the buffer
+    auto select = [&](const std::string& condition, const std::string& order) {
+        std::stringstream stream;
+        stream << "SELECT data.time_value AS time_value, data.device AS device,"
+               << " data.hash AS hash, data.size AS size FROM "
+               << unsynced_table_name_ << " AS unsynced JOIN "
+               << table_name_ << " AS data"
+               << " ON data.time_value=unsynced.time_value AND data.device=unsynced.device"
+               << condition
+               << " ORDER BY " << order
+               << " LIMIT " << limit;
+        return stream.str();
+    };
+
+    std::stringstream stream;
+    if (devices.empty()) {
+        stream << select("", "unsynced.time_value ASC, unsynced.device ASC") << ";";
+        return execute(stream.str());
+    }
+
+    const std::set<unsigned int> unique_devices{devices.begin(), devices.end()};
+    for (auto it = unique_devices.cbegin(); it != unique_devices.cend(); ++it) {
+        if (it != unique_devices.cbegin()) {
+            stream << " UNION ALL ";
+        }
+        stream << "SELECT * FROM ("
+               << select(" WHERE unsynced.device=" + std::to_string(*it),
+                         "unsynced.time_value ASC")
+               << ")";
+    }
+    stream << " ORDER BY time_value ASC, device ASC LIMIT " << limit << ";";
+    return execute(stream.str());
+}
+
+std::vector<Record> Database::Impl::SelectDeletable() {
+    std::stringstream stream;
+    stream << "SELECT hash, size, keep, time_value FROM "
+           << table_name_
+           << " WHERE keep < " << PRESERVE_RECORD
+           << " ORDER BY keep ASC, time_value ASC;";
+    return execute(stream.str());
 }
 
 std::vector<Record> Database::Impl::SelectAll() {
@@ -168,22 +720,35 @@ std::vector<Record> Database::Impl::SelectAll() {
     return execute(stream.str());
 }
 
-bool Database::Impl::SetKeep(const unsigned long long& time_value, const unsigned int& device,
-                             const unsigned int& keep) {
+std::vector<Record> Database::Impl::SelectHashes(const std::vector<std::string>& hashes) {
+    if (hashes.empty()) {
+        return std::vector<Record>{};
+    }
+
     std::stringstream stream;
-    stream << "UPDATE "
+    stream << "SELECT time_value, device, hash, size FROM "
            << table_name_
-           << " SET keep="
-           << keep
-           << " WHERE time_value=" << time_value
-           << " AND device=" << device
-           << "; SELECT * FROM "
+           << " WHERE hash IN " << hashSet(hashes)
+           << ";";
+    return execute(stream.str());
+}
+
+std::vector<Record> Database::Impl::SelectRange(const unsigned int& device,
+                                                const unsigned long long& start_time_value,
+                                                const unsigned long long& end_time_value) {
+    std::stringstream stream;
+    stream << "SELECT time_value, hash, size FROM "
            << table_name_
-           << " WHERE time_value=" << time_value
-           << " AND device=" << device
-           << " LIMIT 1;";
+           << " WHERE device=" << device
+           << " AND time_value BETWEEN " << start_time_value
+           << " AND " << end_time_value
+           << " ORDER BY time_value ASC;";
+    return execute(stream.str());
+}
 
-    return !execute(stream.str()).empty();
+bool Database::Impl::SetKeep(const unsigned long long& time_value, const unsigned int& device,
+                             const unsigned int& keep) {
+    return write(keepStatement(time_value, device, keep), true);
 }
 
 
@@ -218,20 +783,173 @@ bool Database::Impl::BulkSetKeep(const std::vector<unsigned long long>& time_val
            << " AND device=" << device
            << ";";
 
-    return !execute(stream.str()).empty();
+    return write(stream.str(), true);
 }
-int Database::Impl::callback(void* response_ptr, int num_values, char** values, char** names) {
-    auto response = (std::vector<Record>*) response_ptr;
-    auto record = Record();
-    for (int i = 0; i < num_values; ++i) {
-        if (values[i]) {
-            record[names[i]] = values[i];
-        }
-    }
-
-    response->push_back(record);
 
-    return 0;
+bool Database::Impl::SetKeepRange(const std::string& condition, const unsigned int& keep) {
+    std::stringstream stream;
+    stream << "UPDATE "
+           << table_name_
+           << " SET keep="
+           << keep
+           << " WHERE " << condition
+           << "; SELECT id FROM "
+           << table_name_
+           << " WHERE " << condition
+           << " LIMIT 1;";
+
+    return write(stream.str(), true);
+}
+
+void Database::Impl::SetTracer(const std::shared_ptr<Tracer>& tracer) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    tracer_ = tracer;
+}
+
+void Database::Impl::InsertAsync(const unsigned long long& time_value,
+                                 const unsigned int& device, const std::string& hash,
+                                 const unsigned long long& size, const unsigned int& keep,
+                                 const CommitCallback& callback) {
+    if (!validHash(hash)) {
+        callback(false, nullptr);
+        return;
+    }
+
+    if (grouped_) {
+        enqueue(insertStatement(time_value, device, hash, size, keep), false, callback);
+        return;
+    }
+    try {
+        Insert(time_value, device, hash, size, keep);
+    } catch (const DatabaseException& e) {
+        callback(false, std::current_exception());
+        return;
+    }
+    callback(true, nullptr);
+}
+
+void Database::Impl::SetKeepAsync(const unsigned long long& time_value,
+                                  const unsigned int& device, const unsigned int& keep,
+                                  const CommitCallback& callback) {
+    if (grouped_) {
+        enqueue(keepStatement(time_value, device, keep), true, callback);
+        return;
+    }
+    bool applied;
+    try {
+        applied = SetKeep(time_value, device, keep);
+    } catch (const DatabaseException& e) {
+        callback(false, std::current_exception());
+        return;
+    }
+    callback(applied, nullptr);
+}
+
+void Database::Impl::Flush() {
+    if (!grouped_) {
+        return;
+    }
+    // An empty write queued behind the rest completes once they are committed
+    commitWait(std::string{}, false);
+}
+
+std::string Database::Impl::ExpiredCondition(const unsigned long long& cutoff_time_value) {
+    std::stringstream stream;
+    stream << "time_value < " << cutoff_time_value;
+    return stream.str();
+}
+
+std::string Database::Impl::ExpiredCondition(const unsigned int& device,
+                                             const unsigned long long& cutoff_time_value) {
+    std::stringstream stream;
+    stream << "device=" << device
+           << " AND time_value < " << cutoff_time_value;
+    return stream.str();
+}
+
+std::string Database::Impl::ExpiredKeepCondition(const unsigned int& keep,
+                                                 const unsigned long long& cutoff_time_value) {
+    std::stringstream stream;
+    stream << "keep=" << keep
+           << " AND time_value < " << cutoff_time_value;
+    return stream.str();
+}
+
+std::string Database::Impl::RangeCondition(const unsigned long long& start_time_value,
+                                           const unsigned long long& end_time_value) {
+    std::stringstream stream;
+    stream << "time_value BETWEEN " << start_time_value
+           << " AND " << end_time_value;
+    return stream.str();
+}
+
+std::string Database::Impl::RangeCondition(const unsigned int& device,
+                                           const unsigned long long& start_time_value,
+                                           const unsigned long long& end_time_value) {
+    std::stringstream stream;
+    stream << "device=" << device
+           << " AND time_value BETWEEN " << start_time_value
+           << " AND " << end_time_value;
+    return stream.str();
+}
+
+int Database::Impl::callback(void* response_ptr, int num_values, char** values, char** names) {
+    auto response = (std::vector<Record>*) response_ptr;
+    auto record = Record();
+    for (int i = 0; i < num_values; ++i) {
+        if (values[i]) {
+            record[names[i]] = values[i];
+        }
+    }
+
+    response->push_back(record);
+
+    return 0;
+}
+
+std::vector<Record> Database::Impl::executeOn(sqlite3* sqlite_database,
+                                              const std::string& sql_statement) {
+    std::vector<Record> response;
+    char* error;
+    int rc = sqlite3_exec(sqlite_database, sql_statement.data(), &Database::Impl::callback,
+                          &response, &error);
+    if (rc != SQLITE_OK) {
+        auto error_string = std::string{"["}.append(std::to_string(rc)).append("]: ").append(error);
+        sqlite3_free(error);
+        throw DatabaseException{error_string};
+    }
+
+    return response;
+}
+
+std::string Database::Impl::hashSet(const std::vector<std::string>& hashes) {
+    // Produce set of hashes to query
+    std::stringstream hashes_stream;
+    hashes_stream << "(";
+    auto it = hashes.cbegin();
+    for (; it != hashes.end() - 1; ++it) {
+        hashes_stream << "'" << *it << "',";
+    }
+    hashes_stream << "'" << *it << "'";
+    hashes_stream << ")";
+
+    return hashes_stream.str();
+}
+
+bool Database::Impl::validHash(const std::string& hash) {
+    if (hash.empty()) {
+        return false;
+    }
+
+    const auto hash_path = fs::path(hash);
+
+    for (const auto& hash_part : hash_path) {
+        if (!fs::portable_name(hash_part.string())) {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 bool Database::Impl::checkTable() {
@@ -244,6 +962,139 @@ bool Database::Impl::checkTable() {
     return !response.empty();
 }
 
+void Database::Impl::createCompressionTable() {
+    // Codec and raw size of clips stored compressed, whose rows in the data table hold the stored
+    // size that counts against the quota. Like segment locations, they go with the row.
+    std::stringstream stream;
+    stream << "BEGIN; CREATE TABLE IF NOT EXISTS "
+           << compression_table_name_
+           << "("
+           << "hash TEXT PRIMARY KEY NOT NULL,"
+           << "codec UNSIGNED INT NOT NULL,"
+           << "raw_size UNSIGNED BIGINT NOT NULL"
+           << "); CREATE TRIGGER IF NOT EXISTS "
+           << table_name_ << "_compression_delete AFTER DELETE ON " << table_name_
+           << " BEGIN DELETE FROM " << compression_table_name_
+           << " WHERE hash=OLD.hash; END;"
+           << " COMMIT;";
+    execute(stream.str());
+}
+
+void Database::Impl::createDeviceTable() {
+    // Bytes held by each device, kept up to date by triggers like the total in the metadata
+    // table, so per-device quotas never sum over the data table
+    std::stringstream stream;
+    stream << "BEGIN; CREATE TABLE IF NOT EXISTS "
+           << device_table_name_
+           << "("
+           << "device UNSIGNED INT PRIMARY KEY NOT NULL,"
+           << "size BIGINT NOT NULL"
+           << "); INSERT OR IGNORE INTO "
+           << device_table_name_
+           << "(device, size) SELECT device, SUM(size) FROM "
+           << table_name_
+           << " GROUP BY device; CREATE TRIGGER IF NOT EXISTS "
+           << table_name_ << "_device_insert AFTER INSERT ON " << table_name_
+           << " BEGIN INSERT OR IGNORE INTO " << device_table_name_
+           << "(device, size) VALUES (NEW.device, 0); UPDATE " << device_table_name_
+           << " SET size=size+NEW.size WHERE device=NEW.device; END;"
+           << " CREATE TRIGGER IF NOT EXISTS "
+           << table_name_ << "_device_delete AFTER DELETE ON " << table_name_
+           << " BEGIN UPDATE " << device_table_name_
+           << " SET size=size-OLD.size WHERE device=OLD.device; END;"
+           << " CREATE TRIGGER IF NOT EXISTS "
+           << table_name_ << "_device_update AFTER UPDATE OF size ON " << table_name_
+           << " BEGIN UPDATE " << device_table_name_
+           << " SET size=size-OLD.size+NEW.size WHERE device=NEW.device; END;"
+           << " COMMIT;";
+    execute(stream.str());
+}
+
+void Database::Impl::createIndexes() {
+    // Range and expiry filters across all devices are on time_value alone, and the keep indexes
+    // back expiry by keep and the largest-first eviction order
+    std::stringstream stream;
+    stream << "CREATE INDEX IF NOT EXISTS "
+           << table_name_ << "_device_time"
+           << " ON " << table_name_
+           << "(device, time_value); CREATE INDEX IF NOT EXISTS "
+           << table_name_ << "_device_keep_time"
+           << " ON " << table_name_
+           << "(device, keep, time_value); CREATE INDEX IF NOT EXISTS "
+           << table_name_ << "_time"
+           << " ON " << table_name_
+           << "(time_value); CREATE INDEX IF NOT EXISTS "
+           << table_name_ << "_keep_time"
+           << " ON " << table_name_
+           << "(keep, time_value); CREATE INDEX IF NOT EXISTS "
+           << table_name_ << "_keep_size"
+           << " ON " << table_name_
+           << "(keep, size DESC, time_value);";
+    execute(stream.str());
+}
+
+void Database::Impl::createIntentTable() {
+    std::stringstream stream;
+    stream << "CREATE TABLE IF NOT EXISTS "
+           << intent_table_name_
+           << "("
+           << "hash TEXT PRIMARY KEY NOT NULL,"
+           << "operation UNSIGNED INT NOT NULL"
+           << ");";
+    execute(stream.str());
+}
+
+void Database::Impl::createMetadataTable() {
+    // The total stored size is kept up to date by triggers, so reading it at startup replaces a
+    // walk over every file in the buffer
+    std::stringstream stream;
+    stream << "BEGIN; CREATE TABLE IF NOT EXISTS "
+           << metadata_table_name_
+           << "("
+           << "key TEXT PRIMARY KEY NOT NULL,"
+           << "value BIGINT NOT NULL"
+           << "); INSERT OR IGNORE INTO "
+           << metadata_table_name_
+           << "(key, value) SELECT 'size', IFNULL(SUM(size), 0) FROM "
+           << table_name_
+           << "; CREATE TRIGGER IF NOT EXISTS "
+           << table_name_ << "_size_insert AFTER INSERT ON " << table_name_
+           << " BEGIN UPDATE " << metadata_table_name_
+           << " SET value=value+NEW.size WHERE key='size'; END;"
+           << " CREATE TRIGGER IF NOT EXISTS "
+           << table_name_ << "_size_delete AFTER DELETE ON " << table_name_
+           << " BEGIN UPDATE " << metadata_table_name_
+           << " SET value=value-OLD.size WHERE key='size'; END;"
+           << " CREATE TRIGGER IF NOT EXISTS "
+           << table_name_ << "_size_update AFTER UPDATE OF size ON " << table_name_
+           << " BEGIN UPDATE " << metadata_table_name_
+           << " SET value=value-OLD.size+NEW.size WHERE key='size'; END;"
+           << " COMMIT;";
+    execute(stream.str());
+}
+
+void Database::Impl::createSegmentTable() {
+    // Locations of items packed into segment files. Removing a row from the data table removes its
+    // location with it, so every existing delete path stays correct for packed items.
+    std::stringstream stream;
+    stream << "BEGIN; CREATE TABLE IF NOT EXISTS "
+           << segment_table_name_
+           << "("
+           << "hash TEXT PRIMARY KEY NOT NULL,"
+           << "segment UNSIGNED BIGINT NOT NULL,"
+           << "offset UNSIGNED BIGINT NOT NULL,"
+           << "length UNSIGNED BIGINT NOT NULL"
+           << "); CREATE INDEX IF NOT EXISTS "
+           << segment_table_name_ << "_segment"
+           << " ON " << segment_table_name_
+           << "(segment); CREATE TRIGGER IF NOT EXISTS "
+           << table_name_ << "_segment_delete AFTER DELETE ON " << table_name_
+           << " BEGIN DELETE FROM " << segment_table_name_
+           << " WHERE hash=OLD.hash; END;"
+           << " COMMIT;";
+    execute(stream.str());
+}
+
 void Database::Impl::createTable() {
     std::stringstream stream;
     stream << "CREATE TABLE "
@@ -260,20 +1111,214 @@ void Database::Impl::createTable() {
     execute(stream.str());
 }
 
+void Database::Impl::createUnsyncedTable() {
+    // Rows not yet marked synced, added and removed with their row by triggers. Rows that were
+    // already stored when the table is first created start out unsynced.
+    std::stringstream stream;
+    stream << "BEGIN IMMEDIATE; CREATE TABLE IF NOT EXISTS "
+           << unsynced_table_name_
+           << "("
+           << "time_value UNSIGNED BIGINT NOT NULL,"
+           << "device UNSIGNED INT NOT NULL,"
+           << "PRIMARY KEY (time_value, device)"
+           << ") WITHOUT ROWID; CREATE INDEX IF NOT EXISTS "
+           << unsynced_table_name_ << "_device_time"
+           << " ON " << unsynced_table_name_
+           << "(device, time_value); INSERT OR IGNORE INTO "
+           << unsynced_table_name_
+           << "(time_value, device) SELECT time_value, device FROM "
+           << table_name_
+           << " WHERE NOT EXISTS (SELECT 1 FROM sqlite_master WHERE type='trigger' AND name='"
+           << table_name_ << "_unsynced_insert'); CREATE TRIGGER IF NOT EXISTS "
+           << table_name_ << "_unsynced_insert AFTER INSERT ON " << table_name_
+           << " BEGIN INSERT OR IGNORE INTO " << unsynced_table_name_
+           << "(time_value, device) VALUES (NEW.time_value, NEW.device); END;"
+           << " CREATE TRIGGER IF NOT EXISTS "
+           << table_name_ << "_unsynced_delete AFTER DELETE ON " << table_name_
+           << " BEGIN DELETE FROM " << unsynced_table_name_
+           << " WHERE time_value=OLD.time_value AND device=OLD.device; END;"
+           << " COMMIT;";
+    execute(stream.str());
+}
+
+void Database::Impl::commit(std::deque<Mutation>& batch, const std::shared_ptr<Tracer>& tracer) {
+    PRISM_INDEXED_TRACE_SPAN(tracer, "Database::commit");
+    std::vector<char> applied(batch.size(), false);
+    std::vector<std::exception_ptr> errors(batch.size());
+    try {
+        auto sqlite_database = openDatabase();
+        sqlite3_busy_timeout(sqlite_database.get(), 10000);
+        // A write that fails, such as the insert of a row that exists, may roll back the whole
+        // transaction, so it is left out and the rest of the batch is written again
+        bool committed = false;
+        while (!committed) {
+            executeOn(sqlite_database.get(), "BEGIN IMMEDIATE;");
+            std::size_t i = 0;
+            try {
+                for (; i < batch.size(); ++i) {
+                    if (errors[i] || batch[i].sql.empty()) {
+                        continue;
+                    }
+                    auto response = executeOn(sqlite_database.get(), batch[i].sql);
+                    applied[i] = !batch[i].applied_by_row || !response.empty();
+                    if (batch[i].rows) {
+                        batch[i].rows->swap(response);
+                    }
+                }
+            } catch (const DatabaseException& e) {
+                errors[i] = std::current_exception();
+                if (!sqlite3_get_autocommit(sqlite_database.get())) {
+                    executeOn(sqlite_database.get(), "ROLLBACK;");
+                }
+                continue;
+            }
+            executeOn(sqlite_database.get(), "COMMIT;");
+            committed = true;
+        }
+    } catch (const DatabaseException& e) {
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (!errors[i] && !batch[i].sql.empty()) {
+                applied[i] = false;
+                errors[i] = std::current_exception();
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        batch[i].callback(applied[i], errors[i]);
+    }
+}
+
+void Database::Impl::commitLoop() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    while (true) {
+        queue_condition_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        queue_condition_.wait_until(lock, oldest_ + window_.interval, [this]() {
+            return stopping_ || flushing_ ||
+                   (window_.operations > 0 && queue_.size() >= window_.operations);
+        });
+
+        std::deque<Mutation> batch;
+        batch.swap(queue_);
+        flushing_ = false;
+        auto tracer = tracer_;
+        lock.unlock();
+        commit(batch, tracer);
+        lock.lock();
+    }
+}
+
+bool Database::Impl::commitWait(const std::string& sql_statement, const bool& applied_by_row,
+                                std::vector<Record>* rows) {
+    std::promise<bool> promise;
+    auto future = promise.get_future();
+    enqueue(sql_statement, applied_by_row,
+            [&promise](const bool& applied, const std::exception_ptr& error) {
+                if (error) {
+                    promise.set_exception(error);
+                } else {
+                    promise.set_value(applied);
+                }
+            },
+            rows);
+    return future.get();
+}
+
+void Database::Impl::enqueue(const std::string& sql_statement, const bool& applied_by_row,
+                             const CommitCallback& callback, std::vector<Record>* rows) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        if (queue_.empty()) {
+            oldest_ = std::chrono::steady_clock::now();
+        }
+        queue_.push_back(Mutation{sql_statement, applied_by_row, callback, rows});
+        flushing_ = flushing_ || sql_statement.empty();
+    }
+    queue_condition_.notify_one();
+}
+
+Record Database::Impl::findOne(const std::string& sql_statement) {
+    auto response = execute(sql_statement);
+    if (response.empty()) {
+        return Record{};
+    }
+    return response[0];
+}
+
+void Database::Impl::ensureIndex(const std::string& name, const std::string& definition) {
+    // A decay index depends on the policy's decay, so it is built the first time that order is
+    // asked for
+    if (ensured_indexes_.count(name)) {
+        return;
+    }
+    std::stringstream stream;
+    stream << "CREATE INDEX IF NOT EXISTS "
+           << name
+           << " ON " << table_name_
+           << definition << ";";
+    execute(stream.str());
+    ensured_indexes_.insert(name);
+}
+
 std::vector<Record> Database::Impl::execute(const std::string& sql_statement) {
-    std::vector<Record> response;
+    PRISM_INDEXED_TRACE_SPAN(tracer_, "Database::execute");
     auto sqlite_database = openDatabase();
     sqlite3_busy_timeout(sqlite_database.get(), 10000);
-    char* error;
-    int rc = sqlite3_exec(sqlite_database.get(), sql_statement.data(), &Database::Impl::callback,
-                          &response, &error);
-    if (rc != SQLITE_OK) {
-        auto error_string = std::string{"["}.append(std::to_string(rc)).append("]: ").append(error);
-        sqlite3_free(error);
-        throw DatabaseException{error_string};
+    return executeOn(sqlite_database.get(), sql_statement);
+}
+
+// Runs ahead of the insert it is batched with, so a deduplicated push reusing a finalized hash keeps
+// its own intent
+std::string Database::Impl::clearFinalizedStatement() {
+    if (finalized_hashes_.empty()) {
+        return std::string{};
     }
 
-    return response;
+    std::stringstream stream;
+    stream << "DELETE FROM "
+           << intent_table_name_
+           << " WHERE hash IN " << hashSet(finalized_hashes_)
+           << "; ";
+    return stream.str();
+}
+
+std::string Database::Impl::insertStatement(const unsigned long long& time_value,
+                                            const unsigned int& device, const std::string& hash,
+                                            const unsigned long long& size,
+                                            const unsigned int& keep) {
+    std::stringstream stream;
+    stream << "INSERT INTO "
+           << table_name_
+           << "(time_value, device, hash, size, keep)"
+           << "VALUES"
+           << "("
+           << time_value << ","
+           << device << ","
+           << "'" << hash << "',"
+           << size << ","
+           << keep
+           << ");";
+    return stream.str();
+}
+
+std::string Database::Impl::keepStatement(const unsigned long long& time_value,
+                                          const unsigned int& device, const unsigned int& keep) {
+    std::stringstream stream;
+    stream << "UPDATE "
+           << table_name_
+           << " SET keep="
+           << keep
+           << " WHERE time_value=" << time_value
+           << " AND device=" << device
+           << "; SELECT * FROM "
+           << table_name_
+           << " WHERE time_value=" << time_value
+           << " AND device=" << device
+           << " LIMIT 1;";
+    return stream.str();
 }
 
 Database::Impl::DatabaseHandle Database::Impl::openDatabase() {
@@ -289,13 +1334,56 @@ Database::Impl::DatabaseHandle Database::Impl::openDatabase() {
     return DatabaseHandle(sqlite_db, sqlite3_close);
 }
 
+bool Database::Impl::write(const std::string& sql_statement, const bool& applied_by_row) {
+    // A grouped write joins the committer's transaction, so only a write of its own is wrapped
+    // in one
+    if (grouped_) {
+        return commitWait(sql_statement, applied_by_row);
+    }
+    auto response = execute("BEGIN; " + sql_statement + " COMMIT;");
+    return !applied_by_row || !response.empty();
+}
+
+// Like write for a statement that also selects, returning the rows once it is committed
+std::vector<Record> Database::Impl::writeSelect(const std::string& sql_statement) {
+    if (grouped_) {
+        std::vector<Record> rows;
+        commitWait(sql_statement, false, &rows);
+        return rows;
+    }
+    return execute("BEGIN; " + sql_statement + " COMMIT;");
+}
+
+std::vector<std::string> Database::Impl::selectHashes(const std::string& sql_statement) {
+    std::vector<std::string> hashes;
+    for (auto& record : execute(sql_statement)) {
+        if (!record.empty()) {
+            hashes.push_back(record["hash"]);
+        }
+    }
+    return hashes;
+}
+
 
 // Bridge
 
 Database::Database(const std::string& path) : impl_{new Impl{path}} {}
 
+Database::Database(const std::string& path, const CommitWindow& window) : impl_{new Impl{path}} {
+    impl_->StartCommitter(window);
+}
+
 Database::~Database() {}
 
+void Database::ClearIntents(const std::vector<std::string>& hashes) {
+    impl_->ClearIntents(hashes);
+}
+
+void Database::CompactSegment(const std::vector<std::string>& evicted_hashes,
+                              const std::vector<Record>& relocations) {
+    impl_->CompactSegment(evicted_hashes, relocations);
+}
+
 void Database::Delete(const std::string& hash) {
     impl_->Delete(hash);
 }
@@ -304,24 +1392,165 @@ void Database::BulkDelete(const std::vector<std::string>& hashes) {
     impl_->BulkDelete(hashes);
 }
 
+std::vector<std::string> Database::DeleteExpired(const unsigned long long& cutoff_time_value,
+                                                const std::size_t& limit) {
+    return impl_->DeleteExpired(Impl::ExpiredCondition(cutoff_time_value), limit);
+}
+
+std::vector<std::string> Database::DeleteExpired(const unsigned int& device,
+                                                const unsigned long long& cutoff_time_value,
+                                                const std::size_t& limit) {
+    return impl_->DeleteExpired(Impl::ExpiredCondition(device, cutoff_time_value), limit);
+}
+
+std::vector<std::string> Database::DeleteExpiredKeep(const unsigned int& keep,
+                                                    const unsigned long long& cutoff_time_value,
+                                                    const std::size_t& limit) {
+    return impl_->DeleteExpired(Impl::ExpiredKeepCondition(keep, cutoff_time_value), limit);
+}
+
+std::vector<std::string> Database::DeleteRange(const unsigned long long& start_time_value,
+                                               const unsigned long long& end_time_value) {
+    return impl_->DeleteRange(Impl::RangeCondition(start_time_value, end_time_value));
+}
+
+std::vector<std::string> Database::DeleteRange(const unsigned int& device,
+                                               const unsigned long long& start_time_value,
+                                               const unsigned long long& end_time_value) {
+    return impl_->DeleteRange(Impl::RangeCondition(device, start_time_value, end_time_value));
+}
+
+void Database::FinalizePending(const std::string& hash) {
+    impl_->FinalizePending(hash);
+}
+
+std::vector<std::string> Database::GetDecayedDeletableHashes(
+        const unsigned long long& decay_minutes) {
+    return impl_->GetDecayedDeletableHashes(decay_minutes);
+}
+
+std::map<unsigned int, unsigned long long> Database::GetDeviceSizes() {
+    return impl_->GetDeviceSizes();
+}
+
+std::vector<std::string> Database::GetExpiredHashes(const unsigned long long& cutoff_time_value) {
+    return impl_->GetExpiredHashes(cutoff_time_value);
+}
+
+std::vector<Record> Database::GetIntents() {
+    return impl_->GetIntents();
+}
+
+std::vector<std::string> Database::GetLargestDeletableHashes() {
+    return impl_->GetLargestDeletableHashes();
+}
+
+Record Database::GetCompression(const std::string& hash) {
+    return impl_->GetCompression(hash);
+}
+
+Record Database::GetLocation(const std::string& hash) {
+    return impl_->GetLocation(hash);
+}
+
+std::vector<Record> Database::GetLowestDeletable(const unsigned int& device) {
+    return impl_->GetLowestDeletable(device);
+}
+
 std::vector<std::string> Database::GetLowestDeletableHashes() {
     return impl_->GetLowestDeletableHashes();
 }
 
+unsigned long long Database::GetMetadataSize() {
+    return impl_->GetMetadataSize();
+}
+
+std::vector<Record> Database::GetSegmentItems(const unsigned long long& segment) {
+    return impl_->GetSegmentItems(segment);
+}
+
+std::vector<unsigned long long> Database::GetSegments() {
+    return impl_->GetSegments();
+}
+
+unsigned long long Database::GetSegmentedSize() {
+    return impl_->GetSegmentedSize();
+}
+
+unsigned long long Database::GetTotalSize() {
+    return impl_->GetTotalSize();
+}
+
 std::string Database::FindHash(const unsigned long long& time_value, const unsigned int& device) {
     return impl_->FindHash(time_value, device);
 }
 
+Record Database::FindNext(const unsigned long long& time_value, const unsigned int& device) {
+    return impl_->FindNext(time_value, device);
+}
+
+Record Database::FindPrevious(const unsigned long long& time_value, const unsigned int& device) {
+    return impl_->FindPrevious(time_value, device);
+}
+
 void Database::Insert(const unsigned long long& time_value, const unsigned int& device,
                       const std::string& hash, const unsigned long long& size,
                       const unsigned int& keep) {
     impl_->Insert(time_value, device, hash, size, keep);
 }
 
+void Database::InsertCompressed(const unsigned long long& time_value, const unsigned int& device,
+                                const std::string& hash, const unsigned long long& size,
+                                const unsigned int& keep, const unsigned int& codec,
+                                const unsigned long long& raw_size) {
+    impl_->InsertCompressed(time_value, device, hash, size, keep, codec, raw_size);
+}
+
+void Database::InsertPending(const unsigned long long& time_value, const unsigned int& device,
+                             const std::string& hash, const unsigned long long& size,
+                             const unsigned int& keep) {
+    impl_->InsertPending(time_value, device, hash, size, keep);
+}
+
+void Database::InsertSegmented(const unsigned long long& time_value, const unsigned int& device,
+                               const std::string& hash, const unsigned long long& size,
+                               const unsigned int& keep, const unsigned long long& segment,
+                               const unsigned long long& offset) {
+    impl_->InsertSegmented(time_value, device, hash, size, keep, segment, offset);
+}
+
+void Database::MarkDeleting(const std::vector<std::string>& hashes) {
+    impl_->MarkDeleting(hashes);
+}
+
+std::vector<Record> Database::SelectDeletable() {
+    return impl_->SelectDeletable();
+}
+
+bool Database::MarkSynced(const std::vector<unsigned long long>& time_values,
+                          const unsigned int& device) {
+    return impl_->MarkSynced(time_values, device);
+}
+
+std::vector<Record> Database::NextUnsynced(const std::size_t& limit,
+                                           const std::vector<unsigned int>& devices) {
+    return impl_->NextUnsynced(limit, devices);
+}
+
 std::vector<Record> Database::SelectAll() {
     return impl_->SelectAll();
 }
 
+std::vector<Record> Database::SelectHashes(const std::vector<std::string>& hashes) {
+    return impl_->SelectHashes(hashes);
+}
+
+std::vector<Record> Database::SelectRange(const unsigned int& device,
+                                          const unsigned long long& start_time_value,
+                                          const unsigned long long& end_time_value) {
+    return impl_->SelectRange(device, start_time_value, end_time_value);
+}
+
 bool Database::SetKeep(const unsigned long long& time_value, const unsigned int& device,
                        const unsigned int& keep) {
     return impl_->SetKeep(time_value, device, keep);
@@ -332,5 +1561,35 @@ bool Database::BulkSetKeep(const std::vector<unsigned long long>& time_values,
     return impl_->BulkSetKeep(time_values, device, keep);
 }
 
+bool Database::SetKeepRange(const unsigned long long& start_time_value,
+                            const unsigned long long& end_time_value, const unsigned int& keep) {
+    return impl_->SetKeepRange(Impl::RangeCondition(start_time_value, end_time_value), keep);
+}
+
+bool Database::SetKeepRange(const unsigned int& device, const unsigned long long& start_time_value,
+                            const unsigned long long& end_time_value, const unsigned int& keep) {
+    return impl_->SetKeepRange(Impl::RangeCondition(device, start_time_value, end_time_value),
+                               keep);
+}
+
+void Database::SetTracer(const std::shared_ptr<Tracer>& tracer) {
+    impl_->SetTracer(tracer);
+}
+
+void Database::InsertAsync(const unsigned long long& time_value, const unsigned int& device,
+                           const std::string& hash, const unsigned long long& size,
+                           const unsigned int& keep, const CommitCallback& callback) {
+    impl_->InsertAsync(time_value, device, hash, size, keep, callback);
+}
+
+void Database::SetKeepAsync(const unsigned long long& time_value, const unsigned int& device,
+                            const unsigned int& keep, const CommitCallback& callback) {
+    impl_->SetKeepAsync(time_value, device, keep, callback);
+}
+
+void Database::Flush() {
+    impl_->Flush();
+}
+
 } // namespace indexed
 } // namespace prism
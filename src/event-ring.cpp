@@ -0,0 +1,106 @@
+#include "indexed/event-ring.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace prism {
+namespace indexed {
+
+class EventRing::Impl {
+  public:
+    Impl(const std::size_t& capacity);
+
+    bool Push(const Event& event);
+    bool Pop(Event& event);
+    bool Empty() const;
+    void Drop(const uint64_t& count);
+    uint64_t TakeDropped();
+
+  private:
+    static std::size_t roundUp(const std::size_t& capacity);
+
+    // Head is only written by the consumer and tail by the producer. Each publishes its slot
+    // with a release store that the other side reads with acquire.
+    std::vector<Event> slots_;
+    std::size_t mask_;
+    std::atomic<std::size_t> head_;
+    std::atomic<std::size_t> tail_;
+    std::atomic<uint64_t> dropped_;
+};
+
+EventRing::Impl::Impl(const std::size_t& capacity)
+        : slots_(roundUp(capacity)), mask_{slots_.size() - 1}, head_{0}, tail_{0}, dropped_{0} {}
+
+bool EventRing::Impl::Push(const Event& event) {
+    const auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    slots_[tail & mask_] = event;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool EventRing::Impl::Pop(Event& event) {
+    const auto head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    event = slots_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool EventRing::Impl::Empty() const {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+}
+
+void EventRing::Impl::Drop(const uint64_t& count) {
+    dropped_.fetch_add(count, std::memory_order_relaxed);
+}
+
+uint64_t EventRing::Impl::TakeDropped() {
+    return dropped_.exchange(0, std::memory_order_relaxed);
+}
+
+std::size_t EventRing::Impl::roundUp(const std::size_t& capacity) {
+    std::size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    return size;
+}
+
+
+// Bridge
+
+EventRing::EventRing(const std::size_t& capacity) : impl_{new Impl{capacity}} {}
+
+EventRing::~EventRing() {}
+
+bool EventRing::Push(const Event& event) {
+    return impl_->Push(event);
+}
+
+bool EventRing::Pop(Event& event) {
+    return impl_->Pop(event);
+}
+
+bool EventRing::Empty() const {
+    return impl_->Empty();
+}
+
+void EventRing::Drop(const uint64_t& count) {
+    impl_->Drop(count);
+}
+
+uint64_t EventRing::TakeDropped() {
+    return impl_->TakeDropped();
+}
+
+} // namespace indexed
+} // namespace prism
@@ -0,0 +1,44 @@
+#include "indexed/eviction-policy.h"
+
+#include <chrono>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "indexed/chrono-snap.h"
+
+
+namespace prism {
+namespace indexed {
+
+std::vector<std::string> OldestFirstPolicy::Victims(Index& index) {
+    return index.GetLowestDeletableHashes();
+}
+
+std::vector<std::string> LargestFirstPolicy::Victims(Index& index) {
+    return index.GetLargestDeletableHashes();
+}
+
+TimeToLivePolicy::TimeToLivePolicy(const std::chrono::minutes& time_to_live)
+        : time_to_live_(time_to_live) {}
+
+std::vector<std::string> TimeToLivePolicy::Victims(Index& index) {
+    const auto cutoff = utility::SnapToMinute(std::chrono::system_clock::now() - time_to_live_);
+    auto hashes = index.GetExpiredHashes(cutoff);
+    const std::unordered_set<std::string> expired(hashes.begin(), hashes.end());
+    for (auto& hash : index.GetLowestDeletableHashes()) {
+        if (!expired.count(hash)) {
+            hashes.push_back(hash);
+        }
+    }
+    return hashes;
+}
+
+DecayedPriorityPolicy::DecayedPriorityPolicy(const std::chrono::minutes& decay) : decay_(decay) {}
+
+std::vector<std::string> DecayedPriorityPolicy::Victims(Index& index) {
+    return index.GetDecayedDeletableHashes(decay_.count());
+}
+
+} // namespace indexed
+} // namespace prism
@@ -1,9 +1,22 @@
 #include "indexed/filesystem.h"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <boost/filesystem.hpp>
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "indexed/io-engine.h"
 
 
 namespace prism {
@@ -14,27 +27,54 @@ namespace fs = ::boost::filesystem;
 class Filesystem::Impl {
   public:
     Impl(const std::string& buffer_directory, const std::string& buffer_parent,
-         const double& gigabyte_quota);
+         const double& gigabyte_quota, const bool& scan_size);
 
-    bool AboveQuota();
+    void AddSize(const uintmax_t& bytes);
+    bool AboveQuota(const uintmax_t& releasing_bytes);
     bool Delete(const std::string& filename);
+    std::size_t BulkDelete(const std::vector<std::string>& filenames);
     std::string GetBufferDirectory() const;
     std::string GetExistingFilepath(const std::string& filename) const;
     std::string GetFilepath(const std::string& filename) const;
+    uintmax_t GetFileSize(const std::string& filename) const;
+    uintmax_t GetSize() const;
+    void SetSize(const uintmax_t& size);
+    void SetTracer(const std::shared_ptr<Tracer>& tracer);
+    bool VerifySize(const std::atomic<bool>& cancel);
     bool Move(const std::string& filepath_move_from, const std::string& filename_move_to);
+    bool Link(const std::string& filename_link_from, const std::string& filename_link_to);
+    FileListing Scan(const std::chrono::steady_clock::time_point& deadline,
+                     const unsigned int& threads) const;
+    void ShareSize(std::atomic<uintmax_t>& size);
 
   private:
-    uintmax_t getSize() const;
+    uintmax_t getSize(const std::atomic<bool>* cancel = nullptr) const;
+    IoEngine& ioEngine();
+    void removeEmptyParents(const std::string& filename) const;
+    bool scanDirectory(const fs::path& directory,
+                       const std::chrono::steady_clock::time_point& deadline,
+                       std::vector<std::pair<std::string, uintmax_t>>& files) const;
+    std::string relativeName(const fs::path& filepath) const;
+    void subtractSize(const uintmax_t& bytes);
+    bool within(const fs::path& directory) const;
 
     fs::path buffer_path_;
+    fs::path canonical_buffer_path_;
     double byte_quota_;
-    uintmax_t size_;
+    bool scan_size_;
+    // Points at own_size_ unless the size is shared
+    std::atomic<uintmax_t> own_size_;
+    std::atomic<uintmax_t>* size_;
     std::chrono::system_clock::time_point last_size_update_;
+    std::shared_ptr<Tracer> tracer_;
+    std::once_flag io_engine_flag_;
+    std::unique_ptr<IoEngine> io_engine_;
 };
 
 Filesystem::Impl::Impl(const std::string& buffer_directory, const std::string& buffer_parent,
-                       const double& gigabyte_quota)
-        : byte_quota_(gigabyte_quota * 1024 * 1024 * 1024) {
+                       const double& gigabyte_quota, const bool& scan_size)
+        : byte_quota_(gigabyte_quota * 1024 * 1024 * 1024), scan_size_(scan_size), own_size_(0),
+          size_(&own_size_) {
     auto parent_path = buffer_parent.empty() ? fs::temp_directory_path() : fs::path{buffer_parent};
     if (buffer_directory.empty()) {
         throw FilesystemException{"Cannot initialize indexed Filesystem with an empty buffer path"};
@@ -45,48 +85,97 @@ Filesystem::Impl::Impl(const std::string& buffer_directory, const std::string& b
         throw FilesystemException{"Filesystem must be initialized within a valid parent directory"};
     }
     fs::create_directory(buffer_path_);
-    size_ = getSize();
+    canonical_buffer_path_ = fs::canonical(buffer_path_);
+    if (scan_size_) {
+        *size_ = getSize();
+    }
     last_size_update_ = std::chrono::system_clock::now();
 }
 
-bool Filesystem::Impl::AboveQuota() {
+void Filesystem::Impl::AddSize(const uintmax_t& bytes) {
+    *size_ += bytes;
+}
+
+bool Filesystem::Impl::AboveQuota(const uintmax_t& releasing_bytes) {
     auto now = std::chrono::system_clock::now();
-    if (now - last_size_update_ > std::chrono::minutes(10)) {
-        size_ = getSize();
+    if (scan_size_ && now - last_size_update_ > std::chrono::minutes(10)) {
+        *size_ = getSize();
         last_size_update_ = now;
     }
     auto space_info = fs::space(buffer_path_);
-    auto fraction_space_available = space_info.available / static_cast<double>(space_info.capacity);
+    auto fraction_space_available =
+            (space_info.available + releasing_bytes) / static_cast<double>(space_info.capacity);
 
-    return size_ > byte_quota_ || fraction_space_available < 0.1;
+    const uintmax_t size = *size_;
+    return size - std::min(size, releasing_bytes) > byte_quota_ || fraction_space_available < 0.1;
 }
 
 bool Filesystem::Impl::Delete(const std::string& filename) {
-    auto filepath = buffer_path_ / filename;
-
-    if (fs::is_directory(filepath)) {
+    PRISM_INDEXED_TRACE_SPAN(tracer_, "Filesystem::Delete");
+    // One stat and one unlink for a file at the top of the buffer. Emptied parent directories
+    // are removed by rmdir alone, which fails once it reaches a directory still holding anything.
+    // A file with other names left keeps its bytes, so only the last name frees them.
+    const auto filepath = buffer_path_ / filename;
+#ifndef _WIN32
+    struct stat status;
+    if (::stat(filepath.c_str(), &status) != 0 || S_ISDIR(status.st_mode)) {
         return false;
     }
-
-    if (!fs::exists(filepath)) {
+    if (::unlink(filepath.c_str()) != 0) {
         return false;
     }
-
-    auto removed_size = fs::file_size(filepath);
-    auto success = fs::remove(filepath);
-    if (!success) {
+    const uintmax_t links = status.st_nlink;
+    const uintmax_t removed_size = status.st_size;
+#else
+    boost::system::error_code error_code;
+    if (!fs::is_regular_file(filepath, error_code)) {
+        return false;
+    }
+    const auto removed_size = fs::file_size(filepath, error_code);
+    const auto links = fs::hard_link_count(filepath, error_code);
+    if (error_code || !fs::remove(filepath, error_code)) {
         return false;
     }
-    size_ -= removed_size;
+#endif
+    if (links <= 1) {
+        subtractSize(removed_size);
+    }
+    removeEmptyParents(filename);
 
-    auto parent_directory = fs::canonical(filepath.parent_path());
-    const auto canonical_buffer_path = fs::canonical(buffer_path_);
-    while (fs::is_empty(parent_directory) && parent_directory > canonical_buffer_path) {
-        fs::remove(parent_directory);
-        parent_directory = fs::canonical(parent_directory.parent_path());
+    return true;
+}
+
+std::size_t Filesystem::Impl::BulkDelete(const std::vector<std::string>& filenames) {
+    PRISM_INDEXED_TRACE_SPAN(tracer_, "Filesystem::BulkDelete");
+    // Every file is statted in one batch and the regular files unlinked in a second
+    std::vector<IoRequest> requests;
+    requests.reserve(filenames.size());
+    for (const auto& filename : filenames) {
+        requests.push_back(IoRequest{IoOperation::Stat, (buffer_path_ / filename).string(), ""});
+    }
+    const auto statuses = ioEngine().Submit(requests);
+
+    std::vector<std::size_t> indices;
+    std::vector<IoRequest> unlinks;
+    for (std::size_t i = 0; i < filenames.size(); ++i) {
+        if (statuses[i].error == 0 && !statuses[i].directory) {
+            indices.push_back(i);
+            unlinks.push_back(IoRequest{IoOperation::Unlink, requests[i].path, ""});
+        }
     }
+    const auto unlinked = ioEngine().Submit(unlinks);
 
-    return success;
+    std::size_t deleted = 0;
+    for (std::size_t i = 0; i < unlinked.size(); ++i) {
+        if (unlinked[i].error == 0) {
+            if (statuses[indices[i]].links <= 1) {
+                subtractSize(statuses[indices[i]].size);
+            }
+            removeEmptyParents(filenames[indices[i]]);
+            ++deleted;
+        }
+    }
+    return deleted;
 }
 
 std::string Filesystem::Impl::GetBufferDirectory() const {
@@ -106,8 +195,51 @@ std::string Filesystem::Impl::GetFilepath(const std::string& filename) const {
     return (buffer_path_ / filename).string();
 }
 
+uintmax_t Filesystem::Impl::GetFileSize(const std::string& filename) const {
+#ifndef _WIN32
+    struct stat status;
+    if (::stat((buffer_path_ / filename).c_str(), &status) != 0 || S_ISDIR(status.st_mode)) {
+        return 0;
+    }
+    return status.st_size;
+#else
+    boost::system::error_code error_code;
+    const auto size = fs::file_size(buffer_path_ / filename, error_code);
+    return error_code ? 0 : size;
+#endif
+}
+
+uintmax_t Filesystem::Impl::GetSize() const {
+    return *size_;
+}
+
+void Filesystem::Impl::SetSize(const uintmax_t& size) {
+    *size_ = size;
+}
+
+void Filesystem::Impl::SetTracer(const std::shared_ptr<Tracer>& tracer) {
+    tracer_ = tracer;
+}
+
+bool Filesystem::Impl::VerifySize(const std::atomic<bool>& cancel) {
+    // Anything moved in or deleted while the walk runs is carried over on top of the walked total
+    const uintmax_t size_before = *size_;
+    const auto walked_size = getSize(&cancel);
+    if (cancel) {
+        return false;
+    }
+    const uintmax_t size_after = *size_;
+    if (size_after >= size_before) {
+        *size_ = walked_size + (size_after - size_before);
+    } else {
+        *size_ = walked_size - std::min(walked_size, size_before - size_after);
+    }
+    return true;
+}
+
 bool Filesystem::Impl::Move(const std::string& filepath_move_from,
                             const std::string& filename_move_to) {
+    PRISM_INDEXED_TRACE_SPAN(tracer_, "Filesystem::Move");
     auto filepath = buffer_path_ / filename_move_to;
     if (fs::is_directory(filepath)) {
         return false;
@@ -123,23 +255,188 @@ bool Filesystem::Impl::Move(const std::string& filepath_move_from,
             fs::copy_file(filepath_move_from, filepath);
             fs::remove(filepath_move_from);
         }
-        size_ += fs::file_size(filepath);
+        *size_ += fs::file_size(filepath);
         return true;
     }
     return false;
 }
 
-uintmax_t Filesystem::Impl::getSize() const {
-    uintmax_t size = 0;
+bool Filesystem::Impl::Link(const std::string& filename_link_from,
+                            const std::string& filename_link_to) {
+    PRISM_INDEXED_TRACE_SPAN(tracer_, "Filesystem::Link");
+    const auto filepath = buffer_path_ / filename_link_to;
+    const auto parent_directory = filepath.parent_path();
+    if (!fs::exists(parent_directory)) {
+        fs::create_directories(parent_directory);
+    }
+    boost::system::error_code error_code;
+    fs::create_hard_link(buffer_path_ / filename_link_from, filepath, error_code);
+    return !error_code;
+}
+
+void Filesystem::Impl::ShareSize(std::atomic<uintmax_t>& size) {
+    size_ = &size;
+}
+
+FileListing Filesystem::Impl::Scan(const std::chrono::steady_clock::time_point& deadline,
+                                   const unsigned int& threads) const {
+    FileListing listing;
+    listing.complete = true;
+
+    // Top level files are listed here, and each top level directory is walked by one of the
+    // worker threads
+    std::vector<fs::path> directories;
+    for (fs::directory_iterator it(buffer_path_), end; it != end; ++it) {
+        try {
+            if (fs::is_directory(it->status())) {
+                directories.push_back(it->path());
+            } else {
+                listing.files.emplace_back(relativeName(it->path()), fs::file_size(it->path()));
+            }
+        } catch (const std::exception& e) {
+        }
+    }
+
+    const auto worker_count =
+            std::max(1U, std::min(threads, static_cast<unsigned int>(directories.size())));
+    std::vector<std::vector<std::pair<std::string, uintmax_t>>> results(worker_count);
+    std::atomic<std::size_t> next_directory{0};
+    std::atomic<bool> complete{true};
+    auto worker = [&](const unsigned int& index) {
+        std::size_t i;
+        while ((i = next_directory++) < directories.size()) {
+            if (!scanDirectory(directories[i], deadline, results[index])) {
+                complete = false;
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < worker_count; ++i) {
+        workers.emplace_back(worker, i);
+    }
+    worker(0);
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    for (auto& result : results) {
+        listing.files.insert(listing.files.end(), result.begin(), result.end());
+    }
+    listing.complete = complete;
+
+    return listing;
+}
+
+bool Filesystem::Impl::scanDirectory(const fs::path& directory,
+                                     const std::chrono::steady_clock::time_point& deadline,
+                                     std::vector<std::pair<std::string, uintmax_t>>& files) const {
+    std::size_t visited = 0;
     const auto end = fs::recursive_directory_iterator();
-    for (fs::recursive_directory_iterator it(buffer_path_); it != end;) {
+    for (fs::recursive_directory_iterator it(directory); it != end;) {
+        if (++visited % 256 == 0 && std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+
         try {
-            if (!fs::is_directory(*it)) {
-                size += fs::file_size(*it);
+            if (!fs::is_directory(it->status())) {
+                files.emplace_back(relativeName(it->path()), fs::file_size(it->path()));
             }
         } catch (const std::exception& e) {
         }
 
+        try {
+            ++it;
+        } catch (const std::exception& e) {
+            it.no_push();
+            ++it;
+        }
+    }
+
+    return true;
+}
+
+std::string Filesystem::Impl::relativeName(const fs::path& filepath) const {
+    const auto prefix_length = buffer_path_.generic_string().size() + 1;
+    return filepath.generic_string().substr(prefix_length);
+}
+
+IoEngine& Filesystem::Impl::ioEngine() {
+    // Made on first use, so a Filesystem that never deletes in bulk starts no threads
+    static const unsigned int io_threads = 8;
+    std::call_once(io_engine_flag_, [this]() { io_engine_ = IoEngine::Make(io_threads); });
+    return *io_engine_;
+}
+
+void Filesystem::Impl::removeEmptyParents(const std::string& filename) const {
+    // Only directories inside the buffer go, and a removal fails once it reaches a directory
+    // still holding anything. Files at the top of the buffer have none to check.
+    if (fs::path{filename}.parent_path().empty()) {
+        return;
+    }
+    boost::system::error_code error_code;
+    auto parent_directory = fs::canonical((buffer_path_ / filename).parent_path(), error_code);
+    while (!error_code && within(parent_directory) && fs::remove(parent_directory, error_code)) {
+        parent_directory = parent_directory.parent_path();
+    }
+}
+
+bool Filesystem::Impl::within(const fs::path& directory) const {
+    // Compared by component, as a sibling directory sharing the buffer's name as a prefix is not
+    // inside it
+    auto it = directory.begin();
+    for (const auto& component : canonical_buffer_path_) {
+        if (it == directory.end() || *it != component) {
+            return false;
+        }
+        ++it;
+    }
+    return it != directory.end();
+}
+
+void Filesystem::Impl::subtractSize(const uintmax_t& bytes) {
+    // Files that were never counted, such as orphans found after a lazy start, must not wrap the
+    // total around
+    auto size = size_->load();
+    while (!size_->compare_exchange_weak(size, size - std::min(size, bytes))) {
+    }
+}
+
+uintmax_t Filesystem::Impl::getSize(const std::atomic<bool>* cancel) const {
+    // A file with several names is counted once, under whichever name is reached first. Without
+    // inode numbers each name counts its share of the bytes instead, summed before rounding.
+    uintmax_t size = 0;
+#ifndef _WIN32
+    std::unordered_set<ino_t> linked_inodes;
+#else
+    double linked_size = 0;
+#endif
+    const auto end = fs::recursive_directory_iterator();
+    for (fs::recursive_directory_iterator it(buffer_path_); it != end;) {
+        if (cancel && *cancel) {
+            return size;
+        }
+
+#ifndef _WIN32
+        struct stat status;
+        if (::stat(it->path().c_str(), &status) == 0 && !S_ISDIR(status.st_mode) &&
+                (status.st_nlink <= 1 || linked_inodes.insert(status.st_ino).second)) {
+            size += status.st_size;
+        }
+#else
+        boost::system::error_code error_code;
+        if (fs::is_regular_file(it->path(), error_code)) {
+            const auto file_size = fs::file_size(it->path(), error_code);
+            const auto links = fs::hard_link_count(it->path(), error_code);
+            if (!error_code && links <= 1) {
+                size += file_size;
+            } else if (!error_code) {
+                linked_size += static_cast<double>(file_size) / links;
+            }
+        }
+#endif
+
         // Increment to the next iterator
         try {
             ++it;
@@ -149,6 +446,9 @@ uintmax_t Filesystem::Impl::getSize() const {
         }
     }
 
+#ifdef _WIN32
+    size += static_cast<uintmax_t>(linked_size + 0.5);
+#endif
     return size;
 }
 
@@ -156,19 +456,31 @@ uintmax_t Filesystem::Impl::getSize() const {
 // Bridge
 
 Filesystem::Filesystem(const std::string& buffer_directory, const std::string& buffer_parent,
-                       const double& gigabyte_quota)
-        : impl_{new Impl{buffer_directory, buffer_parent, gigabyte_quota}} {}
+                       const double& gigabyte_quota, const bool& scan_size)
+        : impl_{new Impl{buffer_directory, buffer_parent, gigabyte_quota, scan_size}} {}
 
 Filesystem::~Filesystem() {}
 
+void Filesystem::AddSize(const uintmax_t& bytes) {
+    impl_->AddSize(bytes);
+}
+
 bool Filesystem::AboveQuota() {
-    return impl_->AboveQuota();
+    return impl_->AboveQuota(0);
+}
+
+bool Filesystem::AboveQuota(const uintmax_t& releasing_bytes) {
+    return impl_->AboveQuota(releasing_bytes);
 }
 
 bool Filesystem::Delete(const std::string& filename) {
     return impl_->Delete(filename);
 }
 
+std::size_t Filesystem::BulkDelete(const std::vector<std::string>& filenames) {
+    return impl_->BulkDelete(filenames);
+}
+
 std::string Filesystem::GetBufferDirectory() const {
     return impl_->GetBufferDirectory();
 }
@@ -181,9 +493,42 @@ std::string Filesystem::GetFilepath(const std::string& filename) const {
     return impl_->GetFilepath(filename);
 }
 
+uintmax_t Filesystem::GetFileSize(const std::string& filename) const {
+    return impl_->GetFileSize(filename);
+}
+
+uintmax_t Filesystem::GetSize() const {
+    return impl_->GetSize();
+}
+
+void Filesystem::SetSize(const uintmax_t& size) {
+    impl_->SetSize(size);
+}
+
+void Filesystem::SetTracer(const std::shared_ptr<Tracer>& tracer) {
+    impl_->SetTracer(tracer);
+}
+
+bool Filesystem::VerifySize(const std::atomic<bool>& cancel) {
+    return impl_->VerifySize(cancel);
+}
+
 bool Filesystem::Move(const std::string& filepath_move_from, const std::string& filename_move_to) {
     return impl_->Move(filepath_move_from, filename_move_to);
 }
 
+bool Filesystem::Link(const std::string& filename_link_from, const std::string& filename_link_to) {
+    return impl_->Link(filename_link_from, filename_link_to);
+}
+
+FileListing Filesystem::Scan(const std::chrono::steady_clock::time_point& deadline,
+                             const unsigned int& threads) const {
+    return impl_->Scan(deadline, threads);
+}
+
+void Filesystem::ShareSize(std::atomic<uintmax_t>& size) {
+    impl_->ShareSize(size);
+}
+
 } // namespace indexed
 } // namespace prism
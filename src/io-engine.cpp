@@ -0,0 +1,392 @@
+#include "indexed/io-engine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef PRISM_INDEXED_IO_URING
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "indexed/storage.h"
+
+
+namespace prism {
+namespace indexed {
+
+namespace {
+
+namespace fs = ::boost::filesystem;
+
+#ifdef _WIN32
+IoResult run(const IoRequest& request) {
+    IoResult result{0, 0, 0, false};
+    boost::system::error_code error_code;
+    switch (request.operation) {
+        case IoOperation::Stat: {
+            const auto status = fs::status(request.path, error_code);
+            if (!error_code && !fs::exists(status)) {
+                result.error = ENOENT;
+                break;
+            }
+            result.directory = fs::is_directory(status);
+            if (!error_code && !result.directory) {
+                result.size = fs::file_size(request.path, error_code);
+                result.links = fs::hard_link_count(request.path, error_code);
+            }
+            break;
+        }
+        case IoOperation::Unlink:
+            // Unlike unlink, remove would also take an empty directory
+            if (fs::is_directory(request.path, error_code)) {
+                result.error = EISDIR;
+            } else if (!error_code && !fs::remove(request.path, error_code) && !error_code) {
+                result.error = ENOENT;
+            }
+            break;
+        case IoOperation::Rename:
+            fs::rename(request.path, request.target, error_code);
+            break;
+    }
+    if (error_code) {
+        result.error = error_code.value();
+    }
+    return result;
+}
+#else
+IoResult run(const IoRequest& request) {
+    IoResult result{0, 0, 0, false};
+    switch (request.operation) {
+        case IoOperation::Stat: {
+            struct stat status;
+            if (::stat(request.path.c_str(), &status) != 0) {
+                result.error = errno;
+                break;
+            }
+            result.size = status.st_size;
+            result.links = status.st_nlink;
+            result.directory = S_ISDIR(status.st_mode);
+            break;
+        }
+        case IoOperation::Unlink:
+            if (::unlink(request.path.c_str()) != 0) {
+                result.error = errno;
+            }
+            break;
+        case IoOperation::Rename:
+            if (::rename(request.path.c_str(), request.target.c_str()) != 0) {
+                result.error = errno;
+            }
+            break;
+    }
+    return result;
+}
+#endif
+
+} // namespace
+
+class ThreadPoolIoEngine::Impl {
+  public:
+    Impl(const unsigned int& threads);
+    ~Impl();
+
+    std::vector<IoResult> Submit(const std::vector<IoRequest>& requests);
+
+  private:
+    struct Batch {
+        const std::vector<IoRequest>& requests;
+        std::vector<IoResult> results;
+        std::size_t remaining;
+    };
+
+    void work();
+
+    std::mutex mutex_;
+    std::condition_variable work_condition_;
+    std::condition_variable done_condition_;
+    std::deque<std::pair<Batch*, std::size_t>> queue_;
+    bool stopping_;
+    std::vector<std::thread> workers_;
+};
+
+ThreadPoolIoEngine::Impl::Impl(const unsigned int& threads) : stopping_{false} {
+    for (unsigned int i = 0; i < std::max(1U, threads); ++i) {
+        workers_.emplace_back(&ThreadPoolIoEngine::Impl::work, this);
+    }
+}
+
+ThreadPoolIoEngine::Impl::~Impl() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_condition_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+std::vector<IoResult> ThreadPoolIoEngine::Impl::Submit(const std::vector<IoRequest>& requests) {
+    Batch batch{requests, std::vector<IoResult>(requests.size()), requests.size()};
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (std::size_t i = 0; i < requests.size(); ++i) {
+        queue_.emplace_back(&batch, i);
+    }
+    work_condition_.notify_all();
+    done_condition_.wait(lock, [&batch]() { return batch.remaining == 0; });
+    return std::move(batch.results);
+}
+
+void ThreadPoolIoEngine::Impl::work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_condition_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+
+        auto item = queue_.front();
+        queue_.pop_front();
+        lock.unlock();
+        auto result = run(item.first->requests[item.second]);
+        lock.lock();
+        item.first->results[item.second] = result;
+        if (--item.first->remaining == 0) {
+            done_condition_.notify_all();
+        }
+    }
+}
+
+#ifdef PRISM_INDEXED_IO_URING
+class UringIoEngine::Impl {
+  public:
+    Impl(const unsigned int& queue_depth);
+    ~Impl();
+
+    std::vector<IoResult> Submit(const std::vector<IoRequest>& requests);
+
+  private:
+    void release();
+    void submitChunk(const std::vector<IoRequest>& requests, const std::size_t& begin,
+                     const std::size_t& end, std::vector<IoResult>& results);
+
+    int fd_;
+    unsigned int entries_;
+    void* sq_ring_;
+    std::size_t sq_ring_size_;
+    void* cq_ring_;
+    std::size_t cq_ring_size_;
+    io_uring_sqe* sqes_;
+    std::size_t sqes_size_;
+    unsigned int* sq_tail_;
+    unsigned int* sq_mask_;
+    unsigned int* sq_array_;
+    unsigned int* cq_head_;
+    unsigned int* cq_tail_;
+    unsigned int* cq_mask_;
+    io_uring_cqe* cqes_;
+    std::mutex mutex_;
+};
+
+UringIoEngine::Impl::Impl(const unsigned int& queue_depth)
+        : sq_ring_{MAP_FAILED}, cq_ring_{MAP_FAILED}, sqes_{nullptr} {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd_ = syscall(__NR_io_uring_setup, queue_depth, &params);
+    if (fd_ < 0) {
+        throw FilesystemException{"Cannot set up an io_uring instance"};
+    }
+    entries_ = params.sq_entries;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd_, IORING_OFF_SQ_RING);
+    cq_ring_ = single_mmap ? sq_ring_
+                           : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    auto sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                     IORING_OFF_SQES);
+    if (sqes != MAP_FAILED) {
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+    }
+    if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || !sqes_) {
+        release();
+        throw FilesystemException{"Cannot map the io_uring rings"};
+    }
+
+    auto sq_ring = static_cast<char*>(sq_ring_);
+    auto cq_ring = static_cast<char*>(cq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned int*>(sq_ring + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned int*>(cq_ring + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned int*>(cq_ring + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned int*>(cq_ring + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ring + params.cq_off.cqes);
+
+    // Kernels before 5.11 set up a ring but reject unlinkat and renameat, so every operation is
+    // checked up front rather than failing request by request later
+    static const unsigned int probe_ops = 256;
+    std::vector<char> probe_buffer(sizeof(io_uring_probe) + probe_ops * sizeof(io_uring_probe_op));
+    auto probe = reinterpret_cast<io_uring_probe*>(probe_buffer.data());
+    if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, probe_ops) < 0) {
+        release();
+        throw FilesystemException{"Cannot probe the io_uring operations"};
+    }
+    for (const unsigned int op : {IORING_OP_STATX, IORING_OP_UNLINKAT, IORING_OP_RENAMEAT}) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            release();
+            throw FilesystemException{"io_uring lacks statx, unlinkat or renameat"};
+        }
+    }
+}
+
+UringIoEngine::Impl::~Impl() {
+    release();
+}
+
+std::vector<IoResult> UringIoEngine::Impl::Submit(const std::vector<IoRequest>& requests) {
+    std::vector<IoResult> results(requests.size(), IoResult{0, 0, 0, false});
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::size_t begin = 0; begin < requests.size(); begin += entries_) {
+        submitChunk(requests, begin, std::min<std::size_t>(requests.size(), begin + entries_),
+                    results);
+    }
+    return results;
+}
+
+void UringIoEngine::Impl::release() {
+    if (sqes_) {
+        munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+        munmap(sq_ring_, sq_ring_size_);
+    }
+    close(fd_);
+}
+
+void UringIoEngine::Impl::submitChunk(const std::vector<IoRequest>& requests,
+                                      const std::size_t& begin, const std::size_t& end,
+                                      std::vector<IoResult>& results) {
+    std::vector<struct statx> statuses(end - begin);
+    auto tail = *sq_tail_;
+    for (auto i = begin; i < end; ++i) {
+        const auto index = tail & *sq_mask_;
+        auto sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uintptr_t>(requests[i].path.c_str());
+        sqe->user_data = i;
+        switch (requests[i].operation) {
+            case IoOperation::Stat:
+                sqe->opcode = IORING_OP_STATX;
+                sqe->len = STATX_TYPE | STATX_SIZE | STATX_NLINK;
+                sqe->off = reinterpret_cast<uintptr_t>(&statuses[i - begin]);
+                break;
+            case IoOperation::Unlink:
+                sqe->opcode = IORING_OP_UNLINKAT;
+                break;
+            case IoOperation::Rename:
+                sqe->opcode = IORING_OP_RENAMEAT;
+                sqe->len = static_cast<uint32_t>(AT_FDCWD);
+                sqe->off = reinterpret_cast<uintptr_t>(requests[i].target.c_str());
+                break;
+        }
+        sq_array_[index] = index;
+        ++tail;
+    }
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+
+    auto to_submit = static_cast<unsigned int>(end - begin);
+    std::size_t completed = 0;
+    while (completed < end - begin) {
+        auto entered = syscall(__NR_io_uring_enter, fd_, to_submit, 1, IORING_ENTER_GETEVENTS,
+                               nullptr, 0);
+        if (entered < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            throw FilesystemException{"Cannot submit to io_uring: " +
+                                      std::string{std::strerror(errno)}};
+        }
+        to_submit -= std::min<unsigned int>(to_submit, entered);
+
+        auto head = *cq_head_;
+        const auto cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != cq_tail; ++head) {
+            const auto& cqe = cqes_[head & *cq_mask_];
+            auto& result = results[cqe.user_data];
+            if (cqe.res < 0) {
+                result.error = -cqe.res;
+            } else if (requests[cqe.user_data].operation == IoOperation::Stat) {
+                const auto& status = statuses[cqe.user_data - begin];
+                result.size = status.stx_size;
+                result.links = status.stx_nlink;
+                result.directory = S_ISDIR(status.stx_mode);
+            }
+            ++completed;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+}
+#endif
+
+std::unique_ptr<IoEngine> IoEngine::Make(const unsigned int& threads) {
+#ifdef PRISM_INDEXED_IO_URING
+    try {
+        return std::unique_ptr<IoEngine>{new UringIoEngine{}};
+    } catch (const FilesystemException& e) {
+    }
+#endif
+    return std::unique_ptr<IoEngine>{new ThreadPoolIoEngine{threads}};
+}
+
+// Bridge
+
+ThreadPoolIoEngine::ThreadPoolIoEngine(const unsigned int& threads)
+        : impl_{new Impl{threads}} {}
+
+ThreadPoolIoEngine::~ThreadPoolIoEngine() {}
+
+std::vector<IoResult> ThreadPoolIoEngine::Submit(const std::vector<IoRequest>& requests) {
+    return impl_->Submit(requests);
+}
+
+#ifdef PRISM_INDEXED_IO_URING
+UringIoEngine::UringIoEngine(const unsigned int& queue_depth)
+        : impl_{new Impl{queue_depth}} {}
+
+UringIoEngine::~UringIoEngine() {}
+
+std::vector<IoResult> UringIoEngine::Submit(const std::vector<IoRequest>& requests) {
+    return impl_->Submit(requests);
+}
+#endif
+
+} // namespace indexed
+} // namespace prism
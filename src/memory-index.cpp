@@ -0,0 +1,1665 @@
+#include "indexed/memory-index.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+
+namespace prism {
+namespace indexed {
+
+namespace fs = ::boost::filesystem;
+
+namespace {
+
+// The snapshot and journal are written through raw descriptors, so appends reach the file without
+// a stream buffer in between
+#ifdef _WIN32
+int openFile(const std::string& filepath, const bool& append) {
+    return append ? ::_open(filepath.data(), _O_WRONLY | _O_APPEND | _O_BINARY)
+                  : ::_open(filepath.data(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+                            _S_IREAD | _S_IWRITE);
+}
+
+long long writeSome(const int& fd, const char* data, const std::size_t& length) {
+    return ::_write(fd, data, static_cast<unsigned int>(length));
+}
+
+bool syncFile(const int& fd) {
+    return ::_commit(fd) == 0;
+}
+
+void closeFile(const int& fd) {
+    ::_close(fd);
+}
+#else
+int openFile(const std::string& filepath, const bool& append) {
+    return append ? ::open(filepath.data(), O_WRONLY | O_APPEND)
+                  : ::open(filepath.data(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+long long writeSome(const int& fd, const char* data, const std::size_t& length) {
+    return ::write(fd, data, length);
+}
+
+bool syncFile(const int& fd) {
+    return ::fsync(fd) == 0;
+}
+
+void closeFile(const int& fd) {
+    ::close(fd);
+}
+#endif
+
+} // namespace
+
+class MemoryIndex::Impl {
+  public:
+    Impl(const std::string& path, const std::size_t& compact_records);
+    ~Impl();
+
+    void ClearIntents(const std::vector<std::string>& hashes);
+    void CompactSegment(const std::vector<std::string>& evicted_hashes,
+                        const std::vector<Record>& relocations);
+    void Delete(const std::string& hash);
+    void BulkDelete(const std::vector<std::string>& hashes);
+    std::vector<std::string> DeleteRange(const bool& all_devices, const unsigned int& device,
+                                         const unsigned long long& start_time_value,
+                                         const unsigned long long& end_time_value);
+    std::vector<std::string> DeleteExpired(const bool& all_devices, const unsigned int& device,
+                                           const unsigned long long& cutoff_time_value,
+                                           const std::size_t& limit);
+    std::vector<std::string> DeleteExpiredKeep(const unsigned int& keep,
+                                               const unsigned long long& cutoff_time_value,
+                                               const std::size_t& limit);
+    void FinalizePending(const std::string& hash);
+    Record GetCompression(const std::string& hash);
+    std::vector<std::string> GetDecayedDeletableHashes(const unsigned long long& decay_minutes);
+    std::map<unsigned int, unsigned long long> GetDeviceSizes();
+    std::vector<std::string> GetExpiredHashes(const unsigned long long& cutoff_time_value);
+    std::vector<Record> GetIntents();
+    std::vector<std::string> GetLargestDeletableHashes();
+    Record GetLocation(const std::string& hash);
+    std::vector<Record> GetLowestDeletable(const unsigned int& device);
+    std::vector<std::string> GetLowestDeletableHashes();
+    unsigned long long GetMetadataSize();
+    std::vector<Record> GetSegmentItems(const unsigned long long& segment);
+    std::vector<unsigned long long> GetSegments();
+    unsigned long long GetSegmentedSize();
+    unsigned long long GetTotalSize();
+    std::string FindHash(const unsigned long long& time_value, const unsigned int& device);
+    Record FindNext(const unsigned long long& time_value, const unsigned int& device);
+    Record FindPrevious(const unsigned long long& time_value, const unsigned int& device);
+    void Insert(const char& operation, const unsigned long long& time_value,
+                const unsigned int& device, const std::string& hash,
+                const unsigned long long& size, const unsigned int& keep,
+                const unsigned long long& segment, const unsigned long long& offset);
+    void InsertCompressed(const unsigned long long& time_value, const unsigned int& device,
+                          const std::string& hash, const unsigned long long& size,
+                          const unsigned int& keep, const unsigned int& codec,
+                          const unsigned long long& raw_size);
+    void MarkDeleting(const std::vector<std::string>& hashes);
+    bool MarkSynced(const std::vector<unsigned long long>& time_values,
+                    const unsigned int& device);
+    std::vector<Record> NextUnsynced(const std::size_t& limit,
+                                     const std::vector<unsigned int>& devices);
+    std::vector<Record> SelectAll();
+    std::vector<Record> SelectHashes(const std::vector<std::string>& hashes);
+    std::vector<Record> SelectRange(const unsigned int& device,
+                                    const unsigned long long& start_time_value,
+                                    const unsigned long long& end_time_value);
+    bool SetKeep(const unsigned long long& time_value, const unsigned int& device,
+                 const unsigned int& keep);
+    bool BulkSetKeep(const std::vector<unsigned long long>& time_values, const unsigned int& device,
+                     const unsigned int& keep);
+    bool SetKeepRange(const bool& all_devices, const unsigned int& device,
+                      const unsigned long long& start_time_value,
+                      const unsigned long long& end_time_value, const unsigned int& keep);
+    void SetTracer(const std::shared_ptr<Tracer>& tracer);
+    void Compact();
+
+  private:
+    // Rows are ordered by device then time for range queries, by keep then time for eviction, and
+    // by time alone for expiry. The size and decay orders hold deletable rows only, and the
+    // unsynced orders rows not yet marked synced.
+    using Key = std::pair<unsigned int, unsigned long long>;
+    using EvictionKey = std::tuple<unsigned int, unsigned long long, unsigned int>;
+    using DeviceEvictionKey = std::pair<unsigned int, unsigned long long>;
+    using SizeKey = std::tuple<unsigned int, unsigned long long, unsigned long long, unsigned int>;
+    using TimeKey = std::pair<unsigned long long, unsigned int>;
+    using DecayKey = std::tuple<unsigned long long, unsigned long long, unsigned int>;
+
+    struct Entry {
+        unsigned long long id;
+        unsigned long long time_value;
+        unsigned int device;
+        std::string hash;
+        unsigned long long size;
+        unsigned int keep;
+        bool packed;
+        unsigned long long segment;
+        unsigned long long offset;
+        unsigned int codec;
+        unsigned long long raw_size;
+        bool synced;
+    };
+
+    static std::string hashList(const std::vector<std::string>& hashes);
+    static bool validHash(const std::string& hash);
+    static void writeAll(const int& fd, const std::string& data);
+
+    void apply(const std::string& line);
+    bool clearIntents(const std::vector<std::string>& hashes);
+    void compact();
+    void compactSegment(const std::vector<std::string>& evicted_hashes,
+                        const std::vector<Record>& relocations);
+    std::vector<std::string> deleteRange(const bool& all_devices, const unsigned int& device,
+                                         const unsigned long long& start_time_value,
+                                         const unsigned long long& end_time_value);
+    bool erase(const std::string& hash);
+    void expire(const std::vector<std::string>& hashes);
+    Entry& insert(const unsigned long long& time_value, const unsigned int& device,
+                  const std::string& hash, const unsigned long long& size,
+                  const unsigned int& keep);
+    void journal(const std::string& line);
+    void load();
+    void locate(Entry& entry, const unsigned long long& segment, const unsigned long long& offset);
+    void order(const Entry& entry);
+    void unorder(const Entry& entry);
+    std::vector<Entry*> range(const bool& all_devices, const unsigned int& device,
+                              const unsigned long long& start_time_value,
+                              const unsigned long long& end_time_value);
+    bool markSynced(const std::vector<unsigned long long>& time_values,
+                    const unsigned int& device);
+    void setKeep(Entry& entry, const unsigned int& keep);
+    bool setKeepRange(const bool& all_devices, const unsigned int& device,
+                      const unsigned long long& start_time_value,
+                      const unsigned long long& end_time_value, const unsigned int& keep);
+    bool setKeeps(const std::vector<unsigned long long>& time_values, const unsigned int& device,
+                  const unsigned int& keep);
+
+    std::string path_;
+    std::string journal_path_;
+    std::size_t compact_records_;
+    std::map<Key, Entry> rows_;
+    std::unordered_map<std::string, Key> hashes_;
+    std::map<EvictionKey, const Entry*> eviction_order_;
+    std::map<unsigned int, std::map<DeviceEvictionKey, const Entry*>> device_eviction_orders_;
+    std::map<unsigned int, unsigned long long> device_sizes_;
+    std::map<SizeKey, const Entry*> size_order_;
+    std::map<TimeKey, const Entry*> time_order_;
+    std::map<TimeKey, const Entry*> unsynced_order_;
+    std::map<unsigned int, std::map<unsigned long long, const Entry*>> device_unsynced_orders_;
+    // Built on the first request for a decay and rebuilt only when a different one is asked for
+    std::map<DecayKey, const Entry*> decay_order_;
+    unsigned long long decay_minutes_;
+    std::map<unsigned long long, std::map<unsigned long long, const Entry*>> segments_;
+    std::map<std::string, unsigned int> intents_;
+    std::vector<std::string> finalized_hashes_;
+    unsigned long long next_id_;
+    unsigned long long total_size_;
+    unsigned long long segmented_size_;
+    unsigned long long generation_;
+    std::size_t journal_records_;
+    int journal_fd_;
+    std::mutex mutex_;
+    std::shared_ptr<Tracer> tracer_;
+};
+
+MemoryIndex::Impl::Impl(const std::string& path, const std::size_t& compact_records)
+        : path_(path),
+          journal_path_(path + "-journal"),
+          compact_records_(std::max<std::size_t>(compact_records, 1)),
+          decay_minutes_(0),
+          next_id_(1),
+          total_size_(0),
+          segmented_size_(0),
+          generation_(0),
+          journal_records_(0),
+          journal_fd_(-1) {
+    load();
+}
+
+MemoryIndex::Impl::~Impl() {
+    try {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!finalized_hashes_.empty()) {
+            journal(std::string{});
+        }
+    } catch (const DatabaseException& e) {
+    }
+    if (journal_fd_ >= 0) {
+        closeFile(journal_fd_);
+    }
+}
+
+void MemoryIndex::Impl::ClearIntents(const std::vector<std::string>& hashes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> cleared;
+    for (const auto& hash : hashes) {
+        if (intents_.count(hash)) {
+            cleared.push_back(hash);
+        }
+    }
+    if (clearIntents(cleared)) {
+        journal("C " + hashList(cleared));
+    }
+}
+
+void MemoryIndex::Impl::CompactSegment(const std::vector<std::string>& evicted_hashes,
+                                       const std::vector<Record>& relocations) {
+    if (evicted_hashes.empty() && relocations.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> evicted;
+    for (const auto& hash : evicted_hashes) {
+        if (hashes_.count(hash)) {
+            evicted.push_back(hash);
+        }
+    }
+    std::stringstream stream;
+    stream << "X " << hashList(evicted);
+    std::vector<Record> relocated;
+    for (const auto& relocation : relocations) {
+        if (hashes_.count(relocation.at("hash"))) {
+            relocated.push_back(relocation);
+            stream << " " << relocation.at("hash")
+                   << " " << relocation.at("segment")
+                   << " " << relocation.at("offset");
+        }
+    }
+    compactSegment(evicted, relocated);
+    journal(stream.str());
+}
+
+void MemoryIndex::Impl::Delete(const std::string& hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (erase(hash)) {
+        journal("D " + hash);
+    }
+}
+
+void MemoryIndex::Impl::BulkDelete(const std::vector<std::string>& hashes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> deleted;
+    for (const auto& hash : hashes) {
+        if (hashes_.count(hash) || intents_.count(hash)) {
+            deleted.push_back(hash);
+        }
+    }
+    if (deleted.empty()) {
+        return;
+    }
+    for (const auto& hash : deleted) {
+        erase(hash);
+    }
+    clearIntents(deleted);
+    journal("B " + hashList(deleted));
+}
+
+std::vector<std::string> MemoryIndex::Impl::DeleteRange(const bool& all_devices,
+                                                        const unsigned int& device,
+                                                        const unsigned long long& start_time_value,
+                                                        const unsigned long long& end_time_value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto hashes = deleteRange(all_devices, device, start_time_value, end_time_value);
+    if (!hashes.empty()) {
+        std::stringstream stream;
+        if (all_devices) {
+            stream << "R " << start_time_value << " " << end_time_value;
+        } else {
+            stream << "r " << device << " " << start_time_value << " " << end_time_value;
+        }
+        journal(stream.str());
+    }
+    return hashes;
+}
+
+std::vector<std::string> MemoryIndex::Impl::DeleteExpired(
+        const bool& all_devices, const unsigned int& device,
+        const unsigned long long& cutoff_time_value, const std::size_t& limit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> hashes;
+    if (all_devices) {
+        for (auto item = time_order_.begin(); item != time_order_.end() && hashes.size() < limit &&
+                                              item->first.first < cutoff_time_value;
+             ++item) {
+            hashes.push_back(item->second->hash);
+        }
+    } else {
+        for (auto row = rows_.lower_bound(Key{device, 0});
+             row != rows_.end() && hashes.size() < limit && row->first.first == device &&
+             row->first.second < cutoff_time_value;
+             ++row) {
+            hashes.push_back(row->second.hash);
+        }
+    }
+    expire(hashes);
+    return hashes;
+}
+
+std::vector<std::string> MemoryIndex::Impl::DeleteExpiredKeep(
+        const unsigned int& keep, const unsigned long long& cutoff_time_value,
+        const std::size_t& limit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> hashes;
+    for (auto item = eviction_order_.lower_bound(EvictionKey{keep, 0, 0});
+         item != eviction_order_.end() && hashes.size() < limit &&
+         std::get<0>(item->first) == keep && std::get<1>(item->first) < cutoff_time_value;
+         ++item) {
+        hashes.push_back(item->second->hash);
+    }
+    expire(hashes);
+    return hashes;
+}
+
+void MemoryIndex::Impl::FinalizePending(const std::string& hash) {
+    // Like Database, finalized intents reach the journal with the next write, so completing a
+    // push never costs a write of its own
+    static const std::size_t max_finalized_hashes = 1024;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!intents_.erase(hash)) {
+        return;
+    }
+    finalized_hashes_.push_back(hash);
+    if (finalized_hashes_.size() >= max_finalized_hashes) {
+        journal(std::string{});
+    }
+}
+
+std::vector<std::string> MemoryIndex::Impl::GetDecayedDeletableHashes(
+        const unsigned long long& decay_minutes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> hashes;
+    if (decay_minutes == 0) {
+        for (const auto& item : time_order_) {
+            if (item.second->keep < PRESERVE_RECORD) {
+                hashes.push_back(item.second->hash);
+            }
+        }
+        return hashes;
+    }
+    if (decay_minutes != decay_minutes_) {
+        decay_order_.clear();
+        decay_minutes_ = decay_minutes;
+        for (const auto& item : time_order_) {
+            const auto& entry = *item.second;
+            if (entry.keep >= PRESERVE_RECORD) {
+                continue;
+            }
+            decay_order_[DecayKey{entry.keep * decay_minutes_ + entry.time_value,
+                                  entry.time_value, entry.device}] = &entry;
+        }
+    }
+    for (const auto& item : decay_order_) {
+        hashes.push_back(item.second->hash);
+    }
+    return hashes;
+}
+
+std::map<unsigned int, unsigned long long> MemoryIndex::Impl::GetDeviceSizes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return device_sizes_;
+}
+
+std::vector<std::string> MemoryIndex::Impl::GetExpiredHashes(
+        const unsigned long long& cutoff_time_value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> hashes;
+    for (auto item = time_order_.begin();
+         item != time_order_.end() && item->first.first < cutoff_time_value; ++item) {
+        if (item->second->keep < PRESERVE_RECORD) {
+            hashes.push_back(item->second->hash);
+        }
+    }
+    return hashes;
+}
+
+std::vector<Record> MemoryIndex::Impl::GetIntents() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Record> intents;
+    for (const auto& intent : intents_) {
+        intents.push_back(
+                Record{{"hash", intent.first}, {"operation", std::to_string(intent.second)}});
+    }
+    return intents;
+}
+
+Record MemoryIndex::Impl::GetCompression(const std::string& hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = hashes_.find(hash);
+    if (found == hashes_.end()) {
+        return Record{};
+    }
+    const auto& entry = rows_.at(found->second);
+    if (entry.codec == 0) {
+        return Record{};
+    }
+    return Record{{"codec", std::to_string(entry.codec)},
+                  {"raw_size", std::to_string(entry.raw_size)}};
+}
+
+Record MemoryIndex::Impl::GetLocation(const std::string& hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = hashes_.find(hash);
+    if (found == hashes_.end()) {
+        return Record{};
+    }
+    const auto& entry = rows_.at(found->second);
+    if (!entry.packed) {
+        return Record{};
+    }
+    return Record{{"segment", std::to_string(entry.segment)},
+                  {"offset", std::to_string(entry.offset)},
+                  {"length", std::to_string(entry.size)},
+                  {"keep", std::to_string(entry.keep)}};
+}
+
+std::vector<std::string> MemoryIndex::Impl::GetLargestDeletableHashes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> hashes;
+    for (const auto& item : size_order_) {
+        hashes.push_back(item.second->hash);
+    }
+    return hashes;
+}
+
+std::vector<Record> MemoryIndex::Impl::GetLowestDeletable(const unsigned int& device) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Record> records;
+    auto found = device_eviction_orders_.find(device);
+    if (found == device_eviction_orders_.end()) {
+        return records;
+    }
+    for (const auto& item : found->second) {
+        if (item.first.first >= PRESERVE_RECORD) {
+            break;
+        }
+        records.push_back(Record{{"hash", item.second->hash},
+                                 {"size", std::to_string(item.second->size)}});
+    }
+    return records;
+}
+
+std::vector<std::string> MemoryIndex::Impl::GetLowestDeletableHashes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> hashes;
+    for (const auto& item : eviction_order_) {
+        if (std::get<0>(item.first) >= PRESERVE_RECORD) {
+            break;
+        }
+        hashes.push_back(item.second->hash);
+    }
+    return hashes;
+}
+
+unsigned long long MemoryIndex::Impl::GetMetadataSize() {
+    unsigned long long size = 0;
+    for (const auto& filepath : {path_, journal_path_}) {
+        boost::system::error_code error;
+        const auto file_size = fs::file_size(filepath, error);
+        if (!error) {
+            size += file_size;
+        }
+    }
+    return size;
+}
+
+std::vector<Record> MemoryIndex::Impl::GetSegmentItems(const unsigned long long& segment) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Record> items;
+    auto found = segments_.find(segment);
+    if (found == segments_.end()) {
+        return items;
+    }
+    for (const auto& item : found->second) {
+        items.push_back(Record{{"hash", item.second->hash},
+                               {"offset", std::to_string(item.first)},
+                               {"length", std::to_string(item.second->size)},
+                               {"keep", std::to_string(item.second->keep)}});
+    }
+    return items;
+}
+
+std::vector<unsigned long long> MemoryIndex::Impl::GetSegments() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<unsigned long long> segments;
+    for (const auto& segment : segments_) {
+        segments.push_back(segment.first);
+    }
+    return segments;
+}
+
+unsigned long long MemoryIndex::Impl::GetSegmentedSize() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return segmented_size_;
+}
+
+unsigned long long MemoryIndex::Impl::GetTotalSize() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_size_;
+}
+
+std::string MemoryIndex::Impl::FindHash(const unsigned long long& time_value,
+                                        const unsigned int& device) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = rows_.find(Key{device, time_value});
+    if (found == rows_.end()) {
+        return std::string{};
+    }
+    return found->second.hash;
+}
+
+Record MemoryIndex::Impl::FindNext(const unsigned long long& time_value,
+                                   const unsigned int& device) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto next = rows_.lower_bound(Key{device, time_value});
+    if (next == rows_.end() || next->first.first != device) {
+        return Record{};
+    }
+    return Record{{"time_value", std::to_string(next->second.time_value)},
+                  {"hash", next->second.hash},
+                  {"size", std::to_string(next->second.size)}};
+}
+
+Record MemoryIndex::Impl::FindPrevious(const unsigned long long& time_value,
+                                       const unsigned int& device) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto previous = rows_.upper_bound(Key{device, time_value});
+    if (previous == rows_.begin() || (--previous)->first.first != device) {
+        return Record{};
+    }
+    return Record{{"time_value", std::to_string(previous->second.time_value)},
+                  {"hash", previous->second.hash},
+                  {"size", std::to_string(previous->second.size)}};
+}
+
+void MemoryIndex::Impl::Insert(const char& operation, const unsigned long long& time_value,
+                               const unsigned int& device, const std::string& hash,
+                               const unsigned long long& size, const unsigned int& keep,
+                               const unsigned long long& segment,
+                               const unsigned long long& offset) {
+    if (!validHash(hash)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = insert(time_value, device, hash, size, keep);
+    std::stringstream stream;
+    stream << operation << " "
+           << time_value << " "
+           << device << " "
+           << hash << " "
+           << size << " "
+           << keep;
+    if (operation == 'P') {
+        intents_[hash] = INTENT_PUSH;
+    } else if (operation == 'G') {
+        locate(entry, segment, offset);
+        stream << " " << segment << " " << offset;
+    }
+    journal(stream.str());
+}
+
+void MemoryIndex::Impl::InsertCompressed(const unsigned long long& time_value,
+                                         const unsigned int& device, const std::string& hash,
+                                         const unsigned long long& size, const unsigned int& keep,
+                                         const unsigned int& codec,
+                                         const unsigned long long& raw_size) {
+    if (!validHash(hash)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& entry = insert(time_value, device, hash, size, keep);
+    entry.codec = codec;
+    entry.raw_size = raw_size;
+    intents_[hash] = INTENT_PUSH;
+    std::stringstream stream;
+    stream << "Z "
+           << time_value << " "
+           << device << " "
+           << hash << " "
+           << size << " "
+           << keep << " "
+           << codec << " "
+           << raw_size;
+    journal(stream.str());
+}
+
+void MemoryIndex::Impl::MarkDeleting(const std::vector<std::string>& hashes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> marked;
+    for (const auto& hash : hashes) {
+        if (validHash(hash)) {
+            intents_[hash] = INTENT_DELETE;
+            marked.push_back(hash);
+        }
+    }
+    if (!marked.empty()) {
+        journal("M " + hashList(marked));
+    }
+}
+
+std::vector<Record> MemoryIndex::Impl::SelectAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Record> records;
+    records.reserve(rows_.size());
+    for (const auto& row : rows_) {
+        const auto& entry = row.second;
+        records.push_back(Record{{"id", std::to_string(entry.id)},
+                                 {"time_value", std::to_string(entry.time_value)},
+                                 {"device", std::to_string(entry.device)},
+                                 {"hash", entry.hash},
+                                 {"size", std::to_string(entry.size)},
+                                 {"keep", std::to_string(entry.keep)}});
+    }
+    return records;
+}
+
+std::vector<Record> MemoryIndex::Impl::SelectHashes(const std::vector<std::string>& hashes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Record> records;
+    for (const auto& hash : hashes) {
+        auto found = hashes_.find(hash);
+        if (found == hashes_.end()) {
+            continue;
+        }
+        const auto& entry = rows_.at(found->second);
+        records.push_back(Record{{"time_value", std::to_string(entry.time_value)},
+                                 {"device", std::to_string(entry.device)},
+                                 {"hash", entry.hash},
+                                 {"size", std::to_string(entry.size)}});
+    }
+    return records;
+}
+
+std::vector<Record> MemoryIndex::Impl::SelectRange(const unsigned int& device,
+                                                   const unsigned long long& start_time_value,
+                                                   const unsigned long long& end_time_value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Record> records;
+    for (const auto entry : range(false, device, start_time_value, end_time_value)) {
+        records.push_back(Record{{"time_value", std::to_string(entry->time_value)},
+                                 {"hash", entry->hash},
+                                 {"size", std::to_string(entry->size)}});
+    }
+    return records;
+}
+
+bool MemoryIndex::Impl::MarkSynced(const std::vector<unsigned long long>& time_values,
+                                   const unsigned int& device) {
+    if (time_values.empty()) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!markSynced(time_values, device)) {
+        return false;
+    }
+    std::stringstream stream;
+    stream << "S " << device << " " << time_values.size();
+    for (const auto& time_value : time_values) {
+        stream << " " << time_value;
+    }
+    journal(stream.str());
+    return true;
+}
+
+std::vector<Record> MemoryIndex::Impl::NextUnsynced(const std::size_t& limit,
+                                                    const std::vector<unsigned int>& devices) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<const Entry*> entries;
+    if (devices.empty()) {
+        for (auto item = unsynced_order_.begin();
+             item != unsynced_order_.end() && entries.size() < limit; ++item) {
+            entries.push_back(item->second);
+        }
+    } else {
+        // The first limit rows of each device are enough to find the first limit of them all
+        std::map<TimeKey, const Entry*> merged;
+        for (const auto& device : std::set<unsigned int>{devices.begin(), devices.end()}) {
+            auto found = device_unsynced_orders_.find(device);
+            if (found == device_unsynced_orders_.end()) {
+                continue;
+            }
+            std::size_t taken = 0;
+            for (auto item = found->second.begin();
+                 item != found->second.end() && taken < limit; ++item, ++taken) {
+                merged[TimeKey{item->first, device}] = item->second;
+            }
+        }
+        for (auto item = merged.begin(); item != merged.end() && entries.size() < limit;
+             ++item) {
+            entries.push_back(item->second);
+        }
+    }
+
+    std::vector<Record> records;
+    for (const auto entry : entries) {
+        records.push_back(Record{{"time_value", std::to_string(entry->time_value)},
+                                 {"device", std::to_string(entry->device)},
+                                 {"hash", entry->hash},
+                                 {"size", std::to_string(entry->size)}});
+    }
+    return records;
+}
+
+bool MemoryIndex::Impl::SetKeep(const unsigned long long& time_value, const unsigned int& device,
+                                const unsigned int& keep) {
+    return BulkSetKeep(std::vector<unsigned long long>{time_value}, device, keep);
+}
+
+bool MemoryIndex::Impl::BulkSetKeep(const std::vector<unsigned long long>& time_values,
+                                    const unsigned int& device, const unsigned int& keep) {
+    if (time_values.empty()) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!setKeeps(time_values, device, keep)) {
+        return false;
+    }
+    std::stringstream stream;
+    stream << "K " << device << " " << keep << " " << time_values.size();
+    for (const auto& time_value : time_values) {
+        stream << " " << time_value;
+    }
+    journal(stream.str());
+    return true;
+}
+
+bool MemoryIndex::Impl::SetKeepRange(const bool& all_devices, const unsigned int& device,
+                                     const unsigned long long& start_time_value,
+                                     const unsigned long long& end_time_value,
+                                     const unsigned int& keep) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!setKeepRange(all_devices, device, start_time_value, end_time_value, keep)) {
+        return false;
+    }
+    std::stringstream stream;
+    if (all_devices) {
+        stream << "W " << start_time_value << " " << end_time_value << " " << keep;
+    } else {
+        stream << "w " << device << " " << start_time_value << " " << end_time_value << " "
+               << keep;
+    }
+    journal(stream.str());
+    return true;
+}
+
+void MemoryIndex::Impl::SetTracer(const std::shared_ptr<Tracer>& tracer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tracer_ = tracer;
+}
+
+void MemoryIndex::Impl::Compact() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    compact();
+}
+
+std::string MemoryIndex::Impl::hashList(const std::vector<std::string>& hashes) {
+    std::stringstream stream;
+    stream << hashes.size();
+    for (const auto& hash : hashes) {
+        stream << " " << hash;
+    }
+    return stream.str();
+}
+
+bool MemoryIndex::Impl::validHash(const std::string& hash) {
+    if (hash.empty()) {
+        return false;
+    }
+
+    const auto hash_path = fs::path(hash);
+
+    for (const auto& hash_part : hash_path) {
+        if (!fs::portable_name(hash_part.string())) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void MemoryIndex::Impl::writeAll(const int& fd, const std::string& data) {
+    std::size_t written = 0;
+    while (written < data.size()) {
+        const auto result = writeSome(fd, data.data() + written, data.size() - written);
+        if (result < 0) {
+            throw DatabaseException{"Cannot write the memory index journal or snapshot"};
+        }
+        written += result;
+    }
+}
+
+void MemoryIndex::Impl::apply(const std::string& line) {
+    std::istringstream stream{line};
+    char operation;
+    stream >> operation;
+
+    auto read_hashes = [&stream]() {
+        std::size_t count = 0;
+        stream >> count;
+        std::vector<std::string> hashes(count);
+        for (auto& hash : hashes) {
+            stream >> hash;
+        }
+        return hashes;
+    };
+
+    unsigned long long time_value, size, start, end, segment, offset, raw_size;
+    unsigned int device, keep, codec;
+    std::string hash;
+    switch (operation) {
+        case 'I':
+        case 'P':
+        case 'G': {
+            stream >> time_value >> device >> hash >> size >> keep;
+            auto& entry = insert(time_value, device, hash, size, keep);
+            if (operation == 'P') {
+                intents_[hash] = INTENT_PUSH;
+            } else if (operation == 'G') {
+                stream >> segment >> offset;
+                locate(entry, segment, offset);
+            }
+            break;
+        }
+        case 'Z': {
+            stream >> time_value >> device >> hash >> size >> keep >> codec >> raw_size;
+            auto& entry = insert(time_value, device, hash, size, keep);
+            entry.codec = codec;
+            entry.raw_size = raw_size;
+            intents_[hash] = INTENT_PUSH;
+            break;
+        }
+        case 'D':
+            stream >> hash;
+            erase(hash);
+            break;
+        case 'B': {
+            auto hashes = read_hashes();
+            for (const auto& bulk_hash : hashes) {
+                erase(bulk_hash);
+            }
+            clearIntents(hashes);
+            break;
+        }
+        case 'C':
+            clearIntents(read_hashes());
+            break;
+        case 'E':
+            for (const auto& expired_hash : read_hashes()) {
+                intents_[expired_hash] = INTENT_DELETE;
+                erase(expired_hash);
+            }
+            break;
+        case 'M':
+            for (const auto& marked_hash : read_hashes()) {
+                intents_[marked_hash] = INTENT_DELETE;
+            }
+            break;
+        case 'X': {
+            auto evicted = read_hashes();
+            std::vector<Record> relocations;
+            while (stream >> hash >> segment >> offset) {
+                relocations.push_back(Record{{"hash", hash},
+                                             {"segment", std::to_string(segment)},
+                                             {"offset", std::to_string(offset)}});
+            }
+            compactSegment(evicted, relocations);
+            break;
+        }
+        case 'R':
+            stream >> start >> end;
+            deleteRange(true, 0, start, end);
+            break;
+        case 'r':
+            stream >> device >> start >> end;
+            deleteRange(false, device, start, end);
+            break;
+        case 'K': {
+            std::size_t count = 0;
+            stream >> device >> keep >> count;
+            std::vector<unsigned long long> time_values(count);
+            for (auto& value : time_values) {
+                stream >> value;
+            }
+            setKeeps(time_values, device, keep);
+            break;
+        }
+        case 'S': {
+            std::size_t count = 0;
+            stream >> device >> count;
+            std::vector<unsigned long long> time_values(count);
+            for (auto& value : time_values) {
+                stream >> value;
+            }
+            markSynced(time_values, device);
+            break;
+        }
+        case 'W':
+            stream >> start >> end >> keep;
+            setKeepRange(true, 0, start, end, keep);
+            break;
+        case 'w':
+            stream >> device >> start >> end >> keep;
+            setKeepRange(false, device, start, end, keep);
+            break;
+        default:
+            throw DatabaseException{"Unknown memory index journal entry: " + line};
+    }
+}
+
+bool MemoryIndex::Impl::clearIntents(const std::vector<std::string>& hashes) {
+    bool cleared = false;
+    for (const auto& hash : hashes) {
+        cleared = intents_.erase(hash) > 0 || cleared;
+    }
+    return cleared;
+}
+
+void MemoryIndex::Impl::compact() {
+    PRISM_INDEXED_TRACE_SPAN(tracer_, "MemoryIndex::compact");
+    // The new generation marks the old journal as already folded in, so a crash between the two
+    // renames below never replays it onto the new snapshot
+    const auto generation = generation_ + 1;
+    const auto snapshot_temporary = path_ + ".tmp";
+    const int snapshot_fd = openFile(snapshot_temporary, false);
+    if (snapshot_fd < 0) {
+        throw DatabaseException{"Cannot create memory index snapshot " + snapshot_temporary};
+    }
+
+    static const std::size_t chunk_size = 1 << 20;
+    try {
+        std::stringstream stream;
+        stream << "prism_indexed_snapshot " << generation
+               << " " << next_id_
+               << " " << rows_.size()
+               << " " << intents_.size()
+               << "\n";
+        for (const auto& row : rows_) {
+            const auto& entry = row.second;
+            stream << entry.id << " "
+                   << entry.time_value << " "
+                   << entry.device << " "
+                   << entry.hash << " "
+                   << entry.size << " "
+                   << entry.keep << " "
+                   << entry.packed << " "
+                   << entry.segment << " "
+                   << entry.offset << "\n";
+            if (stream.tellp() >= static_cast<std::streamoff>(chunk_size)) {
+                writeAll(snapshot_fd, stream.str());
+                stream.str(std::string{});
+            }
+        }
+        for (const auto& intent : intents_) {
+            stream << intent.first << " " << intent.second << "\n";
+        }
+        // Compressed rows follow as a section of their own, which snapshots written before
+        // compression simply lack
+        std::vector<const Entry*> compressed;
+        for (const auto& row : rows_) {
+            if (row.second.codec != 0) {
+                compressed.push_back(&row.second);
+            }
+        }
+        stream << "compressed " << compressed.size() << "\n";
+        for (const auto entry : compressed) {
+            stream << entry->hash << " " << entry->codec << " " << entry->raw_size << "\n";
+        }
+        // As are synced rows, so every row of an older snapshot starts unsynced
+        stream << "synced " << rows_.size() - unsynced_order_.size() << "\n";
+        for (const auto& row : rows_) {
+            if (row.second.synced) {
+                stream << row.second.hash << "\n";
+                if (stream.tellp() >= static_cast<std::streamoff>(chunk_size)) {
+                    writeAll(snapshot_fd, stream.str());
+                    stream.str(std::string{});
+                }
+            }
+        }
+        writeAll(snapshot_fd, stream.str());
+        if (!syncFile(snapshot_fd)) {
+            throw DatabaseException{"Cannot sync memory index snapshot " + snapshot_temporary};
+        }
+    } catch (const DatabaseException& e) {
+        closeFile(snapshot_fd);
+        throw;
+    }
+    closeFile(snapshot_fd);
+
+    const auto journal_temporary = journal_path_ + ".tmp";
+    const int journal_fd = openFile(journal_temporary, false);
+    if (journal_fd < 0) {
+        throw DatabaseException{"Cannot create memory index journal " + journal_temporary};
+    }
+    try {
+        writeAll(journal_fd, "prism_indexed_journal " + std::to_string(generation) + "\n");
+    } catch (const DatabaseException& e) {
+        closeFile(journal_fd);
+        throw;
+    }
+    closeFile(journal_fd);
+
+    boost::system::error_code error_code;
+    fs::rename(snapshot_temporary, path_, error_code);
+    if (!error_code) {
+        fs::rename(journal_temporary, journal_path_, error_code);
+    }
+    if (error_code) {
+        throw DatabaseException{"Cannot replace memory index snapshot " + path_};
+    }
+
+    if (journal_fd_ >= 0) {
+        closeFile(journal_fd_);
+    }
+    journal_fd_ = openFile(journal_path_, true);
+    if (journal_fd_ < 0) {
+        throw DatabaseException{"Cannot open memory index journal " + journal_path_};
+    }
+    generation_ = generation;
+    journal_records_ = 0;
+    finalized_hashes_.clear();
+}
+
+void MemoryIndex::Impl::compactSegment(const std::vector<std::string>& evicted_hashes,
+                                       const std::vector<Record>& relocations) {
+    for (const auto& hash : evicted_hashes) {
+        erase(hash);
+    }
+    for (const auto& relocation : relocations) {
+        auto found = hashes_.find(relocation.at("hash"));
+        if (found != hashes_.end()) {
+            locate(rows_.at(found->second), std::stoull(relocation.at("segment")),
+                   std::stoull(relocation.at("offset")));
+        }
+    }
+}
+
+std::vector<std::string> MemoryIndex::Impl::deleteRange(const bool& all_devices,
+                                                        const unsigned int& device,
+                                                        const unsigned long long& start_time_value,
+                                                        const unsigned long long& end_time_value) {
+    std::vector<std::string> hashes;
+    for (const auto entry : range(all_devices, device, start_time_value, end_time_value)) {
+        hashes.push_back(entry->hash);
+    }
+    for (const auto& hash : hashes) {
+        intents_[hash] = INTENT_DELETE;
+        erase(hash);
+    }
+    return hashes;
+}
+
+void MemoryIndex::Impl::expire(const std::vector<std::string>& hashes) {
+    if (hashes.empty()) {
+        return;
+    }
+    for (const auto& hash : hashes) {
+        intents_[hash] = INTENT_DELETE;
+        erase(hash);
+    }
+    journal("E " + hashList(hashes));
+}
+
+bool MemoryIndex::Impl::erase(const std::string& hash) {
+    auto found = hashes_.find(hash);
+    if (found == hashes_.end()) {
+        return false;
+    }
+
+    auto row = rows_.find(found->second);
+    auto& entry = row->second;
+    unorder(entry);
+    if (entry.size > 0) {
+        auto device_size = device_sizes_.find(entry.device);
+        device_size->second -= entry.size;
+        if (device_size->second == 0) {
+            device_sizes_.erase(device_size);
+        }
+    }
+    if (entry.packed) {
+        auto segment = segments_.find(entry.segment);
+        segment->second.erase(entry.offset);
+        if (segment->second.empty()) {
+            segments_.erase(segment);
+        }
+        segmented_size_ -= entry.size;
+    }
+    total_size_ -= entry.size;
+    hashes_.erase(found);
+    rows_.erase(row);
+    return true;
+}
+
+MemoryIndex::Impl::Entry& MemoryIndex::Impl::insert(const unsigned long long& time_value,
+                                                    const unsigned int& device,
+                                                    const std::string& hash,
+                                                    const unsigned long long& size,
+                                                    const unsigned int& keep) {
+    const Key key{device, time_value};
+    if (rows_.count(key) || hashes_.count(hash)) {
+        throw DatabaseException{"UNIQUE constraint failed: " + hash};
+    }
+
+    auto& entry = rows_[key];
+    entry = Entry{next_id_++, time_value, device, hash, size, keep, false, 0, 0, 0, 0, false};
+    hashes_[hash] = key;
+    order(entry);
+    if (size > 0) {
+        device_sizes_[device] += size;
+    }
+    total_size_ += size;
+    return entry;
+}
+
+void MemoryIndex::Impl::journal(const std::string& line) {
+    PRISM_INDEXED_TRACE_SPAN(tracer_, "MemoryIndex::journal");
+    std::string data;
+    if (!finalized_hashes_.empty()) {
+        data.append("C ").append(hashList(finalized_hashes_)).append("\n");
+    }
+    if (!line.empty()) {
+        data.append(line).append("\n");
+    }
+    writeAll(journal_fd_, data);
+    finalized_hashes_.clear();
+    if (++journal_records_ >= compact_records_) {
+        compact();
+    }
+}
+
+void MemoryIndex::Impl::load() {
+    std::ifstream snapshot{path_, std::ios::binary};
+    if (snapshot) {
+        std::string magic;
+        unsigned long long next_id = 1;
+        std::size_t rows = 0;
+        std::size_t intents = 0;
+        snapshot >> magic >> generation_ >> next_id >> rows >> intents;
+        if (!snapshot || magic != "prism_indexed_snapshot") {
+            throw DatabaseException{"Cannot read memory index snapshot " + path_};
+        }
+        for (std::size_t i = 0; i < rows; ++i) {
+            Entry entry;
+            snapshot >> entry.id >> entry.time_value >> entry.device >> entry.hash >> entry.size >>
+                    entry.keep >> entry.packed >> entry.segment >> entry.offset;
+            if (!snapshot) {
+                throw DatabaseException{"Truncated memory index snapshot " + path_};
+            }
+            auto& inserted = insert(entry.time_value, entry.device, entry.hash, entry.size,
+                                    entry.keep);
+            inserted.id = entry.id;
+            if (entry.packed) {
+                locate(inserted, entry.segment, entry.offset);
+            }
+        }
+        for (std::size_t i = 0; i < intents; ++i) {
+            std::string hash;
+            unsigned int operation;
+            snapshot >> hash >> operation;
+            intents_[hash] = operation;
+        }
+        std::string section;
+        std::size_t compressed = 0;
+        if (snapshot >> section >> compressed && section == "compressed") {
+            for (std::size_t i = 0; i < compressed; ++i) {
+                std::string hash;
+                unsigned int codec;
+                unsigned long long raw_size;
+                snapshot >> hash >> codec >> raw_size;
+                auto found = hashes_.find(hash);
+                if (!snapshot || found == hashes_.end()) {
+                    throw DatabaseException{"Truncated memory index snapshot " + path_};
+                }
+                auto& entry = rows_.at(found->second);
+                entry.codec = codec;
+                entry.raw_size = raw_size;
+            }
+        }
+        std::size_t synced = 0;
+        if (snapshot >> section >> synced && section == "synced") {
+            for (std::size_t i = 0; i < synced; ++i) {
+                std::string hash;
+                snapshot >> hash;
+                auto found = hashes_.find(hash);
+                if (!snapshot || found == hashes_.end()) {
+                    throw DatabaseException{"Truncated memory index snapshot " + path_};
+                }
+                auto& entry = rows_.at(found->second);
+                unorder(entry);
+                entry.synced = true;
+                order(entry);
+            }
+        }
+        next_id_ = next_id;
+    }
+
+    // Only complete lines from a journal of this snapshot's generation are replayed. Anything
+    // else means the journal predates the snapshot or ends in a torn write, and compacting
+    // straight away starts a clean journal either way.
+    bool clean = false;
+    std::ifstream journal_stream{journal_path_, std::ios::binary};
+    std::string line;
+    if (std::getline(journal_stream, line) && !journal_stream.eof() &&
+            line == "prism_indexed_journal " + std::to_string(generation_)) {
+        clean = true;
+        while (std::getline(journal_stream, line)) {
+            if (journal_stream.eof()) {
+                clean = false;
+                break;
+            }
+            try {
+                apply(line);
+            } catch (const DatabaseException& e) {
+            } catch (const std::exception& e) {
+                clean = false;
+                break;
+            }
+            ++journal_records_;
+        }
+    }
+    journal_stream.close();
+
+    if (!clean || journal_records_ >= compact_records_) {
+        compact();
+        return;
+    }
+    journal_fd_ = openFile(journal_path_, true);
+    if (journal_fd_ < 0) {
+        throw DatabaseException{"Cannot open memory index journal " + journal_path_};
+    }
+}
+
+void MemoryIndex::Impl::locate(Entry& entry, const unsigned long long& segment,
+                               const unsigned long long& offset) {
+    if (entry.packed) {
+        auto previous = segments_.find(entry.segment);
+        previous->second.erase(entry.offset);
+        if (previous->second.empty()) {
+            segments_.erase(previous);
+        }
+    } else {
+        segmented_size_ += entry.size;
+    }
+    entry.packed = true;
+    entry.segment = segment;
+    entry.offset = offset;
+    segments_[segment][offset] = &entry;
+}
+
+void MemoryIndex::Impl::order(const Entry& entry) {
+    eviction_order_[EvictionKey{entry.keep, entry.time_value, entry.device}] = &entry;
+    device_eviction_orders_[entry.device][DeviceEvictionKey{entry.keep, entry.time_value}] = &entry;
+    time_order_[TimeKey{entry.time_value, entry.device}] = &entry;
+    if (!entry.synced) {
+        unsynced_order_[TimeKey{entry.time_value, entry.device}] = &entry;
+        device_unsynced_orders_[entry.device][entry.time_value] = &entry;
+    }
+    if (entry.keep >= PRESERVE_RECORD) {
+        return;
+    }
+    size_order_[SizeKey{entry.keep, std::numeric_limits<unsigned long long>::max() - entry.size,
+                        entry.time_value, entry.device}] = &entry;
+    if (decay_minutes_ > 0) {
+        decay_order_[DecayKey{entry.keep * decay_minutes_ + entry.time_value, entry.time_value,
+                              entry.device}] = &entry;
+    }
+}
+
+void MemoryIndex::Impl::unorder(const Entry& entry) {
+    eviction_order_.erase(EvictionKey{entry.keep, entry.time_value, entry.device});
+    auto device_order = device_eviction_orders_.find(entry.device);
+    device_order->second.erase(DeviceEvictionKey{entry.keep, entry.time_value});
+    if (device_order->second.empty()) {
+        device_eviction_orders_.erase(device_order);
+    }
+    time_order_.erase(TimeKey{entry.time_value, entry.device});
+    if (!entry.synced) {
+        unsynced_order_.erase(TimeKey{entry.time_value, entry.device});
+        auto device_unsynced = device_unsynced_orders_.find(entry.device);
+        device_unsynced->second.erase(entry.time_value);
+        if (device_unsynced->second.empty()) {
+            device_unsynced_orders_.erase(device_unsynced);
+        }
+    }
+    if (entry.keep >= PRESERVE_RECORD) {
+        return;
+    }
+    size_order_.erase(SizeKey{entry.keep, std::numeric_limits<unsigned long long>::max() - entry.size,
+                              entry.time_value, entry.device});
+    if (decay_minutes_ > 0) {
+        decay_order_.erase(DecayKey{entry.keep * decay_minutes_ + entry.time_value,
+                                    entry.time_value, entry.device});
+    }
+}
+
+std::vector<MemoryIndex::Impl::Entry*> MemoryIndex::Impl::range(
+        const bool& all_devices, const unsigned int& device,
+        const unsigned long long& start_time_value, const unsigned long long& end_time_value) {
+    std::vector<Entry*> entries;
+    if (start_time_value > end_time_value) {
+        return entries;
+    }
+
+    auto collect = [&](const unsigned int& range_device) {
+        auto it = rows_.lower_bound(Key{range_device, start_time_value});
+        for (; it != rows_.end() && it->first.first == range_device &&
+               it->first.second <= end_time_value;
+             ++it) {
+            entries.push_back(&it->second);
+        }
+    };
+
+    if (!all_devices) {
+        collect(device);
+        return entries;
+    }
+
+    // Each device is a contiguous run of rows, so the scan jumps from one run to the next
+    auto it = rows_.begin();
+    while (it != rows_.end()) {
+        const auto range_device = it->first.first;
+        collect(range_device);
+        if (range_device == std::numeric_limits<unsigned int>::max()) {
+            break;
+        }
+        it = rows_.lower_bound(Key{range_device + 1, 0});
+    }
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry* a, const Entry* b) {
+        return a->time_value < b->time_value;
+    });
+    return entries;
+}
+
+bool MemoryIndex::Impl::markSynced(const std::vector<unsigned long long>& time_values,
+                                   const unsigned int& device) {
+    bool found = false;
+    for (const auto& time_value : time_values) {
+        auto row = rows_.find(Key{device, time_value});
+        if (row == rows_.end()) {
+            continue;
+        }
+        found = true;
+        if (!row->second.synced) {
+            unorder(row->second);
+            row->second.synced = true;
+            order(row->second);
+        }
+    }
+    return found;
+}
+
+void MemoryIndex::Impl::setKeep(Entry& entry, const unsigned int& keep) {
+    if (entry.keep == keep) {
+        return;
+    }
+    unorder(entry);
+    entry.keep = keep;
+    order(entry);
+}
+
+bool MemoryIndex::Impl::setKeepRange(const bool& all_devices, const unsigned int& device,
+                                     const unsigned long long& start_time_value,
+                                     const unsigned long long& end_time_value,
+                                     const unsigned int& keep) {
+    auto entries = range(all_devices, device, start_time_value, end_time_value);
+    for (const auto entry : entries) {
+        setKeep(*entry, keep);
+    }
+    return !entries.empty();
+}
+
+bool MemoryIndex::Impl::setKeeps(const std::vector<unsigned long long>& time_values,
+                                 const unsigned int& device, const unsigned int& keep) {
+    bool found = false;
+    for (const auto& time_value : time_values) {
+        auto row = rows_.find(Key{device, time_value});
+        if (row != rows_.end()) {
+            setKeep(row->second, keep);
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Bridge
+
+MemoryIndex::MemoryIndex(const std::string& path, const std::size_t& compact_records)
+        : impl_{new Impl{path, compact_records}} {}
+
+MemoryIndex::~MemoryIndex() {}
+
+void MemoryIndex::ClearIntents(const std::vector<std::string>& hashes) {
+    impl_->ClearIntents(hashes);
+}
+
+void MemoryIndex::CompactSegment(const std::vector<std::string>& evicted_hashes,
+                                 const std::vector<Record>& relocations) {
+    impl_->CompactSegment(evicted_hashes, relocations);
+}
+
+void MemoryIndex::Delete(const std::string& hash) {
+    impl_->Delete(hash);
+}
+
+void MemoryIndex::BulkDelete(const std::vector<std::string>& hashes) {
+    impl_->BulkDelete(hashes);
+}
+
+std::vector<std::string> MemoryIndex::DeleteRange(const unsigned long long& start_time_value,
+                                                  const unsigned long long& end_time_value) {
+    return impl_->DeleteRange(true, 0, start_time_value, end_time_value);
+}
+
+std::vector<std::string> MemoryIndex::DeleteRange(const unsigned int& device,
+                                                  const unsigned long long& start_time_value,
+                                                  const unsigned long long& end_time_value) {
+    return impl_->DeleteRange(false, device, start_time_value, end_time_value);
+}
+
+std::vector<std::string> MemoryIndex::DeleteExpired(const unsigned long long& cutoff_time_value,
+                                                   const std::size_t& limit) {
+    return impl_->DeleteExpired(true, 0, cutoff_time_value, limit);
+}
+
+std::vector<std::string> MemoryIndex::DeleteExpired(const unsigned int& device,
+                                                   const unsigned long long& cutoff_time_value,
+                                                   const std::size_t& limit) {
+    return impl_->DeleteExpired(false, device, cutoff_time_value, limit);
+}
+
+std::vector<std::string> MemoryIndex::DeleteExpiredKeep(const unsigned int& keep,
+                                                       const unsigned long long& cutoff_time_value,
+                                                       const std::size_t& limit) {
+    return impl_->DeleteExpiredKeep(keep, cutoff_time_value, limit);
+}
+
+void MemoryIndex::FinalizePending(const std::string& hash) {
+    impl_->FinalizePending(hash);
+}
+
+Record MemoryIndex::GetCompression(const std::string& hash) {
+    return impl_->GetCompression(hash);
+}
+
+std::vector<std::string> MemoryIndex::GetDecayedDeletableHashes(
+        const unsigned long long& decay_minutes) {
+    return impl_->GetDecayedDeletableHashes(decay_minutes);
+}
+
+std::map<unsigned int, unsigned long long> MemoryIndex::GetDeviceSizes() {
+    return impl_->GetDeviceSizes();
+}
+
+std::vector<std::string> MemoryIndex::GetExpiredHashes(const unsigned long long& cutoff_time_value) {
+    return impl_->GetExpiredHashes(cutoff_time_value);
+}
+
+std::vector<Record> MemoryIndex::GetIntents() {
+    return impl_->GetIntents();
+}
+
+std::vector<std::string> MemoryIndex::GetLargestDeletableHashes() {
+    return impl_->GetLargestDeletableHashes();
+}
+
+Record MemoryIndex::GetLocation(const std::string& hash) {
+    return impl_->GetLocation(hash);
+}
+
+std::vector<Record> MemoryIndex::GetLowestDeletable(const unsigned int& device) {
+    return impl_->GetLowestDeletable(device);
+}
+
+std::vector<std::string> MemoryIndex::GetLowestDeletableHashes() {
+    return impl_->GetLowestDeletableHashes();
+}
+
+unsigned long long MemoryIndex::GetMetadataSize() {
+    return impl_->GetMetadataSize();
+}
+
+std::vector<Record> MemoryIndex::GetSegmentItems(const unsigned long long& segment) {
+    return impl_->GetSegmentItems(segment);
+}
+
+std::vector<unsigned long long> MemoryIndex::GetSegments() {
+    return impl_->GetSegments();
+}
+
+unsigned long long MemoryIndex::GetSegmentedSize() {
+    return impl_->GetSegmentedSize();
+}
+
+unsigned long long MemoryIndex::GetTotalSize() {
+    return impl_->GetTotalSize();
+}
+
+std::string MemoryIndex::FindHash(const unsigned long long& time_value,
+                                  const unsigned int& device) {
+    return impl_->FindHash(time_value, device);
+}
+
+Record MemoryIndex::FindNext(const unsigned long long& time_value, const unsigned int& device) {
+    return impl_->FindNext(time_value, device);
+}
+
+Record MemoryIndex::FindPrevious(const unsigned long long& time_value,
+                                 const unsigned int& device) {
+    return impl_->FindPrevious(time_value, device);
+}
+
+void MemoryIndex::Insert(const unsigned long long& time_value, const unsigned int& device,
+                         const std::string& hash, const unsigned long long& size,
+                         const unsigned int& keep) {
+    impl_->Insert('I', time_value, device, hash, size, keep, 0, 0);
+}
+
+void MemoryIndex::InsertCompressed(const unsigned long long& time_value,
+                                   const unsigned int& device, const std::string& hash,
+                                   const unsigned long long& size, const unsigned int& keep,
+                                   const unsigned int& codec,
+                                   const unsigned long long& raw_size) {
+    impl_->InsertCompressed(time_value, device, hash, size, keep, codec, raw_size);
+}
+
+void MemoryIndex::InsertPending(const unsigned long long& time_value, const unsigned int& device,
+                                const std::string& hash, const unsigned long long& size,
+                                const unsigned int& keep) {
+    impl_->Insert('P', time_value, device, hash, size, keep, 0, 0);
+}
+
+void MemoryIndex::InsertSegmented(const unsigned long long& time_value, const unsigned int& device,
+                                  const std::string& hash, const unsigned long long& size,
+                                  const unsigned int& keep, const unsigned long long& segment,
+                                  const unsigned long long& offset) {
+    impl_->Insert('G', time_value, device, hash, size, keep, segment, offset);
+}
+
+void MemoryIndex::MarkDeleting(const std::vector<std::string>& hashes) {
+    impl_->MarkDeleting(hashes);
+}
+
+bool MemoryIndex::MarkSynced(const std::vector<unsigned long long>& time_values,
+                             const unsigned int& device) {
+    return impl_->MarkSynced(time_values, device);
+}
+
+std::vector<Record> MemoryIndex::NextUnsynced(const std::size_t& limit,
+                                              const std::vector<unsigned int>& devices) {
+    return impl_->NextUnsynced(limit, devices);
+}
+
+std::vector<Record> MemoryIndex::SelectAll() {
+    return impl_->SelectAll();
+}
+
+std::vector<Record> MemoryIndex::SelectHashes(const std::vector<std::string>& hashes) {
+    return impl_->SelectHashes(hashes);
+}
+
+std::vector<Record> MemoryIndex::SelectRange(const unsigned int& device,
+                                             const unsigned long long& start_time_value,
+                                             const unsigned long long& end_time_value) {
+    return impl_->SelectRange(device, start_time_value, end_time_value);
+}
+
+bool MemoryIndex::SetKeep(const unsigned long long& time_value, const unsigned int& device,
+                          const unsigned int& keep) {
+    return impl_->SetKeep(time_value, device, keep);
+}
+
+bool MemoryIndex::BulkSetKeep(const std::vector<unsigned long long>& time_values,
+                              const unsigned int& device, const unsigned int& keep) {
+    return impl_->BulkSetKeep(time_values, device, keep);
+}
+
+bool MemoryIndex::SetKeepRange(const unsigned long long& start_time_value,
+                               const unsigned long long& end_time_value,
+                               const unsigned int& keep) {
+    return impl_->SetKeepRange(true, 0, start_time_value, end_time_value, keep);
+}
+
+bool MemoryIndex::SetKeepRange(const unsigned int& device,
+                               const unsigned long long& start_time_value,
+                               const unsigned long long& end_time_value,
+                               const unsigned int& keep) {
+    return impl_->SetKeepRange(false, device, start_time_value, end_time_value, keep);
+}
+
+void MemoryIndex::SetTracer(const std::shared_ptr<Tracer>& tracer) {
+    impl_->SetTracer(tracer);
+}
+
+void MemoryIndex::Compact() {
+    impl_->Compact();
+}
+
+} // namespace indexed
+} // namespace prism
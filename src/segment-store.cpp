@@ -0,0 +1,333 @@
+#include "indexed/segment-store.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "indexed/storage.h"
+
+
+namespace prism {
+namespace indexed {
+
+namespace fs = ::boost::filesystem;
+
+namespace {
+
+// Positioned reads and writes, with seek and transfer for the CRT that has none. The store is
+// only used by one caller at a time, so nothing moves a descriptor between the two.
+#ifdef _WIN32
+int openFile(const std::string& filepath, const bool& create) {
+    return create ? ::_open(filepath.data(), _O_RDWR | _O_CREAT | _O_EXCL | _O_BINARY,
+                            _S_IREAD | _S_IWRITE)
+                  : ::_open(filepath.data(), _O_RDONLY | _O_BINARY);
+}
+
+long long readAt(const int& fd, char* buffer, const uintmax_t& length, const uintmax_t& offset) {
+    if (::_lseeki64(fd, offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    return ::_read(fd, buffer, static_cast<unsigned int>(length));
+}
+
+long long writeAt(const int& fd, const char* buffer, const uintmax_t& length,
+                  const uintmax_t& offset) {
+    if (::_lseeki64(fd, offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    return ::_write(fd, buffer, static_cast<unsigned int>(length));
+}
+
+bool reserve(const int& fd, const uintmax_t& length) {
+    return ::_chsize_s(fd, length) == 0;
+}
+
+void closeFile(const int& fd) {
+    ::_close(fd);
+}
+#else
+int openFile(const std::string& filepath, const bool& create) {
+    return create ? ::open(filepath.data(), O_RDWR | O_CREAT | O_EXCL, 0644)
+                  : ::open(filepath.data(), O_RDONLY);
+}
+
+long long readAt(const int& fd, char* buffer, const uintmax_t& length, const uintmax_t& offset) {
+    return ::pread(fd, buffer, length, offset);
+}
+
+long long writeAt(const int& fd, const char* buffer, const uintmax_t& length,
+                  const uintmax_t& offset) {
+    return ::pwrite(fd, buffer, length, offset);
+}
+
+bool reserve(const int& fd, const uintmax_t& length) {
+#ifdef __linux__
+    return ::posix_fallocate(fd, 0, length) == 0;
+#else
+    return ::ftruncate(fd, length) == 0;
+#endif
+}
+
+void closeFile(const int& fd) {
+    ::close(fd);
+}
+#endif
+
+} // namespace
+
+class SegmentStore::Impl {
+  public:
+    Impl(Storage& storage, const uintmax_t& segment_size);
+    ~Impl();
+
+    SegmentLocation Append(const std::string& filepath);
+    SegmentLocation Copy(const SegmentLocation& location);
+    unsigned long long GetActive() const;
+    uintmax_t GetAllocatedSize() const;
+    std::string GetFilepath(const unsigned long long& segment) const;
+    std::vector<unsigned long long> List() const;
+    bool Remove(const unsigned long long& segment);
+    void Seal();
+
+  private:
+    SegmentLocation append(const int& source_fd, const uintmax_t& source_offset,
+                           const uintmax_t& length);
+    void open();
+    std::string relativeName(const unsigned long long& segment) const;
+
+    Storage& storage_;
+    uintmax_t segment_size_;
+    unsigned long long next_segment_;
+    unsigned long long active_segment_;
+    int active_fd_;
+    uintmax_t active_end_;
+    std::vector<char> copy_buffer_;
+};
+
+SegmentStore::Impl::Impl(Storage& storage, const uintmax_t& segment_size)
+        : storage_(storage),
+          segment_size_(segment_size),
+          next_segment_(1),
+          active_segment_(0),
+          active_fd_(-1),
+          active_end_(0) {
+    if (segment_size_ == 0) {
+        throw FilesystemException{"Cannot initialize a SegmentStore with an empty segment size"};
+    }
+
+    // A restart never appends to an old segment, since its committed end is only known to the
+    // index. The unused tail is given back when the segment is evicted.
+    const auto segments = List();
+    if (!segments.empty()) {
+        next_segment_ = segments.back() + 1;
+    }
+}
+
+SegmentStore::Impl::~Impl() {
+    Seal();
+}
+
+SegmentLocation SegmentStore::Impl::Append(const std::string& filepath) {
+    const auto length = fs::file_size(filepath);
+    const int source_fd = openFile(filepath, false);
+    if (source_fd < 0) {
+        throw FilesystemException{"Cannot open " + filepath + " to append to a segment"};
+    }
+
+    SegmentLocation location;
+    try {
+        location = append(source_fd, 0, length);
+    } catch (const FilesystemException& e) {
+        closeFile(source_fd);
+        throw;
+    }
+    closeFile(source_fd);
+    fs::remove(filepath);
+    return location;
+}
+
+SegmentLocation SegmentStore::Impl::Copy(const SegmentLocation& location) {
+    const auto filepath = GetFilepath(location.segment);
+    const int source_fd = openFile(filepath, false);
+    if (source_fd < 0) {
+        throw FilesystemException{"Cannot open segment " + filepath};
+    }
+
+    SegmentLocation copied;
+    try {
+        copied = append(source_fd, location.offset, location.length);
+    } catch (const FilesystemException& e) {
+        closeFile(source_fd);
+        throw;
+    }
+    closeFile(source_fd);
+    return copied;
+}
+
+unsigned long long SegmentStore::Impl::GetActive() const {
+    return active_segment_;
+}
+
+uintmax_t SegmentStore::Impl::GetAllocatedSize() const {
+    uintmax_t size = 0;
+    for (const auto& segment : List()) {
+        size += fs::file_size(GetFilepath(segment));
+    }
+    return size;
+}
+
+std::string SegmentStore::Impl::GetFilepath(const unsigned long long& segment) const {
+    return storage_.GetFilepath(relativeName(segment));
+}
+
+std::vector<unsigned long long> SegmentStore::Impl::List() const {
+    std::vector<unsigned long long> segments;
+    const fs::path directory{storage_.GetFilepath(SegmentStore::Directory())};
+    if (!fs::is_directory(directory)) {
+        return segments;
+    }
+
+    for (fs::directory_iterator it(directory), end; it != end; ++it) {
+        const auto name = it->path().filename().string();
+        if (!name.empty() && std::all_of(name.begin(), name.end(), ::isdigit)) {
+            segments.push_back(std::stoull(name));
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+bool SegmentStore::Impl::Remove(const unsigned long long& segment) {
+    if (segment == active_segment_) {
+        Seal();
+    }
+    return storage_.Delete(relativeName(segment));
+}
+
+void SegmentStore::Impl::Seal() {
+    if (active_fd_ >= 0) {
+        closeFile(active_fd_);
+    }
+    active_fd_ = -1;
+    active_segment_ = 0;
+    active_end_ = 0;
+}
+
+SegmentLocation SegmentStore::Impl::append(const int& source_fd, const uintmax_t& source_offset,
+                                           const uintmax_t& length) {
+    if (length > segment_size_) {
+        throw FilesystemException{"Item is larger than a segment"};
+    }
+    if (active_fd_ < 0 || active_end_ + length > segment_size_) {
+        open();
+    }
+
+    copy_buffer_.resize(std::max<std::size_t>(copy_buffer_.size(), length));
+    uintmax_t copied = 0;
+    while (copied < length) {
+        const auto read_size = readAt(source_fd, copy_buffer_.data() + copied, length - copied,
+                                      source_offset + copied);
+        if (read_size <= 0) {
+            throw FilesystemException{"Short read while appending to a segment"};
+        }
+        copied += read_size;
+    }
+
+    uintmax_t written = 0;
+    while (written < length) {
+        const auto write_size = writeAt(active_fd_, copy_buffer_.data() + written,
+                                        length - written, active_end_ + written);
+        if (write_size <= 0) {
+            throw FilesystemException{"Short write while appending to a segment"};
+        }
+        written += write_size;
+    }
+
+    SegmentLocation location{active_segment_, active_end_, length};
+    active_end_ += length;
+    return location;
+}
+
+void SegmentStore::Impl::open() {
+    Seal();
+    const auto segment = next_segment_++;
+    const auto filepath = GetFilepath(segment);
+    fs::create_directories(fs::path{filepath}.parent_path());
+    const int fd = openFile(filepath, true);
+    if (fd < 0) {
+        throw FilesystemException{"Cannot create segment " + filepath};
+    }
+
+    // The whole segment is reserved up front so appends never extend the file
+    if (!reserve(fd, segment_size_)) {
+        closeFile(fd);
+        fs::remove(filepath);
+        throw FilesystemException{"Cannot allocate segment " + filepath};
+    }
+
+    storage_.AddSize(segment_size_);
+    active_fd_ = fd;
+    active_segment_ = segment;
+    active_end_ = 0;
+}
+
+std::string SegmentStore::Impl::relativeName(const unsigned long long& segment) const {
+    return (fs::path{SegmentStore::Directory()} / std::to_string(segment)).string();
+}
+
+// Bridge
+
+SegmentStore::SegmentStore(Storage& storage, const uintmax_t& segment_size)
+        : impl_{new Impl{storage, segment_size}} {}
+
+SegmentStore::~SegmentStore() {}
+
+SegmentLocation SegmentStore::Append(const std::string& filepath) {
+    return impl_->Append(filepath);
+}
+
+SegmentLocation SegmentStore::Copy(const SegmentLocation& location) {
+    return impl_->Copy(location);
+}
+
+unsigned long long SegmentStore::GetActive() const {
+    return impl_->GetActive();
+}
+
+uintmax_t SegmentStore::GetAllocatedSize() const {
+    return impl_->GetAllocatedSize();
+}
+
+std::string SegmentStore::GetFilepath(const unsigned long long& segment) const {
+    return impl_->GetFilepath(segment);
+}
+
+std::vector<unsigned long long> SegmentStore::List() const {
+    return impl_->List();
+}
+
+bool SegmentStore::Remove(const unsigned long long& segment) {
+    return impl_->Remove(segment);
+}
+
+void SegmentStore::Seal() {
+    impl_->Seal();
+}
+
+const char* SegmentStore::Directory() {
+    return "prism_indexed_segments";
+}
+
+} // namespace indexed
+} // namespace prism
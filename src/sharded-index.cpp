@@ -0,0 +1,848 @@
+#include "indexed/sharded-index.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "indexed/database.h"
+
+
+namespace prism {
+namespace indexed {
+
+namespace {
+
+// A deletable row with its ordering columns parsed once, for merging shards
+struct DeletableRow {
+    unsigned long long keep;
+    unsigned long long time_value;
+    unsigned long long size;
+    std::string hash;
+};
+
+std::string shardPath(const std::string& path, const std::size_t& shard) {
+    if (shard == 0) {
+        return path;
+    }
+    static const std::string extension = ".db";
+    if (path.size() > extension.size() &&
+        path.compare(path.size() - extension.size(), extension.size(), extension) == 0) {
+        return path.substr(0, path.size() - extension.size()) + "." + std::to_string(shard) +
+               extension;
+    }
+    return path + "." + std::to_string(shard);
+}
+
+std::vector<std::string> hashesOf(const std::vector<DeletableRow>& rows) {
+    std::vector<std::string> hashes;
+    hashes.reserve(rows.size());
+    for (const auto& row : rows) {
+        hashes.push_back(row.hash);
+    }
+    return hashes;
+}
+
+} // namespace
+
+class ShardedIndex::Impl {
+  public:
+    Impl(const std::string& path, const std::size_t& shards);
+
+    void ClearIntents(const std::vector<std::string>& hashes);
+    void CompactSegment(const std::vector<std::string>& evicted_hashes,
+                        const std::vector<Record>& relocations);
+    void Delete(const std::string& hash);
+    void BulkDelete(const std::vector<std::string>& hashes);
+    std::vector<std::string> DeleteRange(const unsigned long long& start_time_value,
+                                         const unsigned long long& end_time_value);
+    std::vector<std::string> DeleteRange(const unsigned int& device,
+                                         const unsigned long long& start_time_value,
+                                         const unsigned long long& end_time_value);
+    std::vector<std::string> DeleteExpired(const unsigned long long& cutoff_time_value,
+                                           const std::size_t& limit);
+    std::vector<std::string> DeleteExpired(const unsigned int& device,
+                                           const unsigned long long& cutoff_time_value,
+                                           const std::size_t& limit);
+    std::vector<std::string> DeleteExpiredKeep(const unsigned int& keep,
+                                               const unsigned long long& cutoff_time_value,
+                                               const std::size_t& limit);
+    void FinalizePending(const std::string& hash);
+    Record GetCompression(const std::string& hash);
+    std::vector<std::string> GetDecayedDeletableHashes(const unsigned long long& decay_minutes);
+    std::map<unsigned int, unsigned long long> GetDeviceSizes();
+    std::vector<std::string> GetExpiredHashes(const unsigned long long& cutoff_time_value);
+    std::vector<Record> GetIntents();
+    std::vector<std::string> GetLargestDeletableHashes();
+    Record GetLocation(const std::string& hash);
+    std::vector<Record> GetLowestDeletable(const unsigned int& device);
+    std::vector<std::string> GetLowestDeletableHashes();
+    unsigned long long GetMetadataSize();
+    std::vector<Record> GetSegmentItems(const unsigned long long& segment);
+    std::vector<unsigned long long> GetSegments();
+    unsigned long long GetSegmentedSize();
+    unsigned long long GetTotalSize();
+    std::string FindHash(const unsigned long long& time_value, const unsigned int& device);
+    Record FindNext(const unsigned long long& time_value, const unsigned int& device);
+    Record FindPrevious(const unsigned long long& time_value, const unsigned int& device);
+    void Insert(const unsigned long long& time_value, const unsigned int& device,
+                const std::string& hash, const unsigned long long& size, const unsigned int& keep);
+    void InsertCompressed(const unsigned long long& time_value, const unsigned int& device,
+                          const std::string& hash, const unsigned long long& size,
+                          const unsigned int& keep, const unsigned int& codec,
+                          const unsigned long long& raw_size);
+    void InsertPending(const unsigned long long& time_value, const unsigned int& device,
+                       const std::string& hash, const unsigned long long& size,
+                       const unsigned int& keep);
+    void InsertSegmented(const unsigned long long& time_value, const unsigned int& device,
+                         const std::string& hash, const unsigned long long& size,
+                         const unsigned int& keep, const unsigned long long& segment,
+                         const unsigned long long& offset);
+    void MarkDeleting(const std::vector<std::string>& hashes);
+    bool MarkSynced(const std::vector<unsigned long long>& time_values,
+                    const unsigned int& device);
+    std::vector<Record> NextUnsynced(const std::size_t& limit,
+                                     const std::vector<unsigned int>& devices);
+    std::vector<Record> SelectAll();
+    std::vector<Record> SelectHashes(const std::vector<std::string>& hashes);
+    std::vector<Record> SelectRange(const unsigned int& device,
+                                    const unsigned long long& start_time_value,
+                                    const unsigned long long& end_time_value);
+    bool SetKeep(const unsigned long long& time_value, const unsigned int& device,
+                 const unsigned int& keep);
+    bool BulkSetKeep(const std::vector<unsigned long long>& time_values, const unsigned int& device,
+                     const unsigned int& keep);
+    bool SetKeepRange(const unsigned long long& start_time_value,
+                      const unsigned long long& end_time_value, const unsigned int& keep);
+    bool SetKeepRange(const unsigned int& device, const unsigned long long& start_time_value,
+                      const unsigned long long& end_time_value, const unsigned int& keep);
+    void SetTracer(const std::shared_ptr<Tracer>& tracer);
+    std::size_t GetShardCount() const;
+    std::string GetShardPath(const unsigned int& device) const;
+
+  private:
+    // Each database is used by one caller at a time, so callers on different shards run in
+    // parallel
+    struct Shard {
+        std::string path;
+        std::unique_ptr<Database> database;
+        std::mutex mutex;
+    };
+
+    Shard& shardOf(const unsigned int& device);
+    void forEach(const std::function<void(Database&)>& function);
+    std::vector<DeletableRow> deletableRows();
+    // Deletable rows of each shard, each in the order of GetLowestDeletableHashes
+    std::vector<std::vector<DeletableRow>> shardDeletableRows();
+    std::vector<std::string> deleteLimited(
+            const std::size_t& limit,
+            const std::function<std::vector<std::string>(Database&, const std::size_t&)>&
+                    function);
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+ShardedIndex::Impl::Impl(const std::string& path, const std::size_t& shards) {
+    if (shards == 0) {
+        throw DatabaseException{"ShardedIndex needs at least one shard"};
+    }
+    for (std::size_t i = 0; i < shards; ++i) {
+        std::unique_ptr<Shard> shard{new Shard};
+        shard->path = shardPath(path, i);
+        shard->database.reset(new Database{shard->path});
+        shards_.push_back(std::move(shard));
+    }
+}
+
+void ShardedIndex::Impl::ClearIntents(const std::vector<std::string>& hashes) {
+    forEach([&](Database& database) { database.ClearIntents(hashes); });
+}
+
+void ShardedIndex::Impl::CompactSegment(const std::vector<std::string>& evicted_hashes,
+                                        const std::vector<Record>& relocations) {
+    // Segments hold clips of every device, and each shard only changes the rows it has
+    forEach([&](Database& database) { database.CompactSegment(evicted_hashes, relocations); });
+}
+
+void ShardedIndex::Impl::Delete(const std::string& hash) {
+    forEach([&](Database& database) { database.Delete(hash); });
+}
+
+void ShardedIndex::Impl::BulkDelete(const std::vector<std::string>& hashes) {
+    forEach([&](Database& database) { database.BulkDelete(hashes); });
+}
+
+std::vector<std::string> ShardedIndex::Impl::DeleteRange(const unsigned long long& start_time_value,
+                                                         const unsigned long long& end_time_value) {
+    std::vector<std::string> hashes;
+    forEach([&](Database& database) {
+        auto deleted = database.DeleteRange(start_time_value, end_time_value);
+        hashes.insert(hashes.end(), deleted.begin(), deleted.end());
+    });
+    return hashes;
+}
+
+std::vector<std::string> ShardedIndex::Impl::DeleteRange(const unsigned int& device,
+                                                         const unsigned long long& start_time_value,
+                                                         const unsigned long long& end_time_value) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.database->DeleteRange(device, start_time_value, end_time_value);
+}
+
+std::vector<std::string> ShardedIndex::Impl::DeleteExpired(
+        const unsigned long long& cutoff_time_value, const std::size_t& limit) {
+    return deleteLimited(limit, [&](Database& database, const std::size_t& remaining) {
+        return database.DeleteExpired(cutoff_time_value, remaining);
+    });
+}
+
+std::vector<std::string> ShardedIndex::Impl::DeleteExpired(
+        const unsigned int& device, const unsigned long long& cutoff_time_value,
+        const std::size_t& limit) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.database->DeleteExpired(device, cutoff_time_value, limit);
+}
+
+std::vector<std::string> ShardedIndex::Impl::DeleteExpiredKeep(
+        const unsigned int& keep, const unsigned long long& cutoff_time_value,
+        const std::size_t& limit) {
+    return deleteLimited(limit, [&](Database& database, const std::size_t& remaining) {
+        return database.DeleteExpiredKeep(keep, cutoff_time_value, remaining);
+    });
+}
+
+void ShardedIndex::Impl::FinalizePending(const std::string& hash) {
+    forEach([&](Database& database) { database.FinalizePending(hash); });
+}
+
+Record ShardedIndex::Impl::GetCompression(const std::string& hash) {
+    Record record;
+    forEach([&](Database& database) {
+        if (record.empty()) {
+            record = database.GetCompression(hash);
+        }
+    });
+    return record;
+}
+
+std::vector<std::string> ShardedIndex::Impl::GetDecayedDeletableHashes(
+        const unsigned long long& decay_minutes) {
+    auto rows = deletableRows();
+    std::stable_sort(rows.begin(), rows.end(),
+                     [&decay_minutes](const DeletableRow& a, const DeletableRow& b) {
+                         return a.keep * decay_minutes + a.time_value <
+                                b.keep * decay_minutes + b.time_value;
+                     });
+    return hashesOf(rows);
+}
+
+std::map<unsigned int, unsigned long long> ShardedIndex::Impl::GetDeviceSizes() {
+    std::map<unsigned int, unsigned long long> sizes;
+    forEach([&](Database& database) {
+        auto shard_sizes = database.GetDeviceSizes();
+        sizes.insert(shard_sizes.begin(), shard_sizes.end());
+    });
+    return sizes;
+}
+
+std::vector<std::string> ShardedIndex::Impl::GetExpiredHashes(
+        const unsigned long long& cutoff_time_value) {
+    auto rows = deletableRows();
+    rows.erase(std::remove_if(rows.begin(), rows.end(),
+                              [&cutoff_time_value](const DeletableRow& row) {
+                                  return row.time_value >= cutoff_time_value;
+                              }),
+               rows.end());
+    std::stable_sort(rows.begin(), rows.end(), [](const DeletableRow& a, const DeletableRow& b) {
+        return a.time_value < b.time_value;
+    });
+    return hashesOf(rows);
+}
+
+std::vector<Record> ShardedIndex::Impl::GetIntents() {
+    // Intents by hash are written to every shard, so each is reported once
+    std::vector<Record> intents;
+    std::set<std::string> seen;
+    forEach([&](Database& database) {
+        for (auto& intent : database.GetIntents()) {
+            if (!intent.empty() && seen.insert(intent["hash"]).second) {
+                intents.push_back(intent);
+            }
+        }
+    });
+    return intents;
+}
+
+std::vector<std::string> ShardedIndex::Impl::GetLargestDeletableHashes() {
+    auto rows = deletableRows();
+    std::stable_sort(rows.begin(), rows.end(), [](const DeletableRow& a, const DeletableRow& b) {
+        return std::make_tuple(a.keep, b.size, a.time_value) <
+               std::make_tuple(b.keep, a.size, b.time_value);
+    });
+    return hashesOf(rows);
+}
+
+Record ShardedIndex::Impl::GetLocation(const std::string& hash) {
+    Record record;
+    forEach([&](Database& database) {
+        if (record.empty()) {
+            record = database.GetLocation(hash);
+        }
+    });
+    return record;
+}
+
+std::vector<Record> ShardedIndex::Impl::GetLowestDeletable(const unsigned int& device) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.database->GetLowestDeletable(device);
+}
+
+std::vector<std::string> ShardedIndex::Impl::GetLowestDeletableHashes() {
+    // Every shard returns its rows in eviction order already, so they are merged by always taking
+    // the lowest head among the shards
+    const auto shard_rows = shardDeletableRows();
+    std::size_t total = 0;
+    for (const auto& rows : shard_rows) {
+        total += rows.size();
+    }
+
+    using Head = std::tuple<unsigned long long, unsigned long long, std::size_t, std::size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    for (std::size_t i = 0; i < shard_rows.size(); ++i) {
+        if (!shard_rows[i].empty()) {
+            heads.emplace(shard_rows[i][0].keep, shard_rows[i][0].time_value, i, 0);
+        }
+    }
+    std::vector<std::string> hashes;
+    hashes.reserve(total);
+    while (!heads.empty()) {
+        const auto head = heads.top();
+        heads.pop();
+        const auto shard = std::get<2>(head);
+        const auto next = std::get<3>(head) + 1;
+        hashes.push_back(shard_rows[shard][std::get<3>(head)].hash);
+        if (next < shard_rows[shard].size()) {
+            heads.emplace(shard_rows[shard][next].keep, shard_rows[shard][next].time_value, shard,
+                          next);
+        }
+    }
+    return hashes;
+}
+
+unsigned long long ShardedIndex::Impl::GetMetadataSize() {
+    unsigned long long size = 0;
+    forEach([&](Database& database) { size += database.GetMetadataSize(); });
+    return size;
+}
+
+std::vector<Record> ShardedIndex::Impl::GetSegmentItems(const unsigned long long& segment) {
+    std::vector<Record> items;
+    forEach([&](Database& database) {
+        for (auto& item : database.GetSegmentItems(segment)) {
+            if (!item.empty()) {
+                items.push_back(item);
+            }
+        }
+    });
+    std::stable_sort(items.begin(), items.end(), [](const Record& a, const Record& b) {
+        return std::stoull(a.at("offset")) < std::stoull(b.at("offset"));
+    });
+    return items;
+}
+
+std::vector<unsigned long long> ShardedIndex::Impl::GetSegments() {
+    std::set<unsigned long long> segments;
+    forEach([&](Database& database) {
+        auto shard_segments = database.GetSegments();
+        segments.insert(shard_segments.begin(), shard_segments.end());
+    });
+    return std::vector<unsigned long long>{segments.begin(), segments.end()};
+}
+
+unsigned long long ShardedIndex::Impl::GetSegmentedSize() {
+    unsigned long long size = 0;
+    forEach([&](Database& database) { size += database.GetSegmentedSize(); });
+    return size;
+}
+
+unsigned long long ShardedIndex::Impl::GetTotalSize() {
+    unsigned long long size = 0;
+    forEach([&](Database& database) { size += database.GetTotalSize(); });
+    return size;
+}
+
+std::string ShardedIndex::Impl::FindHash(const unsigned long long& time_value,
+                                         const unsigned int& device) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.database->FindHash(time_value, device);
+}
+
+Record ShardedIndex::Impl::FindNext(const unsigned long long& time_value,
+                                    const unsigned int& device) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.database->FindNext(time_value, device);
+}
+
+Record ShardedIndex::Impl::FindPrevious(const unsigned long long& time_value,
+                                        const unsigned int& device) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.database->FindPrevious(time_value, device);
+}
+
+void ShardedIndex::Impl::Insert(const unsigned long long& time_value, const unsigned int& device,
+                                const std::string& hash, const unsigned long long& size,
+                                const unsigned int& keep) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.database->Insert(time_value, device, hash, size, keep);
+}
+
+void ShardedIndex::Impl::InsertCompressed(const unsigned long long& time_value,
+                                          const unsigned int& device, const std::string& hash,
+                                          const unsigned long long& size,
+                                          const unsigned int& keep, const unsigned int& codec,
+                                          const unsigned long long& raw_size) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.database->InsertCompressed(time_value, device, hash, size, keep, codec, raw_size);
+}
+
+void ShardedIndex::Impl::InsertPending(const unsigned long long& time_value,
+                                       const unsigned int& device, const std::string& hash,
+                                       const unsigned long long& size, const unsigned int& keep) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.database->InsertPending(time_value, device, hash, size, keep);
+}
+
+void ShardedIndex::Impl::InsertSegmented(const unsigned long long& time_value,
+                                         const unsigned int& device, const std::string& hash,
+                                         const unsigned long long& size, const unsigned int& keep,
+                                         const unsigned long long& segment,
+                                         const unsigned long long& offset) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.database->InsertSegmented(time_value, device, hash, size, keep, segment, offset);
+}
+
+void ShardedIndex::Impl::MarkDeleting(const std::vector<std::string>& hashes) {
+    forEach([&](Database& database) { database.MarkDeleting(hashes); });
+}
+
+std::vector<Record> ShardedIndex::Impl::SelectAll() {
+    std::vector<Record> records;
+    forEach([&](Database& database) {
+        for (auto& record : database.SelectAll()) {
+            if (!record.empty()) {
+                records.push_back(record);
+            }
+        }
+    });
+    std::stable_sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+        return std::make_pair(std::stoul(a.at("device")), std::stoull(a.at("time_value"))) <
+               std::make_pair(std::stoul(b.at("device")), std::stoull(b.at("time_value")));
+    });
+    return records;
+}
+
+bool ShardedIndex::Impl::MarkSynced(const std::vector<unsigned long long>& time_values,
+                                    const unsigned int& device) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.database->MarkSynced(time_values, device);
+}
+
+std::vector<Record> ShardedIndex::Impl::NextUnsynced(const std::size_t& limit,
+                                                     const std::vector<unsigned int>& devices) {
+    // Each shard returns its first limit rows, and the first limit of those are the first of all
+    using Position = std::pair<unsigned long long, unsigned int>;
+    std::vector<std::pair<Position, Record>> rows;
+    auto collect = [&](Database& database, const std::vector<unsigned int>& shard_devices) {
+        for (auto& record : database.NextUnsynced(limit, shard_devices)) {
+            if (!record.empty()) {
+                Position position{std::stoull(record["time_value"]),
+                                  static_cast<unsigned int>(std::stoul(record["device"]))};
+                rows.emplace_back(position, std::move(record));
+            }
+        }
+    };
+
+    if (devices.empty()) {
+        forEach([&](Database& database) { collect(database, devices); });
+    } else {
+        std::map<Shard*, std::vector<unsigned int>> shard_devices;
+        for (const auto& device : devices) {
+            shard_devices[&shardOf(device)].push_back(device);
+        }
+        for (auto& item : shard_devices) {
+            std::lock_guard<std::mutex> lock(item.first->mutex);
+            collect(*item.first->database, item.second);
+        }
+    }
+
+    std::sort(rows.begin(), rows.end(),
+              [](const std::pair<Position, Record>& a, const std::pair<Position, Record>& b) {
+                  return a.first < b.first;
+              });
+    std::vector<Record> records;
+    for (auto& row : rows) {
+        if (records.size() >= limit) {
+            break;
+        }
+        records.push_back(std::move(row.second));
+    }
+    return records;
+}
+
+std::vector<Record> ShardedIndex::Impl::SelectHashes(const std::vector<std::string>& hashes) {
+    // A hash alone does not say which shard holds it
+    std::vector<Record> records;
+    if (hashes.empty()) {
+        return records;
+    }
+    forEach([&](Database& database) {
+        for (auto& record : database.SelectHashes(hashes)) {
+            if (!record.empty()) {
+                records.push_back(record);
+            }
+        }
+    });
+    return records;
+}
+
+std::vector<Record> ShardedIndex::Impl::SelectRange(const unsigned int& device,
+                                                    const unsigned long long& start_time_value,
+                                                    const unsigned long long& end_time_value) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.database->SelectRange(device, start_time_value, end_time_value);
+}
+
+bool ShardedIndex::Impl::SetKeep(const unsigned long long& time_value, const unsigned int& device,
+                                 const unsigned int& keep) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.database->SetKeep(time_value, device, keep);
+}
+
+bool ShardedIndex::Impl::BulkSetKeep(const std::vector<unsigned long long>& time_values,
+                                     const unsigned int& device, const unsigned int& keep) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.database->BulkSetKeep(time_values, device, keep);
+}
+
+bool ShardedIndex::Impl::SetKeepRange(const unsigned long long& start_time_value,
+                                      const unsigned long long& end_time_value,
+                                      const unsigned int& keep) {
+    bool set = false;
+    forEach([&](Database& database) {
+        set = database.SetKeepRange(start_time_value, end_time_value, keep) || set;
+    });
+    return set;
+}
+
+bool ShardedIndex::Impl::SetKeepRange(const unsigned int& device,
+                                      const unsigned long long& start_time_value,
+                                      const unsigned long long& end_time_value,
+                                      const unsigned int& keep) {
+    auto& shard = shardOf(device);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.database->SetKeepRange(device, start_time_value, end_time_value, keep);
+}
+
+void ShardedIndex::Impl::SetTracer(const std::shared_ptr<Tracer>& tracer) {
+    forEach([&](Database& database) { database.SetTracer(tracer); });
+}
+
+std::size_t ShardedIndex::Impl::GetShardCount() const {
+    return shards_.size();
+}
+
+std::string ShardedIndex::Impl::GetShardPath(const unsigned int& device) const {
+    return shards_[device % shards_.size()]->path;
+}
+
+ShardedIndex::Impl::Shard& ShardedIndex::Impl::shardOf(const unsigned int& device) {
+    return *shards_[device % shards_.size()];
+}
+
+void ShardedIndex::Impl::forEach(const std::function<void(Database&)>& function) {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        function(*shard->database);
+    }
+}
+
+std::vector<DeletableRow> ShardedIndex::Impl::deletableRows() {
+    std::vector<DeletableRow> rows;
+    for (auto& shard : shardDeletableRows()) {
+        std::move(shard.begin(), shard.end(), std::back_inserter(rows));
+    }
+    return rows;
+}
+
+std::vector<std::vector<DeletableRow>> ShardedIndex::Impl::shardDeletableRows() {
+    std::vector<std::vector<DeletableRow>> shard_rows;
+    forEach([&](Database& database) {
+        std::vector<DeletableRow> rows;
+        for (auto& record : database.SelectDeletable()) {
+            if (!record.empty()) {
+                rows.push_back(DeletableRow{std::stoull(record["keep"]),
+                                            std::stoull(record["time_value"]),
+                                            std::stoull(record["size"]), record["hash"]});
+            }
+        }
+        shard_rows.push_back(std::move(rows));
+    });
+    return shard_rows;
+}
+
+std::vector<std::string> ShardedIndex::Impl::deleteLimited(
+        const std::size_t& limit,
+        const std::function<std::vector<std::string>(Database&, const std::size_t&)>& function) {
+    // Shards are asked in turn for what is left of the limit, so the limit holds across them all
+    std::vector<std::string> hashes;
+    forEach([&](Database& database) {
+        if (hashes.size() < limit) {
+            auto deleted = function(database, limit - hashes.size());
+            hashes.insert(hashes.end(), deleted.begin(), deleted.end());
+        }
+    });
+    return hashes;
+}
+
+
+// Bridge
+
+ShardedIndex::ShardedIndex(const std::string& path, const std::size_t& shards)
+        : impl_{new Impl{path, shards}} {}
+
+ShardedIndex::~ShardedIndex() {}
+
+void ShardedIndex::ClearIntents(const std::vector<std::string>& hashes) {
+    impl_->ClearIntents(hashes);
+}
+
+void ShardedIndex::CompactSegment(const std::vector<std::string>& evicted_hashes,
+                                  const std::vector<Record>& relocations) {
+    impl_->CompactSegment(evicted_hashes, relocations);
+}
+
+void ShardedIndex::Delete(const std::string& hash) {
+    impl_->Delete(hash);
+}
+
+void ShardedIndex::BulkDelete(const std::vector<std::string>& hashes) {
+    impl_->BulkDelete(hashes);
+}
+
+std::vector<std::string> ShardedIndex::DeleteRange(const unsigned long long& start_time_value,
+                                                   const unsigned long long& end_time_value) {
+    return impl_->DeleteRange(start_time_value, end_time_value);
+}
+
+std::vector<std::string> ShardedIndex::DeleteRange(const unsigned int& device,
+                                                   const unsigned long long& start_time_value,
+                                                   const unsigned long long& end_time_value) {
+    return impl_->DeleteRange(device, start_time_value, end_time_value);
+}
+
+std::vector<std::string> ShardedIndex::DeleteExpired(const unsigned long long& cutoff_time_value,
+                                                     const std::size_t& limit) {
+    return impl_->DeleteExpired(cutoff_time_value, limit);
+}
+
+std::vector<std::string> ShardedIndex::DeleteExpired(const unsigned int& device,
+                                                     const unsigned long long& cutoff_time_value,
+                                                     const std::size_t& limit) {
+    return impl_->DeleteExpired(device, cutoff_time_value, limit);
+}
+
+std::vector<std::string> ShardedIndex::DeleteExpiredKeep(
+        const unsigned int& keep, const unsigned long long& cutoff_time_value,
+        const std::size_t& limit) {
+    return impl_->DeleteExpiredKeep(keep, cutoff_time_value, limit);
+}
+
+void ShardedIndex::FinalizePending(const std::string& hash) {
+    impl_->FinalizePending(hash);
+}
+
+Record ShardedIndex::GetCompression(const std::string& hash) {
+    return impl_->GetCompression(hash);
+}
+
+std::vector<std::string> ShardedIndex::GetDecayedDeletableHashes(
+        const unsigned long long& decay_minutes) {
+    return impl_->GetDecayedDeletableHashes(decay_minutes);
+}
+
+std::map<unsigned int, unsigned long long> ShardedIndex::GetDeviceSizes() {
+    return impl_->GetDeviceSizes();
+}
+
+std::vector<std::string> ShardedIndex::GetExpiredHashes(
+        const unsigned long long& cutoff_time_value) {
+    return impl_->GetExpiredHashes(cutoff_time_value);
+}
+
+std::vector<Record> ShardedIndex::GetIntents() {
+    return impl_->GetIntents();
+}
+
+std::vector<std::string> ShardedIndex::GetLargestDeletableHashes() {
+    return impl_->GetLargestDeletableHashes();
+}
+
+Record ShardedIndex::GetLocation(const std::string& hash) {
+    return impl_->GetLocation(hash);
+}
+
+std::vector<Record> ShardedIndex::GetLowestDeletable(const unsigned int& device) {
+    return impl_->GetLowestDeletable(device);
+}
+
+std::vector<std::string> ShardedIndex::GetLowestDeletableHashes() {
+    return impl_->GetLowestDeletableHashes();
+}
+
+unsigned long long ShardedIndex::GetMetadataSize() {
+    return impl_->GetMetadataSize();
+}
+
+std::vector<Record> ShardedIndex::GetSegmentItems(const unsigned long long& segment) {
+    return impl_->GetSegmentItems(segment);
+}
+
+std::vector<unsigned long long> ShardedIndex::GetSegments() {
+    return impl_->GetSegments();
+}
+
+unsigned long long ShardedIndex::GetSegmentedSize() {
+    return impl_->GetSegmentedSize();
+}
+
+unsigned long long ShardedIndex::GetTotalSize() {
+    return impl_->GetTotalSize();
+}
+
+std::string ShardedIndex::FindHash(const unsigned long long& time_value,
+                                   const unsigned int& device) {
+    return impl_->FindHash(time_value, device);
+}
+
+Record ShardedIndex::FindNext(const unsigned long long& time_value, const unsigned int& device) {
+    return impl_->FindNext(time_value, device);
+}
+
+Record ShardedIndex::FindPrevious(const unsigned long long& time_value,
+                                  const unsigned int& device) {
+    return impl_->FindPrevious(time_value, device);
+}
+
+void ShardedIndex::Insert(const unsigned long long& time_value, const unsigned int& device,
+                          const std::string& hash, const unsigned long long& size,
+                          const unsigned int& keep) {
+    impl_->Insert(time_value, device, hash, size, keep);
+}
+
+void ShardedIndex::InsertCompressed(const unsigned long long& time_value,
+                                    const unsigned int& device, const std::string& hash,
+                                    const unsigned long long& size, const unsigned int& keep,
+                                    const unsigned int& codec,
+                                    const unsigned long long& raw_size) {
+    impl_->InsertCompressed(time_value, device, hash, size, keep, codec, raw_size);
+}
+
+void ShardedIndex::InsertPending(const unsigned long long& time_value, const unsigned int& device,
+                                 const std::string& hash, const unsigned long long& size,
+                                 const unsigned int& keep) {
+    impl_->InsertPending(time_value, device, hash, size, keep);
+}
+
+void ShardedIndex::InsertSegmented(const unsigned long long& time_value,
+                                   const unsigned int& device, const std::string& hash,
+                                   const unsigned long long& size, const unsigned int& keep,
+                                   const unsigned long long& segment,
+                                   const unsigned long long& offset) {
+    impl_->InsertSegmented(time_value, device, hash, size, keep, segment, offset);
+}
+
+void ShardedIndex::MarkDeleting(const std::vector<std::string>& hashes) {
+    impl_->MarkDeleting(hashes);
+}
+
+bool ShardedIndex::MarkSynced(const std::vector<unsigned long long>& time_values,
+                              const unsigned int& device) {
+    return impl_->MarkSynced(time_values, device);
+}
+
+std::vector<Record> ShardedIndex::NextUnsynced(const std::size_t& limit,
+                                               const std::vector<unsigned int>& devices) {
+    return impl_->NextUnsynced(limit, devices);
+}
+
+std::vector<Record> ShardedIndex::SelectAll() {
+    return impl_->SelectAll();
+}
+
+std::vector<Record> ShardedIndex::SelectHashes(const std::vector<std::string>& hashes) {
+    return impl_->SelectHashes(hashes);
+}
+
+std::vector<Record> ShardedIndex::SelectRange(const unsigned int& device,
+                                              const unsigned long long& start_time_value,
+                                              const unsigned long long& end_time_value) {
+    return impl_->SelectRange(device, start_time_value, end_time_value);
+}
+
+bool ShardedIndex::SetKeep(const unsigned long long& time_value, const unsigned int& device,
+                           const unsigned int& keep) {
+    return impl_->SetKeep(time_value, device, keep);
+}
+
+bool ShardedIndex::BulkSetKeep(const std::vector<unsigned long long>& time_values,
+                               const unsigned int& device, const unsigned int& keep) {
+    return impl_->BulkSetKeep(time_values, device, keep);
+}
+
+bool ShardedIndex::SetKeepRange(const unsigned long long& start_time_value,
+                                const unsigned long long& end_time_value,
+                                const unsigned int& keep) {
+    return impl_->SetKeepRange(start_time_value, end_time_value, keep);
+}
+
+bool ShardedIndex::SetKeepRange(const unsigned int& device,
+                                const unsigned long long& start_time_value,
+                                const unsigned long long& end_time_value,
+                                const unsigned int& keep) {
+    return impl_->SetKeepRange(device, start_time_value, end_time_value, keep);
+}
+
+void ShardedIndex::SetTracer(const std::shared_ptr<Tracer>& tracer) {
+    impl_->SetTracer(tracer);
+}
+
+std::size_t ShardedIndex::GetShardCount() const {
+    return impl_->GetShardCount();
+}
+
+std::string ShardedIndex::GetShardPath(const unsigned int& device) const {
+    return impl_->GetShardPath(device);
+}
+
+} // namespace indexed
+} // namespace prism
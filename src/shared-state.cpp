@@ -0,0 +1,363 @@
+#include "indexed/shared-state.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "indexed/storage.h"
+
+
+namespace prism {
+namespace indexed {
+
+namespace fs = ::boost::filesystem;
+
+namespace {
+
+const uint64_t shared_magic = 0x707269736d736831;
+
+// Laid out in the mapped file. The counters waited on are 32 bits wide, as a futex word must be.
+struct SharedBlock {
+    std::atomic<uint64_t> magic;
+    std::atomic<uintmax_t> size;
+    std::atomic<uint32_t> changes;
+    std::atomic<uint32_t> eviction_requests;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "Counters shared between processes must be lock free");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "Counters waited on must have the layout of a futex word");
+
+#ifndef _WIN32
+int openFile(const fs::path& filepath) {
+    const int fd = ::open(filepath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw FilesystemException{"Cannot open " + filepath.string()};
+    }
+    return fd;
+}
+
+void lockFile(const int& fd, const int& operation) {
+    while (::flock(fd, operation) != 0) {
+        if (errno != EINTR) {
+            throw FilesystemException{"Cannot lock shared buffer state"};
+        }
+    }
+}
+
+bool waitFor(const std::atomic<uint32_t>& word, const uint32_t& expected,
+             const std::chrono::milliseconds& timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (word.load() == expected) {
+        const auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            return false;
+        }
+#ifdef __linux__
+        // Sleeps only while the word still holds expected, so a change made in between is not
+        // missed. A timeout, wakeup or signal all go back around the loop.
+        struct timespec wait_time;
+        wait_time.tv_sec = remaining.count() / 1000000000;
+        wait_time.tv_nsec = remaining.count() % 1000000000;
+        ::syscall(SYS_futex, reinterpret_cast<const uint32_t*>(&word), FUTEX_WAIT, expected,
+                  &wait_time, nullptr, 0);
+#else
+        std::this_thread::sleep_for(
+                std::min<std::chrono::nanoseconds>(remaining, std::chrono::milliseconds{10}));
+#endif
+    }
+    return true;
+}
+
+void wake(std::atomic<uint32_t>& word) {
+    ++word;
+#ifdef __linux__
+    ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr,
+              nullptr, 0);
+#endif
+}
+#endif
+
+} // namespace
+
+class SharedState::Impl {
+  public:
+    Impl(const std::string& buffer_directory);
+    ~Impl();
+
+    bool IsFresh() const;
+    std::atomic<uintmax_t>& Size();
+    void Lock();
+    void Unlock();
+    bool AcquireOwnership();
+    bool IsOwner() const;
+    unsigned int GetChangeSequence() const;
+    void NotifyChange();
+    bool WaitForChange(const unsigned int& sequence,
+                       const std::chrono::milliseconds& timeout) const;
+    unsigned int GetEvictionRequests() const;
+    void RequestEviction();
+    bool WaitForEvictionRequest(const unsigned int& seen,
+                                const std::chrono::milliseconds& timeout) const;
+
+  private:
+    void close();
+
+    int block_fd_;
+    int lock_fd_;
+    int owner_fd_;
+    SharedBlock* block_;
+    bool fresh_;
+    std::atomic<bool> owner_;
+};
+
+#ifndef _WIN32
+SharedState::Impl::Impl(const std::string& buffer_directory)
+        : block_fd_(-1), lock_fd_(-1), owner_fd_(-1), block_(nullptr), fresh_(false),
+          owner_(false) {
+    // Named after the database so Reconcile leaves them alone
+    const fs::path directory{buffer_directory};
+    try {
+        block_fd_ = openFile(directory / "prism_indexed_data.shared");
+        lock_fd_ = openFile(directory / "prism_indexed_data.lock");
+        owner_fd_ = openFile(directory / "prism_indexed_data.owner");
+
+        // Every process holds a shared lock on the mapped file while it has the buffer open. One
+        // that can lock it exclusively is alone, and counters left by processes that have since
+        // exited are stale. The check runs under the change lock so two processes opening the
+        // buffer at once cannot both find themselves alone.
+        lockFile(lock_fd_, LOCK_EX);
+        fresh_ = ::flock(block_fd_, LOCK_EX | LOCK_NB) == 0;
+        lockFile(block_fd_, LOCK_SH);
+
+        struct stat status;
+        if (::fstat(block_fd_, &status) != 0 ||
+                (static_cast<std::size_t>(status.st_size) < sizeof(SharedBlock) &&
+                 ::ftruncate(block_fd_, sizeof(SharedBlock)) != 0)) {
+            throw FilesystemException{"Cannot size shared buffer state"};
+        }
+        void* mapping = ::mmap(nullptr, sizeof(SharedBlock), PROT_READ | PROT_WRITE, MAP_SHARED,
+                               block_fd_, 0);
+        if (mapping == MAP_FAILED) {
+            throw FilesystemException{"Cannot map shared buffer state"};
+        }
+        block_ = static_cast<SharedBlock*>(mapping);
+
+        if (fresh_ || block_->magic != shared_magic) {
+            block_->size = 0;
+            block_->eviction_requests = 0;
+            block_->magic = shared_magic;
+            fresh_ = true;
+        }
+        lockFile(lock_fd_, LOCK_UN);
+    } catch (const FilesystemException& e) {
+        close();
+        throw;
+    }
+}
+
+SharedState::Impl::~Impl() {
+    close();
+}
+
+bool SharedState::Impl::IsFresh() const {
+    return fresh_;
+}
+
+std::atomic<uintmax_t>& SharedState::Impl::Size() {
+    return block_->size;
+}
+
+void SharedState::Impl::Lock() {
+    lockFile(lock_fd_, LOCK_EX);
+}
+
+void SharedState::Impl::Unlock() {
+    ::flock(lock_fd_, LOCK_UN);
+}
+
+bool SharedState::Impl::AcquireOwnership() {
+    if (!owner_ && ::flock(owner_fd_, LOCK_EX | LOCK_NB) == 0) {
+        owner_ = true;
+    }
+    return owner_;
+}
+
+bool SharedState::Impl::IsOwner() const {
+    return owner_;
+}
+
+unsigned int SharedState::Impl::GetChangeSequence() const {
+    return block_->changes;
+}
+
+void SharedState::Impl::NotifyChange() {
+    wake(block_->changes);
+}
+
+bool SharedState::Impl::WaitForChange(const unsigned int& sequence,
+                                      const std::chrono::milliseconds& timeout) const {
+    return waitFor(block_->changes, sequence, timeout);
+}
+
+unsigned int SharedState::Impl::GetEvictionRequests() const {
+    return block_->eviction_requests;
+}
+
+void SharedState::Impl::RequestEviction() {
+    wake(block_->eviction_requests);
+}
+
+bool SharedState::Impl::WaitForEvictionRequest(const unsigned int& seen,
+                                               const std::chrono::milliseconds& timeout) const {
+    return waitFor(block_->eviction_requests, seen, timeout);
+}
+
+void SharedState::Impl::close() {
+    // Closing the files drops every lock held through them
+    if (block_) {
+        ::munmap(block_, sizeof(SharedBlock));
+    }
+    for (const auto& fd : {block_fd_, lock_fd_, owner_fd_}) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+#else
+// The state leans on flock, mmap and futexes, so elsewhere opening a shared buffer fails up front
+// and nothing past the constructor is ever reached
+SharedState::Impl::Impl(const std::string&)
+        : block_fd_(-1), lock_fd_(-1), owner_fd_(-1), block_(nullptr), fresh_(false),
+          owner_(false) {
+    throw FilesystemException{"Shared buffers are only supported on POSIX systems"};
+}
+
+SharedState::Impl::~Impl() {}
+
+bool SharedState::Impl::IsFresh() const {
+    return fresh_;
+}
+
+std::atomic<uintmax_t>& SharedState::Impl::Size() {
+    return block_->size;
+}
+
+void SharedState::Impl::Lock() {}
+
+void SharedState::Impl::Unlock() {}
+
+bool SharedState::Impl::AcquireOwnership() {
+    return owner_;
+}
+
+bool SharedState::Impl::IsOwner() const {
+    return owner_;
+}
+
+unsigned int SharedState::Impl::GetChangeSequence() const {
+    return 0;
+}
+
+void SharedState::Impl::NotifyChange() {}
+
+bool SharedState::Impl::WaitForChange(const unsigned int&,
+                                      const std::chrono::milliseconds&) const {
+    return false;
+}
+
+unsigned int SharedState::Impl::GetEvictionRequests() const {
+    return 0;
+}
+
+void SharedState::Impl::RequestEviction() {}
+
+bool SharedState::Impl::WaitForEvictionRequest(const unsigned int&,
+                                               const std::chrono::milliseconds&) const {
+    return false;
+}
+
+void SharedState::Impl::close() {}
+#endif
+
+
+// Bridge
+
+SharedState::SharedState(const std::string& buffer_directory)
+        : impl_{new Impl{buffer_directory}} {}
+
+SharedState::~SharedState() {}
+
+bool SharedState::IsFresh() const {
+    return impl_->IsFresh();
+}
+
+std::atomic<uintmax_t>& SharedState::Size() {
+    return impl_->Size();
+}
+
+void SharedState::lock() {
+    impl_->Lock();
+}
+
+void SharedState::unlock() {
+    impl_->Unlock();
+}
+
+bool SharedState::AcquireOwnership() {
+    return impl_->AcquireOwnership();
+}
+
+bool SharedState::IsOwner() const {
+    return impl_->IsOwner();
+}
+
+unsigned int SharedState::GetChangeSequence() const {
+    return impl_->GetChangeSequence();
+}
+
+void SharedState::NotifyChange() {
+    impl_->NotifyChange();
+}
+
+bool SharedState::WaitForChange(const unsigned int& sequence,
+                                const std::chrono::milliseconds& timeout) const {
+    return impl_->WaitForChange(sequence, timeout);
+}
+
+unsigned int SharedState::GetEvictionRequests() const {
+    return impl_->GetEvictionRequests();
+}
+
+void SharedState::RequestEviction() {
+    impl_->RequestEviction();
+}
+
+bool SharedState::WaitForEvictionRequest(const unsigned int& seen,
+                                         const std::chrono::milliseconds& timeout) const {
+    return impl_->WaitForEvictionRequest(seen, timeout);
+}
+
+} // namespace indexed
+} // namespace prism
@@ -0,0 +1,328 @@
+#include "indexed/stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace prism {
+namespace indexed {
+
+namespace {
+
+// Eight linear buckets below 8ns, then eight per power of two up to 2^41ns (about 36 minutes)
+const std::size_t sub_buckets = 8;
+const std::size_t sub_bucket_bits = 3;
+const std::size_t max_magnitude = 40;
+const std::size_t bucket_count = (max_magnitude - 1) * sub_buckets;
+
+const Operation operations[] = {Operation::BulkKeepIfPossible, Operation::BulkPreserveRecord,
+                                Operation::BulkSetLowPriority, Operation::Delete,
+                                Operation::DeleteRange,        Operation::Expire,
+                                Operation::FindNearest,        Operation::Full,
+                                Operation::GetCatalog,         Operation::GetFilepath,
+                                Operation::GetFilepaths,       Operation::GetLocation,
+                                Operation::KeepIfPossible,     Operation::MarkSynced,
+                                Operation::NextUnsynced,       Operation::PreserveRecord,
+                                Operation::Push,               Operation::Reconcile,
+                                Operation::SetKeepRange,       Operation::SetLowPriority};
+const Phase phases[] = {Phase::LockWait, Phase::QuotaCheck, Phase::Eviction, Phase::Move,
+                        Phase::Insert};
+
+std::size_t highestBit(uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return index;
+#elif defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    std::size_t index = 0;
+    while (value >>= 1) {
+        ++index;
+    }
+    return index;
+#endif
+}
+
+class Histogram {
+  public:
+    Histogram() : count_(0), sum_(0), max_(0) {
+        for (auto& bucket : buckets_) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Record(const uint64_t& nanoseconds) {
+        buckets_[Stats::BucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(nanoseconds, std::memory_order_relaxed);
+        auto max = max_.load(std::memory_order_relaxed);
+        while (nanoseconds > max &&
+               !max_.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+        }
+    }
+
+    HistogramSnapshot Snapshot() const {
+        HistogramSnapshot snapshot{count_.load(std::memory_order_relaxed),
+                                   sum_.load(std::memory_order_relaxed),
+                                   max_.load(std::memory_order_relaxed),
+                                   std::vector<uint64_t>(bucket_count, 0)};
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        }
+        return snapshot;
+    }
+
+  private:
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+    std::atomic<uint64_t> buckets_[bucket_count];
+};
+
+void writeHistogram(std::stringstream& stream, const std::string& metric, const std::string& label,
+                    const std::string& name, const HistogramSnapshot& histogram) {
+    // Every fourth power of two from about a microsecond to about a minute. Each one falls on a
+    // bucket boundary, so the cumulative counts are exact.
+    uint64_t cumulative = 0;
+    std::size_t index = 0;
+    for (std::size_t magnitude = 10; magnitude <= 36; magnitude += 2) {
+        const uint64_t bound = uint64_t{1} << magnitude;
+        for (; index < histogram.buckets.size() && Stats::BucketLowerBound(index + 1) <= bound;
+             ++index) {
+            cumulative += histogram.buckets[index];
+        }
+        stream << metric << "_bucket{" << label << "=\"" << name << "\",le=\""
+               << bound / 1e9 << "\"} " << cumulative << "\n";
+    }
+    stream << metric << "_bucket{" << label << "=\"" << name << "\",le=\"+Inf\"} "
+           << histogram.count << "\n";
+    stream << metric << "_sum{" << label << "=\"" << name << "\"} " << histogram.sum / 1e9
+           << "\n";
+    stream << metric << "_count{" << label << "=\"" << name << "\"} " << histogram.count << "\n";
+}
+
+} // namespace
+
+class Stats::Impl {
+  public:
+    Impl();
+
+    void AddEvicted(const uint64_t& files, const uint64_t& bytes);
+    void AddIngested(const uint64_t& bytes);
+    void Record(const Operation& operation, const std::chrono::nanoseconds& elapsed);
+    void Record(const Phase& phase, const std::chrono::nanoseconds& elapsed);
+    StatsSnapshot Snapshot() const;
+
+  private:
+    Histogram operations_[sizeof(operations) / sizeof(operations[0])];
+    Histogram phases_[sizeof(phases) / sizeof(phases[0])];
+    std::atomic<uint64_t> bytes_ingested_;
+    std::atomic<uint64_t> bytes_evicted_;
+    std::atomic<uint64_t> files_evicted_;
+};
+
+Stats::Impl::Impl() : bytes_ingested_(0), bytes_evicted_(0), files_evicted_(0) {}
+
+void Stats::Impl::AddEvicted(const uint64_t& files, const uint64_t& bytes) {
+    files_evicted_.fetch_add(files, std::memory_order_relaxed);
+    bytes_evicted_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Stats::Impl::AddIngested(const uint64_t& bytes) {
+    bytes_ingested_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Stats::Impl::Record(const Operation& operation, const std::chrono::nanoseconds& elapsed) {
+    operations_[static_cast<std::size_t>(operation)].Record(elapsed.count());
+}
+
+void Stats::Impl::Record(const Phase& phase, const std::chrono::nanoseconds& elapsed) {
+    phases_[static_cast<std::size_t>(phase)].Record(elapsed.count());
+}
+
+StatsSnapshot Stats::Impl::Snapshot() const {
+    StatsSnapshot snapshot;
+    for (const auto& operation : operations) {
+        snapshot.operations[Stats::Name(operation)] =
+                operations_[static_cast<std::size_t>(operation)].Snapshot();
+    }
+    for (const auto& phase : phases) {
+        snapshot.phases[Stats::Name(phase)] = phases_[static_cast<std::size_t>(phase)].Snapshot();
+    }
+    snapshot.bytes_ingested = bytes_ingested_.load(std::memory_order_relaxed);
+    snapshot.bytes_evicted = bytes_evicted_.load(std::memory_order_relaxed);
+    snapshot.files_evicted = files_evicted_.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+uint64_t HistogramSnapshot::Percentile(const double& quantile) const {
+    if (count == 0) {
+        return 0;
+    }
+
+    const auto rank = static_cast<uint64_t>(quantile * (count - 1)) + 1;
+    uint64_t seen = 0;
+    for (std::size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::min(Stats::BucketLowerBound(i + 1) - 1, max);
+        }
+    }
+    return max;
+}
+
+// Bridge
+
+Stats::Stats() : impl_{new Impl{}} {}
+
+Stats::~Stats() {}
+
+void Stats::AddEvicted(const uint64_t& files, const uint64_t& bytes) {
+    impl_->AddEvicted(files, bytes);
+}
+
+void Stats::AddIngested(const uint64_t& bytes) {
+    impl_->AddIngested(bytes);
+}
+
+void Stats::Record(const Operation& operation, const std::chrono::nanoseconds& elapsed) {
+    impl_->Record(operation, elapsed);
+}
+
+void Stats::Record(const Phase& phase, const std::chrono::nanoseconds& elapsed) {
+    impl_->Record(phase, elapsed);
+}
+
+StatsSnapshot Stats::Snapshot() const {
+    return impl_->Snapshot();
+}
+
+std::size_t Stats::BucketIndex(const uint64_t& nanoseconds) {
+    if (nanoseconds < sub_buckets) {
+        return nanoseconds;
+    }
+
+    std::size_t magnitude = highestBit(nanoseconds);
+    if (magnitude > max_magnitude) {
+        return bucket_count - 1;
+    }
+    auto sub_bucket = (nanoseconds >> (magnitude - sub_bucket_bits)) & (sub_buckets - 1);
+    return (magnitude - 2) * sub_buckets + sub_bucket;
+}
+
+uint64_t Stats::BucketLowerBound(const std::size_t& index) {
+    if (index < sub_buckets) {
+        return index;
+    }
+
+    const auto magnitude = index / sub_buckets + 2;
+    const auto sub_bucket = index % sub_buckets;
+    return (sub_buckets + sub_bucket) << (magnitude - sub_bucket_bits);
+}
+
+std::string Stats::FormatPrometheus(const StatsSnapshot& snapshot) {
+    std::stringstream stream;
+    stream << std::setprecision(9);
+
+    stream << "# HELP prism_indexed_operation_seconds Latency of public Buffer operations.\n";
+    stream << "# TYPE prism_indexed_operation_seconds histogram\n";
+    for (const auto& operation : snapshot.operations) {
+        writeHistogram(stream, "prism_indexed_operation_seconds", "operation", operation.first,
+                       operation.second);
+    }
+
+    stream << "# HELP prism_indexed_phase_seconds Latency of internal Push phases.\n";
+    stream << "# TYPE prism_indexed_phase_seconds histogram\n";
+    for (const auto& phase : snapshot.phases) {
+        writeHistogram(stream, "prism_indexed_phase_seconds", "phase", phase.first,
+                       phase.second);
+    }
+
+    stream << "# HELP prism_indexed_ingested_bytes_total Bytes moved into the buffer.\n";
+    stream << "# TYPE prism_indexed_ingested_bytes_total counter\n";
+    stream << "prism_indexed_ingested_bytes_total " << snapshot.bytes_ingested << "\n";
+    stream << "# HELP prism_indexed_evicted_bytes_total Bytes evicted to stay under quota.\n";
+    stream << "# TYPE prism_indexed_evicted_bytes_total counter\n";
+    stream << "prism_indexed_evicted_bytes_total " << snapshot.bytes_evicted << "\n";
+    stream << "# HELP prism_indexed_evicted_files_total Files evicted to stay under quota.\n";
+    stream << "# TYPE prism_indexed_evicted_files_total counter\n";
+    stream << "prism_indexed_evicted_files_total " << snapshot.files_evicted << "\n";
+
+    return stream.str();
+}
+
+const char* Stats::Name(const Operation& operation) {
+    switch (operation) {
+        case Operation::BulkKeepIfPossible:
+            return "bulk_keep_if_possible";
+        case Operation::BulkPreserveRecord:
+            return "bulk_preserve_record";
+        case Operation::BulkSetLowPriority:
+            return "bulk_set_low_priority";
+        case Operation::Delete:
+            return "delete";
+        case Operation::DeleteRange:
+            return "delete_range";
+        case Operation::Expire:
+            return "expire";
+        case Operation::FindNearest:
+            return "find_nearest";
+        case Operation::Full:
+            return "full";
+        case Operation::GetCatalog:
+            return "get_catalog";
+        case Operation::GetFilepath:
+            return "get_filepath";
+        case Operation::GetFilepaths:
+            return "get_filepaths";
+        case Operation::GetLocation:
+            return "get_location";
+        case Operation::KeepIfPossible:
+            return "keep_if_possible";
+        case Operation::MarkSynced:
+            return "mark_synced";
+        case Operation::NextUnsynced:
+            return "next_unsynced";
+        case Operation::PreserveRecord:
+            return "preserve_record";
+        case Operation::Push:
+            return "push";
+        case Operation::Reconcile:
+            return "reconcile";
+        case Operation::SetKeepRange:
+            return "set_keep_range";
+        case Operation::SetLowPriority:
+            return "set_low_priority";
+    }
+    return "unknown";
+}
+
+const char* Stats::Name(const Phase& phase) {
+    switch (phase) {
+        case Phase::LockWait:
+            return "lock_wait";
+        case Phase::QuotaCheck:
+            return "quota_check";
+        case Phase::Eviction:
+            return "eviction";
+        case Phase::Move:
+            return "move";
+        case Phase::Insert:
+            return "insert";
+    }
+    return "unknown";
+}
+
+} // namespace indexed
+} // namespace prism
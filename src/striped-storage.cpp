@@ -0,0 +1,359 @@
+#include "indexed/striped-storage.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "indexed/filesystem.h"
+
+
+namespace prism {
+namespace indexed {
+
+namespace fs = ::boost::filesystem;
+
+class StripedStorage::Impl {
+  public:
+    Impl(const std::string& buffer_directory, const std::vector<std::string>& roots,
+         const double& gigabyte_quota, const StripePlacement& placement);
+
+    void AddSize(const uintmax_t& bytes);
+    bool AboveQuota(const uintmax_t& releasing_bytes);
+    bool Delete(const std::string& filename);
+    std::size_t BulkDelete(const std::vector<std::string>& filenames);
+    std::string GetBufferDirectory() const;
+    std::string GetExistingFilepath(const std::string& filename) const;
+    std::string GetFilepath(const std::string& filename) const;
+    uintmax_t GetFileSize(const std::string& filename) const;
+    uintmax_t GetSize() const;
+    void SetSize(const uintmax_t& size);
+    void SetTracer(const std::shared_ptr<Tracer>& tracer);
+    bool VerifySize(const std::atomic<bool>& cancel);
+    bool Move(const std::string& filepath_move_from, const std::string& filename_move_to);
+    bool Link(const std::string& filename_link_from, const std::string& filename_link_to);
+    FileListing Scan(const std::chrono::steady_clock::time_point& deadline,
+                     const unsigned int& threads) const;
+    std::vector<std::string> GetDegradedRoots() const;
+    uintmax_t GetRootSize(const std::size_t& root) const;
+
+  private:
+    // Runs function for every root, each on a thread of its own so the disks work in parallel
+    template <typename Function>
+    void forEachRoot(Function function) const {
+        if (roots_.size() == 1) {
+            function(0);
+            return;
+        }
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < roots_.size(); ++i) {
+            threads.emplace_back(function, i);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    Filesystem* place();
+
+    std::vector<std::unique_ptr<Filesystem>> roots_;
+    std::vector<std::string> degraded_;
+    double byte_quota_;
+    StripePlacement placement_;
+    std::atomic<std::size_t> next_root_;
+};
+
+StripedStorage::Impl::Impl(const std::string& buffer_directory,
+                           const std::vector<std::string>& roots, const double& gigabyte_quota,
+                           const StripePlacement& placement)
+        : byte_quota_(0), placement_(placement), next_root_(0) {
+    // Every root is walked for its size on a thread of its own. Each root is given the whole
+    // quota, so only its disk running out of space holds it back.
+    std::vector<std::unique_ptr<Filesystem>> candidates(roots.size());
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < roots.size(); ++i) {
+        threads.emplace_back([&, i]() {
+            try {
+                if (!roots[i].empty() && !fs::is_directory(roots[i])) {
+                    return;
+                }
+                std::unique_ptr<Filesystem> root{
+                        new Filesystem{buffer_directory, roots[i], gigabyte_quota, false}};
+                std::atomic<bool> cancel{false};
+                root->VerifySize(cancel);
+                candidates[i] = std::move(root);
+            } catch (const FilesystemException& e) {
+            } catch (const fs::filesystem_error& e) {
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (std::size_t i = 0; i < roots.size(); ++i) {
+        if (candidates[i]) {
+            roots_.push_back(std::move(candidates[i]));
+        } else {
+            degraded_.push_back(roots[i]);
+        }
+    }
+    if (roots_.empty()) {
+        throw FilesystemException{"StripedStorage has no usable root"};
+    }
+    byte_quota_ = gigabyte_quota * 1024 * 1024 * 1024 * roots_.size() / roots.size();
+}
+
+void StripedStorage::Impl::AddSize(const uintmax_t& bytes) {
+    roots_.front()->AddSize(bytes);
+}
+
+bool StripedStorage::Impl::AboveQuota(const uintmax_t& releasing_bytes) {
+    const auto size = GetSize();
+    if (size - std::min(size, releasing_bytes) > byte_quota_) {
+        return true;
+    }
+    for (const auto& root : roots_) {
+        if (!root->AboveQuota(0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool StripedStorage::Impl::Delete(const std::string& filename) {
+    for (const auto& root : roots_) {
+        if (root->Delete(filename)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::size_t StripedStorage::Impl::BulkDelete(const std::vector<std::string>& filenames) {
+    // Each root takes the whole batch and deletes the files it holds
+    std::vector<std::size_t> deleted(roots_.size(), 0);
+    forEachRoot([&](const std::size_t& i) { deleted[i] = roots_[i]->BulkDelete(filenames); });
+    std::size_t total = 0;
+    for (const auto& count : deleted) {
+        total += count;
+    }
+    return total;
+}
+
+std::string StripedStorage::Impl::GetBufferDirectory() const {
+    return roots_.front()->GetBufferDirectory();
+}
+
+std::string StripedStorage::Impl::GetExistingFilepath(const std::string& filename) const {
+    for (const auto& root : roots_) {
+        auto filepath = root->GetExistingFilepath(filename);
+        if (!filepath.empty()) {
+            return filepath;
+        }
+    }
+    return std::string{};
+}
+
+std::string StripedStorage::Impl::GetFilepath(const std::string& filename) const {
+    return roots_.front()->GetFilepath(filename);
+}
+
+uintmax_t StripedStorage::Impl::GetFileSize(const std::string& filename) const {
+    for (const auto& root : roots_) {
+        if (!root->GetExistingFilepath(filename).empty()) {
+            return root->GetFileSize(filename);
+        }
+    }
+    return 0;
+}
+
+uintmax_t StripedStorage::Impl::GetSize() const {
+    uintmax_t size = 0;
+    for (const auto& root : roots_) {
+        size += root->GetSize();
+    }
+    return size;
+}
+
+void StripedStorage::Impl::SetSize(const uintmax_t& size) {
+    // The other roots keep their walked sizes, and the rest of the total is on the first
+    uintmax_t others = 0;
+    for (std::size_t i = 1; i < roots_.size(); ++i) {
+        others += roots_[i]->GetSize();
+    }
+    roots_.front()->SetSize(size - std::min(size, others));
+}
+
+void StripedStorage::Impl::SetTracer(const std::shared_ptr<Tracer>& tracer) {
+    for (const auto& root : roots_) {
+        root->SetTracer(tracer);
+    }
+}
+
+bool StripedStorage::Impl::VerifySize(const std::atomic<bool>& cancel) {
+    std::vector<char> verified(roots_.size(), false);
+    forEachRoot([&](const std::size_t& i) { verified[i] = roots_[i]->VerifySize(cancel); });
+    return std::all_of(verified.begin(), verified.end(), [](const char& v) { return v; });
+}
+
+bool StripedStorage::Impl::Move(const std::string& filepath_move_from,
+                                const std::string& filename_move_to) {
+    // Files are never rebalanced between roots afterwards. Each root is its own disk, so moving a
+    // file across is a copy that rename cannot batch, and the roots only fill unevenly while one
+    // is passed over for being nearly full. The per-root batches that do exist, BulkDelete on
+    // every root at once, already go through each root's IoEngine.
+    return place()->Move(filepath_move_from, filename_move_to);
+}
+
+bool StripedStorage::Impl::Link(const std::string& filename_link_from,
+                                const std::string& filename_link_to) {
+    // A hard link cannot cross disks, so it is made on the root holding the file
+    for (const auto& root : roots_) {
+        if (!root->GetExistingFilepath(filename_link_from).empty()) {
+            return root->Link(filename_link_from, filename_link_to);
+        }
+    }
+    return false;
+}
+
+FileListing StripedStorage::Impl::Scan(const std::chrono::steady_clock::time_point& deadline,
+                                       const unsigned int& threads) const {
+    std::vector<FileListing> listings(roots_.size());
+    forEachRoot([&](const std::size_t& i) { listings[i] = roots_[i]->Scan(deadline, threads); });
+    FileListing listing;
+    listing.complete = true;
+    for (const auto& root_listing : listings) {
+        listing.files.insert(listing.files.end(), root_listing.files.begin(),
+                             root_listing.files.end());
+        listing.complete = listing.complete && root_listing.complete;
+    }
+    return listing;
+}
+
+std::vector<std::string> StripedStorage::Impl::GetDegradedRoots() const {
+    return degraded_;
+}
+
+uintmax_t StripedStorage::Impl::GetRootSize(const std::size_t& root) const {
+    return root < roots_.size() ? roots_[root]->GetSize() : 0;
+}
+
+Filesystem* StripedStorage::Impl::place() {
+    // Roots whose disks are nearly full are passed over while any other has room
+    std::vector<Filesystem*> open;
+    for (const auto& root : roots_) {
+        if (!root->AboveQuota(0)) {
+            open.push_back(root.get());
+        }
+    }
+    if (open.empty()) {
+        return roots_[next_root_++ % roots_.size()].get();
+    }
+
+    if (placement_ == StripePlacement::FreeSpace) {
+        Filesystem* most_free = open.front();
+        uintmax_t most_available = 0;
+        for (const auto& root : open) {
+            boost::system::error_code error_code;
+            const auto space_info = fs::space(root->GetBufferDirectory(), error_code);
+            if (!error_code && space_info.available > most_available) {
+                most_free = root;
+                most_available = space_info.available;
+            }
+        }
+        return most_free;
+    }
+    return open[next_root_++ % open.size()];
+}
+
+
+// Bridge
+
+StripedStorage::StripedStorage(const std::string& buffer_directory,
+                               const std::vector<std::string>& roots,
+                               const double& gigabyte_quota, const StripePlacement& placement)
+        : impl_{new Impl{buffer_directory, roots, gigabyte_quota, placement}} {}
+
+StripedStorage::~StripedStorage() {}
+
+void StripedStorage::AddSize(const uintmax_t& bytes) {
+    impl_->AddSize(bytes);
+}
+
+bool StripedStorage::AboveQuota() {
+    return impl_->AboveQuota(0);
+}
+
+bool StripedStorage::AboveQuota(const uintmax_t& releasing_bytes) {
+    return impl_->AboveQuota(releasing_bytes);
+}
+
+bool StripedStorage::Delete(const std::string& filename) {
+    return impl_->Delete(filename);
+}
+
+std::size_t StripedStorage::BulkDelete(const std::vector<std::string>& filenames) {
+    return impl_->BulkDelete(filenames);
+}
+
+std::string StripedStorage::GetBufferDirectory() const {
+    return impl_->GetBufferDirectory();
+}
+
+std::string StripedStorage::GetExistingFilepath(const std::string& filename) const {
+    return impl_->GetExistingFilepath(filename);
+}
+
+std::string StripedStorage::GetFilepath(const std::string& filename) const {
+    return impl_->GetFilepath(filename);
+}
+
+uintmax_t StripedStorage::GetFileSize(const std::string& filename) const {
+    return impl_->GetFileSize(filename);
+}
+
+uintmax_t StripedStorage::GetSize() const {
+    return impl_->GetSize();
+}
+
+void StripedStorage::SetSize(const uintmax_t& size) {
+    impl_->SetSize(size);
+}
+
+void StripedStorage::SetTracer(const std::shared_ptr<Tracer>& tracer) {
+    impl_->SetTracer(tracer);
+}
+
+bool StripedStorage::VerifySize(const std::atomic<bool>& cancel) {
+    return impl_->VerifySize(cancel);
+}
+
+bool StripedStorage::Move(const std::string& filepath_move_from,
+                          const std::string& filename_move_to) {
+    return impl_->Move(filepath_move_from, filename_move_to);
+}
+
+bool StripedStorage::Link(const std::string& filename_link_from,
+                          const std::string& filename_link_to) {
+    return impl_->Link(filename_link_from, filename_link_to);
+}
+
+FileListing StripedStorage::Scan(const std::chrono::steady_clock::time_point& deadline,
+                                 const unsigned int& threads) const {
+    return impl_->Scan(deadline, threads);
+}
+
+std::vector<std::string> StripedStorage::GetDegradedRoots() const {
+    return impl_->GetDegradedRoots();
+}
+
+uintmax_t StripedStorage::GetRootSize(const std::size_t& root) const {
+    return impl_->GetRootSize(root);
+}
+
+} // namespace indexed
+} // namespace prism
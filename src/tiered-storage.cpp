@@ -0,0 +1,548 @@
+#include "indexed/tiered-storage.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "indexed/filesystem.h"
+
+
+namespace prism {
+namespace indexed {
+
+namespace fs = ::boost::filesystem;
+
+namespace {
+
+// Files starting with this belong to the index, segments or staging and never move between tiers
+const std::string reserved_prefix = Storage::ReservedPrefix();
+// Demoted files are copied in here on the slower tier and renamed into place once complete. A
+// crash leaves only partial copies there, which are removed at startup.
+const std::string staging_directory = reserved_prefix + "_staging";
+
+} // namespace
+
+class TieredStorage::Impl {
+  public:
+    Impl(const std::string& buffer_directory, const std::vector<StorageTier>& tiers,
+         const double& demote_fraction);
+    ~Impl();
+
+    void AddSize(const uintmax_t& bytes);
+    bool AboveQuota(const uintmax_t& releasing_bytes);
+    bool Delete(const std::string& filename);
+    std::size_t BulkDelete(const std::vector<std::string>& filenames);
+    std::string GetBufferDirectory() const;
+    std::string GetExistingFilepath(const std::string& filename) const;
+    std::string GetFilepath(const std::string& filename) const;
+    uintmax_t GetFileSize(const std::string& filename) const;
+    uintmax_t GetSize() const;
+    void SetSize(const uintmax_t& size);
+    void SetTracer(const std::shared_ptr<Tracer>& tracer);
+    bool VerifySize(const std::atomic<bool>& cancel);
+    bool Move(const std::string& filepath_move_from, const std::string& filename_move_to);
+    bool Link(const std::string& filename_link_from, const std::string& filename_link_to);
+    FileListing Scan(const std::chrono::steady_clock::time_point& deadline,
+                     const unsigned int& threads) const;
+    std::size_t Demote();
+    uintmax_t GetTierSize(const std::size_t& tier) const;
+
+  private:
+    // Every tier but the last keeps its files in the order they arrived, which is the order they
+    // are demoted in
+    struct Tier {
+        std::unique_ptr<Filesystem> storage;
+        uintmax_t quota;
+        std::map<unsigned long long, std::string> order;
+        std::unordered_map<std::string, unsigned long long> positions;
+    };
+
+    static bool copyFile(const std::string& source, const std::string& destination);
+
+    bool demote(const std::size_t& tier, const std::string& filename);
+    void forget(Tier& tier, const std::string& filename);
+    void load(Tier& tier);
+    std::size_t locate(const std::string& filename) const;
+    void move();
+    bool overFull(const Tier& tier) const;
+    void remember(const std::size_t& tier, const std::string& filename);
+
+    std::vector<Tier> tiers_;
+    double demote_fraction_;
+    unsigned long long next_position_;
+    std::shared_ptr<Tracer> tracer_;
+
+    mutable std::mutex mutex_;
+    // Held through a whole Demote, so a call racing the mover cannot demote past the fraction
+    std::mutex demote_mutex_;
+    std::condition_variable move_condition_;
+    bool demote_requested_;
+    bool stopping_;
+    std::thread mover_;
+};
+
+TieredStorage::Impl::Impl(const std::string& buffer_directory,
+                          const std::vector<StorageTier>& tiers, const double& demote_fraction)
+        : demote_fraction_(demote_fraction),
+          next_position_(0),
+          demote_requested_(true),
+          stopping_(false) {
+    if (tiers.empty()) {
+        throw FilesystemException{"TieredStorage needs at least one tier"};
+    }
+
+    // Only the faster tiers are walked at startup, for their sizes and the order to demote their
+    // files in. The last tier is sized from the index through SetSize like a lone Filesystem.
+    for (const auto& tier : tiers) {
+        tiers_.push_back(Tier{std::unique_ptr<Filesystem>{new Filesystem{
+                                      buffer_directory, tier.root, tier.gigabyte_quota, false}},
+                              static_cast<uintmax_t>(tier.gigabyte_quota * 1024 * 1024 * 1024),
+                              {},
+                              {}});
+    }
+    for (std::size_t i = 1; i < tiers_.size(); ++i) {
+        boost::system::error_code error_code;
+        fs::remove_all(tiers_[i].storage->GetFilepath(staging_directory), error_code);
+    }
+    for (std::size_t i = 0; i + 1 < tiers_.size(); ++i) {
+        load(tiers_[i]);
+    }
+    // A crash between renaming a demoted copy into place and deleting the faster one leaves the
+    // file on both tiers. The faster copy is the one the tier map knows, so the other goes.
+    for (std::size_t i = 0; i + 1 < tiers_.size(); ++i) {
+        for (const auto& position : tiers_[i].positions) {
+            for (std::size_t j = i + 1; j < tiers_.size(); ++j) {
+                if (!tiers_[j].storage->GetExistingFilepath(position.first).empty()) {
+                    forget(tiers_[j], position.first);
+                    tiers_[j].storage->Delete(position.first);
+                }
+            }
+        }
+    }
+
+    mover_ = std::thread{&TieredStorage::Impl::move, this};
+}
+
+TieredStorage::Impl::~Impl() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    move_condition_.notify_all();
+    mover_.join();
+}
+
+void TieredStorage::Impl::AddSize(const uintmax_t& bytes) {
+    tiers_.front().storage->AddSize(bytes);
+}
+
+bool TieredStorage::Impl::AboveQuota(const uintmax_t& releasing_bytes) {
+    uintmax_t quota = 0;
+    for (const auto& tier : tiers_) {
+        quota += tier.quota;
+    }
+    const auto size = GetSize();
+    return size - std::min(size, releasing_bytes) > quota ||
+           tiers_.back().storage->AboveQuota(releasing_bytes);
+}
+
+bool TieredStorage::Impl::Delete(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& tier = tiers_[locate(filename)];
+    forget(tier, filename);
+    return tier.storage->Delete(filename);
+}
+
+std::size_t TieredStorage::Impl::BulkDelete(const std::vector<std::string>& filenames) {
+    // Each tier takes the part of the batch it holds, so the batching survives
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::vector<std::string>> batches(tiers_.size());
+    for (const auto& filename : filenames) {
+        const auto tier = locate(filename);
+        forget(tiers_[tier], filename);
+        batches[tier].push_back(filename);
+    }
+    std::size_t deleted = 0;
+    for (std::size_t i = 0; i < tiers_.size(); ++i) {
+        if (!batches[i].empty()) {
+            deleted += tiers_[i].storage->BulkDelete(batches[i]);
+        }
+    }
+    return deleted;
+}
+
+std::string TieredStorage::Impl::GetBufferDirectory() const {
+    return tiers_.front().storage->GetBufferDirectory();
+}
+
+std::string TieredStorage::Impl::GetExistingFilepath(const std::string& filename) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tiers_[locate(filename)].storage->GetExistingFilepath(filename);
+}
+
+std::string TieredStorage::Impl::GetFilepath(const std::string& filename) const {
+    return tiers_.front().storage->GetFilepath(filename);
+}
+
+uintmax_t TieredStorage::Impl::GetFileSize(const std::string& filename) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tiers_[locate(filename)].storage->GetFileSize(filename);
+}
+
+uintmax_t TieredStorage::Impl::GetSize() const {
+    uintmax_t size = 0;
+    for (const auto& tier : tiers_) {
+        size += tier.storage->GetSize();
+    }
+    return size;
+}
+
+void TieredStorage::Impl::SetSize(const uintmax_t& size) {
+    // The faster tiers were measured at startup, and the rest of the total is on the last
+    uintmax_t measured = 0;
+    for (std::size_t i = 0; i + 1 < tiers_.size(); ++i) {
+        measured += tiers_[i].storage->GetSize();
+    }
+    tiers_.back().storage->SetSize(size - std::min(size, measured));
+}
+
+void TieredStorage::Impl::SetTracer(const std::shared_ptr<Tracer>& tracer) {
+    // The mover may be running, and it only touches the tracers under the lock
+    std::lock_guard<std::mutex> lock(mutex_);
+    tracer_ = tracer;
+    for (auto& tier : tiers_) {
+        tier.storage->SetTracer(tracer);
+    }
+}
+
+bool TieredStorage::Impl::VerifySize(const std::atomic<bool>& cancel) {
+    for (auto& tier : tiers_) {
+        if (!tier.storage->VerifySize(cancel)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TieredStorage::Impl::Move(const std::string& filepath_move_from,
+                               const std::string& filename_move_to) {
+    boost::system::error_code error_code;
+    const auto incoming = fs::file_size(filepath_move_from, error_code);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::size_t i = 0; i < tiers_.size(); ++i) {
+        auto& tier = tiers_[i];
+        if (i + 1 < tiers_.size() && tier.storage->GetSize() + incoming > tier.quota) {
+            continue;
+        }
+        if (!tier.storage->Move(filepath_move_from, filename_move_to)) {
+            return false;
+        }
+        remember(i, filename_move_to);
+        if (i + 1 < tiers_.size() && overFull(tier)) {
+            demote_requested_ = true;
+            move_condition_.notify_one();
+        }
+        return true;
+    }
+    return false;
+}
+
+bool TieredStorage::Impl::Link(const std::string& filename_link_from,
+                               const std::string& filename_link_to) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto tier = locate(filename_link_from);
+    if (!tiers_[tier].storage->Link(filename_link_from, filename_link_to)) {
+        return false;
+    }
+    remember(tier, filename_link_to);
+    return true;
+}
+
+FileListing TieredStorage::Impl::Scan(const std::chrono::steady_clock::time_point& deadline,
+                                      const unsigned int& threads) const {
+    FileListing listing;
+    listing.complete = true;
+    for (const auto& tier : tiers_) {
+        auto tier_listing = tier.storage->Scan(deadline, threads);
+        listing.files.insert(listing.files.end(), tier_listing.files.begin(),
+                             tier_listing.files.end());
+        listing.complete = listing.complete && tier_listing.complete;
+    }
+    return listing;
+}
+
+std::size_t TieredStorage::Impl::Demote() {
+    std::shared_ptr<Tracer> tracer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tracer = tracer_;
+    }
+    PRISM_INDEXED_TRACE_SPAN(tracer, "TieredStorage::Demote");
+    std::lock_guard<std::mutex> demote_lock(demote_mutex_);
+    std::size_t demoted = 0;
+    for (std::size_t i = 0; i + 1 < tiers_.size(); ++i) {
+        while (true) {
+            std::string filename;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto& tier = tiers_[i];
+                if (stopping_ || tier.order.empty() || !overFull(tier)) {
+                    break;
+                }
+                filename = tier.order.begin()->second;
+            }
+            if (demote(i, filename)) {
+                ++demoted;
+                continue;
+            }
+
+            // A file that failed to copy keeps its place and is tried again on the next pass
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!tiers_[i].storage->GetExistingFilepath(filename).empty()) {
+                break;
+            }
+            forget(tiers_[i], filename);
+        }
+    }
+    return demoted;
+}
+
+uintmax_t TieredStorage::Impl::GetTierSize(const std::size_t& tier) const {
+    return tier < tiers_.size() ? tiers_[tier].storage->GetSize() : 0;
+}
+
+bool TieredStorage::Impl::copyFile(const std::string& source, const std::string& destination) {
+    boost::system::error_code error_code;
+    fs::create_directories(fs::path{destination}.parent_path(), error_code);
+    fs::remove(destination, error_code);
+    fs::copy_file(source, destination, error_code);
+    if (error_code) {
+        return false;
+    }
+
+    // The faster copy is removed right after the rename, so the slower one must be on disk first
+#ifdef _WIN32
+    const int fd = ::_open(destination.data(), _O_WRONLY | _O_BINARY);
+    if (fd < 0) {
+        return false;
+    }
+    const bool synced = ::_commit(fd) == 0;
+    ::_close(fd);
+#else
+    const int fd = ::open(destination.data(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    const bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+#endif
+    return synced;
+}
+
+bool TieredStorage::Impl::demote(const std::size_t& tier, const std::string& filename) {
+    auto& from = tiers_[tier];
+    auto& to = tiers_[tier + 1];
+    const auto source = from.storage->GetExistingFilepath(filename);
+    const auto staging = to.storage->GetFilepath(staging_directory + "/" + filename);
+    boost::system::error_code error_code;
+    // The copy runs without the lock, so pushes and reads carry on while a large file moves
+    if (source.empty() || !copyFile(source, staging)) {
+        fs::remove(staging, error_code);
+        return false;
+    }
+
+    // A file deleted during the copy must not come back on the slower tier. The tier map
+    // switches under the same lock as the rename, so lookups find exactly one copy throughout.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (from.storage->GetExistingFilepath(filename).empty() ||
+        !to.storage->Move(staging, filename)) {
+        fs::remove(staging, error_code);
+        return false;
+    }
+    forget(from, filename);
+    remember(tier + 1, filename);
+    from.storage->Delete(filename);
+    return true;
+}
+
+void TieredStorage::Impl::forget(Tier& tier, const std::string& filename) {
+    auto found = tier.positions.find(filename);
+    if (found != tier.positions.end()) {
+        tier.order.erase(found->second);
+        tier.positions.erase(found);
+    }
+}
+
+void TieredStorage::Impl::load(Tier& tier) {
+    auto listing =
+            tier.storage->Scan(std::chrono::steady_clock::time_point::max(),
+                               std::max(1U, std::thread::hardware_concurrency()));
+    uintmax_t size = 0;
+    std::vector<std::pair<std::time_t, std::string>> files;
+    for (const auto& file : listing.files) {
+        size += file.second;
+        if (file.first.compare(0, reserved_prefix.size(), reserved_prefix) == 0) {
+            continue;
+        }
+        boost::system::error_code error_code;
+        const auto modified =
+                fs::last_write_time(tier.storage->GetFilepath(file.first), error_code);
+        files.emplace_back(error_code ? 0 : modified, file.first);
+    }
+    tier.storage->SetSize(size);
+
+    std::sort(files.begin(), files.end());
+    for (const auto& file : files) {
+        const auto position = next_position_++;
+        tier.order[position] = file.second;
+        tier.positions[file.second] = position;
+    }
+}
+
+// The tier holding filename, from the faster tiers' maps and the last tier for anything they do
+// not hold. Reserved files are not mapped and never move, so they are looked for in order.
+std::size_t TieredStorage::Impl::locate(const std::string& filename) const {
+    const bool reserved = filename.compare(0, reserved_prefix.size(), reserved_prefix) == 0;
+    for (std::size_t i = 0; i + 1 < tiers_.size(); ++i) {
+        if (reserved && !tiers_[i].storage->GetExistingFilepath(filename).empty()) {
+            return i;
+        }
+        if (tiers_[i].positions.count(filename)) {
+            return i;
+        }
+    }
+    return tiers_.size() - 1;
+}
+
+void TieredStorage::Impl::move() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        move_condition_.wait(lock, [this]() { return stopping_ || demote_requested_; });
+        if (stopping_) {
+            return;
+        }
+        demote_requested_ = false;
+        lock.unlock();
+        Demote();
+        lock.lock();
+    }
+}
+
+bool TieredStorage::Impl::overFull(const Tier& tier) const {
+    return tier.storage->GetSize() > demote_fraction_ * tier.quota;
+}
+
+void TieredStorage::Impl::remember(const std::size_t& tier, const std::string& filename) {
+    if (tier + 1 == tiers_.size() ||
+        filename.compare(0, reserved_prefix.size(), reserved_prefix) == 0) {
+        return;
+    }
+    forget(tiers_[tier], filename);
+    const auto position = next_position_++;
+    tiers_[tier].order[position] = filename;
+    tiers_[tier].positions[filename] = position;
+}
+
+
+// Bridge
+
+TieredStorage::TieredStorage(const std::string& buffer_directory,
+                             const std::vector<StorageTier>& tiers,
+                             const double& demote_fraction)
+        : impl_{new Impl{buffer_directory, tiers, demote_fraction}} {}
+
+TieredStorage::~TieredStorage() {}
+
+void TieredStorage::AddSize(const uintmax_t& bytes) {
+    impl_->AddSize(bytes);
+}
+
+bool TieredStorage::AboveQuota() {
+    return impl_->AboveQuota(0);
+}
+
+bool TieredStorage::AboveQuota(const uintmax_t& releasing_bytes) {
+    return impl_->AboveQuota(releasing_bytes);
+}
+
+bool TieredStorage::Delete(const std::string& filename) {
+    return impl_->Delete(filename);
+}
+
+std::size_t TieredStorage::BulkDelete(const std::vector<std::string>& filenames) {
+    return impl_->BulkDelete(filenames);
+}
+
+std::string TieredStorage::GetBufferDirectory() const {
+    return impl_->GetBufferDirectory();
+}
+
+std::string TieredStorage::GetExistingFilepath(const std::string& filename) const {
+    return impl_->GetExistingFilepath(filename);
+}
+
+std::string TieredStorage::GetFilepath(const std::string& filename) const {
+    return impl_->GetFilepath(filename);
+}
+
+uintmax_t TieredStorage::GetFileSize(const std::string& filename) const {
+    return impl_->GetFileSize(filename);
+}
+
+uintmax_t TieredStorage::GetSize() const {
+    return impl_->GetSize();
+}
+
+void TieredStorage::SetSize(const uintmax_t& size) {
+    impl_->SetSize(size);
+}
+
+void TieredStorage::SetTracer(const std::shared_ptr<Tracer>& tracer) {
+    impl_->SetTracer(tracer);
+}
+
+bool TieredStorage::VerifySize(const std::atomic<bool>& cancel) {
+    return impl_->VerifySize(cancel);
+}
+
+bool TieredStorage::Move(const std::string& filepath_move_from,
+                         const std::string& filename_move_to) {
+    return impl_->Move(filepath_move_from, filename_move_to);
+}
+
+bool TieredStorage::Link(const std::string& filename_link_from,
+                         const std::string& filename_link_to) {
+    return impl_->Link(filename_link_from, filename_link_to);
+}
+
+FileListing TieredStorage::Scan(const std::chrono::steady_clock::time_point& deadline,
+                                const unsigned int& threads) const {
+    return impl_->Scan(deadline, threads);
+}
+
+std::size_t TieredStorage::Demote() {
+    return impl_->Demote();
+}
+
+uintmax_t TieredStorage::GetTierSize(const std::size_t& tier) const {
+    return impl_->GetTierSize(tier);
+}
+
+} // namespace indexed
+} // namespace prism
@@ -0,0 +1,145 @@
+#include "indexed/trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+
+namespace prism {
+namespace indexed {
+
+namespace {
+
+unsigned long processId() {
+#ifdef _WIN32
+    return ::_getpid();
+#else
+    return ::getpid();
+#endif
+}
+
+} // namespace
+
+class ChromeTracer::Impl {
+  public:
+    Impl(const std::string& filepath);
+    ~Impl();
+
+    void Flush();
+    void Write(const char* name, const char& phase);
+
+  private:
+    static std::string escape(const char* name);
+
+    void flush(std::unique_lock<std::mutex>& lock);
+
+    std::mutex mutex_;
+    // Taken before mutex_ is released, so batches reach the file in the order they were cut
+    std::mutex write_mutex_;
+    std::ofstream out_stream_;
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point last_flush_;
+    std::map<std::thread::id, unsigned int> thread_ids_;
+    std::string pending_;
+    unsigned long pid_;
+    bool first_event_;
+};
+
+ChromeTracer::Impl::Impl(const std::string& filepath)
+        : out_stream_{filepath},
+          start_{std::chrono::steady_clock::now()},
+          last_flush_{start_},
+          pid_{processId()},
+          first_event_{true} {
+    out_stream_ << "[";
+    out_stream_.flush();
+}
+
+ChromeTracer::Impl::~Impl() {
+    Flush();
+    out_stream_ << "\n]\n";
+}
+
+void ChromeTracer::Impl::Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    flush(lock);
+}
+
+void ChromeTracer::Impl::Write(const char* name, const char& phase) {
+    // Events are gathered in memory and written a batch at a time, so a traced call only waits on
+    // the file when it is the one to cut a batch
+    static const std::size_t batch_size = 64 * 1024;
+    static const std::chrono::seconds batch_age{1};
+    const auto now = std::chrono::steady_clock::now();
+    const auto timestamp =
+            std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(now - start_);
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    // Thread ids are numbered in order of first appearance, which the viewers show as lanes
+    auto thread_id = thread_ids_.emplace(std::this_thread::get_id(), thread_ids_.size()).first;
+    std::ostringstream event;
+    event << (first_event_ ? "\n" : ",\n")
+          << "{\"name\":\"" << escape(name) << "\","
+          << "\"cat\":\"prism_indexed\","
+          << "\"ph\":\"" << phase << "\","
+          << "\"ts\":" << std::fixed << timestamp.count() << ","
+          << "\"pid\":" << pid_ << ","
+          << "\"tid\":" << thread_id->second << "}";
+    pending_.append(event.str());
+    first_event_ = false;
+    if (pending_.size() >= batch_size || now - last_flush_ >= batch_age) {
+        flush(lock);
+    }
+}
+
+void ChromeTracer::Impl::flush(std::unique_lock<std::mutex>& lock) {
+    std::string batch;
+    batch.swap(pending_);
+    last_flush_ = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    lock.unlock();
+    out_stream_ << batch;
+    out_stream_.flush();
+}
+
+std::string ChromeTracer::Impl::escape(const char* name) {
+    std::string escaped;
+    for (auto character = name; *character; ++character) {
+        if (*character == '"' || *character == '\\') {
+            escaped.push_back('\\');
+        }
+        escaped.push_back(*character);
+    }
+    return escaped;
+}
+
+// Bridge
+
+ChromeTracer::ChromeTracer(const std::string& filepath) : impl_{new Impl{filepath}} {}
+
+ChromeTracer::~ChromeTracer() {}
+
+void ChromeTracer::Flush() {
+    impl_->Flush();
+}
+
+void ChromeTracer::Begin(const char* name) {
+    impl_->Write(name, 'B');
+}
+
+void ChromeTracer::End(const char* name) {
+    impl_->Write(name, 'E');
+}
+
+} // namespace indexed
+} // namespace prism
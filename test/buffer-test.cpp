@@ -1,6 +1,13 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
 
 #include <boost/filesystem.hpp>
 
@@ -1204,3 +1211,882 @@ TEST_F(BufferFixture, PushConstantlyAboveQuotaDatabaseCheckTest) {
     auto response = execute(stream.str());
     EXPECT_EQ(1, response.size());
 }
+
+TEST_F(BufferFixture, FindNearestEmptyTest) {
+    prism::indexed::Buffer buffer;
+    auto now = std::chrono::system_clock::now();
+    EXPECT_TRUE(buffer.FindNearest(now, 1, prism::indexed::Direction::Nearest).filepath.empty());
+    EXPECT_TRUE(buffer.FindNearest(now, 1, prism::indexed::Direction::Before).filepath.empty());
+    EXPECT_TRUE(buffer.FindNearest(now, 1, prism::indexed::Direction::After).filepath.empty());
+}
+
+TEST_F(BufferFixture, FindNearestExactTest) {
+    prism::indexed::Buffer buffer;
+    auto now = std::chrono::system_clock::now();
+    writeStagingFile(filename_, contents_);
+    EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+    auto clip = buffer.FindNearest(now, 1, prism::indexed::Direction::Nearest);
+    EXPECT_EQ(buffer.GetFilepath(now, 1), clip.filepath);
+    EXPECT_EQ(now + std::chrono::seconds(30) -
+                      (now + std::chrono::seconds(30)).time_since_epoch() % std::chrono::minutes(1),
+              clip.time_point);
+}
+
+TEST_F(BufferFixture, FindNearestGapTest) {
+    prism::indexed::Buffer buffer;
+    auto now = std::chrono::system_clock::now();
+    writeStagingFile(filename_, contents_);
+    EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+    writeStagingFile(filename_, contents_);
+    EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(10), 1, filepath_));
+    auto before = buffer.GetFilepath(now, 1);
+    auto after = buffer.GetFilepath(now + std::chrono::minutes(10), 1);
+    EXPECT_NE(before, after);
+
+    auto seek = now + std::chrono::minutes(3);
+    EXPECT_EQ(before, buffer.FindNearest(seek, 1, prism::indexed::Direction::Before).filepath);
+    EXPECT_EQ(after, buffer.FindNearest(seek, 1, prism::indexed::Direction::After).filepath);
+    EXPECT_EQ(before, buffer.FindNearest(seek, 1, prism::indexed::Direction::Nearest).filepath);
+    seek = now + std::chrono::minutes(7);
+    EXPECT_EQ(after, buffer.FindNearest(seek, 1, prism::indexed::Direction::Nearest).filepath);
+    EXPECT_TRUE(buffer.FindNearest(seek, 2, prism::indexed::Direction::Nearest).filepath.empty());
+}
+
+TEST_F(BufferFixture, FindNearestSkipsMissingFileTest) {
+    prism::indexed::Buffer buffer;
+    auto now = std::chrono::system_clock::now();
+    writeStagingFile(filename_, contents_);
+    EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+    writeStagingFile(filename_, contents_);
+    EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(10), 1, filepath_));
+    auto before = buffer.GetFilepath(now, 1);
+    auto after = buffer.GetFilepath(now + std::chrono::minutes(10), 1);
+    fs::remove(before);
+    auto seek = now + std::chrono::minutes(3);
+    EXPECT_EQ(after, buffer.FindNearest(seek, 1, prism::indexed::Direction::Nearest).filepath);
+    EXPECT_TRUE(buffer.FindNearest(seek, 1, prism::indexed::Direction::Before).filepath.empty());
+    std::stringstream stream;
+    stream << "SELECT * FROM "
+           << table_name_
+           << ";";
+    auto response = execute(stream.str());
+    EXPECT_EQ(1, response.size());
+}
+
+TEST_F(BufferFixture, GetFilepathsEmptyTest) {
+    prism::indexed::Buffer buffer;
+    auto now = std::chrono::system_clock::now();
+    EXPECT_TRUE(buffer.GetFilepaths(1, now - std::chrono::hours(24), now).empty());
+}
+
+TEST_F(BufferFixture, GetFilepathsFullHourTest) {
+    prism::indexed::Buffer buffer;
+    auto now = std::chrono::system_clock::now();
+    for (int i = 0; i < 60; ++i) {
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 2, filepath_));
+    }
+    auto clips = buffer.GetFilepaths(1, now + std::chrono::minutes(10),
+                                     now + std::chrono::minutes(19));
+    EXPECT_EQ(10, clips.size());
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(buffer.GetFilepath(now + std::chrono::minutes(10 + i), 1), clips[i].filepath);
+        if (i > 0) {
+            EXPECT_EQ(std::chrono::minutes(1), clips[i].time_point - clips[i - 1].time_point);
+        }
+    }
+}
+
+TEST_F(BufferFixture, GetFilepathsMissingFileTest) {
+    prism::indexed::Buffer buffer;
+    auto now = std::chrono::system_clock::now();
+    for (int i = 0; i < 3; ++i) {
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+    }
+    fs::remove(buffer.GetFilepath(now + std::chrono::minutes(1), 1));
+    auto clips = buffer.GetFilepaths(1, now, now + std::chrono::minutes(2));
+    EXPECT_EQ(2, clips.size());
+    std::stringstream stream;
+    stream << "SELECT * FROM "
+           << table_name_
+           << ";";
+    auto response = execute(stream.str());
+    EXPECT_EQ(2, response.size());
+}
+
+TEST_F(BufferFixture, SetKeepRangeEmptyTest) {
+    prism::indexed::Buffer buffer;
+    auto now = std::chrono::system_clock::now();
+    EXPECT_FALSE(buffer.SetKeepRange(now - std::chrono::hours(12), now, PRESERVE_RECORD));
+    EXPECT_FALSE(buffer.SetKeepRange(1, now - std::chrono::hours(12), now, PRESERVE_RECORD));
+}
+
+TEST_F(BufferFixture, SetKeepRangeWindowTest) {
+    prism::indexed::Buffer buffer;
+    auto now = std::chrono::system_clock::now();
+    for (int i = 0; i < 10; ++i) {
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 2, filepath_));
+    }
+    EXPECT_TRUE(buffer.SetKeepRange(1, now + std::chrono::minutes(2),
+                                    now + std::chrono::minutes(5), PRESERVE_RECORD));
+    EXPECT_TRUE(buffer.SetKeepRange(now + std::chrono::minutes(8), now + std::chrono::minutes(9),
+                                    DELETE_IF_FULL));
+    std::stringstream stream;
+    stream << "SELECT keep, COUNT(*) AS count FROM "
+           << table_name_
+           << " GROUP BY keep ORDER BY keep ASC;";
+    auto response = execute(stream.str());
+    EXPECT_EQ(3, response.size());
+    EXPECT_EQ(4, std::stoi(response[0]["count"]));
+    EXPECT_EQ(12, std::stoi(response[1]["count"]));
+    EXPECT_EQ(4, std::stoi(response[2]["count"]));
+}
+
+TEST_F(BufferFixture, DeleteRangeEmptyTest) {
+    prism::indexed::Buffer buffer;
+    auto now = std::chrono::system_clock::now();
+    EXPECT_FALSE(buffer.DeleteRange(now - std::chrono::hours(12), now));
+    EXPECT_FALSE(buffer.DeleteRange(1, now - std::chrono::hours(12), now));
+}
+
+TEST_F(BufferFixture, DeleteRangeDeviceTest) {
+    auto now = std::chrono::system_clock::now();
+    {
+        prism::indexed::Buffer buffer;
+        for (int i = 0; i < 10; ++i) {
+            writeStagingFile(filename_, contents_);
+            EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+            writeStagingFile(filename_, contents_);
+            EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 2, filepath_));
+        }
+        EXPECT_TRUE(buffer.DeleteRange(1, now, now + std::chrono::minutes(4)));
+        EXPECT_TRUE(buffer.GetFilepath(now, 1).empty());
+        EXPECT_FALSE(buffer.GetFilepath(now, 2).empty());
+    }
+    EXPECT_EQ(15, numberOfFiles());
+    std::stringstream stream;
+    stream << "SELECT * FROM "
+           << table_name_
+           << ";";
+    auto response = execute(stream.str());
+    EXPECT_EQ(15, response.size());
+}
+
+TEST_F(BufferFixture, DeleteRangeAllDevicesTest) {
+    auto now = std::chrono::system_clock::now();
+    {
+        prism::indexed::Buffer buffer;
+        for (int i = 0; i < 10; ++i) {
+            writeStagingFile(filename_, contents_);
+            EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+            writeStagingFile(filename_, contents_);
+            EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 2, filepath_));
+        }
+        EXPECT_TRUE(buffer.DeleteRange(now, now + std::chrono::minutes(9)));
+    }
+    EXPECT_EQ(0, numberOfFiles());
+    std::stringstream stream;
+    stream << "SELECT * FROM "
+           << table_name_
+           << ";";
+    auto response = execute(stream.str());
+    EXPECT_EQ(0, response.size());
+}
+
+TEST_F(BufferFixture, ReconcileCleanTest) {
+    prism::indexed::Buffer buffer;
+    writeStagingFile(filename_, contents_);
+    auto now = std::chrono::system_clock::now();
+    EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+    auto report = buffer.Reconcile(std::chrono::seconds(10));
+    EXPECT_TRUE(report.complete);
+    EXPECT_EQ(0, report.orphan_files_removed);
+    EXPECT_EQ(0, report.orphan_bytes_removed);
+    EXPECT_EQ(0, report.missing_records_removed);
+    EXPECT_EQ(1, numberOfFiles());
+}
+
+TEST_F(BufferFixture, ReconcileOrphanFileTest) {
+    {
+        prism::indexed::Buffer buffer;
+        writeStagingFile(filename_, contents_);
+        auto now = std::chrono::system_clock::now();
+        EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+        fs::create_directories(buffer_path_ / "nested");
+        {
+            std::ofstream out_stream{(buffer_path_ / "nested" / "orphan").native()};
+            out_stream << contents_;
+        }
+        EXPECT_EQ(2, numberOfFiles());
+        auto report = buffer.Reconcile(std::chrono::seconds(10));
+        EXPECT_TRUE(report.complete);
+        EXPECT_EQ(1, report.orphan_files_removed);
+        EXPECT_EQ(contents_.length(), report.orphan_bytes_removed);
+        EXPECT_EQ(0, report.missing_records_removed);
+    }
+    EXPECT_EQ(1, numberOfFiles());
+    EXPECT_FALSE(fs::exists(buffer_path_ / "nested"));
+}
+
+TEST_F(BufferFixture, ReconcileSkipsReservedTest) {
+    prism::indexed::Buffer buffer;
+    fs::create_directories(buffer_path_ / "prism_indexed_staging");
+    {
+        std::ofstream out_stream{(buffer_path_ / "prism_indexed_staging" / "copy").native()};
+        out_stream << contents_;
+        std::ofstream other_stream{(buffer_path_ / "prism_indexed_other").native()};
+        other_stream << contents_;
+    }
+    auto report = buffer.Reconcile(std::chrono::seconds(10));
+    EXPECT_TRUE(report.complete);
+    EXPECT_EQ(0, report.orphan_files_removed);
+    EXPECT_TRUE(fs::exists(buffer_path_ / "prism_indexed_staging" / "copy"));
+    EXPECT_TRUE(fs::exists(buffer_path_ / "prism_indexed_other"));
+}
+
+TEST_F(BufferFixture, ReconcileSkipsIntentTest) {
+    prism::indexed::Buffer buffer;
+    {
+        prism::indexed::Database database{db_string_};
+        database.Insert(1, 1, "hash", 5, ATTEMPT_KEEP);
+        database.MarkDeleting({"hash"});
+        database.Delete("hash");
+        std::ofstream out_stream{(buffer_path_ / "hash").native()};
+        out_stream << contents_;
+    }
+    auto report = buffer.Reconcile(std::chrono::seconds(10));
+    EXPECT_TRUE(report.complete);
+    EXPECT_EQ(0, report.orphan_files_removed);
+    EXPECT_TRUE(fs::exists(buffer_path_ / "hash"));
+}
+
+TEST_F(BufferFixture, ReconcileSkipsReclaimingTest) {
+    prism::indexed::Options options;
+    options.unlink_in_background = true;
+    prism::indexed::Buffer buffer{std::string{}, 1.0, options};
+    auto now = std::chrono::system_clock::now();
+    for (int i = 0; i < 20; ++i) {
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+    }
+    EXPECT_TRUE(buffer.DeleteRange(now, now + std::chrono::minutes(20)));
+    // Files the reclaimer has yet to unlink are not orphans to count again
+    auto report = buffer.Reconcile(std::chrono::seconds(10));
+    EXPECT_EQ(0, report.orphan_files_removed);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (numberOfFiles() > 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(0, numberOfFiles());
+}
+
+TEST_F(BufferFixture, ReconcileMissingFileTest) {
+    prism::indexed::Buffer buffer;
+    auto now = std::chrono::system_clock::now();
+    for (int i = 0; i < 3; ++i) {
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+    }
+    fs::remove(buffer.GetFilepath(now, 1));
+    auto report = buffer.Reconcile(std::chrono::seconds(10));
+    EXPECT_TRUE(report.complete);
+    EXPECT_EQ(0, report.orphan_files_removed);
+    EXPECT_EQ(1, report.missing_records_removed);
+    std::stringstream stream;
+    stream << "SELECT * FROM "
+           << table_name_
+           << ";";
+    auto response = execute(stream.str());
+    EXPECT_EQ(2, response.size());
+}
+
+TEST_F(BufferFixture, PushLeavesNoIntentsTest) {
+    {
+        prism::indexed::Buffer buffer;
+        auto now = std::chrono::system_clock::now();
+        for (int i = 0; i < 3; ++i) {
+            writeStagingFile(filename_, contents_);
+            EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+        }
+    }
+    prism::indexed::Database database{db_string_};
+    EXPECT_TRUE(database.GetIntents().empty());
+    EXPECT_EQ(3, database.SelectAll().size());
+    EXPECT_EQ(3, numberOfFiles());
+}
+
+TEST_F(BufferFixture, RecoverInterruptedPushBeforeMoveTest) {
+    {
+        prism::indexed::Database database{db_string_};
+        database.InsertPending(1, 1, "hash", 5, ATTEMPT_KEEP);
+    }
+    prism::indexed::Buffer buffer;
+    prism::indexed::Database database{db_string_};
+    EXPECT_TRUE(database.GetIntents().empty());
+    EXPECT_TRUE(database.SelectAll().empty());
+}
+
+TEST_F(BufferFixture, RecoverInterruptedPushAfterMoveTest) {
+    {
+        prism::indexed::Database database{db_string_};
+        database.InsertPending(1, 1, "hash", 5, ATTEMPT_KEEP);
+        std::ofstream out_stream{(buffer_path_ / "hash").native()};
+        out_stream << contents_;
+    }
+    prism::indexed::Buffer buffer;
+    prism::indexed::Database database{db_string_};
+    EXPECT_TRUE(database.GetIntents().empty());
+    EXPECT_EQ(1, database.SelectAll().size());
+    EXPECT_EQ(1, numberOfFiles());
+}
+
+TEST_F(BufferFixture, RecoverInterruptedEvictionTest) {
+    {
+        prism::indexed::Database database{db_string_};
+        database.Insert(1, 1, "hash", 5, ATTEMPT_KEEP);
+        database.Insert(2, 1, "hashbrowns", 5, ATTEMPT_KEEP);
+        database.MarkDeleting({"hash"});
+        std::ofstream out_stream{(buffer_path_ / "hash").native()};
+        out_stream << contents_;
+        std::ofstream other_stream{(buffer_path_ / "hashbrowns").native()};
+        other_stream << contents_;
+    }
+    prism::indexed::Buffer buffer;
+    prism::indexed::Database database{db_string_};
+    EXPECT_TRUE(database.GetIntents().empty());
+    auto records = database.SelectAll();
+    ASSERT_EQ(1, records.size());
+    EXPECT_EQ(std::string{"hashbrowns"}, records[0]["hash"]);
+    EXPECT_EQ(1, numberOfFiles());
+    EXPECT_FALSE(fs::exists(buffer_path_ / "hash"));
+}
+
+TEST_F(BufferFixture, StartupSizeFromDatabaseTest) {
+    auto now = std::chrono::system_clock::now();
+    {
+        prism::indexed::Buffer buffer;
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+    }
+    prism::indexed::Database database{db_string_};
+    EXPECT_EQ(contents_.length(), database.GetTotalSize());
+    prism::indexed::Buffer buffer{std::string{},
+                                  (fs::file_size(db_path_) + contents_.length() - 1) /
+                                          (1024 * 1024 * 1024.)};
+    EXPECT_TRUE(buffer.Full());
+}
+
+TEST_F(BufferFixture, StartupIgnoresUnindexedFilesTest) {
+    prism::indexed::Database database{db_string_};
+    {
+        std::ofstream out_stream{(buffer_path_ / "unindexed").native()};
+        out_stream << contents_;
+    }
+    prism::indexed::Buffer buffer{std::string{},
+                                  (fs::file_size(db_path_) + 5) / (1024 * 1024 * 1024.)};
+    EXPECT_FALSE(buffer.Full());
+}
+
+TEST_F(BufferFixture, VerifySizeOptionTest) {
+    prism::indexed::Database database{db_string_};
+    {
+        std::ofstream out_stream{(buffer_path_ / "unindexed").native()};
+        out_stream << contents_;
+    }
+    prism::indexed::Options options;
+    options.verify_size_interval = std::chrono::minutes(10);
+    prism::indexed::Buffer buffer{std::string{},
+                                  (fs::file_size(db_path_) + 5) / (1024 * 1024 * 1024.), options};
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!buffer.Full() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(buffer.Full());
+}
+
+TEST_F(BufferFixture, ReconcileCountsOrphanBytesTest) {
+    prism::indexed::Database database{db_string_};
+    {
+        std::ofstream out_stream{(buffer_path_ / "orphan").native()};
+        out_stream << contents_;
+    }
+    {
+        prism::indexed::Buffer buffer;
+        auto report = buffer.Reconcile(std::chrono::seconds(10));
+        EXPECT_EQ(1, report.orphan_files_removed);
+    }
+    EXPECT_EQ(0, numberOfFiles());
+}
+
+TEST_F(BufferFixture, StatsPushTest) {
+    prism::indexed::Buffer buffer;
+    auto size = writeStagingFile(filename_, contents_);
+    auto now = std::chrono::system_clock::now();
+    EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+    EXPECT_FALSE(buffer.GetFilepath(now, 1).empty());
+    auto stats = buffer.GetStats();
+    EXPECT_EQ(1, stats.operations["push"].count);
+    EXPECT_EQ(1, stats.operations["get_filepath"].count);
+    EXPECT_EQ(2, stats.phases["lock_wait"].count);
+    EXPECT_EQ(1, stats.phases["quota_check"].count);
+    EXPECT_EQ(1, stats.phases["insert"].count);
+    EXPECT_EQ(1, stats.phases["move"].count);
+    EXPECT_EQ(0, stats.phases["eviction"].count);
+    EXPECT_EQ(size, stats.bytes_ingested);
+    EXPECT_EQ(0, stats.files_evicted);
+}
+
+TEST_F(BufferFixture, StatsOperationNamesTest) {
+    prism::indexed::Buffer buffer;
+    writeStagingFile(filename_, contents_);
+    auto now = std::chrono::system_clock::now();
+    EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+    EXPECT_FALSE(buffer.GetLocation(now, 1).filepath.empty());
+    EXPECT_TRUE(buffer.KeepIfPossible(now, 1));
+    EXPECT_TRUE(buffer.BulkPreserveRecord({now}, 1));
+    EXPECT_EQ(1, buffer.NextUnsynced(10, {}).size());
+    EXPECT_TRUE(buffer.MarkSynced({now}, 1));
+    EXPECT_FALSE(buffer.Full());
+    EXPECT_EQ(0, buffer.Expire());
+    auto stats = buffer.GetStats();
+    EXPECT_EQ(0, stats.operations["get_filepath"].count);
+    EXPECT_EQ(1, stats.operations["get_location"].count);
+    EXPECT_EQ(1, stats.operations["keep_if_possible"].count);
+    EXPECT_EQ(1, stats.operations["bulk_preserve_record"].count);
+    EXPECT_EQ(1, stats.operations["next_unsynced"].count);
+    EXPECT_EQ(1, stats.operations["mark_synced"].count);
+    EXPECT_EQ(1, stats.operations["full"].count);
+    EXPECT_LE(1, stats.operations["expire"].count);
+}
+
+TEST_F(BufferFixture, StatsEvictionTest) {
+    prism::indexed::Database database{db_string_};
+    prism::indexed::Buffer buffer{std::string{}, (fs::file_size(db_path_) + 5) / (1024 * 1024 * 1024.)};
+    auto now = std::chrono::system_clock::now();
+    for (auto i = 0; i < 10; ++i) {
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+    }
+    auto stats = buffer.GetStats();
+    EXPECT_EQ(10, stats.operations["push"].count);
+    EXPECT_EQ(9, stats.phases["eviction"].count);
+    EXPECT_EQ(9, stats.files_evicted);
+    EXPECT_EQ(9 * contents_.size(), stats.bytes_evicted);
+    EXPECT_EQ(10 * contents_.size(), stats.bytes_ingested);
+}
+
+TEST_F(BufferFixture, DumpStatsTest) {
+    prism::indexed::Buffer buffer;
+    writeStagingFile(filename_, contents_);
+    EXPECT_TRUE(buffer.Push(std::chrono::system_clock::now(), 1, filepath_));
+    auto dump_path = staging_path_ / "prism_indexed.prom";
+    EXPECT_TRUE(buffer.DumpStats(dump_path.string()));
+    EXPECT_FALSE(fs::exists(dump_path.string() + ".tmp"));
+    std::ifstream in_stream{dump_path.native()};
+    std::stringstream contents;
+    contents << in_stream.rdbuf();
+    EXPECT_NE(std::string::npos,
+              contents.str().find("prism_indexed_operation_seconds_count{operation=\"push\"} 1"));
+}
+
+TEST_F(BufferFixture, DumpStatsMissingDirectoryTest) {
+    prism::indexed::Buffer buffer;
+    EXPECT_FALSE(buffer.DumpStats((staging_path_ / "missing" / "prism_indexed.prom").string()));
+}
+
+class RecordingTracer : public prism::indexed::Tracer {
+  public:
+    void Begin(const char* name) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        names_.emplace_back(name);
+    }
+    void End(const char*) override {}
+
+    bool Saw(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::find(names_.begin(), names_.end(), name) != names_.end();
+    }
+
+    std::size_t Count() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return names_.size();
+    }
+
+  private:
+    std::mutex mutex_;
+    std::vector<std::string> names_;
+};
+
+TEST_F(BufferFixture, TracerPushSpansTest) {
+    prism::indexed::Database database{db_string_};
+    auto tracer = std::make_shared<RecordingTracer>();
+    prism::indexed::Options options;
+    options.tracer = tracer;
+    prism::indexed::Buffer buffer{std::string{}, (fs::file_size(db_path_) + 5) / (1024 * 1024 * 1024.),
+                                  options};
+    auto now = std::chrono::system_clock::now();
+    writeStagingFile(filename_, contents_);
+    EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+    writeStagingFile(filename_, contents_);
+    EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(1), 1, filepath_));
+#ifdef PRISM_INDEXED_TRACING
+    EXPECT_TRUE(tracer->Saw("Buffer::Push"));
+    EXPECT_TRUE(tracer->Saw("Buffer::evict"));
+    EXPECT_TRUE(tracer->Saw("Database::execute"));
+    EXPECT_TRUE(tracer->Saw("Filesystem::Move"));
+    EXPECT_TRUE(tracer->Saw("Filesystem::Delete"));
+#else
+    EXPECT_EQ(0, tracer->Count());
+#endif
+}
+
+TEST_F(BufferFixture, PackedPushTest) {
+    prism::indexed::Options options;
+    options.segment_threshold = 1024;
+    prism::indexed::Buffer buffer{std::string{}, 2.0, options};
+    writeStagingFile(filename_, contents_);
+    auto now = std::chrono::system_clock::now();
+    EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+    EXPECT_FALSE(fs::exists(filepath_));
+    EXPECT_TRUE(buffer.GetFilepath(now, 1).empty());
+    auto clip = buffer.GetLocation(now, 1);
+    EXPECT_EQ(0, clip.offset);
+    EXPECT_EQ(contents_.size(), clip.length);
+    std::ifstream in_stream{clip.filepath, std::ios::binary};
+    std::string contents(clip.length, '\0');
+    in_stream.read(&contents[0], clip.length);
+    EXPECT_EQ(contents_, contents);
+    EXPECT_EQ(1, buffer.GetCatalog()[1].size());
+}
+
+TEST_F(BufferFixture, PackedLargeClipUsesFileTest) {
+    prism::indexed::Options options;
+    options.segment_threshold = 4;
+    prism::indexed::Buffer buffer{std::string{}, 2.0, options};
+    writeStagingFile(filename_, contents_);
+    auto now = std::chrono::system_clock::now();
+    EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+    auto filepath = buffer.GetFilepath(now, 1);
+    EXPECT_FALSE(filepath.empty());
+    auto clip = buffer.GetLocation(now, 1);
+    EXPECT_EQ(filepath, clip.filepath);
+    EXPECT_EQ(0, clip.offset);
+    EXPECT_EQ(contents_.size(), clip.length);
+}
+
+TEST_F(BufferFixture, PackedRangeAndNearestTest) {
+    prism::indexed::Options options;
+    options.segment_threshold = 1024;
+    prism::indexed::Buffer buffer{std::string{}, 2.0, options};
+    auto now = std::chrono::system_clock::now();
+    for (auto i = 0; i < 3; ++i) {
+        writeStagingFile(filename_, contents_ + std::to_string(i));
+        EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+    }
+    auto clips = buffer.GetFilepaths(1, now, now + std::chrono::minutes(2));
+    ASSERT_EQ(3, clips.size());
+    EXPECT_EQ(clips[0].filepath, clips[2].filepath);
+    EXPECT_EQ(2 * (contents_.size() + 1), clips[2].offset);
+    auto nearest = buffer.FindNearest(now + std::chrono::minutes(5), 1,
+                                      prism::indexed::Direction::Before);
+    EXPECT_EQ(clips[2].offset, nearest.offset);
+}
+
+TEST_F(BufferFixture, PackedDeleteTest) {
+    prism::indexed::Options options;
+    options.segment_threshold = 1024;
+    prism::indexed::Buffer buffer{std::string{}, 2.0, options};
+    writeStagingFile(filename_, contents_);
+    auto now = std::chrono::system_clock::now();
+    EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+    EXPECT_TRUE(buffer.Delete(now, 1));
+    EXPECT_TRUE(buffer.GetLocation(now, 1).filepath.empty());
+}
+
+TEST_F(BufferFixture, PackedEvictionFreesSegmentTest) {
+    prism::indexed::Database database{db_string_};
+    prism::indexed::Options options;
+    options.segment_threshold = 1024;
+    options.segment_size = 64;
+    prism::indexed::Buffer buffer{std::string{},
+                                  (fs::file_size(db_path_) + 2 * 64 + 8) / (1024 * 1024 * 1024.),
+                                  options};
+    auto now = std::chrono::system_clock::now();
+    for (auto i = 0; i < 20; ++i) {
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+    }
+    EXPECT_FALSE(buffer.GetLocation(now + std::chrono::minutes(19), 1).filepath.empty());
+    EXPECT_TRUE(buffer.GetLocation(now, 1).filepath.empty());
+    auto stats = buffer.GetStats();
+    EXPECT_LT(0, stats.files_evicted);
+    fs::directory_iterator begin(buffer_path_ / "prism_indexed_segments"), end;
+    EXPECT_GE(3, std::distance(begin, end));
+}
+
+TEST_F(BufferFixture, PackedEvictionEventsTest) {
+    prism::indexed::Database database{db_string_};
+    prism::indexed::Options options;
+    options.segment_threshold = 1024;
+    options.segment_size = 64;
+    prism::indexed::Buffer buffer{std::string{},
+                                  (fs::file_size(db_path_) + 2 * 64 + 8) / (1024 * 1024 * 1024.),
+                                  options};
+    std::mutex mutex;
+    std::vector<prism::indexed::Event> events;
+    buffer.Subscribe([&mutex, &events](const prism::indexed::Event& event) {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(event);
+    });
+    auto now = std::chrono::system_clock::now();
+    for (auto i = 0; i < 20; ++i) {
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+    }
+    const auto evicted = buffer.GetStats().files_evicted;
+    ASSERT_LT(0, evicted);
+
+    // Every item leaving with its segment is reported once
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    std::size_t count = 0;
+    while (count < 20 + evicted && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::lock_guard<std::mutex> lock(mutex);
+        count = events.size();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    ASSERT_EQ(20 + evicted, events.size());
+    std::set<long long> evicted_minutes;
+    for (const auto& event : events) {
+        EXPECT_NE(prism::indexed::EventType::Dropped, event.type);
+        if (event.type == prism::indexed::EventType::Evicted) {
+            EXPECT_EQ(contents_.size(), event.size);
+            evicted_minutes.insert(std::chrono::duration_cast<std::chrono::minutes>(
+                                           event.time_point.time_since_epoch())
+                                           .count());
+        }
+    }
+    EXPECT_EQ(evicted, evicted_minutes.size());
+}
+
+TEST_F(BufferFixture, PackedEvictionKeepsPreservedTest) {
+    prism::indexed::Database database{db_string_};
+    prism::indexed::Options options;
+    options.segment_threshold = 1024;
+    options.segment_size = 64;
+    prism::indexed::Buffer buffer{std::string{},
+                                  (fs::file_size(db_path_) + 2 * 64 + 8) / (1024 * 1024 * 1024.),
+                                  options};
+    auto now = std::chrono::system_clock::now();
+    writeStagingFile(filename_, contents_);
+    EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+    EXPECT_TRUE(buffer.PreserveRecord(now, 1));
+    for (auto i = 1; i < 20; ++i) {
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+    }
+    auto clip = buffer.GetLocation(now, 1);
+    ASSERT_FALSE(clip.filepath.empty());
+    std::ifstream in_stream{clip.filepath, std::ios::binary};
+    in_stream.seekg(clip.offset);
+    std::string contents(clip.length, '\0');
+    in_stream.read(&contents[0], clip.length);
+    EXPECT_EQ(contents_, contents);
+}
+
+TEST_F(BufferFixture, PackedStartupSizeTest) {
+    prism::indexed::Options options;
+    options.segment_threshold = 1024;
+    options.segment_size = 4096;
+    {
+        prism::indexed::Buffer buffer{std::string{}, 2.0, options};
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(std::chrono::system_clock::now(), 1, filepath_));
+    }
+    prism::indexed::Buffer buffer{std::string{}, (fs::file_size(db_path_) + 4096 + 1) /
+                                                         (1024 * 1024 * 1024.),
+                                  options};
+    EXPECT_FALSE(buffer.Full());
+    prism::indexed::Buffer smaller{std::string{}, (fs::file_size(db_path_) + 4095) /
+                                                          (1024 * 1024 * 1024.),
+                                   options};
+    EXPECT_TRUE(smaller.Full());
+}
+
+TEST_F(BufferFixture, PackedUnreferencedSegmentRemovedTest) {
+    fs::create_directories(buffer_path_ / "prism_indexed_segments");
+    {
+        std::ofstream out_stream{(buffer_path_ / "prism_indexed_segments" / "7").native()};
+        out_stream << contents_;
+    }
+    prism::indexed::Buffer buffer;
+    EXPECT_FALSE(fs::exists(buffer_path_ / "prism_indexed_segments" / "7"));
+}
+
+TEST_F(BufferFixture, PackedReconcileTest) {
+    prism::indexed::Options options;
+    options.segment_threshold = 1024;
+    prism::indexed::Buffer buffer{std::string{}, 2.0, options};
+    writeStagingFile(filename_, contents_);
+    auto now = std::chrono::system_clock::now();
+    EXPECT_TRUE(buffer.Push(now, 1, filepath_));
+    auto report = buffer.Reconcile(std::chrono::seconds(10));
+    EXPECT_TRUE(report.complete);
+    EXPECT_EQ(0, report.orphan_files_removed);
+    EXPECT_EQ(0, report.missing_records_removed);
+    EXPECT_FALSE(buffer.GetLocation(now, 1).filepath.empty());
+}
+
+TEST_F(BufferFixture, TieredPushDemotesTest) {
+    const auto cold_root = fs::temp_directory_path() / fs::path{"prism_cold_root"};
+    fs::remove_all(cold_root);
+    fs::create_directories(cold_root);
+    {
+        prism::indexed::Database database{db_string_};
+    }
+    const std::string contents(1000, 'c');
+    prism::indexed::Options options;
+    options.tiers = {prism::indexed::StorageTier{cold_root.string(), 1.0}};
+    {
+        prism::indexed::Buffer buffer{std::string{},
+                                      (fs::file_size(db_path_) + 4000) / (1024 * 1024 * 1024.),
+                                      options};
+        auto now = std::chrono::system_clock::now();
+        for (auto i = 0; i < 10; ++i) {
+            writeStagingFile(filename_, contents);
+            EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+        }
+        auto is_cold = [&cold_root](const std::string& filepath) {
+            return filepath.compare(0, cold_root.string().size(), cold_root.string()) == 0;
+        };
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!is_cold(buffer.GetFilepath(now, 1)) &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        EXPECT_TRUE(is_cold(buffer.GetFilepath(now, 1)));
+        for (auto i = 0; i < 10; ++i) {
+            auto filepath = buffer.GetFilepath(now + std::chrono::minutes(i), 1);
+            ASSERT_FALSE(filepath.empty());
+            EXPECT_EQ(contents.size(), fs::file_size(filepath));
+        }
+        EXPECT_FALSE(buffer.Full());
+        EXPECT_EQ(0, buffer.GetStats().files_evicted);
+    }
+    fs::remove_all(cold_root);
+}
+
+TEST_F(BufferFixture, StripedPushTest) {
+    const auto stripe_root = fs::temp_directory_path() / fs::path{"prism_stripe_root"};
+    fs::remove_all(stripe_root);
+    fs::create_directories(stripe_root);
+    {
+        prism::indexed::Options options;
+        options.stripe_roots = {stripe_root.string(),
+                                (fs::temp_directory_path() / "prism_stripe_missing").string()};
+        prism::indexed::Buffer buffer{std::string{}, 2.0, options};
+        auto now = std::chrono::system_clock::now();
+        for (auto i = 0; i < 4; ++i) {
+            writeStagingFile(filename_, contents_);
+            EXPECT_TRUE(buffer.Push(now + std::chrono::minutes(i), 1, filepath_));
+        }
+        auto striped = 0;
+        for (auto i = 0; i < 4; ++i) {
+            auto filepath = buffer.GetFilepath(now + std::chrono::minutes(i), 1);
+            ASSERT_FALSE(filepath.empty());
+            if (filepath.compare(0, stripe_root.string().size(), stripe_root.string()) == 0) {
+                ++striped;
+            }
+        }
+        EXPECT_EQ(2, striped);
+        auto report = buffer.Reconcile(std::chrono::seconds(10));
+        EXPECT_EQ(0, report.orphan_files_removed);
+        EXPECT_EQ(0, report.missing_records_removed);
+        EXPECT_TRUE(buffer.Delete(now, 1));
+        EXPECT_TRUE(buffer.Delete(now + std::chrono::minutes(1), 1));
+    }
+    fs::remove_all(stripe_root);
+}
+
+#ifndef _WIN32
+TEST_F(BufferFixture, SharedBufferTest) {
+    prism::indexed::Options options;
+    options.shared = true;
+    prism::indexed::Buffer first{std::string{}, 2.0, options};
+    prism::indexed::Buffer second{std::string{}, 2.0, options};
+    EXPECT_TRUE(first.IsEvictionOwner());
+    EXPECT_FALSE(second.IsEvictionOwner());
+
+    auto now = std::chrono::system_clock::now();
+    const auto sequence = second.GetChangeSequence();
+    writeStagingFile(filename_, contents_);
+    EXPECT_TRUE(first.Push(now, 1, filepath_));
+    EXPECT_TRUE(second.WaitForChange(sequence, std::chrono::seconds(10)));
+    EXPECT_FALSE(second.GetFilepath(now, 1).empty());
+    EXPECT_EQ(1, second.GetCatalog()[1].size());
+
+    EXPECT_TRUE(second.Delete(now, 1));
+    EXPECT_TRUE(first.GetFilepath(now, 1).empty());
+    EXPECT_EQ(0, numberOfFiles());
+}
+
+TEST_F(BufferFixture, SharedOwnerEvictsTest) {
+    {
+        prism::indexed::Database database{db_string_};
+    }
+    const std::string contents(1000, 'c');
+    const auto quota = (fs::file_size(db_path_) + 4000) / (1024 * 1024 * 1024.);
+    prism::indexed::Options options;
+    options.shared = true;
+    prism::indexed::Buffer owner{std::string{}, quota, options};
+    prism::indexed::Buffer recorder{std::string{}, quota, options};
+    ASSERT_TRUE(owner.IsEvictionOwner());
+
+    auto now = std::chrono::system_clock::now();
+    for (auto i = 0; i < 10; ++i) {
+        writeStagingFile(filename_, contents);
+        EXPECT_TRUE(recorder.Push(now + std::chrono::minutes(i), 1, filepath_));
+    }
+    EXPECT_LT(0, owner.GetStats().files_evicted);
+    EXPECT_EQ(0, recorder.GetStats().files_evicted);
+    EXPECT_TRUE(recorder.GetFilepath(now, 1).empty());
+    EXPECT_FALSE(recorder.GetFilepath(now + std::chrono::minutes(9), 1).empty());
+}
+
+TEST_F(BufferFixture, SharedLeasePassesTest) {
+    prism::indexed::Options options;
+    options.shared = true;
+    prism::indexed::Buffer second{std::string{}, 2.0, options};
+    {
+        prism::indexed::Buffer first{std::string{}, 2.0, options};
+        EXPECT_TRUE(second.IsEvictionOwner());
+        EXPECT_FALSE(first.IsEvictionOwner());
+    }
+    {
+        prism::indexed::Buffer first{std::string{}, 2.0, options};
+        EXPECT_TRUE(second.IsEvictionOwner());
+    }
+    EXPECT_TRUE(second.IsEvictionOwner());
+}
+#else
+TEST_F(BufferFixture, SharedUnsupportedThrowTest) {
+    prism::indexed::Options options;
+    options.shared = true;
+    EXPECT_THROW(prism::indexed::Buffer(std::string{}, 2.0, options),
+                 prism::indexed::FilesystemException);
+}
+#endif
+
+TEST_F(BufferFixture, SharedPackingThrowTest) {
+    prism::indexed::Options options;
+    options.shared = true;
+    options.segment_threshold = 1024;
+    EXPECT_THROW(prism::indexed::Buffer(std::string{}, 2.0, options),
+                 prism::indexed::FilesystemException);
+}
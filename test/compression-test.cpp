@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "indexed/compression.h"
+#include "indexed/storage.h"
+
+
+namespace fs = ::boost::filesystem;
+
+using prism::indexed::DecompressingReader;
+using prism::indexed::FilesystemException;
+
+std::string compress(const std::string& data) {
+    std::string compressed(data.size() * 2 + 16, '\0');
+    auto length = prism::indexed::utility::Lz4Compress(data.data(), data.size(), &compressed[0],
+                                                       compressed.size());
+    compressed.resize(length);
+    return compressed;
+}
+
+bool decompress(const std::string& compressed, std::string& data) {
+    return prism::indexed::utility::Lz4Decompress(compressed.data(), compressed.size(), &data[0],
+                                                  data.size());
+}
+
+std::string sensorText(const std::size_t& size) {
+    std::string data;
+    for (int i = 0; data.size() < size; ++i) {
+        data += "device=" + std::to_string(i % 7) + " frame=" + std::to_string(i) + " ok\n";
+    }
+    data.resize(size);
+    return data;
+}
+
+std::string randomBytes(const std::size_t& size) {
+    std::string data(size, '\0');
+    for (auto& byte : data) {
+        byte = static_cast<char>(std::rand());
+    }
+    return data;
+}
+
+std::string writeFile(const std::string& name, const std::string& contents) {
+    const auto filepath = (fs::temp_directory_path() / name).string();
+    std::ofstream out_stream{filepath, std::ios::binary};
+    out_stream << contents;
+    return filepath;
+}
+
+std::string readAll(DecompressingReader& reader, const std::size_t& chunk_size) {
+    std::string data;
+    std::vector<char> chunk(chunk_size);
+    while (auto read = reader.Read(chunk.data(), chunk.size())) {
+        data.append(chunk.data(), read);
+    }
+    return data;
+}
+
+TEST(CompressionTests, ReferenceBlockTest) {
+    // Produced by the reference LZ4 library
+    const std::string compressed{"\x6f\x70\x72\x69\x73\x6d\x20\x06\x00\x17\xe0\x69\x6e\x64\x65"
+                                 "\x78\x65\x64\x20\x62\x75\x66\x66\x65\x72",
+                                 25};
+    std::string data(62, '\0');
+    ASSERT_TRUE(decompress(compressed, data));
+    std::string expected;
+    for (int i = 0; i < 8; ++i) {
+        expected += "prism ";
+    }
+    EXPECT_EQ(expected + "indexed buffer", data);
+}
+
+TEST(CompressionTests, RoundTripTest) {
+    const std::vector<std::string> inputs{std::string{},
+                                          "a",
+                                          "exactly 13 by",
+                                          std::string(100000, 'a'),
+                                          sensorText(65536),
+                                          sensorText(200000),
+                                          randomBytes(70000)};
+    for (const auto& input : inputs) {
+        auto compressed = compress(input);
+        ASSERT_FALSE(compressed.empty()) << input.size();
+        std::string data(input.size(), '\0');
+        ASSERT_TRUE(decompress(compressed, data)) << input.size();
+        EXPECT_EQ(input, data) << input.size();
+    }
+    EXPECT_LT(compress(sensorText(65536)).size(), 65536 / 3);
+}
+
+TEST(CompressionTests, CompressCapacityTest) {
+    const auto input = randomBytes(4096);
+    std::string compressed(input.size() - 1, '\0');
+    EXPECT_EQ(0, prism::indexed::utility::Lz4Compress(input.data(), input.size(), &compressed[0],
+                                                      compressed.size()));
+}
+
+TEST(CompressionTests, DecompressRejectsCorruptTest) {
+    const auto input = sensorText(4096);
+    const auto compressed = compress(input);
+    std::string data(input.size(), '\0');
+    EXPECT_FALSE(decompress(compressed.substr(0, compressed.size() / 2), data));
+    std::string short_data(input.size() - 1, '\0');
+    EXPECT_FALSE(decompress(compressed, short_data));
+
+    // An offset reaching back before the start of the output
+    const std::string bad_offset{"\x10\x61\xff\x00", 4};
+    std::string bad_data(8, '\0');
+    EXPECT_FALSE(decompress(bad_offset, bad_data));
+}
+
+TEST(CompressionTests, CompressFileReaderTest) {
+    const auto input = sensorText(300000) + randomBytes(100000);
+    const auto source = writeFile("compression_source", input);
+    const auto destination = source + ".lz4";
+    const auto written = prism::indexed::utility::CompressFile(source, destination);
+    ASSERT_GT(written, 0);
+    EXPECT_EQ(written, fs::file_size(destination));
+    EXPECT_LT(written, input.size());
+
+    DecompressingReader reader{destination};
+    EXPECT_EQ(input.size(), reader.GetRawSize());
+    EXPECT_EQ(input, readAll(reader, 1000));
+    EXPECT_EQ(0, reader.Read(nullptr, 0));
+
+    DecompressingReader large_reads{destination};
+    EXPECT_EQ(input, readAll(large_reads, 1 << 20));
+    fs::remove(source);
+    fs::remove(destination);
+}
+
+TEST(CompressionTests, CompressEmptyFileTest) {
+    const auto source = writeFile("compression_empty", "");
+    const auto destination = source + ".lz4";
+    ASSERT_GT(prism::indexed::utility::CompressFile(source, destination), 0);
+    DecompressingReader reader{destination};
+    EXPECT_EQ(0, reader.GetRawSize());
+    EXPECT_EQ(std::string{}, readAll(reader, 16));
+    fs::remove(source);
+    fs::remove(destination);
+}
+
+TEST(CompressionTests, CompressMissingFileTest) {
+    const auto destination = (fs::temp_directory_path() / "compression_missing.lz4").string();
+    EXPECT_EQ(0, prism::indexed::utility::CompressFile(destination + ".none", destination));
+    EXPECT_FALSE(fs::exists(destination));
+}
+
+TEST(CompressionTests, ReaderRejectsPlainFileTest) {
+    const auto filepath = writeFile("compression_plain", "hello world, not compressed");
+    EXPECT_THROW(DecompressingReader{filepath}, FilesystemException);
+    fs::remove(filepath);
+}
+
+TEST(CompressionTests, ReaderRejectsTruncatedFileTest) {
+    const auto source = writeFile("compression_truncated", sensorText(100000));
+    const auto destination = source + ".lz4";
+    const auto written = prism::indexed::utility::CompressFile(source, destination);
+    fs::resize_file(destination, written - 10);
+    DecompressingReader reader{destination};
+    EXPECT_THROW(readAll(reader, 4096), FilesystemException);
+    fs::remove(source);
+    fs::remove(destination);
+}
@@ -0,0 +1,823 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "buffer-fixture.h"
+#include "indexed/buffer.h"
+#include "indexed/chrono-snap.h"
+#include "indexed/compression.h"
+#include "indexed/database.h"
+#include "indexed/eviction-policy.h"
+#include "indexed/filesystem.h"
+#include "indexed/memory-index.h"
+#include "indexed/sharded-index.h"
+
+
+namespace fs = ::boost::filesystem;
+
+// Every storage and index pairing the Buffer can run on. The cases below only go through the
+// public Buffer API so they hold for any backend, new backends are added to this list.
+struct Backend {
+    std::string name;
+    std::function<std::unique_ptr<prism::indexed::Storage>(const std::string&, const double&)>
+            storage_factory;
+    std::function<std::unique_ptr<prism::indexed::Index>(prism::indexed::Storage&)>
+            index_factory;
+};
+
+void PrintTo(const Backend& backend, std::ostream* stream) {
+    *stream << backend.name;
+}
+
+std::vector<Backend> backends() {
+    std::vector<Backend> backends;
+    backends.push_back(Backend{
+            "FilesystemDatabase",
+            [](const std::string& buffer_root, const double& gigabyte_quota) {
+                return std::unique_ptr<prism::indexed::Storage>{new prism::indexed::Filesystem{
+                        "prism_indexed_buffer", buffer_root, gigabyte_quota, false}};
+            },
+            [](prism::indexed::Storage& storage) {
+                return std::unique_ptr<prism::indexed::Index>{new prism::indexed::Database{
+                        storage.GetFilepath("prism_indexed_data.db")}};
+            }});
+    backends.push_back(Backend{
+            "FilesystemMemoryIndex", backends.front().storage_factory,
+            [](prism::indexed::Storage& storage) {
+                return std::unique_ptr<prism::indexed::Index>{new prism::indexed::MemoryIndex{
+                        storage.GetFilepath("prism_indexed_data.snapshot"), 16}};
+            }});
+    backends.push_back(Backend{
+            "FilesystemShardedIndex", backends.front().storage_factory,
+            [](prism::indexed::Storage& storage) {
+                return std::unique_ptr<prism::indexed::Index>{new prism::indexed::ShardedIndex{
+                        storage.GetFilepath("prism_indexed_data.db"), 3}};
+            }});
+    return backends;
+}
+
+class ConformanceFixture : public BufferFixture, public ::testing::WithParamInterface<Backend> {
+  protected:
+    std::unique_ptr<prism::indexed::Buffer> makeBuffer(const prism::indexed::Options& options,
+                                                       const double& gigabyte_quota = 2.0) {
+        auto backend_options = options;
+        backend_options.storage_factory = GetParam().storage_factory;
+        backend_options.index_factory = GetParam().index_factory;
+        return std::unique_ptr<prism::indexed::Buffer>{
+                new prism::indexed::Buffer{std::string{}, gigabyte_quota, backend_options}};
+    }
+
+    std::unique_ptr<prism::indexed::Buffer> makeBuffer(
+            const double& gigabyte_quota = 2.0,
+            const std::map<prism::indexed::Device, prism::indexed::DeviceQuota>& device_quotas =
+                    {},
+            const std::shared_ptr<prism::indexed::EvictionPolicy>& eviction_policy = nullptr) {
+        prism::indexed::Options options;
+        options.device_quotas = device_quotas;
+        options.eviction_policy = eviction_policy;
+        options.storage_factory = GetParam().storage_factory;
+        options.index_factory = GetParam().index_factory;
+        return std::unique_ptr<prism::indexed::Buffer>{
+                new prism::indexed::Buffer{std::string{}, gigabyte_quota, options}};
+    }
+
+    void push(prism::indexed::Buffer& buffer, const std::chrono::system_clock::time_point& time_point,
+              const unsigned int& device) {
+        writeStagingFile(filename_, contents_);
+        EXPECT_TRUE(buffer.Push(time_point, device, filepath_));
+    }
+
+    // Clips large enough that index growth of a page or two cannot be mistaken for a clip
+    void pushLarge(prism::indexed::Buffer& buffer,
+                   const std::chrono::system_clock::time_point& time_point,
+                   const unsigned int& device) {
+        writeStagingFile(filename_, std::string(large_size_, 'x'));
+        EXPECT_TRUE(buffer.Push(time_point, device, filepath_));
+    }
+
+    // Push evicts only while already above quota, so a buffer may hold one clip past it
+    double quota(const unsigned long long& clips) {
+        return (metadataSize() + clips * large_size_ + large_size_ / 2) /
+               (1024 * 1024 * 1024.);
+    }
+
+    // Whatever files the index keeps beside the clips
+    unsigned long long metadataSize() {
+        unsigned long long size = 0;
+        for (fs::directory_iterator it(buffer_path_), end; it != end; ++it) {
+            if (it->path().filename().string().compare(0, 18, "prism_indexed_data") == 0) {
+                size += fs::file_size(it->path());
+            }
+        }
+        return size;
+    }
+
+    // Events delivered to a subscriber that records them, once count have arrived or after ten
+    // seconds
+    std::vector<prism::indexed::Event> waitForEvents(const std::size_t& count) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (std::chrono::steady_clock::now() < deadline) {
+            {
+                std::lock_guard<std::mutex> lock(events_mutex_);
+                if (events_.size() >= count) {
+                    return events_;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        std::lock_guard<std::mutex> lock(events_mutex_);
+        return events_;
+    }
+
+    unsigned int subscribe(prism::indexed::Buffer& buffer) {
+        return buffer.Subscribe([this](const prism::indexed::Event& event) {
+            std::lock_guard<std::mutex> lock(events_mutex_);
+            events_.push_back(event);
+        });
+    }
+
+    void expectEvent(const prism::indexed::Event& event, const prism::indexed::EventType& type,
+                     const unsigned int& device,
+                     const std::chrono::system_clock::time_point& time_point,
+                     const uintmax_t& size) {
+        EXPECT_EQ(type, event.type);
+        EXPECT_EQ(device, event.device);
+        EXPECT_EQ(prism::indexed::utility::SnapToMinute(time_point),
+                  std::chrono::duration_cast<std::chrono::minutes>(
+                          event.time_point.time_since_epoch())
+                          .count());
+        EXPECT_EQ(size, event.size);
+    }
+
+    const unsigned long long large_size_ = 256 * 1024;
+    std::mutex events_mutex_;
+    std::vector<prism::indexed::Event> events_;
+};
+
+TEST_P(ConformanceFixture, ConstructTest) {
+    auto buffer = makeBuffer();
+    EXPECT_TRUE(fs::exists(buffer_path_));
+    EXPECT_FALSE(buffer->Full());
+}
+
+TEST_P(ConformanceFixture, PushSingleTest) {
+    auto buffer = makeBuffer();
+    auto now = std::chrono::system_clock::now();
+    EXPECT_EQ(0, numberOfFiles());
+    push(*buffer, now, 1);
+    EXPECT_EQ(1, numberOfFiles());
+    EXPECT_FALSE(fs::exists(filepath_));
+    EXPECT_TRUE(fs::exists(buffer->GetFilepath(now, 1)));
+}
+
+TEST_P(ConformanceFixture, PushNothingTest) {
+    auto buffer = makeBuffer();
+    auto now = std::chrono::system_clock::now();
+    EXPECT_FALSE(buffer->Push(now, 1, filepath_));
+    EXPECT_EQ(0, numberOfFiles());
+    EXPECT_TRUE(buffer->GetFilepath(now, 1).empty());
+}
+
+TEST_P(ConformanceFixture, DeleteSingleTest) {
+    auto buffer = makeBuffer();
+    auto now = std::chrono::system_clock::now();
+    EXPECT_FALSE(buffer->Delete(now, 1));
+    push(*buffer, now, 1);
+    EXPECT_TRUE(buffer->Delete(now, 1));
+    EXPECT_EQ(0, numberOfFiles());
+    EXPECT_TRUE(buffer->GetFilepath(now, 1).empty());
+    EXPECT_FALSE(buffer->Delete(now, 1));
+}
+
+TEST_P(ConformanceFixture, GetFilepathMissingFileTest) {
+    auto buffer = makeBuffer();
+    auto now = std::chrono::system_clock::now();
+    push(*buffer, now, 1);
+    fs::remove(buffer->GetFilepath(now, 1));
+    EXPECT_TRUE(buffer->GetFilepath(now, 1).empty());
+    EXPECT_TRUE(buffer->GetCatalog().empty());
+}
+
+TEST_P(ConformanceFixture, GetCatalogMultipleDeviceTest) {
+    auto buffer = makeBuffer();
+    auto now = std::chrono::system_clock::now();
+    EXPECT_TRUE(buffer->GetCatalog().empty());
+    for (int i = 0; i < 60; ++i) {
+        push(*buffer, now + std::chrono::minutes(i), 1);
+        push(*buffer, now + std::chrono::minutes(i), 2);
+    }
+    auto catalog = buffer->GetCatalog();
+    EXPECT_EQ(2, catalog.size());
+    for (const auto& device : catalog) {
+        std::size_t minutes = 0;
+        for (const auto& hour : device.second) {
+            minutes += hour.second.size();
+        }
+        EXPECT_EQ(60, minutes);
+    }
+}
+
+TEST_P(ConformanceFixture, FindNearestGapTest) {
+    auto buffer = makeBuffer();
+    auto now = std::chrono::system_clock::now();
+    EXPECT_TRUE(buffer->FindNearest(now, 1, prism::indexed::Direction::Nearest).filepath.empty());
+    push(*buffer, now, 1);
+    push(*buffer, now + std::chrono::minutes(10), 1);
+    auto before = buffer->GetFilepath(now, 1);
+    auto after = buffer->GetFilepath(now + std::chrono::minutes(10), 1);
+    EXPECT_NE(before, after);
+
+    auto seek = now + std::chrono::minutes(3);
+    EXPECT_EQ(before, buffer->FindNearest(seek, 1, prism::indexed::Direction::Before).filepath);
+    EXPECT_EQ(after, buffer->FindNearest(seek, 1, prism::indexed::Direction::After).filepath);
+    EXPECT_EQ(before, buffer->FindNearest(seek, 1, prism::indexed::Direction::Nearest).filepath);
+    seek = now + std::chrono::minutes(7);
+    EXPECT_EQ(after, buffer->FindNearest(seek, 1, prism::indexed::Direction::Nearest).filepath);
+    EXPECT_TRUE(buffer->FindNearest(seek, 2, prism::indexed::Direction::Nearest).filepath.empty());
+}
+
+TEST_P(ConformanceFixture, GetFilepathsWindowTest) {
+    auto buffer = makeBuffer();
+    auto now = std::chrono::system_clock::now();
+    EXPECT_TRUE(buffer->GetFilepaths(1, now - std::chrono::hours(24), now).empty());
+    for (int i = 0; i < 30; ++i) {
+        push(*buffer, now + std::chrono::minutes(i), 1);
+        push(*buffer, now + std::chrono::minutes(i), 2);
+    }
+    auto clips = buffer->GetFilepaths(1, now + std::chrono::minutes(10),
+                                      now + std::chrono::minutes(19));
+    ASSERT_EQ(10, clips.size());
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(buffer->GetFilepath(now + std::chrono::minutes(10 + i), 1), clips[i].filepath);
+    }
+}
+
+TEST_P(ConformanceFixture, DeleteRangeTest) {
+    auto now = std::chrono::system_clock::now();
+    {
+        auto buffer = makeBuffer();
+        EXPECT_FALSE(buffer->DeleteRange(now, now + std::chrono::minutes(9)));
+        for (int i = 0; i < 10; ++i) {
+            push(*buffer, now + std::chrono::minutes(i), 1);
+            push(*buffer, now + std::chrono::minutes(i), 2);
+        }
+        EXPECT_TRUE(buffer->DeleteRange(1, now, now + std::chrono::minutes(4)));
+        EXPECT_TRUE(buffer->GetFilepath(now, 1).empty());
+        EXPECT_FALSE(buffer->GetFilepath(now, 2).empty());
+    }
+    // Ranges are unlinked in the background, which finishes before the buffer is destroyed
+    EXPECT_EQ(15, numberOfFiles());
+    {
+        auto buffer = makeBuffer();
+        EXPECT_TRUE(buffer->DeleteRange(now, now + std::chrono::minutes(9)));
+    }
+    EXPECT_EQ(0, numberOfFiles());
+}
+
+TEST_P(ConformanceFixture, KeepLevelsTest) {
+    auto buffer = makeBuffer();
+    auto now = std::chrono::system_clock::now();
+    EXPECT_FALSE(buffer->PreserveRecord(now, 1));
+    push(*buffer, now, 1);
+    EXPECT_TRUE(buffer->PreserveRecord(now, 1));
+    EXPECT_TRUE(buffer->SetLowPriority(now, 1));
+    EXPECT_TRUE(buffer->KeepIfPossible(now, 1));
+    EXPECT_TRUE(buffer->BulkPreserveRecord({now}, 1));
+    EXPECT_TRUE(buffer->SetKeepRange(1, now, now, DELETE_IF_FULL));
+    EXPECT_FALSE(buffer->SetKeepRange(2, now, now, DELETE_IF_FULL));
+}
+
+TEST_P(ConformanceFixture, PushEvictsOldestTest) {
+    auto now = std::chrono::system_clock::now();
+    {
+        auto buffer = makeBuffer();
+        pushLarge(*buffer, now, 1);
+    }
+    auto buffer = makeBuffer(quota(0));
+    for (int i = 1; i < 10; ++i) {
+        pushLarge(*buffer, now + std::chrono::minutes(i), 1);
+        EXPECT_EQ(1, numberOfFiles());
+    }
+    EXPECT_TRUE(buffer->GetFilepath(now, 1).empty());
+    EXPECT_FALSE(buffer->GetFilepath(now + std::chrono::minutes(9), 1).empty());
+}
+
+TEST_P(ConformanceFixture, PushEvictsLowPriorityFirstTest) {
+    auto now = std::chrono::system_clock::now();
+    {
+        auto buffer = makeBuffer();
+        pushLarge(*buffer, now, 1);
+        pushLarge(*buffer, now + std::chrono::minutes(1), 1);
+        EXPECT_TRUE(buffer->SetLowPriority(now + std::chrono::minutes(1), 1));
+    }
+    auto buffer = makeBuffer(quota(1));
+    pushLarge(*buffer, now + std::chrono::minutes(2), 1);
+    EXPECT_FALSE(buffer->GetFilepath(now, 1).empty());
+    EXPECT_TRUE(buffer->GetFilepath(now + std::chrono::minutes(1), 1).empty());
+}
+
+TEST_P(ConformanceFixture, LargestFirstPolicyTest) {
+    auto now = std::chrono::system_clock::now();
+    {
+        auto buffer = makeBuffer();
+        push(*buffer, now, 1);
+        pushLarge(*buffer, now + std::chrono::minutes(1), 1);
+        pushLarge(*buffer, now + std::chrono::minutes(2), 1);
+    }
+    auto buffer = makeBuffer(quota(1), {}, std::make_shared<prism::indexed::LargestFirstPolicy>());
+    push(*buffer, now + std::chrono::minutes(3), 1);
+    EXPECT_FALSE(buffer->GetFilepath(now, 1).empty());
+    EXPECT_TRUE(buffer->GetFilepath(now + std::chrono::minutes(1), 1).empty());
+    EXPECT_FALSE(buffer->GetFilepath(now + std::chrono::minutes(2), 1).empty());
+}
+
+TEST_P(ConformanceFixture, FairShareEvictsChattyDeviceTest) {
+    auto now = std::chrono::system_clock::now();
+    {
+        auto buffer = makeBuffer();
+        pushLarge(*buffer, now, 2);
+        for (int i = 1; i < 5; ++i) {
+            pushLarge(*buffer, now + std::chrono::minutes(i), 1);
+        }
+    }
+    auto buffer = makeBuffer(quota(4), {{1, {0, 0}}, {2, {0, 0}}});
+    pushLarge(*buffer, now + std::chrono::minutes(5), 1);
+    EXPECT_FALSE(buffer->GetFilepath(now, 2).empty());
+    EXPECT_TRUE(buffer->GetFilepath(now + std::chrono::minutes(1), 1).empty());
+    EXPECT_FALSE(buffer->GetFilepath(now + std::chrono::minutes(2), 1).empty());
+}
+
+TEST_P(ConformanceFixture, FairShareRespectsReserveTest) {
+    auto now = std::chrono::system_clock::now();
+    {
+        auto buffer = makeBuffer();
+        for (int i = 0; i < 3; ++i) {
+            pushLarge(*buffer, now + std::chrono::minutes(i), 2);
+        }
+        pushLarge(*buffer, now + std::chrono::minutes(3), 1);
+        pushLarge(*buffer, now + std::chrono::minutes(4), 1);
+    }
+    auto buffer = makeBuffer(quota(4), {{2, {0, 3 * large_size_}}});
+    pushLarge(*buffer, now + std::chrono::minutes(5), 1);
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_FALSE(buffer->GetFilepath(now + std::chrono::minutes(i), 2).empty());
+    }
+    EXPECT_TRUE(buffer->GetFilepath(now + std::chrono::minutes(3), 1).empty());
+    EXPECT_FALSE(buffer->GetFilepath(now + std::chrono::minutes(4), 1).empty());
+}
+
+TEST_P(ConformanceFixture, DeviceQuotaCapsDeviceTest) {
+    auto now = std::chrono::system_clock::now();
+    auto buffer = makeBuffer(2.0, {{1, {2 * large_size_, 0}}});
+    for (int i = 0; i < 4; ++i) {
+        pushLarge(*buffer, now + std::chrono::minutes(i), 1);
+    }
+    push(*buffer, now, 2);
+    EXPECT_TRUE(buffer->GetFilepath(now + std::chrono::minutes(1), 1).empty());
+    EXPECT_FALSE(buffer->GetFilepath(now + std::chrono::minutes(2), 1).empty());
+    EXPECT_FALSE(buffer->GetFilepath(now + std::chrono::minutes(3), 1).empty());
+    EXPECT_FALSE(buffer->GetFilepath(now, 2).empty());
+    EXPECT_EQ(3, numberOfFiles());
+}
+
+TEST_P(ConformanceFixture, ExpireRetentionTest) {
+    auto now = std::chrono::system_clock::now();
+    std::string expired_filepath;
+    {
+        prism::indexed::Options options;
+        options.retention = std::chrono::minutes(60);
+        options.retention_interval = std::chrono::minutes(60);
+        auto buffer = makeBuffer(options);
+        push(*buffer, now - std::chrono::minutes(120), 1);
+        push(*buffer, now - std::chrono::minutes(90), 2);
+        EXPECT_TRUE(buffer->PreserveRecord(now - std::chrono::minutes(90), 2));
+        push(*buffer, now - std::chrono::minutes(30), 1);
+        expired_filepath = buffer->GetFilepath(now - std::chrono::minutes(120), 1);
+        buffer->Expire();
+        EXPECT_EQ(0, buffer->Expire());
+        EXPECT_TRUE(buffer->GetFilepath(now - std::chrono::minutes(120), 1).empty());
+        EXPECT_TRUE(buffer->GetFilepath(now - std::chrono::minutes(90), 2).empty());
+        EXPECT_FALSE(buffer->GetFilepath(now - std::chrono::minutes(30), 1).empty());
+    }
+    EXPECT_FALSE(fs::exists(expired_filepath));
+    EXPECT_EQ(1, numberOfFiles());
+}
+
+TEST_P(ConformanceFixture, ExpireShortestRetentionTest) {
+    auto now = std::chrono::system_clock::now();
+    prism::indexed::Options options;
+    options.retention = std::chrono::minutes(600);
+    options.device_retention[2] = std::chrono::minutes(60);
+    options.keep_retention[DELETE_IF_FULL] = std::chrono::minutes(30);
+    options.retention_interval = std::chrono::minutes(60);
+    auto buffer = makeBuffer(options);
+    push(*buffer, now - std::chrono::minutes(120), 1);
+    push(*buffer, now - std::chrono::minutes(120), 2);
+    push(*buffer, now - std::chrono::minutes(45), 1);
+    EXPECT_TRUE(buffer->SetLowPriority(now - std::chrono::minutes(45), 1));
+    push(*buffer, now - std::chrono::minutes(20), 1);
+    EXPECT_TRUE(buffer->SetLowPriority(now - std::chrono::minutes(20), 1));
+    buffer->Expire();
+    EXPECT_EQ(0, buffer->Expire());
+    EXPECT_FALSE(buffer->GetFilepath(now - std::chrono::minutes(120), 1).empty());
+    EXPECT_TRUE(buffer->GetFilepath(now - std::chrono::minutes(120), 2).empty());
+    EXPECT_TRUE(buffer->GetFilepath(now - std::chrono::minutes(45), 1).empty());
+    EXPECT_FALSE(buffer->GetFilepath(now - std::chrono::minutes(20), 1).empty());
+}
+
+TEST_P(ConformanceFixture, RetentionBackgroundTaskTest) {
+    auto now = std::chrono::system_clock::now();
+    {
+        auto buffer = makeBuffer();
+        for (int i = 0; i < 300; ++i) {
+            push(*buffer, now - std::chrono::hours(24) - std::chrono::minutes(i), i % 2);
+        }
+        push(*buffer, now, 1);
+    }
+    prism::indexed::Options options;
+    options.retention = std::chrono::minutes(60);
+    auto buffer = makeBuffer(options);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!buffer->GetFilepath(now - std::chrono::hours(24), 0).empty() &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    while (buffer->GetCatalog().size() > 1 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(1, buffer->GetCatalog().size());
+    EXPECT_FALSE(buffer->GetFilepath(now, 1).empty());
+}
+
+TEST_P(ConformanceFixture, UnlinkInBackgroundEvictsOldestTest) {
+    auto now = std::chrono::system_clock::now();
+    {
+        auto buffer = makeBuffer();
+        pushLarge(*buffer, now, 1);
+    }
+    {
+        prism::indexed::Options options;
+        options.unlink_in_background = true;
+        auto buffer = makeBuffer(options, quota(0));
+        for (int i = 1; i < 10; ++i) {
+            pushLarge(*buffer, now + std::chrono::minutes(i), 1);
+        }
+        EXPECT_TRUE(buffer->GetFilepath(now, 1).empty());
+        EXPECT_TRUE(buffer->GetFilepath(now + std::chrono::minutes(8), 1).empty());
+        EXPECT_FALSE(buffer->GetFilepath(now + std::chrono::minutes(9), 1).empty());
+        EXPECT_EQ(9, buffer->GetStats().files_evicted);
+    }
+    EXPECT_EQ(1, numberOfFiles());
+}
+
+TEST_P(ConformanceFixture, UnlinkInBackgroundDeleteTest) {
+    auto now = std::chrono::system_clock::now();
+    {
+        prism::indexed::Options options;
+        options.unlink_in_background = true;
+        auto buffer = makeBuffer(options);
+        push(*buffer, now, 1);
+        EXPECT_TRUE(buffer->Delete(now, 1));
+        EXPECT_TRUE(buffer->GetFilepath(now, 1).empty());
+    }
+    EXPECT_EQ(0, numberOfFiles());
+}
+
+TEST_P(ConformanceFixture, DeduplicateSharesFileTest) {
+    auto now = std::chrono::system_clock::now();
+    prism::indexed::Options options;
+    options.deduplicate = true;
+    auto buffer = makeBuffer(options);
+    for (int i = 0; i < 3; ++i) {
+        push(*buffer, now + std::chrono::minutes(i), 1);
+    }
+    writeStagingFile(filename_, "hello there");
+    EXPECT_TRUE(buffer->Push(now + std::chrono::minutes(3), 1, filepath_));
+
+    const auto filepath = buffer->GetFilepath(now, 1);
+    EXPECT_EQ(3, fs::hard_link_count(filepath));
+    EXPECT_EQ(1, fs::hard_link_count(buffer->GetFilepath(now + std::chrono::minutes(3), 1)));
+
+    EXPECT_TRUE(buffer->Delete(now, 1));
+    EXPECT_TRUE(buffer->Delete(now + std::chrono::minutes(1), 1));
+    const auto remaining = buffer->GetFilepath(now + std::chrono::minutes(2), 1);
+    ASSERT_FALSE(remaining.empty());
+    EXPECT_EQ(1, fs::hard_link_count(remaining));
+    EXPECT_EQ(contents_.size(), fs::file_size(remaining));
+}
+
+TEST_P(ConformanceFixture, DeduplicateChargesQuotaOnceTest) {
+    auto now = std::chrono::system_clock::now();
+    prism::indexed::Options options;
+    options.deduplicate = true;
+    {
+        auto buffer = makeBuffer(options);
+        pushLarge(*buffer, now, 1);
+    }
+    auto buffer = makeBuffer(options, quota(1));
+    for (int i = 1; i < 6; ++i) {
+        pushLarge(*buffer, now + std::chrono::minutes(i), 1);
+    }
+    for (int i = 0; i < 6; ++i) {
+        EXPECT_FALSE(buffer->GetFilepath(now + std::chrono::minutes(i), 1).empty()) << i;
+    }
+    EXPECT_EQ(0, buffer->GetStats().files_evicted);
+}
+
+TEST_P(ConformanceFixture, DeduplicateChargesQuotaOnceAfterRestartTest) {
+    auto now = std::chrono::system_clock::now();
+    prism::indexed::Options options;
+    options.deduplicate = true;
+    {
+        auto buffer = makeBuffer(options);
+        for (int i = 0; i < 4; ++i) {
+            pushLarge(*buffer, now + std::chrono::minutes(i), 1);
+        }
+    }
+    auto buffer = makeBuffer(options, quota(1));
+    pushLarge(*buffer, now + std::chrono::minutes(4), 1);
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_FALSE(buffer->GetFilepath(now + std::chrono::minutes(i), 1).empty()) << i;
+    }
+    EXPECT_EQ(0, buffer->GetStats().files_evicted);
+}
+
+std::string compressibleContents() {
+    std::string contents;
+    for (int i = 0; contents.size() < 100000; ++i) {
+        contents += "device=" + std::to_string(i % 7) + " frame=" + std::to_string(i) + "\n";
+    }
+    return contents;
+}
+
+std::string readClip(const prism::indexed::Clip& clip) {
+    prism::indexed::DecompressingReader reader{clip.filepath};
+    std::string contents;
+    char chunk[4096];
+    while (auto read = reader.Read(chunk, sizeof(chunk))) {
+        contents.append(chunk, read);
+    }
+    return contents;
+}
+
+TEST_P(ConformanceFixture, CompressionStoresCompressedTest) {
+    auto now = std::chrono::system_clock::now();
+    prism::indexed::Options options;
+    options.compression = prism::indexed::Codec::Lz4;
+    auto buffer = makeBuffer(options);
+    const auto contents = compressibleContents();
+    writeStagingFile(filename_, contents);
+    EXPECT_TRUE(buffer->Push(now, 1, filepath_));
+    EXPECT_FALSE(fs::exists(filepath_));
+    EXPECT_FALSE(fs::exists(filepath_ + ".lz4"));
+
+    auto clip = buffer->GetLocation(now, 1);
+    EXPECT_EQ(prism::indexed::Codec::Lz4, clip.codec);
+    EXPECT_EQ(contents.size(), clip.raw_length);
+    EXPECT_EQ(fs::file_size(clip.filepath), clip.length);
+    EXPECT_LT(clip.length, contents.size() / 2);
+    EXPECT_EQ(contents, readClip(clip));
+}
+
+TEST_P(ConformanceFixture, CompressionSkipsIncompressibleTest) {
+    auto now = std::chrono::system_clock::now();
+    prism::indexed::Options options;
+    options.compression = prism::indexed::Codec::Lz4;
+    auto buffer = makeBuffer(options);
+    push(*buffer, now, 1);
+
+    auto clip = buffer->GetLocation(now, 1);
+    EXPECT_EQ(prism::indexed::Codec::None, clip.codec);
+    EXPECT_EQ(contents_.size(), clip.length);
+    EXPECT_EQ(contents_.size(), clip.raw_length);
+    EXPECT_EQ(contents_.size(), fs::file_size(clip.filepath));
+}
+
+TEST_P(ConformanceFixture, CompressionChargesCompressedBytesTest) {
+    auto now = std::chrono::system_clock::now();
+    prism::indexed::Options options;
+    options.compression = prism::indexed::Codec::Lz4;
+    {
+        auto buffer = makeBuffer(options);
+        pushLarge(*buffer, now, 1);
+    }
+    auto buffer = makeBuffer(options, quota(1));
+    for (int i = 1; i < 6; ++i) {
+        pushLarge(*buffer, now + std::chrono::minutes(i), 1);
+    }
+    for (int i = 0; i < 6; ++i) {
+        EXPECT_FALSE(buffer->GetFilepath(now + std::chrono::minutes(i), 1).empty()) << i;
+    }
+    EXPECT_EQ(0, buffer->GetStats().files_evicted);
+}
+
+TEST_P(ConformanceFixture, CompressionPersistsAcrossRestartTest) {
+    auto now = std::chrono::system_clock::now();
+    const auto contents = compressibleContents();
+    {
+        prism::indexed::Options options;
+        options.compression = prism::indexed::Codec::Lz4;
+        auto buffer = makeBuffer(options);
+        writeStagingFile(filename_, contents);
+        EXPECT_TRUE(buffer->Push(now, 1, filepath_));
+    }
+    auto buffer = makeBuffer();
+    auto clip = buffer->FindNearest(now, 1, prism::indexed::Direction::Nearest);
+    EXPECT_EQ(prism::indexed::Codec::Lz4, clip.codec);
+    EXPECT_EQ(contents.size(), clip.raw_length);
+    EXPECT_EQ(contents, readClip(clip));
+}
+
+TEST_P(ConformanceFixture, PersistsAcrossRestartTest) {
+    auto now = std::chrono::system_clock::now();
+    std::string filepath;
+    {
+        auto buffer = makeBuffer();
+        push(*buffer, now, 1);
+        filepath = buffer->GetFilepath(now, 1);
+    }
+    auto buffer = makeBuffer();
+    EXPECT_EQ(filepath, buffer->GetFilepath(now, 1));
+    EXPECT_EQ(1, buffer->GetCatalog()[1].size());
+}
+
+TEST_P(ConformanceFixture, NextUnsyncedTest) {
+    auto now = std::chrono::system_clock::now();
+    const auto minute = [&now](const int& offset) {
+        return std::chrono::minutes(
+                prism::indexed::utility::SnapToMinute(now + std::chrono::minutes(offset)));
+    };
+    {
+        auto buffer = makeBuffer();
+        EXPECT_TRUE(buffer->NextUnsynced(10, {}).empty());
+        push(*buffer, now + std::chrono::minutes(2), 1);
+        push(*buffer, now, 2);
+        push(*buffer, now + std::chrono::minutes(1), 1);
+        push(*buffer, now + std::chrono::minutes(3), 3);
+
+        auto clips = buffer->NextUnsynced(2, {});
+        ASSERT_EQ(2, clips.size());
+        EXPECT_EQ(2, clips[0].device);
+        EXPECT_EQ(minute(0), clips[0].clip.time_point.time_since_epoch());
+        EXPECT_EQ(buffer->GetFilepath(now, 2), clips[0].clip.filepath);
+        EXPECT_EQ(contents_.size(), clips[0].clip.length);
+        EXPECT_EQ(1, clips[1].device);
+        EXPECT_EQ(minute(1), clips[1].clip.time_point.time_since_epoch());
+
+        EXPECT_TRUE(buffer->MarkSynced({now, now + std::chrono::minutes(1)}, 1));
+        EXPECT_TRUE(buffer->MarkSynced({now}, 2));
+        EXPECT_FALSE(buffer->MarkSynced({now}, 4));
+    }
+
+    // Sync state survives a restart, and clips whose file has gone are dropped
+    auto buffer = makeBuffer();
+    fs::remove(buffer->GetFilepath(now + std::chrono::minutes(3), 3));
+    auto clips = buffer->NextUnsynced(10, {1, 3});
+    ASSERT_EQ(1, clips.size());
+    EXPECT_EQ(1, clips[0].device);
+    EXPECT_EQ(minute(2), clips[0].clip.time_point.time_since_epoch());
+    EXPECT_TRUE(buffer->GetFilepath(now + std::chrono::minutes(3), 3).empty());
+    EXPECT_TRUE(buffer->NextUnsynced(10, {2}).empty());
+}
+
+TEST_P(ConformanceFixture, ReconcileOrphanFileTest) {
+    {
+        auto buffer = makeBuffer();
+        auto now = std::chrono::system_clock::now();
+        push(*buffer, now, 1);
+        writeStagingFile(filename_, contents_);
+        fs::rename(filepath_, buffer_path_ / "orphan");
+        auto report = buffer->Reconcile(std::chrono::seconds(10));
+        EXPECT_TRUE(report.complete);
+        EXPECT_EQ(1, report.orphan_files_removed);
+        EXPECT_EQ(0, report.missing_records_removed);
+    }
+    EXPECT_EQ(1, numberOfFiles());
+}
+
+TEST_P(ConformanceFixture, SubscribeTest) {
+    using prism::indexed::EventType;
+    auto buffer = makeBuffer();
+    subscribe(*buffer);
+    auto now = std::chrono::system_clock::now();
+    const auto later = now + std::chrono::minutes(5);
+    push(*buffer, now, 1);
+    push(*buffer, later, 2);
+    EXPECT_TRUE(buffer->SetLowPriority(now, 1));
+    EXPECT_TRUE(buffer->SetKeepRange(now, later, PRESERVE_RECORD));
+    EXPECT_TRUE(buffer->Delete(now, 1));
+    EXPECT_TRUE(buffer->DeleteRange(2, now, later));
+    EXPECT_FALSE(buffer->Delete(now, 1));
+
+    auto events = waitForEvents(7);
+    ASSERT_EQ(7, events.size());
+    const auto size = contents_.size();
+    expectEvent(events[0], EventType::Pushed, 1, now, size);
+    expectEvent(events[1], EventType::Pushed, 2, later, size);
+    expectEvent(events[2], EventType::KeepChanged, 1, now, size);
+    // Clips changed by a range come in no particular order
+    std::map<prism::indexed::Device, prism::indexed::Event> ranged{{events[3].device, events[3]},
+                                                                   {events[4].device, events[4]}};
+    ASSERT_EQ(2, ranged.size());
+    expectEvent(ranged[1], EventType::KeepChanged, 1, now, size);
+    expectEvent(ranged[2], EventType::KeepChanged, 2, later, size);
+    expectEvent(events[5], EventType::Deleted, 1, now, size);
+    expectEvent(events[6], EventType::Deleted, 2, later, size);
+}
+
+TEST_P(ConformanceFixture, SubscribeEvictionTest) {
+    auto buffer = makeBuffer(quota(2));
+    subscribe(*buffer);
+    auto now = std::chrono::system_clock::now();
+    for (auto i = 0; i < 5; ++i) {
+        pushLarge(*buffer, now + std::chrono::minutes(i), 1);
+    }
+    const auto evicted = buffer->GetStats().files_evicted;
+    ASSERT_LT(0, evicted);
+
+    auto events = waitForEvents(5 + evicted);
+    ASSERT_EQ(5 + evicted, events.size());
+    std::size_t evictions = 0;
+    for (const auto& event : events) {
+        if (event.type == prism::indexed::EventType::Evicted) {
+            expectEvent(event, prism::indexed::EventType::Evicted, 1,
+                        now + std::chrono::minutes(evictions), large_size_);
+            ++evictions;
+        }
+    }
+    EXPECT_EQ(evicted, evictions);
+}
+
+TEST_P(ConformanceFixture, SubscribeExpireTest) {
+    prism::indexed::Options options;
+    options.retention = std::chrono::minutes(60);
+    options.retention_interval = std::chrono::minutes(60);
+    auto buffer = makeBuffer(options);
+    subscribe(*buffer);
+    auto now = std::chrono::system_clock::now();
+    push(*buffer, now, 1);
+    push(*buffer, now - std::chrono::minutes(120), 2);
+    // The background task may have expired the clip already
+    buffer->Expire();
+
+    auto events = waitForEvents(3);
+    ASSERT_EQ(3, events.size());
+    expectEvent(events[2], prism::indexed::EventType::Evicted, 2,
+                now - std::chrono::minutes(120), contents_.size());
+}
+
+TEST_P(ConformanceFixture, SubscribeMissingFileTest) {
+    auto buffer = makeBuffer();
+    subscribe(*buffer);
+    auto now = std::chrono::system_clock::now();
+    for (auto i = 0; i < 5; ++i) {
+        push(*buffer, now + std::chrono::minutes(i), 1);
+        fs::remove(buffer->GetFilepath(now + std::chrono::minutes(i), 1));
+    }
+
+    // Every read that finds a clip's file gone drops the clip and reports it
+    EXPECT_TRUE(buffer->GetFilepath(now, 1).empty());
+    EXPECT_TRUE(buffer->GetLocation(now + std::chrono::minutes(1), 1).filepath.empty());
+    EXPECT_TRUE(buffer->GetFilepaths(1, now + std::chrono::minutes(2),
+                                     now + std::chrono::minutes(2))
+                        .empty());
+    EXPECT_TRUE(buffer->NextUnsynced(1, {}).empty());
+    EXPECT_TRUE(buffer->FindNearest(now + std::chrono::minutes(4), 1,
+                                    prism::indexed::Direction::After)
+                        .filepath.empty());
+    EXPECT_TRUE(buffer->GetCatalog().empty());
+
+    auto events = waitForEvents(10);
+    ASSERT_EQ(10, events.size());
+    for (auto i = 0; i < 5; ++i) {
+        expectEvent(events[5 + i], prism::indexed::EventType::Deleted, 1,
+                    now + std::chrono::minutes(i), contents_.size());
+    }
+}
+
+TEST_P(ConformanceFixture, UnsubscribeTest) {
+    auto buffer = makeBuffer();
+    const auto subscription = subscribe(*buffer);
+    auto now = std::chrono::system_clock::now();
+    push(*buffer, now, 1);
+    ASSERT_EQ(1, waitForEvents(1).size());
+    buffer->Unsubscribe(subscription);
+    push(*buffer, now + std::chrono::minutes(1), 1);
+    EXPECT_TRUE(buffer->Delete(now, 1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(1, waitForEvents(1).size());
+}
+
+INSTANTIATE_TEST_CASE_P(Backends, ConformanceFixture, ::testing::ValuesIn(backends()),
+                        [](const ::testing::TestParamInfo<Backend>& info) {
+                            return info.param.name;
+                        });
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "indexed/content-hash.h"
+
+
+namespace fs = ::boost::filesystem;
+
+using prism::indexed::utility::Xxh64;
+
+uint64_t hashString(const std::string& data, const uint64_t& seed = 0) {
+    Xxh64 hash{seed};
+    hash.Update(data.data(), data.size());
+    return hash.Digest();
+}
+
+std::string writeFile(const std::string& name, const std::string& contents) {
+    const auto filepath = (fs::temp_directory_path() / name).string();
+    std::ofstream out_stream{filepath};
+    out_stream << contents;
+    return filepath;
+}
+
+TEST(ContentHashTests, ReferenceVectorsTest) {
+    EXPECT_EQ(0xef46db3751d8e999ULL, hashString(""));
+    EXPECT_EQ(0x44bc2cf5ad770999ULL, hashString("abc"));
+    EXPECT_EQ(0x375041e8b1decfb3ULL, hashString(std::string(100, 'a')));
+    EXPECT_EQ(0xbea9ca8199328908ULL, hashString("abc", 1));
+}
+
+TEST(ContentHashTests, StreamingMatchesOneShotTest) {
+    std::string data;
+    for (int i = 0; i < 1024; ++i) {
+        data.push_back(static_cast<char>(i));
+    }
+    for (const std::size_t piece : {1, 3, 31, 32, 33, 100}) {
+        Xxh64 hash;
+        for (std::size_t i = 0; i < data.size(); i += piece) {
+            hash.Update(data.data() + i, std::min(piece, data.size() - i));
+        }
+        EXPECT_EQ(hashString(data), hash.Digest()) << piece;
+    }
+}
+
+TEST(ContentHashTests, HashFileTest) {
+    const auto first = writeFile("prism_content_hash_first", "hello world");
+    const auto second = writeFile("prism_content_hash_second", "hello world");
+    const auto other = writeFile("prism_content_hash_other", "hello there");
+    const auto hash = prism::indexed::utility::HashFile(first);
+    EXPECT_EQ("b40b75a5685e9e4f45ab6734b21e6968", hash);
+    EXPECT_EQ(hash, prism::indexed::utility::HashFile(second));
+    EXPECT_NE(hash, prism::indexed::utility::HashFile(other));
+    EXPECT_TRUE(prism::indexed::utility::HashFile(first + "_missing").empty());
+    for (const auto& filepath : {first, second, other}) {
+        fs::remove(filepath);
+    }
+}
@@ -1,7 +1,13 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <future>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <boost/filesystem.hpp>
 
@@ -1092,3 +1098,777 @@ TEST_F(DatabaseFixture, DeletedDBThrowSetKeepTest) {
     }
     EXPECT_TRUE(thrown);
 }
+
+TEST_F(DatabaseFixture, FindNextEmptyTest) {
+    prism::indexed::Database database{db_string_};
+    EXPECT_TRUE(database.FindNext(1, 1).empty());
+}
+
+TEST_F(DatabaseFixture, FindNextExactTest) {
+    prism::indexed::Database database{db_string_};
+    database.Insert(1, 1, "hash", 5, 0);
+    auto record = database.FindNext(1, 1);
+    EXPECT_EQ(std::string{"hash"}, record["hash"]);
+    EXPECT_EQ(1, std::stoi(record["time_value"]));
+}
+
+TEST_F(DatabaseFixture, FindNextGapTest) {
+    prism::indexed::Database database{db_string_};
+    database.Insert(1, 1, "hash", 5, 0);
+    database.Insert(5, 1, "hashbrowns", 5, 0);
+    database.Insert(3, 2, "otherdevice", 5, 0);
+    auto record = database.FindNext(2, 1);
+    EXPECT_EQ(std::string{"hashbrowns"}, record["hash"]);
+    EXPECT_EQ(5, std::stoi(record["time_value"]));
+    EXPECT_TRUE(database.FindNext(6, 1).empty());
+}
+
+TEST_F(DatabaseFixture, FindPreviousEmptyTest) {
+    prism::indexed::Database database{db_string_};
+    EXPECT_TRUE(database.FindPrevious(1, 1).empty());
+}
+
+TEST_F(DatabaseFixture, FindPreviousGapTest) {
+    prism::indexed::Database database{db_string_};
+    database.Insert(1, 1, "hash", 5, 0);
+    database.Insert(5, 1, "hashbrowns", 5, 0);
+    database.Insert(3, 2, "otherdevice", 5, 0);
+    auto record = database.FindPrevious(4, 1);
+    EXPECT_EQ(std::string{"hash"}, record["hash"]);
+    EXPECT_EQ(1, std::stoi(record["time_value"]));
+    EXPECT_TRUE(database.FindPrevious(0, 1).empty());
+}
+
+TEST_F(DatabaseFixture, SelectRangeEmptyTest) {
+    prism::indexed::Database database{db_string_};
+    EXPECT_TRUE(database.SelectRange(1, 0, 100).empty());
+}
+
+TEST_F(DatabaseFixture, SelectRangeOrderedTest) {
+    prism::indexed::Database database{db_string_};
+    database.Insert(7, 1, "seven", 5, 0);
+    database.Insert(3, 1, "three", 5, 0);
+    database.Insert(5, 1, "five", 5, 0);
+    database.Insert(9, 1, "nine", 5, 0);
+    database.Insert(5, 2, "otherdevice", 5, 0);
+    auto records = database.SelectRange(1, 3, 7);
+    EXPECT_EQ(3, records.size());
+    EXPECT_EQ(std::string{"three"}, records[0]["hash"]);
+    EXPECT_EQ(std::string{"five"}, records[1]["hash"]);
+    EXPECT_EQ(std::string{"seven"}, records[2]["hash"]);
+}
+
+TEST_F(DatabaseFixture, DeviceTimeIndexTest) {
+    prism::indexed::Database database{db_string_};
+    std::stringstream stream;
+    stream << "SELECT name FROM sqlite_master WHERE type='index' AND name='"
+           << table_name_
+           << "_device_time';";
+    auto response = execute(stream.str());
+    EXPECT_EQ(1, response.size());
+}
+
+TEST_F(DatabaseFixture, RangeTimeIndexTest) {
+    prism::indexed::Database database{db_string_};
+    std::stringstream stream;
+    stream << "SELECT name FROM sqlite_master WHERE type='index' AND name='"
+           << table_name_
+           << "_time';";
+    EXPECT_EQ(1, execute(stream.str()).size());
+    execute("DROP INDEX " + table_name_ + "_time;");
+    database.SetKeepRange(1, 10, PRESERVE_RECORD);
+    database.DeleteRange(1, 10);
+    EXPECT_TRUE(execute(stream.str()).empty());
+    prism::indexed::Database other_database{db_string_};
+    EXPECT_EQ(1, execute(stream.str()).size());
+}
+
+TEST_F(DatabaseFixture, SetKeepRangeEmptyTest) {
+    prism::indexed::Database database{db_string_};
+    EXPECT_FALSE(database.SetKeepRange(1, 10, PRESERVE_RECORD));
+    EXPECT_FALSE(database.SetKeepRange(1, 1, 10, PRESERVE_RECORD));
+}
+
+TEST_F(DatabaseFixture, SetKeepRangeDeviceTest) {
+    prism::indexed::Database database{db_string_};
+    for (int i = 0; i < 10; ++i) {
+        database.Insert(i, 1, "hash" + std::to_string(i), 5, 0);
+        database.Insert(i, 2, "other" + std::to_string(i), 5, 0);
+    }
+    EXPECT_TRUE(database.SetKeepRange(1, 3, 6, PRESERVE_RECORD));
+    std::stringstream stream;
+    stream << "SELECT * FROM "
+           << table_name_
+           << ";";
+    auto response = execute(stream.str());
+    EXPECT_EQ(20, response.size());
+    for (auto& record : response) {
+        auto time_value = std::stoi(record["time_value"]);
+        if (std::stoi(record["device"]) == 1 && time_value >= 3 && time_value <= 6) {
+            EXPECT_EQ(PRESERVE_RECORD, std::stoi(record["keep"]));
+        } else {
+            EXPECT_EQ(0, std::stoi(record["keep"]));
+        }
+    }
+}
+
+TEST_F(DatabaseFixture, SetKeepRangeAllDevicesTest) {
+    prism::indexed::Database database{db_string_};
+    for (int i = 0; i < 10; ++i) {
+        database.Insert(i, 1, "hash" + std::to_string(i), 5, 0);
+        database.Insert(i, 2, "other" + std::to_string(i), 5, 0);
+    }
+    EXPECT_TRUE(database.SetKeepRange(3, 6, ATTEMPT_KEEP));
+    std::stringstream stream;
+    stream << "SELECT * FROM "
+           << table_name_
+           << " WHERE keep=" << ATTEMPT_KEEP
+           << ";";
+    auto response = execute(stream.str());
+    EXPECT_EQ(8, response.size());
+}
+
+TEST_F(DatabaseFixture, SelectHashesTest) {
+    prism::indexed::Database database{db_string_};
+    EXPECT_TRUE(database.SelectHashes({}).empty());
+    database.Insert(10, 1, "hash_a", 100, ATTEMPT_KEEP);
+    database.Insert(11, 2, "hash_b", 200, ATTEMPT_KEEP);
+    database.Insert(12, 1, "hash_c", 300, ATTEMPT_KEEP);
+    auto records = database.SelectHashes({"hash_b", "hash_missing"});
+    ASSERT_EQ(1, records.size());
+    EXPECT_EQ("11", records[0]["time_value"]);
+    EXPECT_EQ("2", records[0]["device"]);
+    EXPECT_EQ("hash_b", records[0]["hash"]);
+    EXPECT_EQ("200", records[0]["size"]);
+    EXPECT_EQ(2, database.SelectHashes({"hash_a", "hash_c"}).size());
+}
+
+TEST_F(DatabaseFixture, DeleteRangeEmptyTest) {
+    prism::indexed::Database database{db_string_};
+    EXPECT_TRUE(database.DeleteRange(1, 10).empty());
+    EXPECT_TRUE(database.DeleteRange(1, 1, 10).empty());
+}
+
+TEST_F(DatabaseFixture, DeleteRangeDeviceTest) {
+    prism::indexed::Database database{db_string_};
+    for (int i = 0; i < 10; ++i) {
+        database.Insert(i, 1, "hash" + std::to_string(i), 5, 0);
+        database.Insert(i, 2, "other" + std::to_string(i), 5, 0);
+    }
+    auto hashes = database.DeleteRange(1, 3, 6);
+    EXPECT_EQ(4, hashes.size());
+    EXPECT_EQ(std::string{"hash3"}, hashes[0]);
+    EXPECT_EQ(std::string{"hash6"}, hashes[3]);
+    std::stringstream stream;
+    stream << "SELECT * FROM "
+           << table_name_
+           << ";";
+    auto response = execute(stream.str());
+    EXPECT_EQ(16, response.size());
+}
+
+TEST_F(DatabaseFixture, DeleteRangeAllDevicesTest) {
+    prism::indexed::Database database{db_string_};
+    for (int i = 0; i < 10; ++i) {
+        database.Insert(i, 1, "hash" + std::to_string(i), 5, 0);
+        database.Insert(i, 2, "other" + std::to_string(i), 5, 0);
+    }
+    EXPECT_EQ(8, database.DeleteRange(3, 6).size());
+    std::stringstream stream;
+    stream << "SELECT * FROM "
+           << table_name_
+           << ";";
+    auto response = execute(stream.str());
+    EXPECT_EQ(12, response.size());
+}
+
+TEST_F(DatabaseFixture, IntentTableTest) {
+    prism::indexed::Database database{db_string_};
+    std::stringstream stream;
+    stream << "SELECT name FROM sqlite_master WHERE type='table' AND name='prism_indexed_intent';";
+    auto response = execute(stream.str());
+    EXPECT_EQ(1, response.size());
+    EXPECT_TRUE(database.GetIntents().empty());
+}
+
+TEST_F(DatabaseFixture, InsertPendingTest) {
+    prism::indexed::Database database{db_string_};
+    database.InsertPending(1, 1, "hash", 5, 0);
+    EXPECT_EQ(std::string{"hash"}, database.FindHash(1, 1));
+    auto intents = database.GetIntents();
+    ASSERT_EQ(1, intents.size());
+    EXPECT_EQ(std::string{"hash"}, intents[0]["hash"]);
+    EXPECT_EQ(INTENT_PUSH, std::stoi(intents[0]["operation"]));
+}
+
+TEST_F(DatabaseFixture, InsertPendingBadHashTest) {
+    prism::indexed::Database database{db_string_};
+    database.InsertPending(1, 1, ";DELETE prism_indexed_buffer;", 5, 0);
+    EXPECT_TRUE(database.SelectAll().empty());
+    EXPECT_TRUE(database.GetIntents().empty());
+}
+
+TEST_F(DatabaseFixture, InsertPendingUniquenessViolationTest) {
+    prism::indexed::Database database{db_string_};
+    database.InsertPending(1, 1, "hash", 5, 0);
+    database.FinalizePending("hash");
+    bool thrown = false;
+    try {
+        database.InsertPending(1, 1, "hashbrowns", 5, 0);
+    } catch (const prism::indexed::DatabaseException& e) {
+        thrown = true;
+    }
+    EXPECT_TRUE(thrown);
+    EXPECT_EQ(1, database.SelectAll().size());
+    EXPECT_EQ(1, database.GetIntents().size());
+}
+
+TEST_F(DatabaseFixture, FinalizePendingBatchedTest) {
+    prism::indexed::Database database{db_string_};
+    database.InsertPending(1, 1, "hash", 5, 0);
+    database.FinalizePending("hash");
+    EXPECT_EQ(1, database.GetIntents().size());
+    database.InsertPending(2, 1, "hashbrowns", 5, 0);
+    auto intents = database.GetIntents();
+    ASSERT_EQ(1, intents.size());
+    EXPECT_EQ(std::string{"hashbrowns"}, intents[0]["hash"]);
+}
+
+TEST_F(DatabaseFixture, FinalizePendingReusedHashTest) {
+    prism::indexed::Database database{db_string_};
+    database.InsertPending(1, 1, "hash", 5, 0);
+    database.FinalizePending("hash");
+    database.Delete("hash");
+    database.InsertPending(2, 1, "hash", 5, 0);
+    auto intents = database.GetIntents();
+    ASSERT_EQ(1, intents.size());
+    EXPECT_EQ(std::string{"hash"}, intents[0]["hash"]);
+}
+
+TEST_F(DatabaseFixture, FinalizePendingOnDestructionTest) {
+    {
+        prism::indexed::Database database{db_string_};
+        database.InsertPending(1, 1, "hash", 5, 0);
+        database.FinalizePending("hash");
+    }
+    prism::indexed::Database database{db_string_};
+    EXPECT_TRUE(database.GetIntents().empty());
+    EXPECT_EQ(1, database.SelectAll().size());
+}
+
+TEST_F(DatabaseFixture, MarkDeletingTest) {
+    prism::indexed::Database database{db_string_};
+    database.Insert(1, 1, "hash", 5, 0);
+    database.Insert(2, 1, "hashbrowns", 5, 0);
+    database.MarkDeleting({"hash", "hashbrowns"});
+    auto intents = database.GetIntents();
+    EXPECT_EQ(2, intents.size());
+    for (auto& intent : intents) {
+        EXPECT_EQ(INTENT_DELETE, std::stoi(intent["operation"]));
+    }
+    database.BulkDelete({"hash"});
+    intents = database.GetIntents();
+    ASSERT_EQ(1, intents.size());
+    EXPECT_EQ(std::string{"hashbrowns"}, intents[0]["hash"]);
+    database.ClearIntents({"hashbrowns"});
+    EXPECT_TRUE(database.GetIntents().empty());
+    EXPECT_EQ(1, database.SelectAll().size());
+}
+
+TEST_F(DatabaseFixture, DeleteRangeIntentTest) {
+    prism::indexed::Database database{db_string_};
+    for (int i = 0; i < 10; ++i) {
+        database.Insert(i, 1, "hash" + std::to_string(i), 5, 0);
+    }
+    EXPECT_EQ(3, database.DeleteRange(1, 2, 4).size());
+    auto intents = database.GetIntents();
+    EXPECT_EQ(3, intents.size());
+    for (auto& intent : intents) {
+        EXPECT_EQ(INTENT_DELETE, std::stoi(intent["operation"]));
+    }
+}
+
+TEST_F(DatabaseFixture, TotalSizeEmptyTest) {
+    prism::indexed::Database database{db_string_};
+    EXPECT_EQ(0, database.GetTotalSize());
+}
+
+TEST_F(DatabaseFixture, TotalSizeMaintainedTest) {
+    prism::indexed::Database database{db_string_};
+    database.Insert(1, 1, "hash", 5, 0);
+    database.Insert(2, 1, "hashbrowns", 10, 0);
+    database.InsertPending(3, 1, "pending", 20, 0);
+    EXPECT_EQ(35, database.GetTotalSize());
+    database.Delete("hash");
+    EXPECT_EQ(30, database.GetTotalSize());
+    database.BulkDelete({"hashbrowns", "pending"});
+    EXPECT_EQ(0, database.GetTotalSize());
+}
+
+TEST_F(DatabaseFixture, TotalSizeRangeDeleteTest) {
+    prism::indexed::Database database{db_string_};
+    for (int i = 0; i < 10; ++i) {
+        database.Insert(i, 1, "hash" + std::to_string(i), 5, 0);
+    }
+    database.DeleteRange(1, 0, 3);
+    EXPECT_EQ(30, database.GetTotalSize());
+}
+
+TEST_F(DatabaseFixture, TotalSizeExistingTableTest) {
+    {
+        prism::indexed::Database database{db_string_};
+        database.Insert(1, 1, "hash", 5, 0);
+        database.Insert(2, 1, "hashbrowns", 10, 0);
+    }
+    std::stringstream stream;
+    stream << "DROP TABLE prism_indexed_meta;";
+    execute(stream.str());
+    prism::indexed::Database database{db_string_};
+    EXPECT_EQ(15, database.GetTotalSize());
+}
+
+TEST_F(DatabaseFixture, InsertSegmentedLocationTest) {
+    prism::indexed::Database database{db_string_};
+    database.InsertSegmented(1, 1, "hash", 5, ATTEMPT_KEEP, 3, 100);
+    auto location = database.GetLocation("hash");
+    EXPECT_EQ("3", location["segment"]);
+    EXPECT_EQ("100", location["offset"]);
+    EXPECT_EQ("5", location["length"]);
+    EXPECT_EQ(std::to_string(ATTEMPT_KEEP), location["keep"]);
+    EXPECT_EQ("hash", database.FindHash(1, 1));
+    EXPECT_TRUE(database.GetIntents().empty());
+}
+
+TEST_F(DatabaseFixture, GetLocationUnpackedTest) {
+    prism::indexed::Database database{db_string_};
+    database.Insert(1, 1, "hash", 5, ATTEMPT_KEEP);
+    EXPECT_TRUE(database.GetLocation("hash").empty());
+    EXPECT_TRUE(database.GetLocation("missing").empty());
+}
+
+TEST_F(DatabaseFixture, DeleteRemovesLocationTest) {
+    prism::indexed::Database database{db_string_};
+    database.InsertSegmented(1, 1, "hash", 5, ATTEMPT_KEEP, 1, 0);
+    database.InsertSegmented(2, 1, "hashbrowns", 5, ATTEMPT_KEEP, 1, 5);
+    database.Delete("hash");
+    EXPECT_TRUE(database.GetLocation("hash").empty());
+    database.DeleteRange(1, 0, 10);
+    EXPECT_TRUE(database.GetLocation("hashbrowns").empty());
+    auto response = execute("SELECT * FROM prism_indexed_segment;");
+    EXPECT_TRUE(response.empty());
+}
+
+TEST_F(DatabaseFixture, InsertCompressedTest) {
+    prism::indexed::Database database{db_string_};
+    database.InsertCompressed(1, 1, "hash.lz4", 5, ATTEMPT_KEEP, 1, 40);
+    database.Insert(2, 1, "plain", 7, ATTEMPT_KEEP);
+    auto compression = database.GetCompression("hash.lz4");
+    EXPECT_EQ("1", compression["codec"]);
+    EXPECT_EQ("40", compression["raw_size"]);
+    EXPECT_TRUE(database.GetCompression("plain").empty());
+    EXPECT_EQ(12, database.GetTotalSize());
+    auto intents = database.GetIntents();
+    ASSERT_EQ(1, intents.size());
+    EXPECT_EQ("hash.lz4", intents[0]["hash"]);
+
+    database.Delete("hash.lz4");
+    EXPECT_TRUE(database.GetCompression("hash.lz4").empty());
+    auto response = execute("SELECT * FROM prism_indexed_compression;");
+    EXPECT_TRUE(response.empty());
+}
+
+TEST_F(DatabaseFixture, GetSegmentItemsTest) {
+    prism::indexed::Database database{db_string_};
+    database.InsertSegmented(1, 1, "second", 7, ATTEMPT_KEEP, 1, 5);
+    database.InsertSegmented(2, 1, "first", 5, PRESERVE_RECORD, 1, 0);
+    database.InsertSegmented(3, 1, "other", 5, ATTEMPT_KEEP, 2, 0);
+    auto items = database.GetSegmentItems(1);
+    ASSERT_EQ(2, items.size());
+    EXPECT_EQ("first", items[0]["hash"]);
+    EXPECT_EQ(std::to_string(PRESERVE_RECORD), items[0]["keep"]);
+    EXPECT_EQ("second", items[1]["hash"]);
+    EXPECT_EQ("7", items[1]["length"]);
+    EXPECT_EQ((std::vector<unsigned long long>{1, 2}), database.GetSegments());
+    EXPECT_EQ(17, database.GetSegmentedSize());
+}
+
+TEST_F(DatabaseFixture, GetSegmentedSizeEmptyTest) {
+    prism::indexed::Database database{db_string_};
+    database.Insert(1, 1, "hash", 5, ATTEMPT_KEEP);
+    EXPECT_EQ(0, database.GetSegmentedSize());
+    EXPECT_TRUE(database.GetSegments().empty());
+}
+
+TEST_F(DatabaseFixture, CompactSegmentTest) {
+    prism::indexed::Database database{db_string_};
+    database.InsertSegmented(1, 1, "evicted", 5, DELETE_IF_FULL, 1, 0);
+    database.InsertSegmented(2, 1, "kept", 5, PRESERVE_RECORD, 1, 5);
+    database.CompactSegment({"evicted"}, {Record{{"hash", "kept"}, {"segment", "4"},
+                                                 {"offset", "20"}}});
+    EXPECT_TRUE(database.FindHash(1, 1).empty());
+    auto location = database.GetLocation("kept");
+    EXPECT_EQ("4", location["segment"]);
+    EXPECT_EQ("20", location["offset"]);
+    EXPECT_TRUE(database.GetSegmentItems(1).empty());
+    EXPECT_EQ(5, database.GetTotalSize());
+}
+
+TEST_F(DatabaseFixture, GetDeviceSizesTest) {
+    prism::indexed::Database database{db_string_};
+    EXPECT_TRUE(database.GetDeviceSizes().empty());
+    database.Insert(1, 1, "hash_a", 5, ATTEMPT_KEEP);
+    database.Insert(2, 1, "hash_b", 7, ATTEMPT_KEEP);
+    database.Insert(1, 2, "hash_c", 3, ATTEMPT_KEEP);
+    auto sizes = database.GetDeviceSizes();
+    ASSERT_EQ(2, sizes.size());
+    EXPECT_EQ(12, sizes[1]);
+    EXPECT_EQ(3, sizes[2]);
+    database.Delete("hash_c");
+    database.DeleteRange(1, 1, 1);
+    sizes = database.GetDeviceSizes();
+    ASSERT_EQ(1, sizes.size());
+    EXPECT_EQ(7, sizes[1]);
+}
+
+TEST_F(DatabaseFixture, GetDeviceSizesExistingTableTest) {
+    {
+        prism::indexed::Database database{db_string_};
+        database.Insert(1, 1, "hash_a", 5, ATTEMPT_KEEP);
+        database.Insert(1, 2, "hash_b", 3, ATTEMPT_KEEP);
+    }
+    execute("DROP TABLE prism_indexed_device;");
+    prism::indexed::Database database{db_string_};
+    auto sizes = database.GetDeviceSizes();
+    ASSERT_EQ(2, sizes.size());
+    EXPECT_EQ(5, sizes[1]);
+    EXPECT_EQ(3, sizes[2]);
+}
+
+TEST_F(DatabaseFixture, GetLowestDeletableDeviceTest) {
+    prism::indexed::Database database{db_string_};
+    database.Insert(3, 1, "hash_a", 5, ATTEMPT_KEEP);
+    database.Insert(1, 1, "hash_b", 6, ATTEMPT_KEEP);
+    database.Insert(2, 1, "hash_c", 7, DELETE_IF_FULL);
+    database.Insert(4, 1, "hash_d", 8, PRESERVE_RECORD);
+    database.Insert(1, 2, "hash_e", 9, DELETE_IF_FULL);
+    auto records = database.GetLowestDeletable(1);
+    ASSERT_EQ(3, records.size());
+    EXPECT_EQ("hash_c", records[0]["hash"]);
+    EXPECT_EQ("7", records[0]["size"]);
+    EXPECT_EQ("hash_b", records[1]["hash"]);
+    EXPECT_EQ("hash_a", records[2]["hash"]);
+    EXPECT_TRUE(database.GetLowestDeletable(3).empty());
+}
+
+TEST_F(DatabaseFixture, EvictionOrdersUseIndexesTest) {
+    prism::indexed::Database database{db_string_};
+    database.Insert(1, 1, "hash", 5, ATTEMPT_KEEP);
+    EXPECT_EQ(1, database.GetLargestDeletableHashes().size());
+    EXPECT_EQ(1, database.GetExpiredHashes(2).size());
+    EXPECT_EQ(1, database.GetDecayedDeletableHashes(60).size());
+    auto plan = [this](const std::string& query) {
+        std::string details;
+        for (auto& record : execute("EXPLAIN QUERY PLAN " + query)) {
+            details += record["detail"] + "\n";
+        }
+        return details;
+    };
+    std::stringstream stream;
+    stream << "SELECT hash FROM " << table_name_ << " WHERE keep < " << PRESERVE_RECORD
+           << " ORDER BY keep ASC, size DESC, time_value ASC;";
+    EXPECT_NE(std::string::npos, plan(stream.str()).find(table_name_ + "_keep_size"));
+    EXPECT_EQ(std::string::npos, plan(stream.str()).find("TEMP B-TREE"));
+    stream.str(std::string{});
+    stream << "SELECT hash FROM " << table_name_ << " WHERE time_value < 2 AND keep < "
+           << PRESERVE_RECORD << " ORDER BY time_value ASC;";
+    EXPECT_EQ(std::string::npos, plan(stream.str()).find("TEMP B-TREE"));
+    stream.str(std::string{});
+    stream << "SELECT hash FROM " << table_name_ << " WHERE keep < " << PRESERVE_RECORD
+           << " ORDER BY keep * 60 + time_value ASC;";
+    EXPECT_NE(std::string::npos, plan(stream.str()).find(table_name_ + "_decay_60"));
+    EXPECT_EQ(std::string::npos, plan(stream.str()).find("TEMP B-TREE"));
+}
+
+TEST_F(DatabaseFixture, DeleteExpiredTest) {
+    prism::indexed::Database database{db_string_};
+    database.Insert(10, 1, "hash_a", 1, ATTEMPT_KEEP);
+    database.Insert(11, 2, "hash_b", 1, PRESERVE_RECORD);
+    database.Insert(12, 1, "hash_c", 1, DELETE_IF_FULL);
+    database.Insert(13, 2, "hash_d", 1, DELETE_IF_FULL);
+    database.Insert(20, 1, "hash_e", 1, DELETE_IF_FULL);
+    EXPECT_EQ((std::vector<std::string>{"hash_a", "hash_b"}), database.DeleteExpired(15, 2));
+    EXPECT_EQ((std::vector<std::string>{"hash_d"}), database.DeleteExpired(2, 15, 2));
+    EXPECT_EQ((std::vector<std::string>{"hash_c"}),
+              database.DeleteExpiredKeep(DELETE_IF_FULL, 15, 2));
+    EXPECT_TRUE(database.DeleteExpired(15, 2).empty());
+    EXPECT_EQ(4, database.GetIntents().size());
+    auto records = database.SelectAll();
+    ASSERT_EQ(1, records.size());
+    EXPECT_EQ("hash_e", records[0]["hash"]);
+    EXPECT_EQ(1, database.GetTotalSize());
+}
+
+TEST_F(DatabaseFixture, GroupCommitInsertTest) {
+    prism::indexed::Database database{
+            db_string_, prism::indexed::CommitWindow{std::chrono::milliseconds{5}, 0}};
+    std::vector<std::thread> writers;
+    for (unsigned int device = 0; device < 4; ++device) {
+        writers.emplace_back([&database, device]() {
+            for (unsigned long long time_value = 0; time_value < 10; ++time_value) {
+                database.Insert(time_value, device,
+                                "hash_" + std::to_string(device) + "_" +
+                                        std::to_string(time_value),
+                                1, ATTEMPT_KEEP);
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    EXPECT_EQ(40, database.SelectAll().size());
+    EXPECT_EQ(40, database.GetTotalSize());
+    EXPECT_EQ("hash_2_7", database.FindHash(7, 2));
+}
+
+TEST_F(DatabaseFixture, GroupCommitAsyncFlushTest) {
+    prism::indexed::Database database{
+            db_string_, prism::indexed::CommitWindow{std::chrono::minutes{1}, 0}};
+    std::atomic<int> applied{0};
+    auto callback = [&applied](const bool& done, const std::exception_ptr& error) {
+        if (done && !error) {
+            ++applied;
+        }
+    };
+    database.InsertAsync(1, 1, "hash_a", 1, ATTEMPT_KEEP, callback);
+    database.InsertAsync(2, 1, "hash_b", 1, ATTEMPT_KEEP, callback);
+    database.SetKeepAsync(1, 1, PRESERVE_RECORD, callback);
+    EXPECT_TRUE(database.SelectAll().empty());
+    database.Flush();
+    EXPECT_EQ(3, applied);
+    auto records = database.SelectAll();
+    ASSERT_EQ(2, records.size());
+    EXPECT_EQ(std::to_string(PRESERVE_RECORD), records[0]["keep"]);
+}
+
+TEST_F(DatabaseFixture, GroupCommitOperationsTest) {
+    prism::indexed::Database database{
+            db_string_, prism::indexed::CommitWindow{std::chrono::minutes{1}, 2}};
+    std::promise<void> committed;
+    database.InsertAsync(1, 1, "hash_a", 1, ATTEMPT_KEEP,
+                         [](const bool&, const std::exception_ptr&) {});
+    database.InsertAsync(2, 1, "hash_b", 1, ATTEMPT_KEEP,
+                         [&committed](const bool&, const std::exception_ptr&) {
+                             committed.set_value();
+                         });
+    EXPECT_EQ(std::future_status::ready,
+              committed.get_future().wait_for(std::chrono::seconds{10}));
+    EXPECT_EQ(2, database.SelectAll().size());
+}
+
+TEST_F(DatabaseFixture, GroupCommitFailureTest) {
+    {
+        prism::indexed::Database database{db_string_};
+        database.Insert(1, 1, "hash_a", 1, ATTEMPT_KEEP);
+    }
+    prism::indexed::Database database{
+            db_string_, prism::indexed::CommitWindow{std::chrono::minutes{1}, 0}};
+    std::vector<char> applied(3, false);
+    std::vector<std::exception_ptr> errors(3);
+    for (unsigned long long i = 0; i < 3; ++i) {
+        database.InsertAsync(i, 2 - (i == 1), "hash_" + std::to_string(i), 1, ATTEMPT_KEEP,
+                             [&applied, &errors, i](const bool& done,
+                                                    const std::exception_ptr& error) {
+                                 applied[i] = done;
+                                 errors[i] = error;
+                             });
+    }
+    database.Flush();
+    EXPECT_TRUE(applied[0] && !errors[0]);
+    EXPECT_FALSE(applied[1]);
+    EXPECT_THROW(std::rethrow_exception(errors[1]), prism::indexed::DatabaseException);
+    EXPECT_TRUE(applied[2] && !errors[2]);
+    EXPECT_EQ(3, database.SelectAll().size());
+    EXPECT_EQ("hash_a", database.FindHash(1, 1));
+}
+
+TEST_F(DatabaseFixture, GroupCommitSyncTest) {
+    prism::indexed::Database database{
+            db_string_, prism::indexed::CommitWindow{std::chrono::milliseconds{1}, 0}};
+    database.Insert(1, 1, "hash_a", 1, ATTEMPT_KEEP);
+    EXPECT_THROW(database.Insert(1, 1, "hash_b", 1, ATTEMPT_KEEP),
+                 prism::indexed::DatabaseException);
+    EXPECT_TRUE(database.SetKeep(1, 1, PRESERVE_RECORD));
+    EXPECT_FALSE(database.SetKeep(2, 1, PRESERVE_RECORD));
+    EXPECT_TRUE(database.GetLowestDeletableHashes().empty());
+}
+
+TEST_F(DatabaseFixture, GroupCommitPendingTest) {
+    prism::indexed::Database database{
+            db_string_, prism::indexed::CommitWindow{std::chrono::minutes{1}, 2}};
+    // The insert waits for a second write to fill the window, and both commit together
+    auto pending = std::async(std::launch::async, [&database]() {
+        database.InsertPending(1, 1, "hash_a", 1, ATTEMPT_KEEP);
+    });
+    EXPECT_EQ(std::future_status::timeout, pending.wait_for(std::chrono::milliseconds{50}));
+    database.MarkDeleting({"hash_b"});
+    EXPECT_EQ(std::future_status::ready, pending.wait_for(std::chrono::seconds{10}));
+    EXPECT_EQ("hash_a", database.FindHash(1, 1));
+    EXPECT_EQ(2, database.GetIntents().size());
+
+    // A write that fails is reported to its caller alone
+    auto duplicate = std::async(std::launch::async, [&database]() {
+        database.InsertPending(1, 1, "hash_c", 1, ATTEMPT_KEEP);
+    });
+    database.BulkDelete({"hash_b"});
+    EXPECT_THROW(duplicate.get(), prism::indexed::DatabaseException);
+    auto intents = database.GetIntents();
+    ASSERT_EQ(1, intents.size());
+    EXPECT_EQ("hash_a", intents[0]["hash"]);
+}
+
+TEST_F(DatabaseFixture, GroupCommitDeleteRangeTest) {
+    prism::indexed::Database database{
+            db_string_, prism::indexed::CommitWindow{std::chrono::minutes{1}, 2}};
+    database.InsertAsync(1, 1, "hash_a", 1, ATTEMPT_KEEP,
+                         [](const bool&, const std::exception_ptr&) {});
+    database.InsertAsync(2, 1, "hash_b", 1, ATTEMPT_KEEP,
+                         [](const bool&, const std::exception_ptr&) {});
+    database.Flush();
+    // The delete waits for a second write to fill the window, and returns what it deleted once
+    // both commit together
+    auto deleted = std::async(std::launch::async, [&database]() {
+        return database.DeleteRange(1, 2);
+    });
+    EXPECT_EQ(std::future_status::timeout, deleted.wait_for(std::chrono::milliseconds{50}));
+    database.MarkDeleting({"hash_c"});
+    ASSERT_EQ(std::future_status::ready, deleted.wait_for(std::chrono::seconds{10}));
+    EXPECT_EQ((std::vector<std::string>{"hash_a", "hash_b"}), deleted.get());
+    EXPECT_TRUE(database.SelectAll().empty());
+    EXPECT_EQ(3, database.GetIntents().size());
+}
+
+TEST_F(DatabaseFixture, GroupCommitDestructFlushesTest) {
+    {
+        prism::indexed::Database database{
+                db_string_, prism::indexed::CommitWindow{std::chrono::minutes{1}, 0}};
+        database.InsertAsync(1, 1, "hash_a", 1, ATTEMPT_KEEP,
+                             [](const bool&, const std::exception_ptr&) {});
+    }
+    prism::indexed::Database database{db_string_};
+    EXPECT_EQ("hash_a", database.FindHash(1, 1));
+}
+
+TEST_F(DatabaseFixture, AsyncWithoutWindowTest) {
+    prism::indexed::Database database{db_string_};
+    bool applied = false;
+    database.InsertAsync(1, 1, "hash_a", 1, ATTEMPT_KEEP,
+                         [&applied](const bool& done, const std::exception_ptr&) {
+                             applied = done;
+                         });
+    EXPECT_TRUE(applied);
+    database.SetKeepAsync(2, 1, PRESERVE_RECORD,
+                          [&applied](const bool& done, const std::exception_ptr&) {
+                              applied = done;
+                          });
+    EXPECT_FALSE(applied);
+    database.InsertAsync(1, 1, "", 1, ATTEMPT_KEEP,
+                         [&applied](const bool& done, const std::exception_ptr& error) {
+                             applied = !done && !error;
+                         });
+    EXPECT_TRUE(applied);
+}
+
+TEST_F(DatabaseFixture, NextUnsyncedTest) {
+    prism::indexed::Database database{db_string_};
+    EXPECT_TRUE(database.NextUnsynced(10, {}).empty());
+    database.Insert(12, 1, "hash_a", 100, ATTEMPT_KEEP);
+    database.Insert(10, 2, "hash_b", 200, ATTEMPT_KEEP);
+    database.InsertPending(10, 1, "hash_c", 300, ATTEMPT_KEEP);
+    database.InsertSegmented(11, 3, "hash_d", 400, ATTEMPT_KEEP, 1, 0);
+    auto records = database.NextUnsynced(3, {});
+    ASSERT_EQ(3, records.size());
+    EXPECT_EQ("hash_c", records[0]["hash"]);
+    EXPECT_EQ("1", records[0]["device"]);
+    EXPECT_EQ("10", records[0]["time_value"]);
+    EXPECT_EQ("300", records[0]["size"]);
+    EXPECT_EQ("hash_b", records[1]["hash"]);
+    EXPECT_EQ("hash_d", records[2]["hash"]);
+    EXPECT_TRUE(database.NextUnsynced(0, {}).empty());
+}
+
+TEST_F(DatabaseFixture, NextUnsyncedDevicesTest) {
+    prism::indexed::Database database{db_string_};
+    for (unsigned long long i = 0; i < 5; ++i) {
+        database.Insert(i, 1, "hash_1_" + std::to_string(i), 5, ATTEMPT_KEEP);
+        database.Insert(i, 2, "hash_2_" + std::to_string(i), 5, ATTEMPT_KEEP);
+        database.Insert(i, 3, "hash_3_" + std::to_string(i), 5, ATTEMPT_KEEP);
+    }
+    auto records = database.NextUnsynced(3, {3, 1, 3});
+    ASSERT_EQ(3, records.size());
+    EXPECT_EQ("hash_1_0", records[0]["hash"]);
+    EXPECT_EQ("hash_3_0", records[1]["hash"]);
+    EXPECT_EQ("hash_1_1", records[2]["hash"]);
+    EXPECT_TRUE(database.NextUnsynced(3, {4}).empty());
+}
+
+TEST_F(DatabaseFixture, MarkSyncedTest) {
+    {
+        prism::indexed::Database database{db_string_};
+        EXPECT_TRUE(database.MarkSynced({}, 1));
+        EXPECT_FALSE(database.MarkSynced({10}, 1));
+        database.Insert(10, 1, "hash_a", 100, ATTEMPT_KEEP);
+        database.Insert(11, 1, "hash_b", 100, ATTEMPT_KEEP);
+        database.Insert(12, 1, "hash_c", 100, ATTEMPT_KEEP);
+        database.Insert(10, 2, "hash_d", 100, ATTEMPT_KEEP);
+        EXPECT_TRUE(database.MarkSynced({10, 12, 13}, 1));
+        EXPECT_TRUE(database.MarkSynced({10}, 1));
+    }
+    prism::indexed::Database database{db_string_};
+    auto records = database.NextUnsynced(10, {});
+    ASSERT_EQ(2, records.size());
+    EXPECT_EQ("hash_d", records[0]["hash"]);
+    EXPECT_EQ("hash_b", records[1]["hash"]);
+
+    // A row stored again after its clip was deleted has not been synced
+    database.Delete("hash_b");
+    database.Delete("hash_a");
+    database.Insert(10, 1, "hash_e", 100, ATTEMPT_KEEP);
+    records = database.NextUnsynced(10, {1});
+    ASSERT_EQ(1, records.size());
+    EXPECT_EQ("hash_e", records[0]["hash"]);
+}
+
+TEST_F(DatabaseFixture, NextUnsyncedExistingTableTest) {
+    {
+        prism::indexed::Database database{db_string_};
+        database.Insert(1, 1, "hash_a", 5, ATTEMPT_KEEP);
+        database.Insert(2, 1, "hash_b", 3, ATTEMPT_KEEP);
+    }
+    execute("DROP TRIGGER prism_indexed_data_unsynced_insert;"
+            "DROP TRIGGER prism_indexed_data_unsynced_delete;"
+            "DROP TABLE prism_indexed_unsynced;");
+    {
+        prism::indexed::Database database{db_string_};
+        EXPECT_EQ(2, database.NextUnsynced(10, {}).size());
+        database.MarkSynced({1}, 1);
+    }
+    prism::indexed::Database database{db_string_};
+    auto records = database.NextUnsynced(10, {});
+    ASSERT_EQ(1, records.size());
+    EXPECT_EQ("hash_b", records[0]["hash"]);
+}
+
+TEST_F(DatabaseFixture, NextUnsyncedQueryPlanTest) {
+    prism::indexed::Database database{db_string_};
+    database.Insert(1, 1, "hash_a", 5, ATTEMPT_KEEP);
+    // Rows come out of the unsynced table in key order, with no sort over all of them
+    auto plan = execute(
+            "EXPLAIN QUERY PLAN SELECT data.hash FROM prism_indexed_unsynced AS unsynced JOIN "
+            "prism_indexed_data AS data ON data.time_value=unsynced.time_value AND "
+            "data.device=unsynced.device ORDER BY unsynced.time_value ASC, unsynced.device ASC "
+            "LIMIT 10;");
+    ASSERT_FALSE(plan.empty());
+    for (auto& step : plan) {
+        EXPECT_EQ(std::string::npos, step["detail"].find("TEMP B-TREE")) << step["detail"];
+    }
+}
@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+#include "indexed/event-ring.h"
+
+
+using prism::indexed::Event;
+using prism::indexed::EventRing;
+using prism::indexed::EventType;
+
+namespace {
+
+Event makeEvent(const uintmax_t& size) {
+    return Event{EventType::Pushed, 1, std::chrono::system_clock::time_point{}, size};
+}
+
+} // namespace
+
+TEST(EventRingTest, EmptyTest) {
+    EventRing ring{4};
+    Event event;
+    EXPECT_TRUE(ring.Empty());
+    EXPECT_FALSE(ring.Pop(event));
+    EXPECT_EQ(0, ring.TakeDropped());
+}
+
+TEST(EventRingTest, FirstInFirstOutTest) {
+    EventRing ring{4};
+    EXPECT_TRUE(ring.Push(makeEvent(1)));
+    EXPECT_TRUE(ring.Push(makeEvent(2)));
+    EXPECT_FALSE(ring.Empty());
+    Event event;
+    ASSERT_TRUE(ring.Pop(event));
+    EXPECT_EQ(1, event.size);
+    ASSERT_TRUE(ring.Pop(event));
+    EXPECT_EQ(2, event.size);
+    EXPECT_TRUE(ring.Empty());
+}
+
+TEST(EventRingTest, FullDropsTest) {
+    // Rounded up to four slots
+    EventRing ring{3};
+    for (auto i = 0; i < 4; ++i) {
+        EXPECT_TRUE(ring.Push(makeEvent(i)));
+    }
+    EXPECT_FALSE(ring.Push(makeEvent(4)));
+    EXPECT_FALSE(ring.Push(makeEvent(5)));
+    ring.Drop(3);
+    EXPECT_EQ(5, ring.TakeDropped());
+    EXPECT_EQ(0, ring.TakeDropped());
+
+    Event event;
+    ASSERT_TRUE(ring.Pop(event));
+    EXPECT_EQ(0, event.size);
+    EXPECT_TRUE(ring.Push(makeEvent(6)));
+}
+
+TEST(EventRingTest, WrapAroundTest) {
+    EventRing ring{2};
+    Event event;
+    for (auto i = 0; i < 10; ++i) {
+        EXPECT_TRUE(ring.Push(makeEvent(i)));
+        ASSERT_TRUE(ring.Pop(event));
+        EXPECT_EQ(i, event.size);
+    }
+    EXPECT_TRUE(ring.Empty());
+}
+
+TEST(EventRingTest, ProducerConsumerTest) {
+    static const uintmax_t count = 100000;
+    EventRing ring{64};
+    std::thread producer{[&ring]() {
+        for (uintmax_t i = 0; i < count; ++i) {
+            while (!ring.Push(makeEvent(i))) {
+                std::this_thread::yield();
+            }
+        }
+    }};
+
+    uintmax_t received = 0;
+    uintmax_t out_of_order = 0;
+    Event event;
+    while (received < count) {
+        if (ring.Pop(event)) {
+            out_of_order += event.size != received;
+            ++received;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    EXPECT_EQ(0, out_of_order);
+    EXPECT_TRUE(ring.Empty());
+}
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "filesystem-fixture.h"
+#include "indexed/chrono-snap.h"
+#include "indexed/database.h"
+#include "indexed/eviction-policy.h"
+#include "indexed/memory-index.h"
+
+
+namespace fs = ::boost::filesystem;
+
+// Each policy against each index, since every index keeps its own copy of the orders
+struct IndexKind {
+    std::string name;
+    std::function<std::unique_ptr<prism::indexed::Index>(const fs::path&)> make;
+};
+
+void PrintTo(const IndexKind& kind, std::ostream* stream) {
+    *stream << kind.name;
+}
+
+std::vector<IndexKind> indexKinds() {
+    return std::vector<IndexKind>{
+            IndexKind{"Database",
+                      [](const fs::path& buffer_path) {
+                          return std::unique_ptr<prism::indexed::Index>{new prism::indexed::Database{
+                                  (buffer_path / "prism_indexed_data.db").string()}};
+                      }},
+            IndexKind{"MemoryIndex", [](const fs::path& buffer_path) {
+                          return std::unique_ptr<prism::indexed::Index>{
+                                  new prism::indexed::MemoryIndex{
+                                          (buffer_path / "prism_indexed_data.snapshot").string()}};
+                      }}};
+}
+
+class EvictionPolicyFixture : public FilesystemFixture,
+                              public ::testing::WithParamInterface<IndexKind> {
+  protected:
+    virtual void SetUp() {
+        FilesystemFixture::SetUp();
+        fs::create_directory(buffer_path_);
+        index_ = GetParam().make(buffer_path_);
+        now_ = prism::indexed::utility::SnapToMinute(std::chrono::system_clock::now());
+    }
+
+    virtual void TearDown() {
+        index_.reset();
+        FilesystemFixture::TearDown();
+    }
+
+    std::unique_ptr<prism::indexed::Index> index_;
+    unsigned long long now_;
+};
+
+TEST_P(EvictionPolicyFixture, OldestFirstTest) {
+    index_->Insert(now_ - 3, 1, "hash_a", 5, ATTEMPT_KEEP);
+    index_->Insert(now_ - 2, 2, "hash_b", 5, DELETE_IF_FULL);
+    index_->Insert(now_ - 4, 1, "hash_c", 5, PRESERVE_RECORD);
+    index_->Insert(now_ - 1, 1, "hash_d", 5, ATTEMPT_KEEP);
+    prism::indexed::OldestFirstPolicy policy;
+    EXPECT_EQ((std::vector<std::string>{"hash_b", "hash_a", "hash_d"}), policy.Victims(*index_));
+}
+
+TEST_P(EvictionPolicyFixture, LargestFirstTest) {
+    index_->Insert(now_ - 4, 1, "small", 5, ATTEMPT_KEEP);
+    index_->Insert(now_ - 3, 1, "large", 20, ATTEMPT_KEEP);
+    index_->Insert(now_ - 2, 2, "medium", 10, ATTEMPT_KEEP);
+    index_->Insert(now_ - 1, 1, "low", 1, DELETE_IF_FULL);
+    index_->Insert(now_, 1, "preserved", 100, PRESERVE_RECORD);
+    prism::indexed::LargestFirstPolicy policy;
+    EXPECT_EQ((std::vector<std::string>{"low", "large", "medium", "small"}),
+              policy.Victims(*index_));
+    EXPECT_TRUE(index_->SetKeep(now_ - 2, 2, DELETE_IF_FULL));
+    index_->Delete("large");
+    EXPECT_EQ((std::vector<std::string>{"medium", "low", "small"}), policy.Victims(*index_));
+}
+
+TEST_P(EvictionPolicyFixture, TimeToLiveTest) {
+    index_->Insert(now_ - 120, 1, "expired", 5, ATTEMPT_KEEP);
+    index_->Insert(now_ - 200, 1, "preserved", 5, PRESERVE_RECORD);
+    index_->Insert(now_ - 2, 1, "fresh_attempt", 5, ATTEMPT_KEEP);
+    index_->Insert(now_ - 1, 2, "fresh_delete", 5, DELETE_IF_FULL);
+    prism::indexed::TimeToLivePolicy policy{std::chrono::minutes(60)};
+    EXPECT_EQ((std::vector<std::string>{"expired", "fresh_delete", "fresh_attempt"}),
+              policy.Victims(*index_));
+}
+
+TEST_P(EvictionPolicyFixture, TimeToLiveNothingExpiredTest) {
+    index_->Insert(now_ - 2, 1, "hash_a", 5, ATTEMPT_KEEP);
+    index_->Insert(now_ - 1, 1, "hash_b", 5, DELETE_IF_FULL);
+    prism::indexed::TimeToLivePolicy policy{std::chrono::minutes(60)};
+    EXPECT_EQ((std::vector<std::string>{"hash_b", "hash_a"}), policy.Victims(*index_));
+}
+
+TEST_P(EvictionPolicyFixture, DecayedPriorityTest) {
+    // With an hour of decay, ATTEMPT_KEEP is worth ten hours of age over DELETE_IF_FULL
+    index_->Insert(now_, 1, "fresh_delete", 5, DELETE_IF_FULL);
+    index_->Insert(now_ - 700, 1, "old_attempt", 5, ATTEMPT_KEEP);
+    index_->Insert(now_ - 500, 2, "recent_attempt", 5, ATTEMPT_KEEP);
+    index_->Insert(now_ - 900, 2, "preserved", 5, PRESERVE_RECORD);
+    prism::indexed::DecayedPriorityPolicy policy{std::chrono::minutes(60)};
+    EXPECT_EQ((std::vector<std::string>{"old_attempt", "fresh_delete", "recent_attempt"}),
+              policy.Victims(*index_));
+    EXPECT_TRUE(index_->SetKeep(now_ - 500, 2, DELETE_IF_FULL));
+    index_->Insert(now_ - 800, 1, "older_attempt", 5, ATTEMPT_KEEP);
+    EXPECT_EQ((std::vector<std::string>{"recent_attempt", "older_attempt", "old_attempt",
+                                        "fresh_delete"}),
+              policy.Victims(*index_));
+}
+
+TEST_P(EvictionPolicyFixture, DecayedPriorityChangedDecayTest) {
+    index_->Insert(now_, 1, "fresh_delete", 5, DELETE_IF_FULL);
+    index_->Insert(now_ - 700, 1, "old_attempt", 5, ATTEMPT_KEEP);
+    prism::indexed::DecayedPriorityPolicy hourly{std::chrono::minutes(60)};
+    prism::indexed::DecayedPriorityPolicy daily{std::chrono::minutes(24 * 60)};
+    prism::indexed::DecayedPriorityPolicy none{std::chrono::minutes(0)};
+    EXPECT_EQ("old_attempt", hourly.Victims(*index_).front());
+    EXPECT_EQ("fresh_delete", daily.Victims(*index_).front());
+    EXPECT_EQ("old_attempt", none.Victims(*index_).front());
+}
+
+INSTANTIATE_TEST_CASE_P(Indexes, EvictionPolicyFixture, ::testing::ValuesIn(indexKinds()),
+                        [](const ::testing::TestParamInfo<IndexKind>& info) {
+                            return info.param.name;
+                        });
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <fstream>
 #include <sstream>
 #include <string>
@@ -291,3 +292,190 @@ TEST_F(FilesystemFixture, MoveNonexistentFileTest) {
     EXPECT_FALSE(fs::exists(filepath_move_from));
     EXPECT_FALSE(fs::exists(filepath_move_to));
 }
+
+TEST_F(FilesystemFixture, ScanEmptyTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    auto listing = filesystem.Scan(std::chrono::steady_clock::now() + std::chrono::seconds(10), 4);
+    EXPECT_TRUE(listing.complete);
+    EXPECT_TRUE(listing.files.empty());
+}
+
+TEST_F(FilesystemFixture, ScanNestedTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    fs::create_directories(buffer_path_ / "nested" / "deeper");
+    fs::create_directories(buffer_path_ / "other");
+    for (const auto& name : {"file", "nested/file", "nested/deeper/file", "other/file"}) {
+        std::ofstream out_stream{(buffer_path_ / name).native()};
+        out_stream << "hello world";
+    }
+    auto listing = filesystem.Scan(std::chrono::steady_clock::now() + std::chrono::seconds(10), 4);
+    EXPECT_TRUE(listing.complete);
+    std::sort(listing.files.begin(), listing.files.end());
+    ASSERT_EQ(4, listing.files.size());
+    EXPECT_EQ(std::string{"file"}, listing.files[0].first);
+    EXPECT_EQ(std::string{"nested/deeper/file"}, listing.files[1].first);
+    EXPECT_EQ(std::string{"nested/file"}, listing.files[2].first);
+    EXPECT_EQ(std::string{"other/file"}, listing.files[3].first);
+    for (const auto& file : listing.files) {
+        EXPECT_EQ(11, file.second);
+    }
+}
+
+TEST_F(FilesystemFixture, ScanDeadlineTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    fs::create_directories(buffer_path_ / "nested");
+    for (int i = 0; i < 1000; ++i) {
+        std::ofstream out_stream{(buffer_path_ / "nested" / std::to_string(i)).native()};
+        out_stream << "hello world";
+    }
+    auto listing = filesystem.Scan(std::chrono::steady_clock::now() - std::chrono::seconds(1), 4);
+    EXPECT_FALSE(listing.complete);
+    EXPECT_GT(1000, listing.files.size());
+}
+
+TEST_F(FilesystemFixture, NoScanSizeTest) {
+    fs::create_directory(buffer_path_);
+    {
+        std::ofstream out_stream{(buffer_path_ / "file").native()};
+        out_stream << "hello world";
+    }
+    prism::indexed::Filesystem scanned{"prism_indexed_buffer"};
+    EXPECT_EQ(11, scanned.GetSize());
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer", std::string{}, 2.0, false};
+    EXPECT_EQ(0, filesystem.GetSize());
+    filesystem.SetSize(11);
+    EXPECT_EQ(11, filesystem.GetSize());
+    filesystem.AddSize(4);
+    EXPECT_EQ(15, filesystem.GetSize());
+}
+
+TEST_F(FilesystemFixture, NoScanAboveQuotaTest) {
+    fs::create_directory(buffer_path_);
+    {
+        std::ofstream out_stream{(buffer_path_ / "file").native()};
+        out_stream << "hello world";
+    }
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer", std::string{},
+                                          10 / (1024 * 1024 * 1024.), false};
+    EXPECT_FALSE(filesystem.AboveQuota());
+    filesystem.SetSize(11);
+    EXPECT_TRUE(filesystem.AboveQuota());
+}
+
+TEST_F(FilesystemFixture, AboveQuotaReleasingTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer", std::string{},
+                                          10 / (1024 * 1024 * 1024.), false};
+    filesystem.SetSize(11);
+    EXPECT_TRUE(filesystem.AboveQuota(0));
+    EXPECT_FALSE(filesystem.AboveQuota(1));
+    EXPECT_FALSE(filesystem.AboveQuota(20));
+    EXPECT_TRUE(filesystem.AboveQuota());
+}
+
+TEST_F(FilesystemFixture, GetFileSizeTest) {
+    fs::create_directories(buffer_path_ / "nested");
+    {
+        std::ofstream out_stream{(buffer_path_ / "nested/file").native()};
+        out_stream << "hello world";
+    }
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    EXPECT_EQ(11, filesystem.GetFileSize("nested/file"));
+    EXPECT_EQ(0, filesystem.GetFileSize("nested"));
+    EXPECT_EQ(0, filesystem.GetFileSize("missing"));
+}
+
+TEST_F(FilesystemFixture, DeleteKeepsNonEmptyParentTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    fs::create_directories(buffer_path_ / "nested" / "deeper");
+    for (const auto& name : {"nested/file", "nested/deeper/file"}) {
+        std::ofstream out_stream{(buffer_path_ / name).native()};
+        out_stream << "hello world";
+    }
+    EXPECT_TRUE(filesystem.Delete("nested/deeper/file"));
+    EXPECT_FALSE(fs::exists(buffer_path_ / "nested/deeper"));
+    EXPECT_TRUE(fs::exists(buffer_path_ / "nested/file"));
+}
+
+TEST_F(FilesystemFixture, DeleteParentsWithinBufferTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    const auto sibling = buffer_path_.parent_path() / "prism_indexed_buffer_sibling";
+    fs::create_directories(sibling);
+    fs::create_directories(buffer_path_ / "nested");
+    for (const auto& path : {sibling / "file", buffer_path_ / "nested" / "file"}) {
+        std::ofstream out_stream{path.native()};
+        out_stream << "hello world";
+    }
+    EXPECT_TRUE(filesystem.Delete("../prism_indexed_buffer_sibling/file"));
+    EXPECT_TRUE(fs::exists(sibling));
+    EXPECT_TRUE(filesystem.Delete("../prism_indexed_buffer/nested/file"));
+    EXPECT_FALSE(fs::exists(buffer_path_ / "nested"));
+    EXPECT_TRUE(fs::exists(buffer_path_));
+    fs::remove_all(sibling);
+}
+
+TEST_F(FilesystemFixture, BulkDeleteTest) {
+    fs::create_directories(buffer_path_ / "nested" / "deeper");
+    for (const auto& name : {"file", "nested/deeper/file"}) {
+        std::ofstream out_stream{(buffer_path_ / name).native()};
+        out_stream << "hello world";
+    }
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    EXPECT_EQ(22, filesystem.GetSize());
+    EXPECT_EQ(2, filesystem.BulkDelete({"file", "nested/deeper/file", "nested", "missing"}));
+    EXPECT_EQ(0, filesystem.GetSize());
+    EXPECT_FALSE(fs::exists(buffer_path_ / "nested"));
+    EXPECT_TRUE(fs::exists(buffer_path_));
+    EXPECT_EQ(0, filesystem.BulkDelete({}));
+}
+
+TEST_F(FilesystemFixture, LinkChargesOnceTest) {
+    fs::create_directory(buffer_path_);
+    {
+        std::ofstream out_stream{(buffer_path_ / "file").native()};
+        out_stream << "hello world";
+    }
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    EXPECT_EQ(11, filesystem.GetSize());
+    EXPECT_TRUE(filesystem.Link("file", "nested/link"));
+    EXPECT_TRUE(filesystem.Link("file", "link"));
+    EXPECT_FALSE(filesystem.Link("missing", "other"));
+    EXPECT_EQ(11, filesystem.GetSize());
+
+    std::atomic<bool> cancel{false};
+    EXPECT_TRUE(filesystem.VerifySize(cancel));
+    EXPECT_EQ(11, filesystem.GetSize());
+
+    EXPECT_TRUE(filesystem.Delete("file"));
+    EXPECT_EQ(1, filesystem.BulkDelete({"nested/link"}));
+    EXPECT_EQ(11, filesystem.GetSize());
+    EXPECT_TRUE(filesystem.Delete("link"));
+    EXPECT_EQ(0, filesystem.GetSize());
+}
+
+TEST_F(FilesystemFixture, DeleteUncountedFileTest) {
+    fs::create_directory(buffer_path_);
+    {
+        std::ofstream out_stream{(buffer_path_ / "file").native()};
+        out_stream << "hello world";
+    }
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer", std::string{}, 2.0, false};
+    filesystem.SetSize(5);
+    EXPECT_TRUE(filesystem.Delete("file"));
+    EXPECT_EQ(0, filesystem.GetSize());
+}
+
+TEST_F(FilesystemFixture, VerifySizeTest) {
+    fs::create_directories(buffer_path_ / "nested");
+    for (const auto& name : {"file", "nested/file"}) {
+        std::ofstream out_stream{(buffer_path_ / name).native()};
+        out_stream << "hello world";
+    }
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer", std::string{}, 2.0, false};
+    std::atomic<bool> cancel{false};
+    EXPECT_TRUE(filesystem.VerifySize(cancel));
+    EXPECT_EQ(22, filesystem.GetSize());
+    cancel = true;
+    filesystem.SetSize(5);
+    EXPECT_FALSE(filesystem.VerifySize(cancel));
+    EXPECT_EQ(5, filesystem.GetSize());
+}
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+
+#include <cerrno>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "filesystem-fixture.h"
+#include "indexed/io-engine.h"
+#include "indexed/storage.h"
+
+
+namespace fs = ::boost::filesystem;
+
+using prism::indexed::IoEngine;
+using prism::indexed::IoOperation;
+using prism::indexed::IoRequest;
+
+class IoEngineFixture : public FilesystemFixture {
+  protected:
+    virtual void SetUp() {
+        FilesystemFixture::SetUp();
+        fs::create_directories(buffer_path_ / "nested");
+    }
+
+    std::string writeFile(const std::string& name, const std::string& contents) {
+        const auto filepath = (buffer_path_ / name).string();
+        std::ofstream out_stream{filepath};
+        out_stream << contents;
+        return filepath;
+    }
+
+    // Runs the check against every engine this build can make
+    void forEachEngine(const std::function<void(IoEngine&)>& check) {
+        prism::indexed::ThreadPoolIoEngine thread_pool{4};
+        check(thread_pool);
+#ifdef PRISM_INDEXED_IO_URING
+        std::unique_ptr<IoEngine> uring;
+        try {
+            uring.reset(new prism::indexed::UringIoEngine{8});
+        } catch (const prism::indexed::FilesystemException& e) {
+            return;
+        }
+        SetUp();
+        check(*uring);
+#endif
+    }
+};
+
+TEST_F(IoEngineFixture, EmptyBatchTest) {
+    forEachEngine([](IoEngine& engine) { EXPECT_TRUE(engine.Submit({}).empty()); });
+}
+
+TEST_F(IoEngineFixture, StatTest) {
+    forEachEngine([this](IoEngine& engine) {
+        const auto filepath = writeFile("file", "hello world");
+        auto results = engine.Submit({IoRequest{IoOperation::Stat, filepath, ""},
+                                      IoRequest{IoOperation::Stat, (buffer_path_ / "nested").string(), ""},
+                                      IoRequest{IoOperation::Stat, (buffer_path_ / "missing").string(), ""}});
+        ASSERT_EQ(3, results.size());
+        EXPECT_EQ(0, results[0].error);
+        EXPECT_EQ(11, results[0].size);
+        EXPECT_FALSE(results[0].directory);
+        EXPECT_EQ(0, results[1].error);
+        EXPECT_TRUE(results[1].directory);
+        EXPECT_EQ(ENOENT, results[2].error);
+    });
+}
+
+TEST_F(IoEngineFixture, UnlinkTest) {
+    forEachEngine([this](IoEngine& engine) {
+        const auto filepath = writeFile("file", "hello world");
+        auto results = engine.Submit({IoRequest{IoOperation::Unlink, filepath, ""},
+                                      IoRequest{IoOperation::Unlink, (buffer_path_ / "missing").string(), ""}});
+        ASSERT_EQ(2, results.size());
+        EXPECT_EQ(0, results[0].error);
+        EXPECT_EQ(ENOENT, results[1].error);
+        EXPECT_FALSE(fs::exists(filepath));
+    });
+}
+
+TEST_F(IoEngineFixture, RenameTest) {
+    forEachEngine([this](IoEngine& engine) {
+        const auto filepath = writeFile("file", "hello world");
+        const auto target = (buffer_path_ / "nested" / "file").string();
+        auto results = engine.Submit({IoRequest{IoOperation::Rename, filepath, target}});
+        ASSERT_EQ(1, results.size());
+        EXPECT_EQ(0, results[0].error);
+        EXPECT_FALSE(fs::exists(filepath));
+        EXPECT_EQ(11, fs::file_size(target));
+    });
+}
+
+TEST_F(IoEngineFixture, BatchLargerThanQueueTest) {
+    forEachEngine([this](IoEngine& engine) {
+        std::vector<IoRequest> requests;
+        for (int i = 0; i < 100; ++i) {
+            requests.push_back(IoRequest{IoOperation::Unlink,
+                                         writeFile(std::to_string(i), std::string(i, 'x')), ""});
+        }
+        auto results = engine.Submit(requests);
+        ASSERT_EQ(100, results.size());
+        for (const auto& result : results) {
+            EXPECT_EQ(0, result.error);
+        }
+        EXPECT_EQ(0, numberOfFiles());
+    });
+}
+
+TEST_F(IoEngineFixture, MakeTest) {
+    auto engine = IoEngine::Make(2);
+    ASSERT_NE(nullptr, engine);
+    const auto filepath = writeFile("file", "hello world");
+    auto results = engine->Submit({IoRequest{IoOperation::Stat, filepath, ""}});
+    ASSERT_EQ(1, results.size());
+    EXPECT_EQ(11, results[0].size);
+}
@@ -0,0 +1,439 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "filesystem-fixture.h"
+#include "indexed/memory-index.h"
+
+
+namespace fs = ::boost::filesystem;
+
+class MemoryIndexFixture : public FilesystemFixture {
+  protected:
+    virtual void SetUp() {
+        FilesystemFixture::SetUp();
+        fs::create_directory(buffer_path_);
+        path_ = (buffer_path_ / "prism_indexed_data.snapshot").string();
+        journal_path_ = path_ + "-journal";
+    }
+
+    void append(const std::string& filepath, const std::string& contents) {
+        std::ofstream out_stream{filepath, std::ios::binary | std::ios::app};
+        out_stream << contents;
+    }
+
+    std::string path_;
+    std::string journal_path_;
+};
+
+TEST_F(MemoryIndexFixture, ConstructCreatesFilesTest) {
+    prism::indexed::MemoryIndex index{path_};
+    EXPECT_TRUE(fs::exists(path_));
+    EXPECT_TRUE(fs::exists(journal_path_));
+    EXPECT_EQ(fs::file_size(path_) + fs::file_size(journal_path_), index.GetMetadataSize());
+    EXPECT_TRUE(index.SelectAll().empty());
+    EXPECT_EQ(0, index.GetTotalSize());
+}
+
+TEST_F(MemoryIndexFixture, InsertFindTest) {
+    prism::indexed::MemoryIndex index{path_};
+    index.Insert(10, 1, "hash_a", 100, ATTEMPT_KEEP);
+    index.Insert(12, 1, "hash_b", 50, ATTEMPT_KEEP);
+    EXPECT_EQ("hash_a", index.FindHash(10, 1));
+    EXPECT_TRUE(index.FindHash(10, 2).empty());
+    EXPECT_TRUE(index.FindHash(11, 1).empty());
+    EXPECT_EQ(150, index.GetTotalSize());
+    auto records = index.SelectAll();
+    ASSERT_EQ(2, records.size());
+    EXPECT_EQ("1", records[0]["id"]);
+    EXPECT_EQ("10", records[0]["time_value"]);
+    EXPECT_EQ("1", records[0]["device"]);
+    EXPECT_EQ("hash_a", records[0]["hash"]);
+    EXPECT_EQ("100", records[0]["size"]);
+    EXPECT_EQ(std::to_string(ATTEMPT_KEEP), records[0]["keep"]);
+    EXPECT_EQ("2", records[1]["id"]);
+}
+
+TEST_F(MemoryIndexFixture, InsertConflictThrowTest) {
+    prism::indexed::MemoryIndex index{path_};
+    index.Insert(10, 1, "hash_a", 100, ATTEMPT_KEEP);
+    EXPECT_THROW(index.Insert(10, 1, "hash_b", 100, ATTEMPT_KEEP),
+                 prism::indexed::DatabaseException);
+    EXPECT_EQ(1, index.SelectAll().size());
+    EXPECT_EQ(100, index.GetTotalSize());
+}
+
+TEST_F(MemoryIndexFixture, InsertInvalidHashIgnoredTest) {
+    prism::indexed::MemoryIndex index{path_};
+    index.Insert(10, 1, "", 100, ATTEMPT_KEEP);
+    index.Insert(11, 1, "bad hash", 100, ATTEMPT_KEEP);
+    EXPECT_TRUE(index.SelectAll().empty());
+}
+
+TEST_F(MemoryIndexFixture, FindNextPreviousTest) {
+    prism::indexed::MemoryIndex index{path_};
+    index.Insert(10, 1, "hash_a", 1, ATTEMPT_KEEP);
+    index.Insert(20, 1, "hash_b", 1, ATTEMPT_KEEP);
+    index.Insert(15, 2, "hash_c", 1, ATTEMPT_KEEP);
+    EXPECT_EQ("hash_b", index.FindNext(11, 1)["hash"]);
+    EXPECT_EQ("20", index.FindNext(11, 1)["time_value"]);
+    EXPECT_EQ("hash_a", index.FindPrevious(19, 1)["hash"]);
+    EXPECT_EQ("hash_a", index.FindNext(10, 1)["hash"]);
+    EXPECT_TRUE(index.FindNext(21, 1).empty());
+    EXPECT_TRUE(index.FindPrevious(9, 1).empty());
+    EXPECT_TRUE(index.FindPrevious(14, 2).empty());
+    EXPECT_TRUE(index.FindNext(10, 3).empty());
+}
+
+TEST_F(MemoryIndexFixture, SelectRangeTest) {
+    prism::indexed::MemoryIndex index{path_};
+    for (unsigned long long i = 0; i < 10; ++i) {
+        index.Insert(i, 1, "hash_" + std::to_string(i), i, ATTEMPT_KEEP);
+        index.Insert(i, 2, "other_" + std::to_string(i), i, ATTEMPT_KEEP);
+    }
+    auto records = index.SelectRange(1, 3, 6);
+    ASSERT_EQ(4, records.size());
+    EXPECT_EQ("hash_3", records[0]["hash"]);
+    EXPECT_EQ("hash_6", records[3]["hash"]);
+    EXPECT_TRUE(index.SelectRange(1, 6, 3).empty());
+}
+
+TEST_F(MemoryIndexFixture, LowestDeletableOrderTest) {
+    prism::indexed::MemoryIndex index{path_};
+    index.Insert(10, 1, "hash_a", 1, ATTEMPT_KEEP);
+    index.Insert(11, 2, "hash_b", 1, DELETE_IF_FULL);
+    index.Insert(5, 1, "hash_c", 1, PRESERVE_RECORD);
+    index.Insert(12, 1, "hash_d", 1, DELETE_IF_FULL);
+    auto hashes = index.GetLowestDeletableHashes();
+    ASSERT_EQ(3, hashes.size());
+    EXPECT_EQ("hash_b", hashes[0]);
+    EXPECT_EQ("hash_d", hashes[1]);
+    EXPECT_EQ("hash_a", hashes[2]);
+    EXPECT_TRUE(index.SetKeep(12, 1, PRESERVE_RECORD));
+    EXPECT_FALSE(index.SetKeep(13, 1, PRESERVE_RECORD));
+    hashes = index.GetLowestDeletableHashes();
+    ASSERT_EQ(2, hashes.size());
+    EXPECT_EQ("hash_a", hashes[1]);
+}
+
+TEST_F(MemoryIndexFixture, DeviceSizesAndLowestDeletableTest) {
+    prism::indexed::MemoryIndex index{path_};
+    index.Insert(10, 1, "hash_a", 5, ATTEMPT_KEEP);
+    index.Insert(11, 1, "hash_b", 6, DELETE_IF_FULL);
+    index.Insert(12, 1, "hash_c", 7, PRESERVE_RECORD);
+    index.Insert(10, 2, "hash_d", 8, DELETE_IF_FULL);
+    auto sizes = index.GetDeviceSizes();
+    ASSERT_EQ(2, sizes.size());
+    EXPECT_EQ(18, sizes[1]);
+    EXPECT_EQ(8, sizes[2]);
+    auto records = index.GetLowestDeletable(1);
+    ASSERT_EQ(2, records.size());
+    EXPECT_EQ("hash_b", records[0]["hash"]);
+    EXPECT_EQ("6", records[0]["size"]);
+    EXPECT_EQ("hash_a", records[1]["hash"]);
+    EXPECT_TRUE(index.SetKeep(10, 1, DELETE_IF_FULL));
+    EXPECT_EQ("hash_a", index.GetLowestDeletable(1)[0]["hash"]);
+    index.Delete("hash_d");
+    EXPECT_TRUE(index.GetLowestDeletable(2).empty());
+    EXPECT_EQ(1, index.GetDeviceSizes().size());
+}
+
+TEST_F(MemoryIndexFixture, DeleteExpiredTest) {
+    {
+        prism::indexed::MemoryIndex index{path_};
+        index.Insert(10, 1, "hash_a", 1, ATTEMPT_KEEP);
+        index.Insert(11, 2, "hash_b", 1, PRESERVE_RECORD);
+        index.Insert(12, 1, "hash_c", 1, DELETE_IF_FULL);
+        index.Insert(13, 2, "hash_d", 1, DELETE_IF_FULL);
+        index.Insert(20, 1, "hash_e", 1, DELETE_IF_FULL);
+        EXPECT_EQ((std::vector<std::string>{"hash_a", "hash_b"}), index.DeleteExpired(15, 2));
+        EXPECT_EQ((std::vector<std::string>{"hash_d"}), index.DeleteExpired(2, 15, 2));
+        EXPECT_EQ((std::vector<std::string>{"hash_c"}), index.DeleteExpiredKeep(DELETE_IF_FULL, 15, 2));
+        EXPECT_TRUE(index.DeleteExpired(15, 2).empty());
+        EXPECT_EQ(4, index.GetIntents().size());
+    }
+    prism::indexed::MemoryIndex index{path_};
+    auto records = index.SelectAll();
+    ASSERT_EQ(1, records.size());
+    EXPECT_EQ("hash_e", records[0]["hash"]);
+    EXPECT_EQ(4, index.GetIntents().size());
+}
+
+TEST_F(MemoryIndexFixture, SetKeepRangeTest) {
+    prism::indexed::MemoryIndex index{path_};
+    for (unsigned long long i = 0; i < 10; ++i) {
+        index.Insert(i, 1, "hash_" + std::to_string(i), 1, ATTEMPT_KEEP);
+        index.Insert(i, 2, "other_" + std::to_string(i), 1, ATTEMPT_KEEP);
+    }
+    EXPECT_TRUE(index.SetKeepRange(1, 0, 4, PRESERVE_RECORD));
+    EXPECT_TRUE(index.SetKeepRange(8, 20, PRESERVE_RECORD));
+    EXPECT_FALSE(index.SetKeepRange(30, 40, PRESERVE_RECORD));
+    EXPECT_FALSE(index.SetKeepRange(3, 0, 40, PRESERVE_RECORD));
+    EXPECT_EQ(11, index.GetLowestDeletableHashes().size());
+    EXPECT_TRUE(index.BulkSetKeep({}, 1, DELETE_IF_FULL));
+    EXPECT_TRUE(index.BulkSetKeep({0, 1, 50}, 1, DELETE_IF_FULL));
+    EXPECT_FALSE(index.BulkSetKeep({50}, 1, DELETE_IF_FULL));
+    EXPECT_EQ("hash_0", index.GetLowestDeletableHashes().front());
+}
+
+TEST_F(MemoryIndexFixture, SelectHashesTest) {
+    prism::indexed::MemoryIndex index{path_};
+    EXPECT_TRUE(index.SelectHashes({}).empty());
+    index.Insert(10, 1, "hash_a", 100, ATTEMPT_KEEP);
+    index.Insert(11, 2, "hash_b", 200, ATTEMPT_KEEP);
+    auto records = index.SelectHashes({"hash_b", "hash_missing"});
+    ASSERT_EQ(1, records.size());
+    EXPECT_EQ("11", records[0]["time_value"]);
+    EXPECT_EQ("2", records[0]["device"]);
+    EXPECT_EQ("hash_b", records[0]["hash"]);
+    EXPECT_EQ("200", records[0]["size"]);
+}
+
+TEST_F(MemoryIndexFixture, NextUnsyncedTest) {
+    prism::indexed::MemoryIndex index{path_};
+    EXPECT_TRUE(index.NextUnsynced(10, {}).empty());
+    for (unsigned long long i = 0; i < 4; ++i) {
+        index.Insert(i, 1, "hash_1_" + std::to_string(i), 5, ATTEMPT_KEEP);
+        index.Insert(i, 2, "hash_2_" + std::to_string(i), 5, ATTEMPT_KEEP);
+        index.Insert(i, 3, "hash_3_" + std::to_string(i), 5, ATTEMPT_KEEP);
+    }
+    auto records = index.NextUnsynced(2, {});
+    ASSERT_EQ(2, records.size());
+    EXPECT_EQ("hash_1_0", records[0]["hash"]);
+    EXPECT_EQ("0", records[0]["time_value"]);
+    EXPECT_EQ("1", records[0]["device"]);
+    EXPECT_EQ("5", records[0]["size"]);
+    EXPECT_EQ("hash_2_0", records[1]["hash"]);
+
+    records = index.NextUnsynced(3, {3, 1, 3});
+    ASSERT_EQ(3, records.size());
+    EXPECT_EQ("hash_1_0", records[0]["hash"]);
+    EXPECT_EQ("hash_3_0", records[1]["hash"]);
+    EXPECT_EQ("hash_1_1", records[2]["hash"]);
+    EXPECT_TRUE(index.NextUnsynced(3, {4}).empty());
+
+    EXPECT_TRUE(index.MarkSynced({}, 1));
+    EXPECT_FALSE(index.MarkSynced({9}, 1));
+    EXPECT_TRUE(index.MarkSynced({0, 1, 9}, 1));
+    index.SetKeep(2, 1, PRESERVE_RECORD);
+    index.Delete("hash_1_3");
+    records = index.NextUnsynced(10, {1});
+    ASSERT_EQ(1, records.size());
+    EXPECT_EQ("hash_1_2", records[0]["hash"]);
+    EXPECT_EQ(9, index.NextUnsynced(10, {}).size());
+}
+
+TEST_F(MemoryIndexFixture, DeleteRangeTest) {
+    prism::indexed::MemoryIndex index{path_};
+    for (unsigned long long i = 0; i < 5; ++i) {
+        index.Insert(i, 1, "hash_" + std::to_string(i), 1, ATTEMPT_KEEP);
+        index.Insert(i, 2, "other_" + std::to_string(i), 1, ATTEMPT_KEEP);
+    }
+    auto hashes = index.DeleteRange(1, 1, 2);
+    ASSERT_EQ(2, hashes.size());
+    EXPECT_EQ("hash_1", hashes[0]);
+    EXPECT_EQ(2, index.GetIntents().size());
+    hashes = index.DeleteRange(0, 4);
+    ASSERT_EQ(8, hashes.size());
+    EXPECT_EQ(0, index.GetTotalSize());
+    for (std::size_t i = 1; i < hashes.size(); ++i) {
+        EXPECT_LE(hashes[i - 1].back(), hashes[i].back());
+    }
+    EXPECT_EQ(10, index.GetIntents().size());
+    index.BulkDelete(hashes);
+    EXPECT_EQ(2, index.GetIntents().size());
+    EXPECT_TRUE(index.DeleteRange(0, 4).empty());
+}
+
+TEST_F(MemoryIndexFixture, IntentsTest) {
+    prism::indexed::MemoryIndex index{path_};
+    index.InsertPending(10, 1, "hash_a", 1, ATTEMPT_KEEP);
+    auto intents = index.GetIntents();
+    ASSERT_EQ(1, intents.size());
+    EXPECT_EQ("hash_a", intents[0]["hash"]);
+    EXPECT_EQ(std::to_string(INTENT_PUSH), intents[0]["operation"]);
+    index.FinalizePending("hash_a");
+    EXPECT_TRUE(index.GetIntents().empty());
+    index.MarkDeleting({"hash_a"});
+    EXPECT_EQ(std::to_string(INTENT_DELETE), index.GetIntents()[0]["operation"]);
+    index.ClearIntents({"hash_a"});
+    EXPECT_TRUE(index.GetIntents().empty());
+    EXPECT_EQ("hash_a", index.FindHash(10, 1));
+}
+
+TEST_F(MemoryIndexFixture, FinalizePendingReusedHashTest) {
+    {
+        prism::indexed::MemoryIndex index{path_};
+        index.InsertPending(10, 1, "hash_a", 1, ATTEMPT_KEEP);
+        index.FinalizePending("hash_a");
+        index.Delete("hash_a");
+        index.InsertPending(11, 1, "hash_a", 1, ATTEMPT_KEEP);
+        ASSERT_EQ(1, index.GetIntents().size());
+    }
+    prism::indexed::MemoryIndex index{path_};
+    auto intents = index.GetIntents();
+    ASSERT_EQ(1, intents.size());
+    EXPECT_EQ("hash_a", intents[0]["hash"]);
+}
+
+TEST_F(MemoryIndexFixture, SegmentsTest) {
+    prism::indexed::MemoryIndex index{path_};
+    index.InsertSegmented(10, 1, "hash_a", 10, ATTEMPT_KEEP, 1, 0);
+    index.InsertSegmented(11, 1, "hash_b", 20, DELETE_IF_FULL, 1, 10);
+    index.InsertSegmented(12, 1, "hash_c", 30, ATTEMPT_KEEP, 2, 0);
+    index.Insert(13, 1, "hash_d", 40, ATTEMPT_KEEP);
+    EXPECT_EQ(60, index.GetSegmentedSize());
+    EXPECT_EQ(100, index.GetTotalSize());
+    EXPECT_EQ((std::vector<unsigned long long>{1, 2}), index.GetSegments());
+    auto location = index.GetLocation("hash_b");
+    EXPECT_EQ("1", location["segment"]);
+    EXPECT_EQ("10", location["offset"]);
+    EXPECT_EQ("20", location["length"]);
+    EXPECT_EQ(std::to_string(DELETE_IF_FULL), location["keep"]);
+    EXPECT_TRUE(index.GetLocation("hash_d").empty());
+    EXPECT_TRUE(index.GetLocation("missing").empty());
+
+    auto items = index.GetSegmentItems(1);
+    ASSERT_EQ(2, items.size());
+    EXPECT_EQ("hash_a", items[0]["hash"]);
+    EXPECT_EQ("hash_b", items[1]["hash"]);
+
+    index.CompactSegment({"hash_b"}, {prism::indexed::Record{
+                                             {"hash", "hash_a"}, {"segment", "2"}, {"offset", "30"}}});
+    EXPECT_EQ((std::vector<unsigned long long>{2}), index.GetSegments());
+    EXPECT_EQ("30", index.GetLocation("hash_a")["offset"]);
+    EXPECT_EQ(40, index.GetSegmentedSize());
+    index.Delete("hash_c");
+    EXPECT_EQ(10, index.GetSegmentedSize());
+    EXPECT_EQ(1, index.GetSegmentItems(2).size());
+}
+
+TEST_F(MemoryIndexFixture, ReopenFromJournalTest) {
+    {
+        prism::indexed::MemoryIndex index{path_};
+        index.Insert(10, 1, "hash_a", 10, ATTEMPT_KEEP);
+        index.InsertPending(11, 1, "hash_b", 20, ATTEMPT_KEEP);
+        index.InsertSegmented(12, 2, "hash_c", 30, ATTEMPT_KEEP, 3, 0);
+        index.SetKeep(10, 1, PRESERVE_RECORD);
+        index.DeleteRange(2, 12, 12);
+        index.FinalizePending("hash_b");
+    }
+    prism::indexed::MemoryIndex index{path_};
+    auto records = index.SelectAll();
+    ASSERT_EQ(2, records.size());
+    EXPECT_EQ(std::to_string(PRESERVE_RECORD), records[0]["keep"]);
+    EXPECT_EQ(30, index.GetTotalSize());
+    EXPECT_TRUE(index.GetSegments().empty());
+    auto intents = index.GetIntents();
+    ASSERT_EQ(1, intents.size());
+    EXPECT_EQ("hash_c", intents[0]["hash"]);
+    index.Insert(13, 1, "hash_d", 1, ATTEMPT_KEEP);
+    EXPECT_EQ("4", index.SelectAll()[2]["id"]);
+}
+
+TEST_F(MemoryIndexFixture, CompressedTest) {
+    {
+        prism::indexed::MemoryIndex index{path_};
+        index.InsertCompressed(10, 1, "hash_a.lz4", 5, ATTEMPT_KEEP, 1, 40);
+        index.InsertCompressed(11, 1, "hash_b.lz4", 6, ATTEMPT_KEEP, 1, 60);
+        index.Insert(12, 1, "hash_c", 7, ATTEMPT_KEEP);
+        EXPECT_EQ("40", index.GetCompression("hash_a.lz4")["raw_size"]);
+        EXPECT_TRUE(index.GetCompression("hash_c").empty());
+        EXPECT_EQ(2, index.GetIntents().size());
+        index.Delete("hash_b.lz4");
+    }
+    {
+        prism::indexed::MemoryIndex index{path_};
+        auto compression = index.GetCompression("hash_a.lz4");
+        EXPECT_EQ("1", compression["codec"]);
+        EXPECT_EQ("40", compression["raw_size"]);
+        EXPECT_TRUE(index.GetCompression("hash_b.lz4").empty());
+        EXPECT_EQ(12, index.GetTotalSize());
+        index.Compact();
+    }
+    prism::indexed::MemoryIndex index{path_};
+    EXPECT_EQ("40", index.GetCompression("hash_a.lz4")["raw_size"]);
+    EXPECT_TRUE(index.GetCompression("hash_c").empty());
+}
+
+TEST_F(MemoryIndexFixture, SyncedReopenTest) {
+    {
+        prism::indexed::MemoryIndex index{path_};
+        index.Insert(10, 1, "hash_a", 5, ATTEMPT_KEEP);
+        index.Insert(11, 1, "hash_b", 5, ATTEMPT_KEEP);
+        index.Insert(12, 2, "hash_c", 5, ATTEMPT_KEEP);
+        index.MarkSynced({10}, 1);
+    }
+    {
+        prism::indexed::MemoryIndex index{path_};
+        auto records = index.NextUnsynced(10, {});
+        ASSERT_EQ(2, records.size());
+        EXPECT_EQ("hash_b", records[0]["hash"]);
+        index.MarkSynced({12}, 2);
+        index.Compact();
+    }
+    prism::indexed::MemoryIndex index{path_};
+    auto records = index.NextUnsynced(10, {});
+    ASSERT_EQ(1, records.size());
+    EXPECT_EQ("hash_b", records[0]["hash"]);
+    EXPECT_TRUE(index.NextUnsynced(10, {2}).empty());
+}
+
+TEST_F(MemoryIndexFixture, ReopenAfterCompactTest) {
+    {
+        prism::indexed::MemoryIndex index{path_, 4};
+        for (unsigned long long i = 0; i < 10; ++i) {
+            index.InsertSegmented(i, 1, "hash_" + std::to_string(i), 5, ATTEMPT_KEEP, 1, i * 5);
+        }
+        index.MarkDeleting({"hash_0"});
+    }
+    prism::indexed::MemoryIndex index{path_, 4};
+    EXPECT_EQ(10, index.SelectAll().size());
+    EXPECT_EQ(50, index.GetSegmentedSize());
+    EXPECT_EQ("45", index.GetLocation("hash_9")["offset"]);
+    EXPECT_EQ(1, index.GetIntents().size());
+    index.Compact();
+    EXPECT_EQ(std::string{"prism_indexed_journal "}.size() + 2, fs::file_size(journal_path_));
+}
+
+TEST_F(MemoryIndexFixture, TornJournalTailTest) {
+    {
+        prism::indexed::MemoryIndex index{path_};
+        index.Insert(10, 1, "hash_a", 10, ATTEMPT_KEEP);
+    }
+    append(journal_path_, "I 11 1 hash_b 1");
+    {
+        prism::indexed::MemoryIndex index{path_};
+        EXPECT_EQ(1, index.SelectAll().size());
+        index.Insert(12, 1, "hash_c", 10, ATTEMPT_KEEP);
+    }
+    prism::indexed::MemoryIndex index{path_};
+    EXPECT_EQ(2, index.SelectAll().size());
+    EXPECT_TRUE(index.FindHash(11, 1).empty());
+}
+
+TEST_F(MemoryIndexFixture, StaleJournalIgnoredTest) {
+    {
+        prism::indexed::MemoryIndex index{path_};
+        index.Insert(10, 1, "hash_a", 10, ATTEMPT_KEEP);
+    }
+    // A crash after the snapshot was replaced leaves the old journal, which is already folded in
+    fs::copy_file(journal_path_, journal_path_ + ".old");
+    {
+        prism::indexed::MemoryIndex index{path_};
+        index.Compact();
+    }
+    fs::remove(journal_path_);
+    fs::rename(journal_path_ + ".old", journal_path_);
+    prism::indexed::MemoryIndex index{path_};
+    EXPECT_EQ(1, index.SelectAll().size());
+}
+
+TEST_F(MemoryIndexFixture, CorruptSnapshotThrowTest) {
+    append(path_, "not a snapshot\n");
+    EXPECT_THROW(prism::indexed::MemoryIndex{path_}, prism::indexed::DatabaseException);
+}
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "filesystem-fixture.h"
+#include "indexed/filesystem.h"
+#include "indexed/segment-store.h"
+
+
+namespace fs = ::boost::filesystem;
+
+class SegmentStoreFixture : public FilesystemFixture {
+  protected:
+    virtual void SetUp() {
+        FilesystemFixture::SetUp();
+        staging_path_ = fs::temp_directory_path() / fs::path{"prism_staging_buffer"};
+        fs::create_directory(staging_path_);
+    }
+
+    virtual void TearDown() {
+        FilesystemFixture::TearDown();
+        fs::remove_all(staging_path_);
+    }
+
+    std::string stage(const std::string& filename, const std::string& contents) {
+        const auto filepath = staging_path_ / filename;
+        std::ofstream out_stream{filepath.native()};
+        out_stream << contents;
+        return filepath.string();
+    }
+
+    std::string read(const std::string& filepath, const uintmax_t& offset,
+                     const uintmax_t& length) {
+        std::ifstream in_stream{filepath, std::ios::binary};
+        in_stream.seekg(offset);
+        std::string contents(length, '\0');
+        in_stream.read(&contents[0], length);
+        return contents;
+    }
+
+    fs::path staging_path_;
+};
+
+TEST_F(SegmentStoreFixture, ConstructEmptyTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    prism::indexed::SegmentStore segments{filesystem, 1024};
+    EXPECT_TRUE(segments.List().empty());
+    EXPECT_EQ(0, segments.GetActive());
+    EXPECT_EQ(0, segments.GetAllocatedSize());
+    EXPECT_EQ(0, filesystem.GetSize());
+}
+
+TEST_F(SegmentStoreFixture, ConstructZeroSizeThrowTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    EXPECT_THROW(prism::indexed::SegmentStore(filesystem, 0),
+                 prism::indexed::FilesystemException);
+}
+
+TEST_F(SegmentStoreFixture, AppendTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    prism::indexed::SegmentStore segments{filesystem, 1024};
+    auto first = segments.Append(stage("first", "hello"));
+    auto second = segments.Append(stage("second", "world!"));
+    EXPECT_EQ(1, first.segment);
+    EXPECT_EQ(0, first.offset);
+    EXPECT_EQ(5, first.length);
+    EXPECT_EQ(1, second.segment);
+    EXPECT_EQ(5, second.offset);
+    EXPECT_EQ(6, second.length);
+    EXPECT_FALSE(fs::exists(staging_path_ / "first"));
+    EXPECT_FALSE(fs::exists(staging_path_ / "second"));
+    EXPECT_EQ("hello", read(segments.GetFilepath(1), first.offset, first.length));
+    EXPECT_EQ("world!", read(segments.GetFilepath(1), second.offset, second.length));
+}
+
+TEST_F(SegmentStoreFixture, AppendPreallocatesTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    prism::indexed::SegmentStore segments{filesystem, 1024};
+    segments.Append(stage("first", "hello"));
+    EXPECT_EQ(1024, fs::file_size(segments.GetFilepath(1)));
+    EXPECT_EQ(1024, segments.GetAllocatedSize());
+    EXPECT_EQ(1024, filesystem.GetSize());
+}
+
+TEST_F(SegmentStoreFixture, AppendRollsOverTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    prism::indexed::SegmentStore segments{filesystem, 8};
+    auto first = segments.Append(stage("first", "hello"));
+    auto second = segments.Append(stage("second", "world"));
+    EXPECT_EQ(1, first.segment);
+    EXPECT_EQ(2, second.segment);
+    EXPECT_EQ(0, second.offset);
+    EXPECT_EQ(2, segments.GetActive());
+    EXPECT_EQ((std::vector<unsigned long long>{1, 2}), segments.List());
+    EXPECT_EQ(16, filesystem.GetSize());
+}
+
+TEST_F(SegmentStoreFixture, AppendTooLargeThrowTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    prism::indexed::SegmentStore segments{filesystem, 4};
+    auto filepath = stage("first", "hello");
+    EXPECT_THROW(segments.Append(filepath), prism::indexed::FilesystemException);
+    EXPECT_TRUE(fs::exists(filepath));
+}
+
+TEST_F(SegmentStoreFixture, CopyTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    prism::indexed::SegmentStore segments{filesystem, 1024};
+    segments.Append(stage("first", "hello"));
+    auto second = segments.Append(stage("second", "world"));
+    segments.Seal();
+    auto copied = segments.Copy(second);
+    EXPECT_EQ(2, copied.segment);
+    EXPECT_EQ(0, copied.offset);
+    EXPECT_EQ("world", read(segments.GetFilepath(copied.segment), copied.offset, copied.length));
+}
+
+TEST_F(SegmentStoreFixture, RemoveTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    prism::indexed::SegmentStore segments{filesystem, 1024};
+    segments.Append(stage("first", "hello"));
+    EXPECT_TRUE(segments.Remove(1));
+    EXPECT_EQ(0, segments.GetActive());
+    EXPECT_TRUE(segments.List().empty());
+    EXPECT_EQ(0, filesystem.GetSize());
+    auto next = segments.Append(stage("second", "world"));
+    EXPECT_EQ(2, next.segment);
+}
+
+TEST_F(SegmentStoreFixture, RestartStartsNewSegmentTest) {
+    prism::indexed::Filesystem filesystem{"prism_indexed_buffer"};
+    {
+        prism::indexed::SegmentStore segments{filesystem, 1024};
+        segments.Append(stage("first", "hello"));
+    }
+    prism::indexed::SegmentStore segments{filesystem, 1024};
+    EXPECT_EQ(0, segments.GetActive());
+    EXPECT_EQ(2, segments.Append(stage("second", "world")).segment);
+}
@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "database-fixture.h"
+#include "indexed/database.h"
+#include "indexed/sharded-index.h"
+
+
+namespace fs = ::boost::filesystem;
+
+using prism::indexed::ShardedIndex;
+
+TEST_F(DatabaseFixture, ShardedConstructTest) {
+    ShardedIndex index{db_string_, 3};
+    EXPECT_EQ(3, index.GetShardCount());
+    EXPECT_TRUE(fs::exists(db_path_));
+    EXPECT_TRUE(fs::exists(buffer_path_ / "prism_indexed_data.1.db"));
+    EXPECT_TRUE(fs::exists(buffer_path_ / "prism_indexed_data.2.db"));
+    EXPECT_EQ(db_string_, index.GetShardPath(3));
+    EXPECT_EQ((buffer_path_ / "prism_indexed_data.1.db").string(), index.GetShardPath(4));
+}
+
+TEST_F(DatabaseFixture, ShardedConstructNoShardsThrowTest) {
+    EXPECT_THROW(ShardedIndex(db_string_, 0), prism::indexed::DatabaseException);
+}
+
+TEST_F(DatabaseFixture, ShardedInsertRoutesByDeviceTest) {
+    {
+        ShardedIndex index{db_string_, 2};
+        index.Insert(10, 0, "a", 100, ATTEMPT_KEEP);
+        index.Insert(10, 1, "b", 200, ATTEMPT_KEEP);
+        index.Insert(11, 2, "c", 300, ATTEMPT_KEEP);
+        EXPECT_EQ("a", index.FindHash(10, 0));
+        EXPECT_EQ("b", index.FindHash(10, 1));
+        EXPECT_EQ("c", index.FindHash(11, 2));
+        EXPECT_EQ(600, index.GetTotalSize());
+        auto sizes = index.GetDeviceSizes();
+        EXPECT_EQ(100, sizes[0]);
+        EXPECT_EQ(200, sizes[1]);
+        EXPECT_EQ(300, sizes[2]);
+    }
+    prism::indexed::Database first{db_string_};
+    prism::indexed::Database second{(buffer_path_ / "prism_indexed_data.1.db").string()};
+    EXPECT_EQ(2, first.SelectAll().size());
+    EXPECT_EQ(1, second.SelectAll().size());
+    EXPECT_EQ("b", second.FindHash(10, 1));
+}
+
+TEST_F(DatabaseFixture, ShardedLowestDeletableMergeTest) {
+    ShardedIndex index{db_string_, 3};
+    index.Insert(14, 0, "a", 100, ATTEMPT_KEEP);
+    index.Insert(12, 1, "b", 100, ATTEMPT_KEEP);
+    index.Insert(13, 2, "c", 100, DELETE_IF_FULL);
+    index.Insert(11, 3, "d", 100, ATTEMPT_KEEP);
+    index.Insert(10, 4, "e", 100, PRESERVE_RECORD);
+    index.Insert(15, 5, "f", 100, DELETE_IF_FULL);
+    std::vector<std::string> expected{"c", "f", "d", "b", "a"};
+    EXPECT_EQ(expected, index.GetLowestDeletableHashes());
+}
+
+TEST_F(DatabaseFixture, ShardedLargestDeletableTest) {
+    ShardedIndex index{db_string_, 2};
+    index.Insert(10, 0, "a", 100, ATTEMPT_KEEP);
+    index.Insert(11, 1, "b", 300, ATTEMPT_KEEP);
+    index.Insert(12, 0, "c", 200, ATTEMPT_KEEP);
+    index.Insert(13, 1, "d", 50, DELETE_IF_FULL);
+    std::vector<std::string> expected{"d", "b", "c", "a"};
+    EXPECT_EQ(expected, index.GetLargestDeletableHashes());
+}
+
+TEST_F(DatabaseFixture, ShardedDecayedDeletableTest) {
+    ShardedIndex index{db_string_, 2};
+    index.Insert(100, 0, "a", 100, ATTEMPT_KEEP);
+    index.Insert(150, 1, "b", 100, DELETE_IF_FULL);
+    index.Insert(195, 1, "c", 100, DELETE_IF_FULL);
+    std::vector<std::string> expected{"b", "c", "a"};
+    EXPECT_EQ(expected, index.GetDecayedDeletableHashes(10));
+}
+
+TEST_F(DatabaseFixture, ShardedExpiredTest) {
+    ShardedIndex index{db_string_, 2};
+    index.Insert(12, 0, "a", 100, ATTEMPT_KEEP);
+    index.Insert(10, 1, "b", 100, ATTEMPT_KEEP);
+    index.Insert(11, 0, "c", 100, PRESERVE_RECORD);
+    index.Insert(20, 1, "d", 100, ATTEMPT_KEEP);
+    std::vector<std::string> expected{"b", "a"};
+    EXPECT_EQ(expected, index.GetExpiredHashes(15));
+
+    // Retention deletes preserved rows as well
+    EXPECT_EQ(1, index.DeleteExpired(15, 1).size());
+    EXPECT_EQ(2, index.DeleteExpired(15, 10).size());
+    EXPECT_TRUE(index.DeleteExpired(15, 10).empty());
+    EXPECT_EQ("d", index.FindHash(20, 1));
+}
+
+TEST_F(DatabaseFixture, ShardedDeleteByHashTest) {
+    ShardedIndex index{db_string_, 2};
+    index.Insert(10, 0, "a", 100, ATTEMPT_KEEP);
+    index.Insert(10, 1, "b", 100, ATTEMPT_KEEP);
+    index.Insert(11, 1, "c", 100, ATTEMPT_KEEP);
+    index.Delete("b");
+    index.BulkDelete({"a", "c"});
+    EXPECT_TRUE(index.SelectAll().empty());
+}
+
+TEST_F(DatabaseFixture, ShardedRangeTest) {
+    ShardedIndex index{db_string_, 2};
+    index.Insert(10, 0, "a", 100, ATTEMPT_KEEP);
+    index.Insert(11, 1, "b", 100, ATTEMPT_KEEP);
+    index.Insert(20, 1, "c", 100, ATTEMPT_KEEP);
+    EXPECT_TRUE(index.SetKeepRange(0, 15, PRESERVE_RECORD));
+    std::vector<std::string> expected{"c"};
+    EXPECT_EQ(expected, index.GetLowestDeletableHashes());
+    EXPECT_EQ(2, index.DeleteRange(0, 15).size());
+    auto records = index.SelectAll();
+    ASSERT_EQ(1, records.size());
+    EXPECT_EQ("c", records[0]["hash"]);
+}
+
+TEST_F(DatabaseFixture, ShardedSelectHashesTest) {
+    ShardedIndex index{db_string_, 2};
+    index.Insert(10, 0, "a", 100, ATTEMPT_KEEP);
+    index.Insert(11, 1, "b", 200, ATTEMPT_KEEP);
+    index.Insert(12, 2, "c", 300, ATTEMPT_KEEP);
+    auto records = index.SelectHashes({"b", "c", "missing"});
+    ASSERT_EQ(2, records.size());
+    std::vector<std::string> devices{records[0]["device"], records[1]["device"]};
+    std::sort(devices.begin(), devices.end());
+    EXPECT_EQ((std::vector<std::string>{"1", "2"}), devices);
+}
+
+TEST_F(DatabaseFixture, ShardedNextUnsyncedTest) {
+    ShardedIndex index{db_string_, 2};
+    index.Insert(11, 1, "a", 100, ATTEMPT_KEEP);
+    index.Insert(10, 0, "b", 100, ATTEMPT_KEEP);
+    index.Insert(9, 1, "c", 100, ATTEMPT_KEEP);
+    index.Insert(12, 2, "d", 100, ATTEMPT_KEEP);
+    index.Insert(10, 3, "e", 100, ATTEMPT_KEEP);
+    auto hashes = [](const std::vector<prism::indexed::Record>& records) {
+        std::vector<std::string> hashes;
+        for (const auto& record : records) {
+            hashes.push_back(record.at("hash"));
+        }
+        return hashes;
+    };
+    EXPECT_EQ((std::vector<std::string>{"c", "b", "e"}), hashes(index.NextUnsynced(3, {})));
+    EXPECT_EQ((std::vector<std::string>{"b", "d"}), hashes(index.NextUnsynced(3, {0, 2})));
+
+    EXPECT_TRUE(index.MarkSynced({9, 11}, 1));
+    EXPECT_FALSE(index.MarkSynced({9}, 3));
+    EXPECT_EQ((std::vector<std::string>{"b", "e", "d"}), hashes(index.NextUnsynced(5, {})));
+}
+
+TEST_F(DatabaseFixture, ShardedSelectAllOrderTest) {
+    ShardedIndex index{db_string_, 2};
+    index.Insert(11, 1, "a", 100, ATTEMPT_KEEP);
+    index.Insert(10, 0, "b", 100, ATTEMPT_KEEP);
+    index.Insert(9, 1, "c", 100, ATTEMPT_KEEP);
+    index.Insert(12, 2, "d", 100, ATTEMPT_KEEP);
+    std::vector<std::string> expected{"b", "c", "a", "d"};
+    std::vector<std::string> hashes;
+    for (auto& record : index.SelectAll()) {
+        hashes.push_back(record["hash"]);
+    }
+    EXPECT_EQ(expected, hashes);
+}
+
+TEST_F(DatabaseFixture, ShardedIntentsOnceTest) {
+    ShardedIndex index{db_string_, 3};
+    index.MarkDeleting({"a", "b"});
+    EXPECT_EQ(2, index.GetIntents().size());
+    index.ClearIntents({"a", "b"});
+    EXPECT_TRUE(index.GetIntents().empty());
+}
+
+TEST_F(DatabaseFixture, ShardedSegmentsTest) {
+    ShardedIndex index{db_string_, 2};
+    index.InsertSegmented(10, 0, "a", 100, ATTEMPT_KEEP, 1, 100);
+    index.InsertSegmented(10, 1, "b", 100, ATTEMPT_KEEP, 1, 0);
+    index.InsertSegmented(11, 1, "c", 100, ATTEMPT_KEEP, 2, 0);
+    std::vector<unsigned long long> segments{1, 2};
+    EXPECT_EQ(segments, index.GetSegments());
+    auto items = index.GetSegmentItems(1);
+    ASSERT_EQ(2, items.size());
+    EXPECT_EQ("b", items[0]["hash"]);
+    EXPECT_EQ("a", items[1]["hash"]);
+    EXPECT_EQ(300, index.GetSegmentedSize());
+    EXPECT_EQ("1", index.GetLocation("b")["segment"]);
+
+    index.CompactSegment({"a"}, {{{"hash", "b"}, {"segment", "3"}, {"offset", "0"}}});
+    EXPECT_EQ("3", index.GetLocation("b")["segment"]);
+    EXPECT_TRUE(index.GetLocation("a").empty());
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+
+#include "filesystem-fixture.h"
+#include "indexed/filesystem.h"
+#include "indexed/shared-state.h"
+#include "indexed/storage.h"
+
+
+namespace fs = ::boost::filesystem;
+
+using prism::indexed::SharedState;
+
+class SharedStateFixture : public FilesystemFixture {
+  protected:
+    virtual void SetUp() {
+        FilesystemFixture::SetUp();
+        fs::create_directory(buffer_path_);
+    }
+};
+
+TEST_F(SharedStateFixture, ConstructMissingDirectoryThrowTest) {
+    EXPECT_THROW(SharedState((buffer_path_ / "missing").string()),
+                 prism::indexed::FilesystemException);
+}
+
+TEST_F(SharedStateFixture, FreshOnlyWhenAloneTest) {
+    {
+        SharedState first{buffer_path_.string()};
+        EXPECT_TRUE(first.IsFresh());
+        first.Size() = 100;
+        SharedState second{buffer_path_.string()};
+        EXPECT_FALSE(second.IsFresh());
+        EXPECT_EQ(100, second.Size());
+        second.Size() += 50;
+        EXPECT_EQ(150, first.Size());
+    }
+
+    // Counters left by processes that have all exited are reset
+    SharedState third{buffer_path_.string()};
+    EXPECT_TRUE(third.IsFresh());
+    EXPECT_EQ(0, third.Size());
+}
+
+TEST_F(SharedStateFixture, OwnershipTest) {
+    SharedState first{buffer_path_.string()};
+    {
+        SharedState second{buffer_path_.string()};
+        EXPECT_FALSE(first.IsOwner());
+        EXPECT_TRUE(second.AcquireOwnership());
+        EXPECT_TRUE(second.AcquireOwnership());
+        EXPECT_FALSE(first.AcquireOwnership());
+        EXPECT_FALSE(first.IsOwner());
+    }
+    EXPECT_TRUE(first.AcquireOwnership());
+    EXPECT_TRUE(first.IsOwner());
+}
+
+TEST_F(SharedStateFixture, LockExcludesOtherStateTest) {
+    SharedState first{buffer_path_.string()};
+    SharedState second{buffer_path_.string()};
+    std::atomic<bool> locked{false};
+    first.lock();
+    std::thread other{[&]() {
+        std::lock_guard<SharedState> lock(second);
+        locked = true;
+    }};
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(locked);
+    first.unlock();
+    other.join();
+    EXPECT_TRUE(locked);
+}
+
+TEST_F(SharedStateFixture, WaitForChangeTest) {
+    SharedState first{buffer_path_.string()};
+    SharedState second{buffer_path_.string()};
+    const auto sequence = second.GetChangeSequence();
+    EXPECT_FALSE(second.WaitForChange(sequence, std::chrono::milliseconds(10)));
+
+    std::thread notifier{[&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        first.NotifyChange();
+    }};
+    EXPECT_TRUE(second.WaitForChange(sequence, std::chrono::seconds(10)));
+    notifier.join();
+    EXPECT_NE(sequence, second.GetChangeSequence());
+    EXPECT_TRUE(second.WaitForChange(sequence, std::chrono::milliseconds(0)));
+}
+
+TEST_F(SharedStateFixture, EvictionRequestTest) {
+    SharedState first{buffer_path_.string()};
+    SharedState second{buffer_path_.string()};
+    const auto seen = first.GetEvictionRequests();
+    EXPECT_FALSE(first.WaitForEvictionRequest(seen, std::chrono::milliseconds(10)));
+    second.RequestEviction();
+    EXPECT_TRUE(first.WaitForEvictionRequest(seen, std::chrono::milliseconds(10)));
+    EXPECT_EQ(seen + 1, first.GetEvictionRequests());
+}
+
+TEST_F(SharedStateFixture, FilesystemShareSizeTest) {
+    SharedState state{buffer_path_.string()};
+    prism::indexed::Filesystem first{"prism_indexed_buffer", std::string{}, 1.0, false};
+    prism::indexed::Filesystem second{"prism_indexed_buffer", std::string{}, 1.0, false};
+    first.ShareSize(state.Size());
+    second.ShareSize(state.Size());
+    first.AddSize(100);
+    EXPECT_EQ(100, second.GetSize());
+    second.SetSize(40);
+    EXPECT_EQ(40, first.GetSize());
+}
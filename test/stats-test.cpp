@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "indexed/stats.h"
+
+
+TEST(StatsTests, BucketIndexExactBelowEight) {
+    for (uint64_t i = 0; i < 8; ++i) {
+        EXPECT_EQ(i, prism::indexed::Stats::BucketIndex(i));
+        EXPECT_EQ(i, prism::indexed::Stats::BucketLowerBound(i));
+    }
+}
+
+TEST(StatsTests, BucketBoundsContainValue) {
+    for (uint64_t value : {8ULL, 9ULL, 15ULL, 16ULL, 1000ULL, 1023ULL, 1024ULL, 123456789ULL,
+                           (1ULL << 40) + 12345}) {
+        auto index = prism::indexed::Stats::BucketIndex(value);
+        EXPECT_LE(prism::indexed::Stats::BucketLowerBound(index), value);
+        EXPECT_GT(prism::indexed::Stats::BucketLowerBound(index + 1), value);
+    }
+}
+
+TEST(StatsTests, BucketRelativeErrorBounded) {
+    for (uint64_t value = 8; value < (1ULL << 40); value = value * 3 + 1) {
+        auto index = prism::indexed::Stats::BucketIndex(value);
+        auto width = prism::indexed::Stats::BucketLowerBound(index + 1) -
+                     prism::indexed::Stats::BucketLowerBound(index);
+        EXPECT_LE(width * 8, value);
+    }
+}
+
+TEST(StatsTests, BucketIndexClampsLargeValues) {
+    EXPECT_EQ(prism::indexed::Stats::BucketIndex(1ULL << 41),
+              prism::indexed::Stats::BucketIndex(~0ULL));
+}
+
+TEST(StatsTests, EmptySnapshotTest) {
+    prism::indexed::Stats stats;
+    auto snapshot = stats.Snapshot();
+    EXPECT_EQ(20, snapshot.operations.size());
+    EXPECT_EQ(5, snapshot.phases.size());
+    EXPECT_EQ(0, snapshot.operations["push"].count);
+    EXPECT_EQ(0, snapshot.operations["push"].Percentile(0.99));
+    EXPECT_EQ(0, snapshot.bytes_ingested);
+    EXPECT_EQ(0, snapshot.bytes_evicted);
+    EXPECT_EQ(0, snapshot.files_evicted);
+}
+
+TEST(StatsTests, RecordOperationTest) {
+    prism::indexed::Stats stats;
+    stats.Record(prism::indexed::Operation::Push, std::chrono::microseconds(10));
+    stats.Record(prism::indexed::Operation::Push, std::chrono::microseconds(30));
+    auto snapshot = stats.Snapshot();
+    auto& push = snapshot.operations["push"];
+    EXPECT_EQ(2, push.count);
+    EXPECT_EQ(40000, push.sum);
+    EXPECT_EQ(30000, push.max);
+    EXPECT_EQ(0, snapshot.operations["delete"].count);
+}
+
+TEST(StatsTests, RecordPhaseTest) {
+    prism::indexed::Stats stats;
+    stats.Record(prism::indexed::Phase::LockWait, std::chrono::nanoseconds(500));
+    auto snapshot = stats.Snapshot();
+    EXPECT_EQ(1, snapshot.phases["lock_wait"].count);
+    EXPECT_EQ(0, snapshot.phases["move"].count);
+}
+
+TEST(StatsTests, PercentileWithinBucketTest) {
+    prism::indexed::Stats stats;
+    for (int i = 1; i <= 100; ++i) {
+        stats.Record(prism::indexed::Operation::GetFilepath, std::chrono::microseconds(i));
+    }
+    auto snapshot = stats.Snapshot();
+    auto& histogram = snapshot.operations["get_filepath"];
+    auto p50 = histogram.Percentile(0.5);
+    EXPECT_GE(p50, 50000);
+    EXPECT_LE(p50, 50000 * 1.125);
+    EXPECT_EQ(100000, histogram.Percentile(1.0));
+    EXPECT_LE(histogram.Percentile(0.0), 1000 * 1.125);
+}
+
+TEST(StatsTests, TimerRecordsScopeTest) {
+    prism::indexed::Stats stats;
+    {
+        prism::indexed::Stats::Timer<prism::indexed::Phase> timer{stats,
+                                                                  prism::indexed::Phase::Move};
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    auto snapshot = stats.Snapshot();
+    EXPECT_EQ(1, snapshot.phases["move"].count);
+    EXPECT_GE(snapshot.phases["move"].sum, 2000000);
+}
+
+TEST(StatsTests, CountersTest) {
+    prism::indexed::Stats stats;
+    stats.AddIngested(100);
+    stats.AddIngested(50);
+    stats.AddEvicted(2, 70);
+    auto snapshot = stats.Snapshot();
+    EXPECT_EQ(150, snapshot.bytes_ingested);
+    EXPECT_EQ(70, snapshot.bytes_evicted);
+    EXPECT_EQ(2, snapshot.files_evicted);
+}
+
+TEST(StatsTests, ConcurrentRecordTest) {
+    prism::indexed::Stats stats;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&stats]() {
+            for (int j = 0; j < 10000; ++j) {
+                stats.Record(prism::indexed::Operation::Push, std::chrono::nanoseconds(j));
+                stats.AddIngested(1);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    auto snapshot = stats.Snapshot();
+    EXPECT_EQ(40000, snapshot.operations["push"].count);
+    EXPECT_EQ(40000, snapshot.bytes_ingested);
+    EXPECT_EQ(9999, snapshot.operations["push"].max);
+}
+
+TEST(StatsTests, FormatPrometheusTest) {
+    prism::indexed::Stats stats;
+    stats.Record(prism::indexed::Operation::Push, std::chrono::microseconds(3));
+    stats.Record(prism::indexed::Operation::Push, std::chrono::seconds(2));
+    stats.AddIngested(1024);
+    auto text = prism::indexed::Stats::FormatPrometheus(stats.Snapshot());
+    EXPECT_NE(std::string::npos, text.find("# TYPE prism_indexed_operation_seconds histogram"));
+    EXPECT_NE(std::string::npos,
+              text.find("prism_indexed_operation_seconds_bucket{operation=\"push\",le=\"4.096e-06\"} 1"));
+    EXPECT_NE(std::string::npos,
+              text.find("prism_indexed_operation_seconds_bucket{operation=\"push\",le=\"+Inf\"} 2"));
+    EXPECT_NE(std::string::npos,
+              text.find("prism_indexed_operation_seconds_count{operation=\"push\"} 2"));
+    EXPECT_NE(std::string::npos, text.find("prism_indexed_phase_seconds_count{phase=\"eviction\"} 0"));
+    EXPECT_NE(std::string::npos, text.find("prism_indexed_ingested_bytes_total 1024"));
+}
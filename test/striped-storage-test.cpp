@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "indexed/storage.h"
+#include "indexed/striped-storage.h"
+
+
+namespace fs = ::boost::filesystem;
+
+using prism::indexed::StripePlacement;
+using prism::indexed::StripedStorage;
+
+class StripedStorageFixture : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+        for (const auto& name : {"prism_stripe_0", "prism_stripe_1", "prism_stripe_2"}) {
+            roots_.push_back(fs::temp_directory_path() / fs::path{name});
+            fs::remove_all(roots_.back());
+            fs::create_directories(roots_.back());
+        }
+        staging_path_ = fs::temp_directory_path() / fs::path{"prism_staging_buffer"};
+        fs::create_directories(staging_path_);
+    }
+
+    virtual void TearDown() {
+        for (const auto& root : roots_) {
+            fs::remove_all(root);
+        }
+        fs::remove_all(staging_path_);
+    }
+
+    std::vector<std::string> rootStrings() {
+        std::vector<std::string> roots;
+        for (const auto& root : roots_) {
+            roots.push_back(root.string());
+        }
+        return roots;
+    }
+
+    std::string stage(const std::string& filename, const uintmax_t& size) {
+        const auto filepath = (staging_path_ / filename).string();
+        std::ofstream out_stream{filepath, std::ios::binary};
+        out_stream << std::string(size, 'x');
+        return filepath;
+    }
+
+    bool onRoot(const std::size_t& root, const std::string& filename) {
+        return fs::exists(roots_[root] / "prism_indexed_buffer" / filename);
+    }
+
+    std::vector<fs::path> roots_;
+    fs::path staging_path_;
+};
+
+TEST_F(StripedStorageFixture, ConstructNoRootsThrowTest) {
+    EXPECT_THROW(StripedStorage("prism_indexed_buffer", {}, 1.0),
+                 prism::indexed::FilesystemException);
+    EXPECT_THROW(StripedStorage("prism_indexed_buffer", {"/nonexistent/prism_stripe"}, 1.0),
+                 prism::indexed::FilesystemException);
+}
+
+TEST_F(StripedStorageFixture, RoundRobinTest) {
+    StripedStorage storage{"prism_indexed_buffer", rootStrings(), 1.0};
+    for (const auto& filename : {"a", "b", "c", "d", "e", "f"}) {
+        ASSERT_TRUE(storage.Move(stage(filename, 100), filename));
+    }
+    EXPECT_TRUE(onRoot(0, "a"));
+    EXPECT_TRUE(onRoot(1, "b"));
+    EXPECT_TRUE(onRoot(2, "c"));
+    EXPECT_TRUE(onRoot(0, "d"));
+    EXPECT_EQ(200, storage.GetRootSize(0));
+    EXPECT_EQ(200, storage.GetRootSize(1));
+    EXPECT_EQ(200, storage.GetRootSize(2));
+    EXPECT_EQ(600, storage.GetSize());
+    EXPECT_EQ((roots_[1] / "prism_indexed_buffer" / "e").string(),
+              storage.GetExistingFilepath("e"));
+    EXPECT_EQ(100, storage.GetFileSize("e"));
+}
+
+TEST_F(StripedStorageFixture, FreeSpaceTest) {
+    StripedStorage storage{"prism_indexed_buffer", rootStrings(), 1.0,
+                           StripePlacement::FreeSpace};
+    ASSERT_TRUE(storage.Move(stage("a", 100), "a"));
+    EXPECT_FALSE(storage.GetExistingFilepath("a").empty());
+    EXPECT_EQ(100, storage.GetSize());
+}
+
+TEST_F(StripedStorageFixture, DegradedRootTest) {
+    auto roots = rootStrings();
+    roots.insert(roots.begin() + 1, (fs::temp_directory_path() / "prism_stripe_missing").string());
+    StripedStorage storage{"prism_indexed_buffer", roots, 4.0};
+    ASSERT_EQ(1, storage.GetDegradedRoots().size());
+    EXPECT_EQ(roots[1], storage.GetDegradedRoots().front());
+    for (const auto& filename : {"a", "b", "c"}) {
+        ASSERT_TRUE(storage.Move(stage(filename, 100), filename));
+    }
+    EXPECT_TRUE(onRoot(0, "a"));
+    EXPECT_TRUE(onRoot(1, "b"));
+    EXPECT_TRUE(onRoot(2, "c"));
+
+    // Three of the four roots are left, so three quarters of the quota
+    storage.SetSize(static_cast<uintmax_t>(3.0 * 1024 * 1024 * 1024) - 100);
+    EXPECT_FALSE(storage.AboveQuota());
+    storage.SetSize(static_cast<uintmax_t>(3.0 * 1024 * 1024 * 1024) + 100);
+    EXPECT_TRUE(storage.AboveQuota());
+    EXPECT_FALSE(storage.AboveQuota(200));
+}
+
+TEST_F(StripedStorageFixture, ConstructMeasuresRootsTest) {
+    {
+        StripedStorage storage{"prism_indexed_buffer", rootStrings(), 1.0};
+        for (const auto& filename : {"a", "b", "c", "d"}) {
+            ASSERT_TRUE(storage.Move(stage(filename, 100), filename));
+        }
+    }
+    StripedStorage storage{"prism_indexed_buffer", rootStrings(), 1.0};
+    EXPECT_EQ(200, storage.GetRootSize(0));
+    EXPECT_EQ(100, storage.GetRootSize(1));
+    EXPECT_EQ(100, storage.GetRootSize(2));
+    EXPECT_EQ(400, storage.GetSize());
+
+    storage.SetSize(1000);
+    EXPECT_EQ(800, storage.GetRootSize(0));
+    EXPECT_EQ(1000, storage.GetSize());
+}
+
+TEST_F(StripedStorageFixture, DeleteAnyRootTest) {
+    StripedStorage storage{"prism_indexed_buffer", rootStrings(), 1.0};
+    for (const auto& filename : {"a", "b", "c"}) {
+        ASSERT_TRUE(storage.Move(stage(filename, 100), filename));
+    }
+    EXPECT_TRUE(storage.Delete("b"));
+    EXPECT_TRUE(storage.Delete("c"));
+    EXPECT_FALSE(storage.Delete("c"));
+    EXPECT_FALSE(onRoot(1, "b"));
+    EXPECT_EQ(100, storage.GetSize());
+}
+
+TEST_F(StripedStorageFixture, BulkDeleteAllRootsTest) {
+    StripedStorage storage{"prism_indexed_buffer", rootStrings(), 1.0};
+    for (const auto& filename : {"a", "b", "c", "d"}) {
+        ASSERT_TRUE(storage.Move(stage(filename, 100), filename));
+    }
+    EXPECT_EQ(3, storage.BulkDelete({"a", "b", "c", "missing"}));
+    EXPECT_TRUE(storage.GetExistingFilepath("b").empty());
+    EXPECT_FALSE(storage.GetExistingFilepath("d").empty());
+    EXPECT_EQ(100, storage.GetSize());
+}
+
+TEST_F(StripedStorageFixture, LinkSameRootTest) {
+    StripedStorage storage{"prism_indexed_buffer", rootStrings(), 1.0};
+    ASSERT_TRUE(storage.Move(stage("a", 100), "a"));
+    ASSERT_TRUE(storage.Move(stage("b", 100), "b"));
+    EXPECT_TRUE(storage.Link("b", "c"));
+    EXPECT_TRUE(onRoot(1, "c"));
+    EXPECT_FALSE(storage.Link("missing", "d"));
+}
+
+TEST_F(StripedStorageFixture, ScanVerifyAllRootsTest) {
+    StripedStorage storage{"prism_indexed_buffer", rootStrings(), 1.0};
+    for (const auto& filename : {"a", "b", "c"}) {
+        ASSERT_TRUE(storage.Move(stage(filename, 100), filename));
+    }
+    auto listing = storage.Scan(std::chrono::steady_clock::now() + std::chrono::seconds(10), 2);
+    EXPECT_TRUE(listing.complete);
+    EXPECT_EQ(3, listing.files.size());
+
+    storage.SetSize(0);
+    std::atomic<bool> cancel{false};
+    EXPECT_TRUE(storage.VerifySize(cancel));
+    EXPECT_EQ(300, storage.GetSize());
+}
+
+TEST_F(StripedStorageFixture, GetFilepathFirstRootTest) {
+    StripedStorage storage{"prism_indexed_buffer", rootStrings(), 1.0};
+    EXPECT_EQ((roots_[0] / "prism_indexed_buffer").string(), storage.GetBufferDirectory());
+    EXPECT_EQ((roots_[0] / "prism_indexed_buffer" / "prism_indexed_data.db").string(),
+              storage.GetFilepath("prism_indexed_data.db"));
+}
@@ -0,0 +1,271 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "indexed/storage.h"
+#include "indexed/tiered-storage.h"
+
+
+namespace fs = ::boost::filesystem;
+
+using prism::indexed::StorageTier;
+using prism::indexed::TieredStorage;
+
+class TieredStorageFixture : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+        hot_root_ = fs::temp_directory_path() / fs::path{"prism_hot_root"};
+        cold_root_ = fs::temp_directory_path() / fs::path{"prism_cold_root"};
+        staging_path_ = fs::temp_directory_path() / fs::path{"prism_staging_buffer"};
+        fs::remove_all(hot_root_);
+        fs::remove_all(cold_root_);
+        fs::create_directories(hot_root_);
+        fs::create_directories(cold_root_);
+        fs::create_directories(staging_path_);
+    }
+
+    virtual void TearDown() {
+        fs::remove_all(hot_root_);
+        fs::remove_all(cold_root_);
+        fs::remove_all(staging_path_);
+    }
+
+    std::vector<StorageTier> tiers(const uintmax_t& hot_bytes, const uintmax_t& cold_bytes) {
+        return {StorageTier{hot_root_.string(), hot_bytes / (1024 * 1024 * 1024.)},
+                StorageTier{cold_root_.string(), cold_bytes / (1024 * 1024 * 1024.)}};
+    }
+
+    std::string stage(const std::string& filename, const uintmax_t& size) {
+        const auto filepath = (staging_path_ / filename).string();
+        std::ofstream out_stream{filepath, std::ios::binary};
+        out_stream << std::string(size, filename.back());
+        return filepath;
+    }
+
+    bool onTier(const fs::path& root, const std::string& filename) {
+        return fs::exists(root / "prism_indexed_buffer" / filename);
+    }
+
+    fs::path hot_root_;
+    fs::path cold_root_;
+    fs::path staging_path_;
+};
+
+TEST_F(TieredStorageFixture, ConstructEmptyThrowTest) {
+    EXPECT_THROW(TieredStorage("prism_indexed_buffer", {}), prism::indexed::FilesystemException);
+}
+
+TEST_F(TieredStorageFixture, MoveLandsOnFirstTierTest) {
+    TieredStorage storage{"prism_indexed_buffer", tiers(1000, 1000)};
+    ASSERT_TRUE(storage.Move(stage("a", 100), "a"));
+    EXPECT_TRUE(onTier(hot_root_, "a"));
+    EXPECT_FALSE(onTier(cold_root_, "a"));
+    EXPECT_EQ(100, storage.GetTierSize(0));
+    EXPECT_EQ(0, storage.GetTierSize(1));
+    EXPECT_EQ(100, storage.GetSize());
+    EXPECT_EQ(100, storage.GetFileSize("a"));
+    EXPECT_EQ((hot_root_ / "prism_indexed_buffer" / "a").string(),
+              storage.GetExistingFilepath("a"));
+}
+
+TEST_F(TieredStorageFixture, MoveSpillsWhenFirstTierFullTest) {
+    TieredStorage storage{"prism_indexed_buffer", tiers(150, 1000), 1.0};
+    ASSERT_TRUE(storage.Move(stage("a", 100), "a"));
+    ASSERT_TRUE(storage.Move(stage("b", 100), "b"));
+    EXPECT_TRUE(onTier(hot_root_, "a"));
+    EXPECT_TRUE(onTier(cold_root_, "b"));
+    EXPECT_EQ((cold_root_ / "prism_indexed_buffer" / "b").string(),
+              storage.GetExistingFilepath("b"));
+    EXPECT_EQ(100, storage.GetFileSize("b"));
+    EXPECT_EQ(200, storage.GetSize());
+}
+
+TEST_F(TieredStorageFixture, DemoteOldestTest) {
+    TieredStorage storage{"prism_indexed_buffer", tiers(1000, 10000), 0.5};
+    for (const auto& filename : {"a", "b", "c", "d", "e"}) {
+        ASSERT_TRUE(storage.Move(stage(filename, 200), filename));
+    }
+    storage.Demote();
+    EXPECT_LE(storage.GetTierSize(0), 500);
+    EXPECT_EQ(1000, storage.GetSize());
+    EXPECT_TRUE(onTier(cold_root_, "a"));
+    EXPECT_TRUE(onTier(cold_root_, "b"));
+    EXPECT_TRUE(onTier(cold_root_, "c"));
+    EXPECT_FALSE(onTier(hot_root_, "a"));
+    EXPECT_TRUE(onTier(hot_root_, "d"));
+    EXPECT_TRUE(onTier(hot_root_, "e"));
+    EXPECT_EQ((cold_root_ / "prism_indexed_buffer" / "a").string(),
+              storage.GetExistingFilepath("a"));
+    std::ifstream in_stream{storage.GetExistingFilepath("a"), std::ios::binary};
+    std::string contents((std::istreambuf_iterator<char>(in_stream)),
+                         std::istreambuf_iterator<char>());
+    EXPECT_EQ(std::string(200, 'a'), contents);
+    EXPECT_FALSE(fs::exists(cold_root_ / "prism_indexed_buffer" / "prism_indexed_staging" / "a"));
+}
+
+TEST_F(TieredStorageFixture, DemoteFailureKeepsOrderTest) {
+    TieredStorage storage{"prism_indexed_buffer", tiers(1000, 10000), 0.5};
+    // A file in place of the staging directory makes every copy fail
+    const auto staging = cold_root_ / "prism_indexed_buffer" / "prism_indexed_staging";
+    {
+        std::ofstream out_stream{staging.string()};
+    }
+    for (const auto& filename : {"a", "b", "c", "d", "e"}) {
+        ASSERT_TRUE(storage.Move(stage(filename, 200), filename));
+    }
+    EXPECT_EQ(0, storage.Demote());
+    EXPECT_TRUE(onTier(hot_root_, "a"));
+
+    fs::remove(staging);
+    storage.Demote();
+    EXPECT_LE(storage.GetTierSize(0), 500);
+    EXPECT_TRUE(onTier(cold_root_, "a"));
+    EXPECT_TRUE(onTier(hot_root_, "e"));
+}
+
+TEST_F(TieredStorageFixture, DemoteNothingBelowFractionTest) {
+    TieredStorage storage{"prism_indexed_buffer", tiers(1000, 10000), 0.5};
+    ASSERT_TRUE(storage.Move(stage("a", 200), "a"));
+    EXPECT_EQ(0, storage.Demote());
+    EXPECT_TRUE(onTier(hot_root_, "a"));
+}
+
+TEST_F(TieredStorageFixture, DemoteSkipsReservedTest) {
+    TieredStorage storage{"prism_indexed_buffer", tiers(1000, 10000), 0.1};
+    ASSERT_TRUE(storage.Move(stage("a", 200), "prism_indexed_data.db"));
+    EXPECT_EQ(0, storage.Demote());
+    EXPECT_TRUE(onTier(hot_root_, "prism_indexed_data.db"));
+}
+
+TEST_F(TieredStorageFixture, ConstructRemovesStagingTest) {
+    const auto staging = cold_root_ / "prism_indexed_buffer" / "prism_indexed_staging";
+    fs::create_directories(staging);
+    {
+        std::ofstream out_stream{(staging / "a").string(), std::ios::binary};
+        out_stream << std::string(100, 'a');
+    }
+    TieredStorage storage{"prism_indexed_buffer", tiers(1000, 10000)};
+    EXPECT_FALSE(fs::exists(staging / "a"));
+}
+
+TEST_F(TieredStorageFixture, DemoteInterruptedResolvesOneTierTest) {
+    {
+        TieredStorage storage{"prism_indexed_buffer", tiers(1000, 10000), 1.0};
+        ASSERT_TRUE(storage.Move(stage("a", 200), "a"));
+        ASSERT_TRUE(storage.Move(stage("b", 200), "b"));
+    }
+    // Killed mid-copy of a, and between the rename of b on the slower tier and the deletion of
+    // its faster copy
+    const auto cold_buffer = cold_root_ / "prism_indexed_buffer";
+    fs::create_directories(cold_buffer / "prism_indexed_staging");
+    {
+        std::ofstream out_stream{(cold_buffer / "prism_indexed_staging" / "a").string(),
+                                 std::ios::binary};
+        out_stream << std::string(50, 'a');
+    }
+    fs::copy_file(hot_root_ / "prism_indexed_buffer" / "b", cold_buffer / "b");
+
+    TieredStorage storage{"prism_indexed_buffer", tiers(1000, 10000), 1.0};
+    for (const auto& filename : {"a", "b"}) {
+        EXPECT_EQ((hot_root_ / "prism_indexed_buffer" / filename).string(),
+                  storage.GetExistingFilepath(filename));
+        EXPECT_TRUE(onTier(hot_root_, filename));
+        EXPECT_FALSE(onTier(cold_root_, filename));
+        EXPECT_EQ(200, storage.GetFileSize(filename));
+    }
+    EXPECT_FALSE(fs::exists(cold_buffer / "prism_indexed_staging" / "a"));
+    auto listing = storage.Scan(std::chrono::steady_clock::now() + std::chrono::seconds(10), 1);
+    EXPECT_EQ(2, listing.files.size());
+    EXPECT_EQ(400, storage.GetTierSize(0));
+
+    EXPECT_TRUE(storage.Delete("b"));
+    EXPECT_TRUE(storage.GetExistingFilepath("b").empty());
+}
+
+TEST_F(TieredStorageFixture, ConstructLoadsFirstTierTest) {
+    {
+        TieredStorage storage{"prism_indexed_buffer", tiers(1000, 10000), 1.0};
+        ASSERT_TRUE(storage.Move(stage("a", 300), "a"));
+        ASSERT_TRUE(storage.Move(stage("b", 300), "b"));
+    }
+    TieredStorage storage{"prism_indexed_buffer", tiers(1000, 10000), 0.5};
+    storage.Demote();
+    EXPECT_EQ(300, storage.GetTierSize(0));
+    EXPECT_TRUE(onTier(cold_root_, "a"));
+    EXPECT_TRUE(onTier(hot_root_, "b"));
+}
+
+TEST_F(TieredStorageFixture, DeleteEitherTierTest) {
+    TieredStorage storage{"prism_indexed_buffer", tiers(150, 1000), 1.0};
+    ASSERT_TRUE(storage.Move(stage("a", 100), "a"));
+    ASSERT_TRUE(storage.Move(stage("b", 100), "b"));
+    EXPECT_TRUE(storage.Delete("a"));
+    EXPECT_TRUE(storage.Delete("b"));
+    EXPECT_FALSE(storage.Delete("c"));
+    EXPECT_FALSE(onTier(hot_root_, "a"));
+    EXPECT_FALSE(onTier(cold_root_, "b"));
+    EXPECT_EQ(0, storage.GetSize());
+}
+
+TEST_F(TieredStorageFixture, BulkDeleteAcrossTiersTest) {
+    TieredStorage storage{"prism_indexed_buffer", tiers(150, 1000), 1.0};
+    ASSERT_TRUE(storage.Move(stage("a", 100), "a"));
+    ASSERT_TRUE(storage.Move(stage("b", 100), "b"));
+    ASSERT_TRUE(storage.Move(stage("c", 100), "c"));
+    EXPECT_EQ(2, storage.BulkDelete({"a", "b", "d"}));
+    EXPECT_TRUE(storage.GetExistingFilepath("a").empty());
+    EXPECT_TRUE(storage.GetExistingFilepath("b").empty());
+    EXPECT_FALSE(storage.GetExistingFilepath("c").empty());
+    EXPECT_EQ(100, storage.GetSize());
+}
+
+TEST_F(TieredStorageFixture, LinkOnSourceTierTest) {
+    TieredStorage storage{"prism_indexed_buffer", tiers(150, 1000), 1.0};
+    ASSERT_TRUE(storage.Move(stage("a", 100), "a"));
+    ASSERT_TRUE(storage.Move(stage("b", 100), "b"));
+    EXPECT_TRUE(storage.Link("b", "c"));
+    EXPECT_TRUE(onTier(cold_root_, "c"));
+    EXPECT_FALSE(storage.Link("d", "e"));
+}
+
+TEST_F(TieredStorageFixture, ScanAllTiersTest) {
+    TieredStorage storage{"prism_indexed_buffer", tiers(150, 1000), 1.0};
+    ASSERT_TRUE(storage.Move(stage("a", 100), "a"));
+    ASSERT_TRUE(storage.Move(stage("b", 100), "b"));
+    auto listing = storage.Scan(std::chrono::steady_clock::now() + std::chrono::seconds(10), 1);
+    EXPECT_TRUE(listing.complete);
+    EXPECT_EQ(2, listing.files.size());
+}
+
+TEST_F(TieredStorageFixture, SetSizeLastTierTest) {
+    TieredStorage storage{"prism_indexed_buffer", tiers(1000, 1000), 1.0};
+    ASSERT_TRUE(storage.Move(stage("a", 100), "a"));
+    storage.SetSize(700);
+    EXPECT_EQ(100, storage.GetTierSize(0));
+    EXPECT_EQ(600, storage.GetTierSize(1));
+    EXPECT_EQ(700, storage.GetSize());
+    EXPECT_EQ(0, storage.GetTierSize(2));
+}
+
+TEST_F(TieredStorageFixture, AboveQuotaLastTierTest) {
+    TieredStorage storage{"prism_indexed_buffer", tiers(1000, 1000), 1.0};
+    EXPECT_FALSE(storage.AboveQuota());
+    storage.SetSize(900);
+    EXPECT_FALSE(storage.AboveQuota());
+    storage.SetSize(1500);
+    EXPECT_TRUE(storage.AboveQuota());
+    EXPECT_FALSE(storage.AboveQuota(600));
+}
+
+TEST_F(TieredStorageFixture, GetFilepathFirstTierTest) {
+    TieredStorage storage{"prism_indexed_buffer", tiers(1000, 1000)};
+    EXPECT_EQ((hot_root_ / "prism_indexed_buffer").string(), storage.GetBufferDirectory());
+    EXPECT_EQ((hot_root_ / "prism_indexed_buffer" / "prism_indexed_data.db").string(),
+              storage.GetFilepath("prism_indexed_data.db"));
+}
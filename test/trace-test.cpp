@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "indexed/trace.h"
+
+
+namespace fs = ::boost::filesystem;
+
+class RecordingTracer : public prism::indexed::Tracer {
+  public:
+    void Begin(const char* name) override {
+        events.emplace_back('B', name);
+    }
+    void End(const char* name) override {
+        events.emplace_back('E', name);
+    }
+
+    std::vector<std::pair<char, std::string>> events;
+};
+
+class TraceFixture : public ::testing::Test {
+  protected:
+    virtual void SetUp() {
+        trace_path_ = fs::temp_directory_path() / fs::path{"prism_indexed_trace.json"};
+        fs::remove(trace_path_);
+    }
+
+    virtual void TearDown() {
+        fs::remove(trace_path_);
+    }
+
+    std::string readTrace() {
+        std::ifstream in_stream{trace_path_.native()};
+        std::stringstream contents;
+        contents << in_stream.rdbuf();
+        return contents.str();
+    }
+
+    fs::path trace_path_;
+};
+
+TEST(TraceTests, SpanNullTracerTest) {
+    prism::indexed::TraceSpan span{nullptr, "noop"};
+}
+
+TEST(TraceTests, SpanBeginEndTest) {
+    RecordingTracer tracer;
+    {
+        prism::indexed::TraceSpan outer{&tracer, "outer"};
+        prism::indexed::TraceSpan inner{&tracer, "inner"};
+        ASSERT_EQ(2, tracer.events.size());
+    }
+    ASSERT_EQ(4, tracer.events.size());
+    EXPECT_EQ(std::make_pair('B', std::string{"outer"}), tracer.events[0]);
+    EXPECT_EQ(std::make_pair('B', std::string{"inner"}), tracer.events[1]);
+    EXPECT_EQ(std::make_pair('E', std::string{"inner"}), tracer.events[2]);
+    EXPECT_EQ(std::make_pair('E', std::string{"outer"}), tracer.events[3]);
+}
+
+TEST_F(TraceFixture, ChromeTracerEmptyTest) {
+    {
+        prism::indexed::ChromeTracer tracer{trace_path_.string()};
+    }
+    EXPECT_EQ("[\n]\n", readTrace());
+}
+
+TEST_F(TraceFixture, ChromeTracerEventsTest) {
+    {
+        prism::indexed::ChromeTracer tracer{trace_path_.string()};
+        prism::indexed::TraceSpan span{&tracer, "Filesystem::Move"};
+    }
+    auto trace = readTrace();
+    EXPECT_EQ('[', trace.front());
+    EXPECT_NE(std::string::npos, trace.find("{\"name\":\"Filesystem::Move\",\"cat\":\"prism_indexed\","
+                                            "\"ph\":\"B\""));
+    EXPECT_NE(std::string::npos, trace.find("\"ph\":\"E\""));
+    EXPECT_NE(std::string::npos, trace.find("},\n{"));
+    EXPECT_EQ("\n]\n", trace.substr(trace.size() - 3));
+}
+
+TEST_F(TraceFixture, ChromeTracerFlushesTest) {
+    prism::indexed::ChromeTracer tracer{trace_path_.string()};
+    tracer.Begin("stuck");
+    EXPECT_EQ(std::string::npos, readTrace().find("\"name\":\"stuck\""));
+    tracer.Flush();
+    EXPECT_NE(std::string::npos, readTrace().find("\"name\":\"stuck\""));
+}
+
+TEST_F(TraceFixture, ChromeTracerBatchOrderTest) {
+    {
+        prism::indexed::ChromeTracer tracer{trace_path_.string()};
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([&tracer]() {
+                for (int j = 0; j < 2000; ++j) {
+                    prism::indexed::TraceSpan span{&tracer, "Buffer::Push"};
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    auto trace = readTrace();
+    EXPECT_EQ("[\n{", trace.substr(0, 3));
+    EXPECT_EQ(std::string::npos, trace.find("}{"));
+    EXPECT_EQ(std::string::npos, trace.find("[\n,"));
+    std::size_t events = 0;
+    for (auto found = trace.find("\"ph\":"); found != std::string::npos;
+         found = trace.find("\"ph\":", found + 1)) {
+        ++events;
+    }
+    EXPECT_EQ(16000, events);
+}
+
+TEST_F(TraceFixture, ChromeTracerEscapeTest) {
+    {
+        prism::indexed::ChromeTracer tracer{trace_path_.string()};
+        tracer.Begin("say \"hi\"");
+    }
+    EXPECT_NE(std::string::npos, readTrace().find("\"name\":\"say \\\"hi\\\"\""));
+}
+
+TEST_F(TraceFixture, ChromeTracerThreadsTest) {
+    {
+        prism::indexed::ChromeTracer tracer{trace_path_.string()};
+        tracer.Begin("main");
+        std::thread thread{[&tracer]() { prism::indexed::TraceSpan span{&tracer, "worker"}; }};
+        thread.join();
+        tracer.End("main");
+    }
+    auto trace = readTrace();
+    EXPECT_NE(std::string::npos, trace.find("\"tid\":0"));
+    EXPECT_NE(std::string::npos, trace.find("\"tid\":1"));
+}